@@ -8,6 +8,9 @@
 #pragma once
 
 #include <stdlib.h>
+#include <limits.h>
+
+#include <lwiot/util/numberconverter.h>
 
 namespace ArduinoJson {
 namespace Internals {
@@ -16,16 +19,25 @@ TFloat parse(const char *);
 
 template <>
 inline float parse<float>(const char *s) {
-  return static_cast<float>(strtod(s, NULL));
+  double value = 0;
+  lwiot::NumberConverter::parseDouble(s, value);
+  return static_cast<float>(value);
 }
 
 template <>
 inline double parse<double>(const char *s) {
-  return strtod(s, NULL);
+  double value = 0;
+  lwiot::NumberConverter::parseDouble(s, value);
+  return value;
 }
 
 template <>
 inline long parse<long>(const char *s) {
+  int64_t value;
+  // strtol() only for the saturation on overflow
+  if (lwiot::NumberConverter::parseInteger(s, value) && value >= LONG_MIN &&
+      value <= LONG_MAX)
+    return static_cast<long>(value);
   return strtol(s, NULL, 10);
 }
 
@@ -37,6 +49,8 @@ inline int parse<int>(const char *s) {
 #if ARDUINOJSON_USE_LONG_LONG
 template <>
 inline long long parse<long long>(const char *s) {
+  int64_t value;
+  if (lwiot::NumberConverter::parseInteger(s, value)) return value;
   return strtoll(s, NULL, 10);
 }
 #endif
@@ -57,6 +57,12 @@ namespace lwiot
 		using Stream::write;
 
 		ssize_t write(const String& format, ...);
+
+		explicit operator bool() const;
+		bool seek(size_t offset);
+		size_t tell() const;
+		size_t size() const;
+		bool flush();
 		
 	private:
 		SharedPointer<Lock> _lock;
@@ -66,5 +72,6 @@ namespace lwiot
 
 		/* Methods */
 		static void fileModeToString(FileMode mode, char *output);
+		size_t length() const;
 	};
 }
@@ -12,12 +12,14 @@
 
 #include <lwiot/kernel/functionalthread.h>
 #include <lwiot/kernel/lock.h>
+#include <lwiot/kernel/event.h>
 
 #include <lwiot/network/mqttclient.h>
 #include <lwiot/network/ipaddress.h>
 #include <lwiot/network/stdnet.h>
+#include <lwiot/network/topictrie.h>
+#include <lwiot/network/mqttstore.h>
 
-#include <lwiot/stl/map.h>
 #include <lwiot/stl/string.h>
 
 namespace lwiot
@@ -53,14 +55,29 @@ namespace lwiot
 		{
 			ScopedLock lock(this->_lock);
 
-			this->_handlers.add(topic, handler);
+			if(!this->_handlers.add(AsyncMqttClient::filter(topic), Subscription{ topic, AsyncHandler(handler) }))
+				return false;
+
 			return MqttClient::subscribe(topic, qos);
 		}
 
 		bool unsubscribe(const stl::String& topic) override;
 		bool publish(const stl::String& topic, const ByteBuffer& data, bool retained) override;
+		bool publish(const stl::String& topic, const ByteBuffer& data, bool retained, QoS qos, uint16_t* id = nullptr) override;
+		bool publish(const stl::String& topic, Stream& payload, size_t length, bool retained = false) override;
 		using MqttClient::publish;
 
+		using MqttClient::StreamHandler;
+		void setStreamHandler(const StreamHandler& handler);
+
+		using MqttClient::ProtocolVersion;
+		void setProtocolVersion(ProtocolVersion version);
+
+		void setWriteCoalescing(size_t size, int latency = DefaultCoalescingLatency);
+		void setReconnectBackoff(int min, int max);
+		void setOfflineStore(MqttStore& store, size_t batch = DefaultReplayBatch, int interval = DefaultReplayInterval);
+		bool flush();
+
 		inline bool connected() override
 		{
 			ScopedLock lock(this->_lock);
@@ -73,14 +90,42 @@ namespace lwiot
 			return MqttClient::state();
 		}
 
+		inline uint8_t reasonCode() const
+		{
+			ScopedLock lock(this->_lock);
+			return MqttClient::reasonCode();
+		}
+
+		static constexpr int DefaultCoalescingLatency = 10;
+		static constexpr int DefaultBackoffMin = 100;
+		static constexpr int DefaultBackoffMax = 30000;
+		static constexpr size_t DefaultReplayBatch = 8;
+		static constexpr int DefaultReplayInterval = 100;
+		static constexpr size_t MaxReplayBatch = 32;
+
+		/* Upper bound on how long the receive loop blocks; bounds the time stop() takes */
+		static constexpr int MaxIdleTime = 250;
+
 	protected:
 		virtual void run();
 
 	private:
-		stl::Map<stl::String, AsyncHandler> _handlers;
+		/* Handlers are removed per subscription, a shared one may overlap with a plain one */
+		struct Subscription {
+			String topic;
+			AsyncHandler handler;
+
+			bool operator==(const Subscription& other) const
+			{
+				return this->topic == other.topic;
+			}
+		};
+
+		TopicTrie<Subscription> _handlers;
 		ReconnectHandler _reconnect_handler;
 		FunctionalThread _executor;
 		mutable Lock _lock;
+		Event _wakeup;
 		bool _running;
 
 		stl::String _id, _user, _pass, _will_topic, _will;
@@ -89,7 +134,33 @@ namespace lwiot
 		bool _clean;
 		int _tmo;
 
+		ByteBuffer _outbound;
+		size_t _coalesce_size;
+		int _coalesce_latency;
+		time_t _oldest;
+
+		int _backoff;
+		int _backoff_min;
+		int _backoff_max;
+
+		MqttStore* _store;
+		size_t _replay_batch;
+		int _replay_interval;
+		time_t _last_replay;
+		uint16_t _replay_ids[MaxReplayBatch];
+		size_t _replay_head;
+		size_t _replay_count;
+
 		/* Methods */
 		void invoke(const String& topic, const ByteBuffer& data) const;
+		bool flushOutbound();
+		bool flushDue() const;
+		int waitTime() const;
+		void reconnect(ScopedLock& lock);
+		void idle(ScopedLock& lock, int ms);
+		void replay();
+		void acknowledge(uint16_t id);
+
+		static String filter(const String& topic);
 	};
 }
@@ -0,0 +1,113 @@
+/*
+ * Table driven base64 codec.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stream.h>
+#include <lwiot/bytebuffer.h>
+
+namespace lwiot
+{
+	/*
+	 * Standard (RFC 4648) base64, without line breaks. Groups of bytes are
+	 * converted through lookup tables, 12 bytes at a time where SSSE3 is
+	 * available. Decoding is strict: the input has to be padded to a multiple
+	 * of four characters, may only hold the alphabet and trailing padding,
+	 * and the unused bits of the last group have to be zero.
+	 */
+	class Base64 {
+	public:
+		static constexpr size_t encodedLength(size_t length)
+		{
+			return (length + 2) / 3 * 4;
+		}
+
+		/* Upper bound, padding makes the actual length up to two bytes shorter */
+		static constexpr size_t decodedLength(size_t length)
+		{
+			return length / 4 * 3;
+		}
+
+		/* Returns the number of characters written, encodedLength(length) */
+		static size_t encode(const void *input, size_t length, char *output);
+		/* Returns the number of bytes written, or -EINVALID for malformed input */
+		static ssize_t decode(const char *input, size_t length, void *output);
+
+		static void encode(const ByteBuffer& input, ByteBuffer& output);
+		static bool decode(const ByteBuffer& input, ByteBuffer& output);
+	};
+
+	/*
+	 * Encodes the data written to it onto a stream, a chunk at a time. The
+	 * last partial group is padded by finish().
+	 */
+	class Base64Encoder {
+	public:
+		explicit Base64Encoder(Stream& output);
+		virtual ~Base64Encoder() = default;
+
+		bool write(const void *data, size_t length);
+		bool write(const ByteBuffer& buffer);
+		bool finish();
+		void reset();
+
+		bool failed() const { return this->_failed; }
+		size_t count() const { return this->_count; }
+
+		static constexpr size_t ChunkSize = 256;
+
+	private:
+		Stream& _output;
+		uint8_t _pending[3];
+		size_t _num_pending;
+		size_t _count;
+		bool _failed;
+		char _chunk[ChunkSize];
+
+		/* Methods */
+		bool flush(const uint8_t *data, size_t length);
+	};
+
+	/*
+	 * Decodes the base64 written to it onto a stream. Input may be split at
+	 * any point. Once malformed input has been seen, or data follows the
+	 * padding, the decoder fails until it is reset.
+	 */
+	class Base64Decoder {
+	public:
+		explicit Base64Decoder(Stream& output);
+		virtual ~Base64Decoder() = default;
+
+		bool write(const char *data, size_t length);
+		bool write(const ByteBuffer& buffer);
+		bool finish();
+		void reset();
+
+		bool failed() const { return this->_failed; }
+		size_t count() const { return this->_count; }
+
+		static constexpr size_t ChunkSize = Base64Encoder::ChunkSize;
+
+	private:
+		Stream& _output;
+		char _pending[4];
+		size_t _num_pending;
+		size_t _count;
+		bool _failed;
+		bool _padded;
+		uint8_t _chunk[ChunkSize / 4 * 3];
+
+		/* Methods */
+		bool flush(const char *data, size_t length);
+		bool fail();
+	};
+}
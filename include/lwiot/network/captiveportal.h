@@ -44,8 +44,9 @@ namespace lwiot
 		IPAddress _bind_addr;
 		uint16_t _port;
 		char *udp_msg;
+		char *udp_reply;
 
 		/* Methods */
-		void respond(UdpClient& client, char *data, const size_t& length);
+		void respond(const remote_addr_t& remote, char *data, const size_t& length);
 	};
 }
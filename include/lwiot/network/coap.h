@@ -0,0 +1,187 @@
+/*
+ * CoAP (RFC 7252) message parser and builder.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+
+#define COAP_PORT 5683
+
+namespace lwiot
+{
+	enum class CoapType : uint8_t {
+		Confirmable = 0,
+		NonConfirmable,
+		Acknowledgement,
+		Reset
+	};
+
+	/* Codes are stored as class << 5 | detail, e.g. 2.05 is 0x45 */
+	enum class CoapCode : uint8_t {
+		Empty = 0x00,
+		Get = 0x01,
+		Post = 0x02,
+		Put = 0x03,
+		Delete = 0x04,
+
+		Created = 0x41,
+		Deleted = 0x42,
+		Valid = 0x43,
+		Changed = 0x44,
+		Content = 0x45,
+		Continue = 0x5F,
+
+		BadRequest = 0x80,
+		Unauthorized = 0x81,
+		BadOption = 0x82,
+		Forbidden = 0x83,
+		NotFound = 0x84,
+		MethodNotAllowed = 0x85,
+		NotAcceptable = 0x86,
+		RequestEntityIncomplete = 0x88,
+		PreconditionFailed = 0x8C,
+		RequestEntityTooLarge = 0x8D,
+		UnsupportedContentFormat = 0x8F,
+
+		InternalServerError = 0xA0,
+		NotImplemented = 0xA1,
+		ServiceUnavailable = 0xA3,
+		GatewayTimeout = 0xA4
+	};
+
+	enum class CoapOption : uint16_t {
+		IfMatch = 1,
+		UriHost = 3,
+		ETag = 4,
+		IfNoneMatch = 5,
+		Observe = 6,
+		UriPort = 7,
+		LocationPath = 8,
+		UriPath = 11,
+		ContentFormat = 12,
+		MaxAge = 14,
+		UriQuery = 15,
+		Accept = 17,
+		LocationQuery = 20,
+		Block2 = 23,
+		Block1 = 27,
+		Size2 = 28,
+		ProxyUri = 35,
+		ProxyScheme = 39,
+		Size1 = 60
+	};
+
+	struct CoapOptionValue {
+		uint16_t number;
+		const uint8_t *value;
+		uint16_t length;
+
+		uint32_t toUnsigned() const;
+	};
+
+	/* Block1 and Block2 option value: block number, more flag and size exponent */
+	struct CoapBlock {
+		uint32_t num;
+		bool more;
+		uint8_t szx;
+
+		size_t size() const { return 16U << this->szx; }
+		size_t offset() const { return this->num * this->size(); }
+		uint32_t encode() const;
+
+		static CoapBlock decode(uint32_t value);
+		static uint8_t exponent(size_t size);
+	};
+
+	/*
+	 * Read-only view of a CoAP message. The header is validated on construction,
+	 * options are decoded on demand straight from the packet.
+	 */
+	class CoapMessage {
+	public:
+		explicit CoapMessage(const void *data, size_t length);
+
+		bool valid() const { return this->_valid; }
+
+		CoapType type() const;
+		CoapCode code() const;
+		uint16_t id() const;
+		const uint8_t *token() const;
+		uint8_t tokenLength() const;
+
+		bool request() const;
+		bool empty() const;
+
+		/* Iterate over all options, `pos` starts at zero */
+		bool next(size_t& pos, uint16_t& last, CoapOptionValue& option) const;
+		bool find(CoapOption number, CoapOptionValue& option) const;
+		bool has(CoapOption number) const;
+		uint32_t option(CoapOption number, uint32_t fallback) const;
+		bool block(CoapOption number, CoapBlock& block) const;
+
+		/* Compares the Uri-Path options to a slash separated path */
+		bool matches(const char *path) const;
+		size_t path(char *output, size_t size) const;
+
+		const uint8_t *payload() const { return this->_payload; }
+		size_t payloadLength() const { return this->_payload_length; }
+
+		const uint8_t *data() const { return this->_data; }
+		size_t length() const { return this->_length; }
+
+	private:
+		const uint8_t *_data;
+		size_t _length;
+		bool _valid;
+		const uint8_t *_payload;
+		size_t _payload_length;
+
+		/* Methods */
+		bool parse();
+	};
+
+	/*
+	 * Builds CoAP messages into a caller supplied buffer. Options have to be
+	 * added in ascending order. A failed call leaves the message as it was.
+	 */
+	class CoapBuilder {
+	public:
+		explicit CoapBuilder(void *buffer, size_t capacity);
+
+		bool begin(CoapType type, CoapCode code, uint16_t id, const uint8_t *token = nullptr, uint8_t tkl = 0);
+		/* Response header for `request`: piggybacked ACK for CON, NON otherwise */
+		bool reply(const CoapMessage& request, CoapCode code, uint16_t id);
+
+		bool option(CoapOption number, const void *value, size_t length);
+		bool option(CoapOption number, uint32_t value);
+		bool option(CoapOption number, const char *value);
+		bool path(const char *path);
+		bool block(CoapOption number, const CoapBlock& block);
+		bool payload(const void *data, size_t length);
+
+		uint8_t *data() const { return this->_buffer; }
+		size_t length() const { return this->_length; }
+		size_t capacity() const { return this->_capacity; }
+
+		static constexpr uint8_t MaxToken = 8;
+
+	private:
+		uint8_t *_buffer;
+		size_t _capacity;
+		size_t _length;
+		uint16_t _last;
+		bool _payload;
+
+		/* Methods */
+		bool put(const void *data, size_t length);
+		bool extended(uint8_t *nibble, uint32_t value);
+	};
+}
@@ -0,0 +1,86 @@
+/*
+ * CoAP (RFC 7252) client.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/function.h>
+
+#include <lwiot/network/udpclient.h>
+#include <lwiot/network/coap.h>
+
+namespace lwiot
+{
+	/*
+	 * CoAP client on top of a UdpClient. Confirmable requests are retransmitted
+	 * with exponential back-off until they are acknowledged. Separate responses
+	 * are supported, as are block-wise uploads (Block1) and downloads (Block2).
+	 * A single resource can be observed at a time; notifications are handed to
+	 * the observe handler from process() or while waiting on another response.
+	 *
+	 * Request methods return the response code, or CoapCode::Empty when no
+	 * response was received. Messages are built in and received into buffers
+	 * owned by the client, so a request does not allocate.
+	 */
+	class CoapClient {
+	public:
+		using Handler = Function<void(const CoapMessage& notification)>;
+
+		/* Sets the receive timeout of `client` to one second */
+		explicit CoapClient(UdpClient& client);
+		CoapClient(const CoapClient&) = delete;
+		virtual ~CoapClient() = default;
+
+		CoapClient& operator=(const CoapClient&) = delete;
+
+		void setConfirmable(bool confirmable);
+
+		/* `length` holds the size of `output` and is set to the length of the response payload */
+		CoapCode get(const char *path, void *output, size_t& length);
+		CoapCode post(const char *path, const void *payload, size_t size, void *output, size_t& length,
+		              int format = -1);
+		CoapCode put(const char *path, const void *payload, size_t size, void *output, size_t& length,
+		             int format = -1);
+		CoapCode remove(const char *path);
+		CoapCode request(CoapCode method, const char *path, const void *payload, size_t size,
+		                 void *output, size_t& length, int format = -1);
+
+		bool observe(const char *path, const Handler& handler);
+		bool cancel(const char *path);
+		bool observing() const { return this->_observing; }
+
+		/* Waits up to a second for a notification */
+		bool process();
+
+		static constexpr time_t AckTimeout = 2;
+		static constexpr int MaxRetransmit = 4;
+		static constexpr size_t MaxMessageSize = 1152;
+		static constexpr size_t BlockSize = 512;
+		static constexpr uint8_t TokenLength = 4;
+
+	private:
+		UdpClient& _udp;
+		bool _confirmable;
+		uint16_t _message_id;
+		uint32_t _token;
+		bool _observing;
+		uint8_t _observe_token[TokenLength];
+		Handler _handler;
+		uint8_t _tx[MaxMessageSize];
+		uint8_t _rx[MaxMessageSize];
+
+		/* Methods */
+		void token(uint8_t *token);
+		ssize_t exchange(size_t length);
+		bool notification(const CoapMessage& message);
+		void acknowledge(uint16_t id);
+	};
+}
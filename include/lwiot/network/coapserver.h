@@ -0,0 +1,175 @@
+/*
+ * CoAP (RFC 7252) server.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/function.h>
+#include <lwiot/uniquepointer.h>
+
+#include <lwiot/kernel/thread.h>
+#include <lwiot/kernel/lock.h>
+
+#include <lwiot/network/stdnet.h>
+#include <lwiot/network/udpclient.h>
+#include <lwiot/network/udpserver.h>
+#include <lwiot/network/coap.h>
+
+#include <lwiot/stl/string.h>
+#include <lwiot/stl/linkedlist.h>
+
+namespace lwiot
+{
+	class CoapServer;
+
+	/* A request and the means to answer it, handed to a resource handler */
+	class CoapExchange {
+	public:
+		const CoapMessage& request() const { return this->_request; }
+		const remote_addr_t& remote() const { return this->_remote; }
+		CoapCode method() const { return this->_request.code(); }
+
+		/* True for the first request of an observation and for every notification */
+		bool observing() const { return this->_observe >= 0; }
+
+		/*
+		 * Answers the request. Payloads larger than the block size are sent
+		 * block-wise (Block2): the handler produces the whole representation
+		 * on every request and the block the client asked for is sent.
+		 * A negative `format` omits the Content-Format option.
+		 */
+		bool respond(CoapCode code, const void *payload = nullptr, size_t length = 0, int format = -1);
+
+		bool responded() const { return this->_responded; }
+
+		static constexpr int TextPlain = 0;
+		static constexpr int LinkFormat = 40;
+		static constexpr int OctetStream = 42;
+		static constexpr int Json = 50;
+		static constexpr int Cbor = 60;
+
+	private:
+		explicit CoapExchange(CoapServer& server, const CoapMessage& request, const remote_addr_t& remote,
+		                      uint8_t *buffer, int32_t observe);
+
+		CoapServer& _server;
+		const CoapMessage& _request;
+		const remote_addr_t& _remote;
+		uint8_t *_buffer;
+		size_t _length;
+		int32_t _observe;
+		bool _enroll;
+		bool _responded;
+
+		friend class CoapServer;
+	};
+
+	/*
+	 * CoAP server on top of a UdpServer. Requests are routed to handlers by
+	 * path and method. Confirmable requests get a piggybacked response, and
+	 * retransmissions are answered from a small cache of recent responses.
+	 * Observable resources keep a fixed table of observers that are notified
+	 * with non-confirmable messages. All buffers are allocated up front, so
+	 * the request path does not touch the heap.
+	 *
+	 * Resources have to be registered before the server is started. Handlers
+	 * run on the server thread, or on the thread calling notify(), and should
+	 * not call notify() themselves.
+	 */
+	class CoapServer : public Thread {
+	public:
+		using Handler = Function<void(CoapExchange& exchange)>;
+
+		explicit CoapServer();
+		CoapServer(const CoapServer&) = delete;
+		virtual ~CoapServer();
+
+		CoapServer& operator=(const CoapServer&) = delete;
+
+		/* The server must be bound before the CoAP server is started */
+		void begin(UdpServer* server);
+		void end();
+
+		void on(const String& path, CoapCode method, const Handler& handler, bool observable = false);
+		void notify(const String& path);
+
+		size_t observers() const;
+
+		static constexpr size_t MaxMessageSize = 1152;
+		static constexpr size_t BlockSize = 512;
+		static constexpr size_t MaxObservers = 8;
+		static constexpr size_t Duplicates = 4;
+
+	protected:
+		void run() override;
+
+	private:
+		struct Route {
+			explicit Route(const String& path, CoapCode method, const Handler& handler, bool observable) :
+				path(path), method(method), handler(handler), observable(observable)
+			{
+			}
+
+			String path;
+			CoapCode method;
+			Handler handler;
+			bool observable;
+		};
+
+		struct Observer {
+			const Route *route;
+			remote_addr_t remote;
+			uint8_t token[CoapBuilder::MaxToken];
+			uint8_t tkl;
+			uint16_t id;
+			bool notified;
+			bool active;
+		};
+
+		struct Response {
+			remote_addr_t remote;
+			uint16_t id;
+			size_t length;
+			uint8_t data[MaxMessageSize];
+		};
+
+		mutable Lock _lock;
+		Lock _notifier;
+		UniquePointer<UdpServer> _udp;
+		stl::LinkedList<Route*> _routes;
+		bool _running;
+		uint16_t _message_id;
+		uint32_t _sequence;
+		Observer _observers[MaxObservers];
+		const Route *_enrolling;
+		Response *_recent;
+		size_t _recent_next;
+		uint8_t *_rx;
+		uint8_t *_tx;
+		uint8_t *_notification;
+		uint8_t *_notification_tx;
+
+		friend class CoapExchange;
+
+		/* Methods */
+		bool running() const;
+		uint16_t nextId();
+		void handle(const remote_addr_t& remote, size_t length);
+		void dispatch(const CoapMessage& request, const remote_addr_t& remote);
+		Observer* find(const CoapMessage& request, const remote_addr_t& remote, const Route *route);
+		int32_t observe(const CoapMessage& request, const remote_addr_t& remote, const Route *route);
+		void enroll(const CoapMessage& request, const remote_addr_t& remote, bool ok);
+		void cancel(const remote_addr_t& remote, uint16_t id);
+		bool send(const remote_addr_t& remote, const uint8_t *data, size_t length);
+		void remember(const remote_addr_t& remote, uint16_t id, const uint8_t *data, size_t length);
+		const Response *recall(const remote_addr_t& remote, uint16_t id) const;
+	};
+}
@@ -0,0 +1,156 @@
+/*
+ * DNS message parser and builder.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stl/string.h>
+
+#include <lwiot/network/dns.h>
+
+namespace lwiot
+{
+	/*
+	 * Domain name inside a DNS message. The name is never copied out of the
+	 * packet: labels are decoded on demand, following compression pointers, so
+	 * the packet has to outlive the name.
+	 */
+	class DnsName {
+	public:
+		explicit DnsName();
+		explicit DnsName(const uint8_t *packet, size_t length, size_t offset);
+
+		/* Case insensitive, a trailing dot on `name` is ignored */
+		bool equals(const char *name) const;
+		bool equals(const String& name) const;
+
+		/* Case insensitive as well, equal names hash equal to their dotted form */
+		uint32_t hash() const;
+		static uint32_t hash(const char *name);
+
+		size_t toString(char *output, size_t size) const;
+		String toString() const;
+
+		size_t offset() const { return this->_offset; }
+		const uint8_t *packet() const { return this->_packet; }
+
+		static constexpr size_t MaxLength = 255;
+		static constexpr size_t MaxLabel = 63;
+
+	private:
+		const uint8_t *_packet;
+		size_t _length;
+		size_t _offset;
+
+		friend class DnsMessage;
+		friend class DnsBuilder;
+
+		/* Methods */
+		bool label(size_t& pos, size_t& hops, const uint8_t*& data, size_t& length) const;
+		static bool skip(const uint8_t *packet, size_t length, size_t& pos);
+	};
+
+	struct DnsQuestion {
+		DnsName name;
+		uint16_t type;
+		uint16_t qclass;
+	};
+
+	struct DnsResource {
+		DnsName name;
+		uint16_t type;
+		uint16_t rclass;
+		uint32_t ttl;
+		const uint8_t *data;
+		uint16_t length;
+	};
+
+	/*
+	 * Read-only view of a DNS message. Questions and resource records are
+	 * parsed in place, in the order they appear in the message. Every offset
+	 * is bounds checked, a malformed message ends the iteration.
+	 */
+	class DnsMessage {
+	public:
+		explicit DnsMessage(const void *data, size_t length);
+
+		bool valid() const;
+		bool malformed() const { return this->_malformed; }
+
+		uint16_t id() const;
+		bool response() const;
+		bool truncated() const;
+		uint8_t opcode() const;
+		DnsReplyCode rcode() const;
+
+		uint16_t questions() const;
+		uint16_t answers() const;
+		uint16_t authorities() const;
+		uint16_t additionals() const;
+
+		bool next(DnsQuestion& question);
+		bool next(DnsResource& resource);
+
+		const uint8_t *data() const { return this->_data; }
+		size_t length() const { return this->_length; }
+
+	private:
+		const uint8_t *_data;
+		size_t _length;
+		size_t _pos;
+		size_t _index;
+		bool _malformed;
+
+		friend class DnsBuilder;
+
+		/* Methods */
+		uint16_t field(size_t offset) const;
+		size_t records() const;
+	};
+
+	/*
+	 * Builds DNS responses into a caller supplied buffer. Answers to a question
+	 * refer back to the name in the copied question section with a compression
+	 * pointer instead of repeating it.
+	 */
+	class DnsBuilder {
+	public:
+		explicit DnsBuilder(void *buffer, size_t capacity);
+
+		/* Copies the header and question section of `query` */
+		bool reply(const DnsMessage& query, DnsReplyCode code = DnsReplyCode::NoError);
+		/* A bare header carrying `code`, without any records */
+		bool error(const DnsMessage& query, DnsReplyCode code);
+
+		bool answer(const DnsName& name, uint16_t type, uint16_t rclass, uint32_t ttl,
+		            const void *data, uint16_t length);
+		bool answer(const DnsQuestion& question, uint32_t ttl, const void *data, uint16_t length);
+		/* Answer with a prebuilt record: type, class, TTL, data length and data */
+		bool answer(const DnsName& name, const uint8_t *record, size_t length);
+
+		const uint8_t *data() const { return this->_buffer; }
+		size_t length() const { return this->_length; }
+
+	private:
+		uint8_t *_buffer;
+		size_t _capacity;
+		size_t _length;
+		const uint8_t *_query;
+		size_t _questions;
+
+		/* Methods */
+		bool put(const void *data, size_t length);
+		bool put16(uint16_t value);
+		bool put32(uint32_t value);
+		bool name(const DnsName& name);
+		void count();
+	};
+}
@@ -15,41 +15,79 @@
 #include <lwiot/uniquepointer.h>
 
 #include <lwiot/kernel/thread.h>
+#include <lwiot/kernel/functionalthread.h>
 #include <lwiot/kernel/lock.h>
 
 #include <lwiot/network/stdnet.h>
 #include <lwiot/network/udpclient.h>
 #include <lwiot/network/udpserver.h>
 #include <lwiot/network/dns.h>
+#include <lwiot/network/dnsmessage.h>
 
-#include <lwiot/stl/map.h>
+#include <lwiot/stl/linkedlist.h>
 
 namespace lwiot
 {
+	/*
+	 * Authoritative server for a table of host names. Names are looked up in a
+	 * case insensitive hash table and the answer record of every host is built
+	 * when it is mapped, so a query costs a hash of the question name and a
+	 * copy. Additional workers receive from the same server to keep up with
+	 * bursts of queries, for example when a fleet of devices boots at once.
+	 */
 	class DnsServer : public Thread {
 	public:
-		explicit DnsServer();
+		explicit DnsServer(size_t workers = 1);
 		virtual ~DnsServer();
 
 		void begin(UdpServer* server);
 		void end();
 
 		void map(const stl::String& hostname, const IPAddress& addr);
+		size_t size() const;
+
+		static constexpr size_t MinBuckets = 16;
 
 	protected:
 		void run() override;
 		void begin();
 
 	private:
-		Lock _lock;
+		static constexpr size_t RecordSize = 14;
+
+		struct Host {
+			stl::String name;
+			uint32_t hash;
+			uint8_t record[RecordSize];
+			Host *next;
+		};
+
+		struct Worker {
+			explicit Worker() : thread("dns-worker")
+			{
+			}
+
+			FunctionalThread thread;
+			char msg[DNS_LEN];
+			char reply[DNS_LEN];
+		};
+
+		mutable Lock _lock;
 		UniquePointer<UdpServer> _udp;
-		stl::Map<stl::String, IPAddress> _table;
+		Host **_buckets;
+		size_t _bucket_count;
+		size_t _hosts;
 		bool _running;
 		char *_udp_msg;
+		char *_udp_reply;
+		size_t _worker_count;
+		stl::LinkedList<Worker*> _workers;
 
 		/* Methods */
-		void respond(UdpClient& client, char *data, const size_t& length);
-		static void respond(UdpClient& client, DnsHeader* hdr, DnsReplyCode drc);
-		bool hasRecord(const String& record);
+		void serve(char *msg, char *reply);
+		bool running() const;
+		void respond(const remote_addr_t& remote, char *data, const size_t& length, char *reply);
+		bool answer(DnsBuilder& builder, const DnsName& name) const;
+		void grow();
 	};
 }
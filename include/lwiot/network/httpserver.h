@@ -22,6 +22,7 @@
 #include <lwiot/network/tcpserver.h>
 #include <lwiot/network/tcpclient.h>
 #include <lwiot/uniquepointer.h>
+#include <lwiot/util/jsonwriter.h>
 
 namespace lwiot
 {
@@ -89,6 +90,25 @@ namespace lwiot
 		void setContentLength(size_t contentLength);
 		void sendHeader(const String &name, const String &value, bool first = false);
 		void sendContent(const String &content);
+		void sendContent(const void *data, size_t length);
+
+		/*
+		 * Streams a JsonObject, JsonArray or JsonVariant as a chunked response,
+		 * without rendering it into a String first.
+		 */
+		template<typename T>
+		void sendJson(int code, const T &document)
+		{
+			JsonWriter writer([this](const void *data, size_t length) {
+				this->sendContent(data, length);
+				return true;
+			});
+
+			this->setContentLength(CONTENT_LENGTH_UNKNOWN);
+			this->send(code, "application/json");
+			writer.json(document);
+			writer.flush();
+		}
 
 		static String urlDecode(const String &text);
 
@@ -23,6 +23,7 @@ namespace lwiot
 		explicit IPAddress(const uint8_t *address);
 		explicit IPAddress(uint32_t address);
 		explicit IPAddress(const remote_addr_t& remote);
+		IPAddress(const IPAddress& other) = default;
 		virtual ~IPAddress() = default;
 
 		virtual String toString() const;
@@ -0,0 +1,165 @@
+/*
+ * In-process loopback network.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/bytebuffer.h>
+#include <lwiot/scopedlock.h>
+#include <lwiot/sharedpointer.h>
+
+#include <lwiot/kernel/lock.h>
+#include <lwiot/kernel/event.h>
+
+#include <lwiot/network/stdnet.h>
+#include <lwiot/network/ipaddress.h>
+
+#include <lwiot/stl/linkedlist.h>
+
+namespace lwiot
+{
+	class LoopbackTcpServer;
+
+	/*
+	 * Properties of every link in a loopback network. Latencies are in
+	 * microseconds, the bandwidth in bytes per second (0 is unlimited) and the
+	 * loss rate is a probability. Lost datagrams are dropped, lost stream
+	 * segments are delivered after the retransmission delay.
+	 */
+	struct LoopbackLink {
+		time_t latency;
+		uint32_t bandwidth;
+		double loss;
+		time_t retransmit;
+	};
+
+	/*
+	 * One direction of a loopback connection, or the inbox of a datagram
+	 * endpoint. Data is kept in a ring buffer of records, each stamped with the
+	 * time at which it arrives at the reader.
+	 */
+	class LoopbackPipe {
+	public:
+		explicit LoopbackPipe(size_t capacity, bool datagram = false);
+		LoopbackPipe(const LoopbackPipe&) = delete;
+		virtual ~LoopbackPipe() = default;
+
+		LoopbackPipe& operator=(const LoopbackPipe&) = delete;
+
+		ssize_t write(const void *data, size_t length, const remote_addr_t& source, int tmo);
+		ssize_t read(void *output, size_t length, remote_addr_t* source, int tmo);
+
+		size_t available() const;
+		bool wait(int tmo);
+
+		/* Closing wakes up all waiters, data already written can still be read */
+		void close();
+		bool closed() const;
+		bool drained() const;
+
+		void setLink(const LoopbackLink& link, uint32_t seed);
+
+	private:
+		struct Record {
+			time_t arrival;
+			uint32_t length;
+			remote_addr_t source;
+		};
+
+		mutable Lock _lock;
+		Event _event;
+		ByteBuffer _ring;
+		size_t _head;
+		size_t _used;
+		size_t _offset;
+		bool _datagram;
+		bool _closed;
+
+		LoopbackLink _link;
+		time_t _busy;
+		time_t _last;
+		uint32_t _seed;
+
+		/* Methods */
+		void copyIn(size_t pos, const void *data, size_t length);
+		void copyOut(size_t pos, void *output, size_t length) const;
+		void push(const void *data, size_t length, const remote_addr_t& source);
+		void pop(size_t length);
+		bool arrived(Record& record, time_t now) const;
+		bool sleep(ScopedLock& guard, time_t deadline, time_t until);
+		bool lost();
+	};
+
+	struct LoopbackConnection {
+		explicit LoopbackConnection(size_t capacity) : upstream(capacity), downstream(capacity), client(), server()
+		{
+		}
+
+		LoopbackPipe upstream;
+		LoopbackPipe downstream;
+		remote_addr_t client;
+		remote_addr_t server;
+	};
+
+	/*
+	 * Registry of the listening and datagram endpoints that make up an
+	 * in-process network. Loopback transports attached to the same network can
+	 * reach each other without touching the network stack of the OS, with
+	 * latency, bandwidth and loss controlled by the link settings. The loss
+	 * pattern is derived from the seed, so runs are repeatable.
+	 */
+	class LoopbackNetwork {
+	public:
+		explicit LoopbackNetwork(size_t capacity = DefaultPipeSize, uint32_t seed = 1);
+		LoopbackNetwork(const LoopbackNetwork&) = delete;
+		virtual ~LoopbackNetwork() = default;
+
+		LoopbackNetwork& operator=(const LoopbackNetwork&) = delete;
+
+		void setLink(const LoopbackLink& link);
+		size_t capacity() const;
+
+		bool listen(LoopbackTcpServer* server, const IPAddress& addr, uint16_t port);
+		void unlisten(LoopbackTcpServer* server);
+		SharedPointer<LoopbackConnection> connect(const IPAddress& addr, uint16_t port);
+
+		bool attach(LoopbackPipe* inbox, const IPAddress& addr, uint16_t port);
+		void detach(LoopbackPipe* inbox);
+		ssize_t send(const IPAddress& addr, uint16_t port, const remote_addr_t& source, const void *data, size_t length);
+
+		/* Ports are in network byte order, like in the socket transports */
+		uint16_t ephemeral();
+
+		static constexpr size_t DefaultPipeSize = 64 * 1024;
+		static constexpr time_t DefaultRetransmit = 200000;
+
+	private:
+		struct Endpoint {
+			IPAddress addr;
+			uint16_t port;
+			LoopbackTcpServer* server;
+			LoopbackPipe* inbox;
+		};
+
+		mutable Lock _lock;
+		stl::LinkedList<Endpoint> _endpoints;
+		LoopbackLink _link;
+		size_t _capacity;
+		uint32_t _seed;
+		uint16_t _next_port;
+
+		/* Methods */
+		Endpoint* find(const IPAddress& addr, uint16_t port, bool stream);
+		void configure(LoopbackPipe& pipe);
+
+		static bool matches(const IPAddress& bound, const IPAddress& addr);
+	};
+}
@@ -0,0 +1,62 @@
+/*
+ * In-process loopback TCP client.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/sharedpointer.h>
+#include <lwiot/stl/string.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/tcpclient.h>
+#include <lwiot/network/loopbacknetwork.h>
+
+namespace lwiot
+{
+	class LoopbackTcpClient : public TcpClient {
+	public:
+		explicit LoopbackTcpClient(LoopbackNetwork& network);
+		explicit LoopbackTcpClient(LoopbackNetwork& network, const IPAddress& addr, uint16_t port);
+		explicit LoopbackTcpClient(LoopbackNetwork& network, const SharedPointer<LoopbackConnection>& connection,
+		                           bool server);
+		LoopbackTcpClient(const LoopbackTcpClient&) = delete;
+		~LoopbackTcpClient() override;
+
+		LoopbackTcpClient& operator=(const LoopbackTcpClient&) = delete;
+
+		explicit operator bool() const override;
+		bool connected() const override;
+
+		size_t available() const override;
+
+		using TcpClient::read;
+		using TcpClient::write;
+
+		ssize_t read(void *output, const size_t &length) override;
+		ssize_t write(const void *bytes, const size_t& length) override;
+
+		bool connect(const IPAddress& addr, uint16_t port) override;
+		bool connect(const String& host, uint16_t port) override;
+
+		void close() override;
+		bool wait(int tmo) override;
+
+	private:
+		LoopbackNetwork& _network;
+		SharedPointer<LoopbackConnection> _connection;
+		LoopbackPipe* _input;
+		LoopbackPipe* _output;
+		remote_addr_t _local;
+
+		/* Methods */
+		void attach(bool server);
+	};
+}
@@ -0,0 +1,66 @@
+/*
+ * In-process loopback TCP server.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/sharedpointer.h>
+#include <lwiot/uniquepointer.h>
+
+#include <lwiot/kernel/lock.h>
+#include <lwiot/kernel/event.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/tcpclient.h>
+#include <lwiot/network/tcpserver.h>
+#include <lwiot/network/loopbacknetwork.h>
+
+#include <lwiot/stl/linkedlist.h>
+
+namespace lwiot
+{
+	class LoopbackTcpServer : public TcpServer {
+	public:
+		explicit LoopbackTcpServer(LoopbackNetwork& network);
+		explicit LoopbackTcpServer(LoopbackNetwork& network, BindAddress addr, uint16_t port);
+		explicit LoopbackTcpServer(LoopbackNetwork& network, const IPAddress& addr, uint16_t port);
+		LoopbackTcpServer(const LoopbackTcpServer&) = delete;
+		~LoopbackTcpServer() override;
+
+		LoopbackTcpServer& operator=(const LoopbackTcpServer&) = delete;
+
+		bool bind() const override;
+		bool bind(BindAddress addr, uint16_t port);
+		bool bind(const IPAddress& addr, uint16_t port) override;
+
+		void connect() override;
+		UniquePointer<TcpClient> accept() override;
+		void close() override;
+		void setTimeout(time_t seconds) override;
+
+		void setBacklog(int backlog);
+
+		/* Block until a connection is pending or `tmo` milliseconds have passed */
+		bool wait(int tmo);
+
+		/* Called by the network, false when the backlog is full */
+		bool offer(const SharedPointer<LoopbackConnection>& connection);
+
+	private:
+		LoopbackNetwork& _network;
+		mutable Lock _lock;
+		Event _event;
+		stl::LinkedList<SharedPointer<LoopbackConnection>> _pending;
+		mutable bool _listening;
+		time_t _timeout;
+		size_t _backlog;
+	};
+}
@@ -0,0 +1,59 @@
+/*
+ * In-process loopback UDP client.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stl/string.h>
+
+#include <lwiot/network/stdnet.h>
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/udpclient.h>
+#include <lwiot/network/loopbacknetwork.h>
+
+namespace lwiot
+{
+	class LoopbackUdpClient : public UdpClient {
+	public:
+		explicit LoopbackUdpClient(LoopbackNetwork& network);
+		explicit LoopbackUdpClient(LoopbackNetwork& network, const IPAddress& addr, uint16_t port);
+
+		/* Reply client handed out by a server, it shares the inbox of that server */
+		explicit LoopbackUdpClient(LoopbackNetwork& network, const IPAddress& addr, uint16_t port,
+		                           LoopbackPipe* inbox, const remote_addr_t& local);
+		LoopbackUdpClient(const LoopbackUdpClient&) = delete;
+		~LoopbackUdpClient() override;
+
+		LoopbackUdpClient& operator=(const LoopbackUdpClient&) = delete;
+
+		void close() override;
+		size_t available() const override;
+
+		void begin() override;
+		void begin(const stl::String& host, uint16_t port) override;
+		void begin(const IPAddress& addr, uint16_t port) override;
+
+		using UdpClient::read;
+		using UdpClient::write;
+
+		ssize_t read(void *output, const size_t &length) override;
+		ssize_t write(const void *bytes, const size_t& length) override;
+
+	private:
+		LoopbackNetwork& _network;
+		LoopbackPipe* _inbox;
+		bool _noclose;
+		remote_addr_t _local;
+
+		/* Methods */
+		bool init();
+	};
+}
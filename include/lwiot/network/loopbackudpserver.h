@@ -0,0 +1,51 @@
+/*
+ * In-process loopback UDP server.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/uniquepointer.h>
+
+#include <lwiot/network/stdnet.h>
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/udpclient.h>
+#include <lwiot/network/udpserver.h>
+#include <lwiot/network/loopbacknetwork.h>
+
+namespace lwiot
+{
+	class LoopbackUdpServer : public UdpServer {
+	public:
+		explicit LoopbackUdpServer(LoopbackNetwork& network);
+		explicit LoopbackUdpServer(LoopbackNetwork& network, bind_addr_t addr, uint16_t port);
+		explicit LoopbackUdpServer(LoopbackNetwork& network, const IPAddress& addr, uint16_t port);
+		LoopbackUdpServer(const LoopbackUdpServer&) = delete;
+		~LoopbackUdpServer() override;
+
+		LoopbackUdpServer& operator=(const LoopbackUdpServer&) = delete;
+
+		void close() override;
+		bool bind() override;
+		bool bind(bind_addr_t addr, uint16_t port) override;
+		bool bind(const IPAddress& addr, uint16_t port) override;
+
+		UniquePointer<UdpClient> recv(void *buffer, size_t& length) override;
+		ssize_t recvFrom(void *buffer, size_t length, remote_addr_t& remote) override;
+		ssize_t sendTo(const void *buffer, size_t length, const remote_addr_t& remote) override;
+		void setTimeout(int tmo) override;
+
+	private:
+		LoopbackNetwork& _network;
+		LoopbackPipe _inbox;
+		bool _bound;
+		int _timeout;
+	};
+}
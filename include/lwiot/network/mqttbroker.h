@@ -0,0 +1,108 @@
+/*
+ * Embedded MQTT broker.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/kernel/functionalthread.h>
+#include <lwiot/kernel/lock.h>
+
+#include <lwiot/network/tcpserver.h>
+#include <lwiot/network/tcpclient.h>
+#include <lwiot/network/topictrie.h>
+
+#include <lwiot/stl/string.h>
+#include <lwiot/stl/linkedlist.h>
+#include <lwiot/stl/vector.h>
+
+namespace lwiot
+{
+	/*
+	 * Minimal MQTT 3.1.1 and 5 broker. Every client connection is served by its
+	 * own thread. Supports QoS 0 and 1, retained messages, wildcard and shared
+	 * subscriptions, inbound topic aliases and last will messages. Sessions are
+	 * always clean and outbound QoS 1 messages are not retransmitted, which makes
+	 * the broker suited to local networks and loopback testing rather than as a
+	 * general purpose broker.
+	 */
+	class MqttBroker {
+	public:
+		/* Every session holds two buffers of the maximum packet size */
+		explicit MqttBroker(TcpServer& server, size_t packet = MaxPacketSize);
+		MqttBroker(const MqttBroker&) = delete;
+		virtual ~MqttBroker();
+
+		MqttBroker& operator=(const MqttBroker&) = delete;
+
+		/* The server must be bound before the broker is started */
+		bool start();
+		void stop();
+
+		size_t sessions() const;
+		size_t retained() const;
+
+		static constexpr size_t MaxPacketSize = 8 * 1024;
+		static constexpr int MaxIdleTime = 250;
+		static constexpr time_t SocketTimeout = 5;
+		static constexpr uint16_t MaxTopicAliases = 32;
+		static constexpr uint16_t ReceiveMaximum = 64;
+
+	private:
+		class Session;
+
+		struct Subscriber {
+			Session* session;
+			uint8_t qos;
+			uint16_t group;
+
+			bool operator==(const Subscriber& other) const
+			{
+				return this->session == other.session && this->group == other.group;
+			}
+		};
+
+		struct Message {
+			String topic;
+			ByteBuffer payload;
+			uint8_t qos;
+			bool retain;
+		};
+
+		TcpServer& _server;
+		FunctionalThread _executor;
+		mutable Lock _lock;
+		bool _running;
+		size_t _packet_size;
+
+		stl::LinkedList<Session*> _sessions;
+		TopicTrie<Subscriber> _subscriptions;
+		stl::Vector<Subscriber> _shared;
+		stl::LinkedList<String> _groups;
+		stl::LinkedList<Message> _retained;
+		size_t _next_member;
+
+		/* Methods */
+		void run();
+		void reap(bool all);
+		bool running() const;
+
+		bool subscribe(Session* session, const String& filter, uint8_t qos);
+		void unsubscribe(Session* session, const String& filter);
+		void release(Session* session, const stl::LinkedList<String>& filters);
+		void route(const char* topic, size_t tl, const uint8_t* payload, size_t pl, uint8_t qos);
+		void retain(const char* topic, size_t tl, const uint8_t* payload, size_t pl, uint8_t qos);
+		void replay(Session* session, const String& filter, uint8_t qos);
+		bool group(const String& filter, bool create, uint16_t& group, String& topics);
+
+		static bool matches(const String& filter, const String& topic);
+	};
+}
@@ -20,18 +20,26 @@
 #include <lwiot/stl/map.h>
 #include <lwiot/function.h>
 #include <lwiot/stl/referencewrapper.h>
+#include <lwiot/util/jsonwriter.h>
 
 namespace lwiot
 {
 	class MqttClient {
 	public:
 		typedef Function<void(const String&, const ByteBuffer&)> Handler;
+		typedef Function<void(const String&, const uint8_t*, size_t, size_t, size_t)> StreamHandler;
+		typedef Function<void(uint16_t)> AckHandler;
 		enum QoS {
 			QOS0 = 0,
 			QOS1,
 			QOS2
 		};
 
+		enum ProtocolVersion {
+			MQTT_V3_1_1 = 4,
+			MQTT_V5 = 5
+		};
+
 		explicit MqttClient();
 		virtual ~MqttClient() = default;
 
@@ -50,6 +58,60 @@ namespace lwiot
 			this->_cb = stl::forward<CB>(cb);
 		}
 
+		/*
+		 * Messages that do not fit the packet buffer are handed to the stream
+		 * callback in chunks as they are read from the connection. The handler
+		 * receives the topic, a chunk, its length, its offset and the total
+		 * payload length.
+		 */
+		void setStreamCallback(const StreamHandler& cb)
+		{
+			this->_stream_cb = cb;
+		}
+
+		/*
+		 * Invoked with the packet identifier of each acknowledged QoS 1 publish.
+		 */
+		void setAckCallback(const AckHandler& cb)
+		{
+			this->_ack_cb = cb;
+		}
+
+		/*
+		 * Select the protocol level used by the next connect(). With MQTT 5 the
+		 * client assigns topic aliases to frequently published topics, resolves
+		 * topic aliases set by the server and limits the number of unacknowledged
+		 * QoS 1 publishes to the receive maximum of the server.
+		 */
+		void setProtocolVersion(ProtocolVersion version)
+		{
+			this->_version = version;
+		}
+
+		ProtocolVersion protocolVersion() const
+		{
+			return static_cast<ProtocolVersion>(this->_version);
+		}
+
+		/*
+		 * Reason code of the last CONNACK, SUBACK, PUBACK or DISCONNECT received.
+		 * Codes of 0x80 and up indicate failure.
+		 */
+		uint8_t reasonCode() const
+		{
+			return this->_reason;
+		}
+
+		uint16_t receiveMaximum() const
+		{
+			return this->_receive_max;
+		}
+
+		uint16_t inflight() const
+		{
+			return this->_inflight;
+		}
+
 		bool connect(const String& id, const String& user, const String& pass);
 		virtual bool connect(const String& id, const String& user, const String& pass,
 				const String& willTopic, uint8_t willQos, bool willRetain,
@@ -66,7 +128,34 @@ namespace lwiot
 		}
 
 		virtual bool publish(const stl::String& topic, const ByteBuffer& data, bool retained);
+		virtual bool publish(const stl::String& topic, const ByteBuffer& data, bool retained, QoS qos, uint16_t* id = nullptr);
 		bool publish(const stl::String& topic, const stl::String& data, bool retained = false);
+		virtual bool publish(const stl::String& topic, Stream& payload, size_t length, bool retained = false);
+
+		bool beginPublish(const stl::String& topic, size_t length, bool retained);
+		ssize_t writePayload(const void* data, size_t length);
+		bool endPublish();
+
+		/*
+		 * Publishes a JsonObject, JsonArray or JsonVariant. The document is
+		 * measured first and then serialized straight into the connection.
+		 */
+		template <typename T>
+		bool publishJson(const stl::String& topic, const T& document, bool retained = false)
+		{
+			if(!this->beginPublish(topic, document.measureLength(), retained))
+				return false;
+
+			JsonWriter writer([this](const void *data, size_t length) {
+				return this->writePayload(data, length) == static_cast<ssize_t>(length);
+			});
+
+			writer.json(document);
+			auto written = writer.flush();
+
+			/* Closes the connection when the payload fell short */
+			return this->endPublish() && written;
+		}
 
 		virtual inline int state() const
 		{
@@ -76,6 +165,17 @@ namespace lwiot
 		static constexpr int MQTT_MAX_PACKET_SIZE = 512;
 		static constexpr int MQTT_MAX_HEADER_SIZE =   5;
 		static constexpr int MQTT_SOCKET_TIMEOUT  =  15;
+		static constexpr size_t MQTT_MAX_REMAINING_LENGTH = 268435455;
+		static constexpr uint16_t MaxTopicAliases = 16;
+
+	protected:
+		size_t encode(ByteBuffer& output, const String& topic, const ByteBuffer& data, bool retained);
+		size_t packetSize(const String& topic, size_t length, QoS qos) const;
+		static size_t encodeLength(uint8_t* output, size_t length);
+		bool flush(const ByteBuffer& packets);
+		bool wait(int tmo);
+		bool hangup();
+		int keepAliveTimeout() const;
 
 	private:
 		stl::ReferenceWrapper<TcpClient> _io;
@@ -89,12 +189,37 @@ namespace lwiot
 		unsigned long _lastInActivity;
 		bool _pingOutstanding;
 		Handler _cb;
+		StreamHandler _stream_cb;
+		AckHandler _ack_cb;
+		size_t _payload_remaining;
+
+		struct TopicAlias {
+			String topic;
+			uint8_t hits;
+		};
+
+		uint8_t _version;
+		uint8_t _reason;
+		uint16_t _receive_max;
+		uint16_t _inflight;
+		uint16_t _alias_max;
+		uint16_t _alias_count;
+		TopicAlias _aliases[MaxTopicAliases];
+		String _inbound_aliases[MaxTopicAliases];
 
 		/* Methods */
 		size_t build(uint8_t header, uint16_t length) const;
 		uint16_t readPacket(uint8_t* data);
+		uint16_t readStream(uint8_t llen, uint32_t length);
+		void dispatch(uint8_t llen, uint16_t length);
+		bool properties(const uint8_t*& pos, const uint8_t* end, uint16_t* alias);
+		bool resolve(const uint8_t* topic, uint16_t length, uint16_t alias, const String*& resolved);
+		uint16_t alias(const String& topic, bool& known);
+		size_t prefix(uint8_t* output, const String& topic, size_t length, bool retained, QoS qos, uint16_t id);
 		bool read(uint8_t * result);
 		bool read(uint8_t * result, uint16_t * index);
+		bool readFully(uint8_t *result, size_t length);
+		bool send(const void *data, size_t length);
 
 		uint16_t write(const stl::String& data, uint16_t pos);
 		size_t write(uint8_t);
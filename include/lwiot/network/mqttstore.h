@@ -0,0 +1,90 @@
+/*
+ * MQTT store-and-forward message log.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/bytebuffer.h>
+#include <lwiot/uniquepointer.h>
+
+#include <lwiot/io/file.h>
+#include <lwiot/stl/string.h>
+
+namespace lwiot
+{
+	/*
+	 * Message log used by AsyncMqttClient to hold publishes while the uplink is
+	 * down. Records are replayed in order through a cursor and only removed from
+	 * the front of the log once the broker has acknowledged them.
+	 */
+	class MqttStore {
+	public:
+		virtual ~MqttStore() = default;
+
+		virtual bool append(const String& topic, const ByteBuffer& payload, bool retained) = 0;
+		virtual bool next(String& topic, ByteBuffer& payload, bool& retained) = 0;
+		virtual bool pop() = 0;
+		virtual void rewind() = 0;
+
+		virtual size_t count() const = 0;
+		virtual size_t pending() const = 0;
+	};
+
+	/*
+	 * Ring log of bounded size in a single file. Every record carries a CRC32 of
+	 * its contents and the log header is rewritten after each change, so a log
+	 * survives a reboot. When the log is full the oldest records are dropped,
+	 * unless they are being replayed. Appending fails in that case.
+	 */
+	class MqttFileStore : public MqttStore {
+	public:
+		explicit MqttFileStore(const String& path, size_t capacity = DefaultCapacity);
+		~MqttFileStore() override = default;
+
+		explicit operator bool() const;
+
+		bool append(const String& topic, const ByteBuffer& payload, bool retained) override;
+		bool next(String& topic, ByteBuffer& payload, bool& retained) override;
+		bool pop() override;
+		void rewind() override;
+		void clear();
+
+		size_t count() const override;
+		size_t pending() const override;
+
+		static constexpr size_t DefaultCapacity = 64 * 1024;
+
+	private:
+		UniquePointer<File> _file;
+		uint32_t _capacity;
+
+		uint32_t _head;
+		uint32_t _tail;
+		uint32_t _count;
+		uint32_t _cursor;
+		uint32_t _sent;
+
+		static constexpr uint32_t Magic = 0x4C574D51;
+		static constexpr size_t HeaderSize = 20;
+		static constexpr size_t RecordHeaderSize = 9;
+		static constexpr uint8_t FlagRetain = 0x1;
+		static constexpr uint8_t FlagWrap = 0x80;
+
+		/* Methods */
+		bool load();
+		bool sync();
+		bool reserve(size_t size, uint32_t& pos, bool& wrap) const;
+		bool locate(uint32_t& pos, uint8_t* header);
+		bool read(size_t offset, void* data, size_t length);
+		bool write(size_t offset, const void* data, size_t length);
+
+		static uint32_t crc32(uint32_t crc, const void* data, size_t length);
+	};
+}
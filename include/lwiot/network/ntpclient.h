@@ -9,15 +9,29 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <lwiot.h>
 
 #include <lwiot/network/udpclient.h>
 #include <lwiot/network/ipaddress.h>
 
-#include <lwiot/stl/referencewrapper.h>
-
 namespace lwiot
 {
+	/*
+	 * SNTP client with a disciplined local clock. Every update queries each
+	 * server once, or in a burst spaced two seconds apart when more samples
+	 * are configured, and keeps per server the sample with the lowest round
+	 * trip delay. The median offset of all servers corrects the clock.
+	 *
+	 * Servers that answer with a DENY or RSTR kiss code are no longer
+	 * queried. A RATE kiss holds a server off for an interval that doubles
+	 * with every repeated kiss.
+	 *
+	 * Large offsets step the clock. Smaller ones are slewed in at no more
+	 * than 500 ppm, so time never runs backwards. The frequency error of the
+	 * local oscillator is estimated from the offsets that remain between
+	 * updates, which keeps time() accurate without frequent polling.
+	 */
 	class NtpClient {
 	public:
 		explicit NtpClient();
@@ -25,20 +39,71 @@ namespace lwiot
 
 		void begin();
 		void begin(UdpClient& client);
+		bool addServer(UdpClient& client);
+		void setSamples(uint8_t samples);
+
 		bool update();
+
 		time_t time() const;
+		uint64_t milliseconds() const;
+
+		bool synchronized() const;
+		/* Results of the last update, in microseconds */
+		int64_t offset() const;
+		int64_t delay() const;
+		/* Estimated frequency correction, in ppm */
+		double drift() const;
+
+		static constexpr size_t MaxServers = 4;
+		static constexpr uint8_t DefaultSamples = 1;
+		static constexpr time_t BurstInterval = 2000000;
+		static constexpr time_t MinBackoff = 16000000;
+		static constexpr time_t MaxBackoff = 1024000000;
+		static constexpr int64_t StepThreshold = 128000;
+		static constexpr double MaxSlew = 500e-6;
+		static constexpr double MaxDrift = 500e-6;
+		static constexpr time_t DriftInterval = 64000000;
 
 	private:
-		mutable stl::ReferenceWrapper<UdpClient> _client;
+		struct Sample {
+			int64_t offset;
+			int64_t delay;
+		};
 
-		time_t _current_epoch;
-		time_t _last_update;
+		struct Server {
+			UdpClient* client;
+			bool denied;
+			time_t backoff;
+			time_t holdoff;
+		};
+
+		Server _servers[MaxServers];
+		size_t _count;
+		uint8_t _samples;
+
+		bool _synchronized;
+		int64_t _base;
+		time_t _base_tick;
+		int64_t _slew;
+		double _drift;
+
+		int64_t _error;
+		time_t _error_tick;
+
+		int64_t _offset;
+		int64_t _delay;
 
 		constexpr static int NTP_PACKET_SIZE = 48;
-		constexpr static int NTP_DEFAULT_PORT = 1337;
-		constexpr static unsigned long SEVENTY_YEARS = 2208988800UL;
+		constexpr static uint64_t SEVENTY_YEARS = 2208988800ULL;
 
 		/* Methods */
-		void sendRequest() const;
+		int64_t now(time_t tick) const;
+		int64_t remaining(time_t tick) const;
+		bool exchange(Server& server, Sample& sample) const;
+		void kiss(Server& server, const uint8_t *code) const;
+		void discipline(int64_t offset, time_t tick);
+
+		static void encode(int64_t time, uint8_t *output);
+		static int64_t decode(const uint8_t *input);
 	};
 }
@@ -15,6 +15,8 @@
 
 #include <lwiot/network/tcpclient.h>
 #include <lwiot/network/stdnet.h>
+#include <lwiot/network/tlssessioncache.h>
+#include <lwiot/network/tlsconfig.h>
 
 namespace lwiot
 {
@@ -41,6 +43,20 @@ namespace lwiot
 		void setServerName(const String& host);
 		void setServerCertificate(const String& cert);
 
+		/* Takes precedence over the server certificate set above */
+		void setConfig(const TlsConfig& config);
+
+		const String& serverCertificate() const;
+		const TlsConfig* config() const;
+
+		/*
+		 * Sessions are saved after every handshake and offered on the next connect
+		 * to the same server. Without a shared cache a client only resumes its own
+		 * previous session.
+		 */
+		void setSessionCache(TlsSessionCache& cache);
+		bool resumed() const;
+
 		explicit operator bool() const override;
 		bool connected() const override;
 
@@ -51,9 +67,19 @@ namespace lwiot
 		ssize_t write(const void *bytes, const size_t& length) override;
 		size_t available() const override;
 
+		static constexpr size_t MaxSessionSize = 1024;
+
 	private:
 		secure_socket_t* _socket;
 		String _host;
 		String _cert;
+		const TlsConfig* _config;
+		bool _resumed;
+
+		TlsSessionCache* _cache;
+		TlsSessionCache _session;
+
+		/* Methods */
+		TlsSessionCache& sessions();
 	};
 }
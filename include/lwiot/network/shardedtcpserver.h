@@ -0,0 +1,80 @@
+/*
+ * Sharded TCP server.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/function.h>
+#include <lwiot/uniquepointer.h>
+
+#include <lwiot/kernel/functionalthread.h>
+#include <lwiot/kernel/lock.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/tcpclient.h>
+#include <lwiot/network/sockettcpserver.h>
+
+#include <lwiot/stl/linkedlist.h>
+
+namespace lwiot
+{
+	/*
+	 * TCP server with several listening sockets bound to the same port, each
+	 * owned by a worker thread. The kernel spreads incoming connections over the
+	 * sockets, so connection setup scales over multiple cores instead of being
+	 * serialised on a single accept queue. The handler runs on the worker that
+	 * accepted the connection and should hand long lived connections off to
+	 * keep that worker accepting. Platforms without port reuse get one shard.
+	 */
+	class ShardedTcpServer {
+	public:
+		typedef Function<void(UniquePointer<TcpClient>&)> Handler;
+
+		explicit ShardedTcpServer(size_t shards = DefaultShards, int backlog = SocketTcpServer::BacklogSize);
+		ShardedTcpServer(const ShardedTcpServer&) = delete;
+		virtual ~ShardedTcpServer();
+
+		ShardedTcpServer& operator=(const ShardedTcpServer&) = delete;
+
+		bool bind(BindAddress addr, uint16_t port);
+		bool bind(const IPAddress& addr, uint16_t port);
+
+		bool start(const Handler& handler);
+		void stop();
+
+		size_t shards() const;
+
+		static constexpr size_t DefaultShards = 4;
+		static constexpr int MaxIdleTime = 250;
+
+	private:
+		struct Shard {
+			explicit Shard(int backlog) : executor("tcp-shard")
+			{
+				server.setBacklog(backlog);
+			}
+
+			SocketTcpServer server;
+			FunctionalThread executor;
+		};
+
+		mutable Lock _lock;
+		stl::LinkedList<Shard*> _shards;
+		size_t _count;
+		int _backlog;
+		bool _running;
+		Handler _handler;
+
+		/* Methods */
+		void run(Shard* shard);
+		bool running() const;
+		void release();
+	};
+}
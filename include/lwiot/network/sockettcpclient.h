@@ -53,6 +53,7 @@ namespace lwiot
 		void setTimeout(time_t seconds) override;
 
 		void close() override;
+		bool wait(int tmo) override;
 
 	private:
 		socket_t *_socket;
@@ -48,6 +48,13 @@ namespace lwiot
 		void close() override;
 		void setTimeout(time_t seconds) override ;
 
+		/* Both take effect on the next bind */
+		void setBacklog(int backlog);
+		bool setReusePort(bool enable);
+
+		/* Block until a connection is pending or `tmo` milliseconds have passed */
+		bool wait(int tmo);
+
 #ifdef HAVE_LWIP
 		static constexpr int BacklogSize = 16;
 #else
@@ -56,5 +63,7 @@ namespace lwiot
 
 	private:
 		socket_t *_socket;
+		int _backlog;
+		bool _reuse_port;
 	};
 }
@@ -27,6 +27,8 @@ namespace lwiot
 		bool bind(const IPAddress& addr, uint16_t port) override;
 
 		UniquePointer<UdpClient> recv(void *buffer, size_t& length) override;
+		ssize_t recvFrom(void *buffer, size_t length, remote_addr_t& remote) override;
+		ssize_t sendTo(const void *buffer, size_t length, const remote_addr_t& remote) override;
 		void setTimeout(int tmo) override;
 
 	private:
@@ -25,6 +25,10 @@ typedef long socket_t;
 typedef long secure_socket_t;
 #endif
 
+#ifndef HAVE_SECURE_CONFIG_DEFINITION
+typedef long secure_config_t;
+#endif
+
 static inline uint32_t lwiot_bswap_32(uint32_t __bsx)
 {
 #ifdef WIN32
@@ -95,12 +99,15 @@ extern DLL_EXPORT size_t udp_socket_available(socket_t *socket);
 
 extern DLL_EXPORT void socket_close(socket_t *socket);
 extern DLL_EXPORT void socket_set_timeout(socket_t *sock, int tmo);
+extern DLL_EXPORT bool socket_wait(socket_t *sock, int tmo);
 
 /* SERVER OPS */
 extern DLL_EXPORT socket_t *server_socket_create(socket_type_t type, bool ipv6);
 extern DLL_EXPORT bool server_socket_bind_to(socket_t *sock, remote_addr_t *remote, uint16_t port);
 extern DLL_EXPORT bool server_socket_bind(socket_t *sock, bind_addr_t addr, uint16_t port);
 extern DLL_EXPORT bool server_socket_listen(socket_t *socket);
+extern DLL_EXPORT bool server_socket_listen_backlog(socket_t *socket, int backlog);
+extern DLL_EXPORT bool server_socket_reuse_port(socket_t *socket);
 extern DLL_EXPORT socket_t *server_socket_accept(socket_t *socket);
 
 /* DNS */
@@ -111,6 +118,13 @@ typedef struct ssl_context {
 	const char *root_ca;
 	const char *client_cert;
 	const char *client_key;
+
+	/* Saved session to resume, NULL for a full handshake */
+	const void *session;
+	size_t session_length;
+
+	/* Pre-parsed configuration, used instead of the PEM strings above when set */
+	const secure_config_t *config;
 } ssl_context_t;
 
 extern DLL_EXPORT bool secure_socket_connect(secure_socket_t *socket, const char *host, remote_addr_t* addr, ssl_context_t* context);
@@ -120,5 +134,24 @@ extern DLL_EXPORT size_t secure_socket_available(secure_socket_t* socket);
 extern DLL_EXPORT ssize_t secure_socket_send(secure_socket_t* socket, const void *data, size_t length);
 extern DLL_EXPORT ssize_t secure_socket_recv(secure_socket_t* socket, void *data, size_t length);
 
+/*
+ * TLS session resumption. A session saved from a connected socket is offered by
+ * the next secure_socket_connect() through ssl_context_t::session, using the
+ * session ID and session ticket it contains. Ports without resumption support
+ * fail to save a session and always perform a full handshake.
+ */
+extern DLL_EXPORT ssize_t secure_socket_session_save(secure_socket_t* socket, void *output, size_t length);
+extern DLL_EXPORT bool secure_socket_session_resumed(secure_socket_t* socket);
+
+/*
+ * Shared TLS configuration. The certificates and key in the context are parsed
+ * once, together with the TLS configuration and random number generator they
+ * need. The result is only read by secure_socket_connect(), so any number of
+ * connections can use it at the same time. Ports without support return NULL,
+ * in which case the PEM strings are parsed for each connection.
+ */
+extern DLL_EXPORT secure_config_t* secure_config_create(const ssl_context_t* context);
+extern DLL_EXPORT void secure_config_destroy(secure_config_t* config);
+
 #endif
 CDECL_END
@@ -66,6 +66,12 @@ namespace lwiot
 
 		virtual void close() = 0;
 
+		/*
+		 * Block until data is available, the connection is gone or `tmo`
+		 * milliseconds have passed. Returns false on timeout.
+		 */
+		virtual bool wait(int tmo);
+
 		const IPAddress& remote() const;
 		uint16_t port() const;
 
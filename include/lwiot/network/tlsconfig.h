@@ -0,0 +1,43 @@
+/*
+ * Shared TLS configuration.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stl/string.h>
+
+#include <lwiot/network/stdnet.h>
+
+namespace lwiot
+{
+	/*
+	 * Root CA, client certificate and key, parsed once and shared by any number
+	 * of SecureTcpClient instances. The configuration is read-only after
+	 * construction and must outlive the clients using it.
+	 */
+	class TlsConfig {
+	public:
+		explicit TlsConfig(const String& ca, const String& cert = "", const String& key = "");
+		TlsConfig(const TlsConfig&) = delete;
+		virtual ~TlsConfig();
+
+		TlsConfig& operator=(const TlsConfig&) = delete;
+
+		/* False when the port cannot pre-parse and parses per connection instead */
+		bool parsed() const;
+		void apply(ssl_context_t& context) const;
+
+	private:
+		String _ca;
+		String _cert;
+		String _key;
+		secure_config_t* _config;
+	};
+}
@@ -0,0 +1,61 @@
+/*
+ * TLS session cache.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/kernel/lock.h>
+
+#include <lwiot/stl/string.h>
+#include <lwiot/stl/linkedlist.h>
+
+namespace lwiot
+{
+	/*
+	 * Saved TLS sessions, keyed by server name and port. A SecureTcpClient that
+	 * finds a session for its server offers it during the handshake, which lets
+	 * the server resume the session (by session ID or session ticket) instead of
+	 * performing a full handshake. Sharing a cache between clients lets every
+	 * client connecting to the same server benefit from a single full handshake.
+	 */
+	class TlsSessionCache {
+	public:
+		explicit TlsSessionCache(size_t capacity = DefaultCapacity, time_t lifetime = DefaultLifetime);
+		TlsSessionCache(const TlsSessionCache&) = delete;
+		virtual ~TlsSessionCache() = default;
+
+		TlsSessionCache& operator=(const TlsSessionCache&) = delete;
+
+		bool load(const String& host, uint16_t port, ByteBuffer& session);
+		void store(const String& host, uint16_t port, const ByteBuffer& session);
+		void remove(const String& host, uint16_t port);
+		void clear();
+
+		size_t size() const;
+
+		static constexpr size_t DefaultCapacity = 4;
+		static constexpr time_t DefaultLifetime = 7200;
+
+	private:
+		struct Entry {
+			String host;
+			uint16_t port;
+			ByteBuffer session;
+			time_t stored;
+		};
+
+		mutable Lock _lock;
+		stl::LinkedList<Entry> _entries;
+		size_t _capacity;
+		time_t _lifetime;
+	};
+}
@@ -0,0 +1,346 @@
+/*
+ * MQTT topic filter trie.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <lwiot.h>
+
+#include <lwiot/stl/string.h>
+#include <lwiot/stl/vector.h>
+#include <lwiot/stl/linkedlist.h>
+#include <lwiot/stl/move.h>
+#include <lwiot/stl/forward.h>
+
+namespace lwiot
+{
+	/*
+	 * Stores values keyed by MQTT topic filters. Filters may contain the single
+	 * level (`+`) and multi level (`#`) wildcards. Each filter level is a trie node,
+	 * with the children of a node sorted so that a topic is matched in
+	 * O(depth * log(fanout)) string compares, independent of the number of filters.
+	 */
+	template <typename T>
+	class TopicTrie {
+	public:
+		typedef T value_type;
+
+		explicit TopicTrie() : _root("", 0), _size(0)
+		{
+		}
+
+		TopicTrie(const TopicTrie&) = delete;
+		TopicTrie& operator=(const TopicTrie&) = delete;
+
+		virtual ~TopicTrie()
+		{
+			this->clear();
+		}
+
+		void clear()
+		{
+			this->_root.clear();
+			this->_size = 0;
+		}
+
+		constexpr size_t size() const
+		{
+			return this->_size;
+		}
+
+		bool add(const String& filter, const value_type& value)
+		{
+			if(!TopicTrie::validate(filter))
+				return false;
+
+			auto node = this->lookup(filter, true);
+			node->values.push_back(value);
+			this->_size++;
+
+			return true;
+		}
+
+		bool remove(const String& filter)
+		{
+			auto node = this->lookup(filter, false);
+
+			if(node == nullptr || node->values.size() == 0)
+				return false;
+
+			this->_size -= node->values.size();
+			node->values.clear();
+			this->prune(filter);
+
+			return true;
+		}
+
+		bool remove(const String& filter, const value_type& value)
+		{
+			auto node = this->lookup(filter, false);
+
+			if(node == nullptr)
+				return false;
+
+			for(auto iter = node->values.begin(); iter != node->values.end(); ++iter) {
+				if(!(*iter == value))
+					continue;
+
+				node->values.erase(iter);
+				this->_size--;
+
+				if(node->values.size() == 0)
+					this->prune(filter);
+
+				return true;
+			}
+
+			return false;
+		}
+
+		bool contains(const String& filter) const
+		{
+			auto node = const_cast<TopicTrie*>(this)->lookup(filter, false);
+			return node != nullptr && node->values.size() != 0;
+		}
+
+		template <typename Func>
+		size_t match(const String& topic, Func&& func) const
+		{
+			return this->match(topic.c_str(), topic.length(), func);
+		}
+
+		template <typename Func>
+		size_t match(const char *topic, size_t length, Func&& func) const
+		{
+			bool system = length > 0 && topic[0] == '$';
+			return this->match(&this->_root, topic, topic + length, !system, func);
+		}
+
+		static bool validate(const String& filter)
+		{
+			const char *str = filter.c_str();
+			size_t length = filter.length();
+
+			if(length == 0)
+				return false;
+
+			for(size_t idx = 0; idx < length; idx++) {
+				bool first = idx == 0 || str[idx - 1] == '/';
+				bool last = idx + 1 == length || str[idx + 1] == '/';
+
+				if(str[idx] == '+' && !(first && last))
+					return false;
+
+				if(str[idx] == '#' && !(first && idx + 1 == length))
+					return false;
+			}
+
+			return true;
+		}
+
+	private:
+		struct Node {
+			explicit Node(const char *level, size_t length) : level(level, length)
+			{
+			}
+
+			~Node()
+			{
+				this->clear();
+			}
+
+			void clear()
+			{
+				for(auto child : this->children)
+					delete child;
+
+				this->children.clear();
+				this->values.clear();
+			}
+
+			int compare(const char *other, size_t length) const
+			{
+				auto len = this->level.length();
+				auto rv = memcmp(this->level.c_str(), other, len < length ? len : length);
+
+				if(rv != 0)
+					return rv;
+
+				return len == length ? 0 : (len < length ? -1 : 1);
+			}
+
+			int find(const char *other, size_t length) const
+			{
+				int lo = 0;
+				int hi = this->children.size() - 1;
+
+				while(lo <= hi) {
+					auto mid = (lo + hi) / 2;
+					auto rv = this->children[mid]->compare(other, length);
+
+					if(rv == 0)
+						return mid;
+
+					if(rv < 0)
+						lo = mid + 1;
+					else
+						hi = mid - 1;
+				}
+
+				return -1;
+			}
+
+			Node* insert(const char *other, size_t length)
+			{
+				auto node = new Node(other, length);
+				auto idx = this->children.size();
+
+				this->children.pushback(node);
+
+				while(idx > 0 && this->children[idx - 1]->compare(other, length) > 0) {
+					this->children[idx] = this->children[idx - 1];
+					idx--;
+				}
+
+				this->children[idx] = node;
+				return node;
+			}
+
+			void erase(int idx)
+			{
+				delete this->children[idx];
+
+				for(size_t next = idx + 1; next < this->children.size(); next++)
+					this->children[next - 1] = this->children[next];
+
+				this->children.popback();
+			}
+
+			bool empty() const
+			{
+				return this->children.size() == 0 && this->values.size() == 0;
+			}
+
+			String level;
+			stl::Vector<Node*> children;
+			stl::LinkedList<value_type> values;
+		};
+
+		Node _root;
+		size_t _size;
+
+		static const char* next(const char *start, const char *end)
+		{
+			auto sep = static_cast<const char*>(memchr(start, '/', end - start));
+			return sep == nullptr ? end : sep;
+		}
+
+		Node* lookup(const String& filter, bool create)
+		{
+			const char *start = filter.c_str();
+			const char *end = start + filter.length();
+			Node* node = &this->_root;
+
+			while(true) {
+				auto sep = TopicTrie::next(start, end);
+				auto idx = node->find(start, sep - start);
+
+				if(idx >= 0)
+					node = node->children[idx];
+				else if(create)
+					node = node->insert(start, sep - start);
+				else
+					return nullptr;
+
+				if(sep == end)
+					return node;
+
+				start = sep + 1;
+			}
+		}
+
+		bool prune(Node* node, const char *start, const char *end)
+		{
+			auto sep = TopicTrie::next(start, end);
+			auto idx = node->find(start, sep - start);
+
+			if(idx < 0)
+				return false;
+
+			auto child = node->children[idx];
+
+			if(sep != end)
+				this->prune(child, sep + 1, end);
+
+			if(child->empty())
+				node->erase(idx);
+
+			return node->empty();
+		}
+
+		void prune(const String& filter)
+		{
+			const char *start = filter.c_str();
+			this->prune(&this->_root, start, start + filter.length());
+		}
+
+		template <typename Func>
+		size_t visit(const Node* node, Func& func) const
+		{
+			for(const auto& value : node->values)
+				func(value);
+
+			return node->values.size();
+		}
+
+		template <typename Func>
+		size_t descend(const Node* node, const char *start, const char *end, Func& func) const
+		{
+			size_t matches;
+			int idx;
+
+			if(start != end)
+				return this->match(node, start + 1, end, true, func);
+
+			/* Last level: `a/#` also matches its parent level `a` */
+			matches = this->visit(node, func);
+			idx = node->find("#", 1);
+
+			if(idx >= 0)
+				matches += this->visit(node->children[idx], func);
+
+			return matches;
+		}
+
+		template <typename Func>
+		size_t match(const Node* node, const char *start, const char *end, bool wildcards, Func& func) const
+		{
+			size_t matches = 0;
+			auto sep = TopicTrie::next(start, end);
+			auto idx = node->find(start, sep - start);
+
+			if(idx >= 0)
+				matches += this->descend(node->children[idx], sep, end, func);
+
+			if(!wildcards)
+				return matches;
+
+			idx = node->find("+", 1);
+
+			if(idx >= 0)
+				matches += this->descend(node->children[idx], sep, end, func);
+
+			idx = node->find("#", 1);
+
+			if(idx >= 0)
+				matches += this->visit(node->children[idx], func);
+
+			return matches;
+		}
+	};
+}
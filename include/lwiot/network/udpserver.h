@@ -24,6 +24,9 @@ namespace lwiot
 		virtual bool bind(const IPAddress& addr, uint16_t port);
 
 		virtual UniquePointer<UdpClient> recv(void *buffer, size_t& length) = 0;
+		/* Allocation free request/response path, the port in `remote` is in network order */
+		virtual ssize_t recvFrom(void *buffer, size_t length, remote_addr_t& remote) = 0;
+		virtual ssize_t sendTo(const void *buffer, size_t length, const remote_addr_t& remote) = 0;
 		virtual void setTimeout(int tmo) = 0;
 
 		const IPAddress& address() const;
@@ -21,6 +21,7 @@
 
 #include <lwiot/kernel/thread.h>
 #include <lwiot/kernel/lock.h>
+#include <lwiot/kernel/event.h>
 
 #include <lwiot/network/xbee/xbee.h>
 #include <lwiot/network/xbee/asyncxbee.h>
@@ -30,9 +31,21 @@
 
 namespace lwiot
 {
+	/*
+	 * Runs an XBee device on its own thread. Requests are queued and written
+	 * by the thread, which keeps up to a configurable number of them in flight.
+	 * Each request gets a frame ID; the TX status or AT command response with
+	 * that ID completes the request and calls its completion handler. Requests
+	 * that are not answered in time complete unsuccessfully. All other frames
+	 * are passed to the response handler. Handlers run on the XBee thread,
+	 * without the device lock held.
+	 *
+	 * Frame ID DEFAULT_FRAME_ID is left to the blocking AT command methods.
+	 */
 	class AsyncXbee : public Thread {
 	public:
 		typedef Function<void(XBeeResponse&)> ResponseHandler;
+		typedef Function<void(bool success, XBeeResponse& response)> CompletionHandler;
 
 		explicit AsyncXbee();
 		explicit AsyncXbee(XBee& xb);
@@ -41,6 +54,7 @@ namespace lwiot
 
 		void begin(ResponseHandler&& handler);
 		void begin(const ResponseHandler& handler);
+		void end();
 
 		void setHandler(const ResponseHandler& handler);
 		void setDevice(XBee& xb);
@@ -51,10 +65,23 @@ namespace lwiot
 		template <typename Func>
 		void send(XBeeRequest& rq, Func&& callback) const
 		{
-			auto success = this->send(rq);
-			callback(success);
+			auto queued = this->enqueue(rq, [callback](bool success, XBeeResponse& response) {
+				callback(success);
+			});
+
+			if(!queued)
+				callback(false);
 		}
 
+		/* The request is encoded right away, its payload does not have to outlive the call */
+		bool enqueue(XBeeRequest& request, const CompletionHandler& handler) const;
+		bool command(const char *cmd, const uint8_t *value, size_t length, const CompletionHandler& handler) const;
+
+		void setMaxInFlight(size_t max);
+		void setTxTimeout(int tmo);
+		size_t inFlight() const;
+		size_t queued() const;
+
 		bool transmit(const stl::String& data, uint16_t addr) const;
 		bool transmit(const stl::String& data, uint64_t addr) const;
 		bool transmit(ZigbeeAddress addr, const ByteBuffer& buffer) const;
@@ -88,16 +115,50 @@ namespace lwiot
 
 		void writeToFlash() const;
 
+		static constexpr size_t MaxInFlight = 16;
+		static constexpr size_t QueueSize = 32;
+		static constexpr int DefaultTxTimeout = 1000;
+		/* Queued requests wake the thread, incoming frames are picked up at this interval */
+		static constexpr time_t PollInterval = 5;
+
 	protected:
 		void run() override;
 		void init();
 
 	private:
+		struct Transmission {
+			uint8_t id;
+			ByteBuffer frame;
+			CompletionHandler handler;
+		};
+
+		struct Outstanding {
+			uint8_t id;
+			time_t deadline;
+			CompletionHandler handler;
+		};
+
 		mutable Lock _lock;
+		mutable Event _wakeup;
 		ResponseHandler _handler;
 		bool _running;
 		mutable XBee _xb;
 
+		mutable Transmission _queue[QueueSize];
+		mutable size_t _head;
+		mutable size_t _count;
+		mutable Outstanding _pending[MaxInFlight];
+		mutable size_t _inflight;
+		mutable uint32_t _ids[256 / 32];
+		size_t _max_inflight;
+		int _tx_timeout;
+
 		bool validateTxRequest() const;
+		uint8_t allocate() const;
+		void release(uint8_t id) const;
+		void flush();
+		bool poll(UniqueLock<Lock>& lock);
+		void expire(UniqueLock<Lock>& lock);
+		void cancel(UniqueLock<Lock>& lock);
 	};
 }
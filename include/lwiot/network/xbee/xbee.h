@@ -18,6 +18,7 @@
 #include <lwiot/network/xbee/xbeeaddress.h>
 #include <lwiot/network/xbee/xbeeresponse.h>
 #include <lwiot/network/xbee/xbeerequest.h>
+#include <lwiot/network/xbee/xbeeframedecoder.h>
 
 #include <lwiot/network/zigbeeaddress.h>
 
@@ -60,6 +61,7 @@ namespace lwiot
 		void send(XBeeRequest &request) const;
 		void send(ZigbeeAddress addr, const ByteBuffer& buffer) const;
 		void send(ZigbeeAddress addr, const ByteBuffer& buffer, uint16_t profile, uint16_t cluster) const;
+		void encode(XBeeRequest& request, ByteBuffer& output) const;
 		uint8_t getNextFrameId();
 		void setSerial(Stream &serial);
 		void setSleepPin(const GpioPin& pin);
@@ -83,6 +85,7 @@ namespace lwiot
 		void writeToFlash();
 
 		uint8_t getMaxPayloadSize() const;
+		const XBeeFrameDecoder& getDecoder() const;
 
 		void setSleepMode(SleepMode sleepmode);
 		void sleep();
@@ -95,10 +98,7 @@ namespace lwiot
 		friend class AsyncXbee;
 
 		XBeeResponse _response;
-		bool _escape;
-		uint8_t _pos;
-		uint8_t b;
-		uint8_t _checksumTotal;
+		XBeeFrameDecoder _decoder;
 		uint8_t _nextFrameId;
 		uint8_t _responseFrameData[MAX_FRAME_DATA_SIZE];
 		uint8_t _max_payload;
@@ -106,8 +106,6 @@ namespace lwiot
 		stl::ReferenceWrapper<Stream> _serial;
 		GpioPin _sleep_pin;
 
-		bool available();
-		uint8_t read();
 		void write(uint8_t val) const;
 		void sendByte(uint8_t b, bool escape) const;
 		void resetResponse();
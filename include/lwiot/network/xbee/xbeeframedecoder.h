@@ -0,0 +1,99 @@
+/*
+ * Block oriented XBee API frame decoder.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stream.h>
+
+#include <lwiot/network/xbee/constants.h>
+
+namespace lwiot
+{
+	/* A complete, checksummed API frame: the API identifier followed by the frame data */
+	struct XBeeFrame {
+		uint16_t length;
+		uint8_t checksum;
+		uint8_t data[MAX_FRAME_DATA_SIZE + 1];
+
+		uint8_t apiId() const { return this->data[0]; }
+		const uint8_t *frameData() const { return this->data + 1; }
+		uint16_t frameDataLength() const { return this->length - 1; }
+	};
+
+	/*
+	 * Decodes escaped (AP=2) API frames from blocks of serial data. Bytes are
+	 * classified through a lookup table, so runs of plain frame data are
+	 * copied and summed in a tight loop. Complete frames are queued in a small
+	 * pool; frames fed to a full pool are dropped and counted, corrupt frames
+	 * are discarded and counted as errors. read() stops once the pool is full,
+	 * so frames read from a stream wait there instead of being dropped.
+	 *
+	 * Unescaped (AP=1) frames are decoded as well, once escaping is disabled.
+	 */
+	class XBeeFrameDecoder {
+	public:
+		explicit XBeeFrameDecoder(bool escaped = true);
+
+		void setEscaped(bool escaped);
+		bool escaped() const { return this->_escaped; }
+
+		/* Reads what the stream has available, as long as there is room in the pool */
+		size_t read(Stream& serial);
+		/* Returns the number of bytes used, which falls short once a frame fills up the pool */
+		size_t feed(const uint8_t *data, size_t length);
+
+		size_t frames() const { return this->_count; }
+		bool full() const { return this->_count == PoolSize; }
+		const XBeeFrame *front() const;
+		void pop();
+		void reset();
+
+		size_t errors() const { return this->_errors; }
+		size_t dropped() const { return this->_dropped; }
+
+		static constexpr size_t PoolSize = 4;
+		static constexpr size_t ReadSize = 64;
+
+	private:
+		enum State {
+			Hunt,
+			LengthMsb,
+			LengthLsb,
+			Body
+		};
+
+		const uint8_t *_classes;
+		bool _escaped;
+		State _state;
+		bool _escape;
+		uint16_t _length;
+		uint16_t _pos;
+		uint8_t _checksum;
+		bool _dropping;
+
+		XBeeFrame _pool[PoolSize];
+		XBeeFrame _overflow;
+		size_t _head;
+		size_t _count;
+
+		size_t _errors;
+		size_t _dropped;
+		uint8_t _rx[ReadSize];
+		size_t _rx_pos;
+		size_t _rx_end;
+
+		/* Methods */
+		void start();
+		XBeeFrame& current();
+		void commit(uint8_t checksum);
+	};
+}
@@ -0,0 +1,148 @@
+/*
+ * Simulated XBee radios.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stream.h>
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/kernel/lock.h>
+#include <lwiot/stl/linkedlist.h>
+
+#include <lwiot/network/xbee/constants.h>
+#include <lwiot/network/xbee/xbeeframedecoder.h>
+
+namespace lwiot
+{
+	class XBeeSimulator;
+
+	/*
+	 * The air shared by a set of simulated radios. Frames arrive after the
+	 * configured latency. Every frame is lost with the configured probability,
+	 * in which case the sender of a unicast frame gets a network ACK failure.
+	 */
+	class XBeeMedium {
+	public:
+		explicit XBeeMedium(uint32_t seed = 1);
+		XBeeMedium(const XBeeMedium&) = delete;
+		virtual ~XBeeMedium() = default;
+
+		XBeeMedium& operator=(const XBeeMedium&) = delete;
+
+		void setLatency(time_t ms);
+		void setLoss(uint8_t percent);
+
+		size_t delivered() const;
+		size_t lost() const;
+
+	private:
+		friend class XBeeSimulator;
+
+		mutable Lock _lock;
+		stl::LinkedList<XBeeSimulator*> _nodes;
+		time_t _latency;
+		uint8_t _loss;
+		uint32_t _random;
+		size_t _delivered;
+		size_t _lost;
+
+		/* Methods */
+		void attach(XBeeSimulator *node);
+		void detach(XBeeSimulator *node);
+		XBeeSimulator *find(uint64_t address, uint16_t network) const;
+		bool drop();
+	};
+
+	/*
+	 * Serial port of a simulated XBee (ZigBee) radio in API mode. Requests
+	 * written to it are handled right away: AT commands are answered from a
+	 * small register file and transmit requests are routed over the medium
+	 * to the other radios. Responses and received frames are read back from
+	 * the port. Both API mode 1 and 2 (ATAP) are supported.
+	 */
+	class XBeeSimulator : public Stream {
+	public:
+		explicit XBeeSimulator(XBeeMedium& medium, uint64_t address, uint16_t network);
+		XBeeSimulator(const XBeeSimulator&) = delete;
+		~XBeeSimulator() override;
+
+		XBeeSimulator& operator=(const XBeeSimulator&) = delete;
+
+		Stream& operator << (char x) override;
+		Stream& operator << (short x) override;
+		Stream& operator << (int  x) override;
+		Stream& operator << (const long&  x) override;
+		Stream& operator << (const long long&  x) override;
+		Stream& operator << (unsigned char x) override;
+		Stream& operator << (unsigned short x) override;
+		Stream& operator << (unsigned int  x) override;
+		Stream& operator << (const unsigned long&  x) override;
+		Stream& operator << (const unsigned long long&  x) override;
+		Stream& operator << (const double& flt) override;
+		Stream& operator << (const float& flt) override;
+		Stream& operator << (const String& str) override;
+		Stream& operator << (const char *cstr) override;
+
+		size_t available() const override;
+		uint8_t read() override;
+		ssize_t read(void *output, const size_t& length) override;
+
+		bool write(uint8_t byte) override;
+		ssize_t write(const void *bytes, const size_t& length) override;
+
+		uint64_t address() const;
+		uint16_t network() const;
+		uint8_t mode() const;
+
+		static constexpr uint8_t MaxPayload = 84;
+		static constexpr size_t MaxValue = 20;
+		static constexpr size_t MaxRegisters = 24;
+
+	private:
+		struct Delivery {
+			time_t due;
+			ByteBuffer frame;
+		};
+
+		struct Register {
+			char command[2];
+			uint8_t length;
+			uint8_t value[MaxValue];
+			bool writable;
+			bool secret;
+		};
+
+		XBeeMedium& _medium;
+		uint64_t _address;
+		uint16_t _network;
+		XBeeFrameDecoder _decoder;
+
+		mutable ByteBuffer _output;
+		mutable size_t _read;
+		mutable stl::LinkedList<Delivery> _deliveries;
+
+		Register _registers[MaxRegisters];
+		size_t _num_registers;
+
+		/* Methods */
+		void define(const char *cmd, const void *value, uint8_t length, bool writable, bool secret = false);
+		Register *lookup(const uint8_t *cmd);
+
+		void handle(const XBeeFrame& frame);
+		void command(const XBeeFrame& frame);
+		void transmit(const XBeeFrame& frame);
+		void status(uint8_t id, uint16_t network, uint8_t delivery, time_t due);
+		void deliver(const uint8_t *data, size_t length, time_t due);
+		void encode(ByteBuffer& output, const uint8_t *data, size_t length) const;
+		void poll() const;
+	};
+}
@@ -37,6 +37,7 @@ namespace lwiot
 			// fails, the string will be marked as invalid (i.e. "if (s)" will
 			// be false).
 			String(const char *cstr = "");
+			explicit String(const char *cstr, size_t length);
 			explicit String(const lwiot::ByteBuffer& buf);
 			String(const String &str);
 
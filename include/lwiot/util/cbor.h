@@ -0,0 +1,137 @@
+/*
+ * CBOR (RFC 8949) encoding for JSON documents.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stream.h>
+#include <lwiot/bytebuffer.h>
+#include <lwiot/function.h>
+#include <lwiot/util/json.h>
+
+namespace lwiot
+{
+	/*
+	 * Encodes CBOR with the same builder methods as JsonWriter, so a
+	 * payload can be produced in either format by the same code. Existing
+	 * documents are encoded with json(). Integers and floats take the
+	 * smallest encoding that holds them exactly.
+	 *
+	 * The writer either fills a caller supplied buffer, and fails once it is
+	 * full, or hands its output to a sink through a small internal buffer.
+	 * Neither allocates. Arrays and objects opened without a size use the
+	 * indefinite length encoding.
+	 */
+	class CborWriter {
+	public:
+		/* Returns false when the data could not be accepted */
+		typedef Function<bool(const void *, size_t)> Sink;
+
+		explicit CborWriter(void *output, size_t size);
+		explicit CborWriter(Stream& output);
+		explicit CborWriter(ByteBuffer& output);
+		explicit CborWriter(const Sink& sink);
+		CborWriter(const CborWriter&) = delete;
+		virtual ~CborWriter();
+
+		CborWriter& operator=(const CborWriter&) = delete;
+
+		bool flush();
+		void reset();
+
+		CborWriter& beginObject();
+		CborWriter& beginObject(size_t pairs);
+		CborWriter& endObject();
+		CborWriter& beginArray();
+		CborWriter& beginArray(size_t elements);
+		CborWriter& endArray();
+		CborWriter& key(const char *name);
+
+		CborWriter& value(const char *text);
+		CborWriter& value(const char *text, size_t length);
+		CborWriter& value(bool boolean);
+		CborWriter& value(int number);
+		CborWriter& value(unsigned int number);
+		CborWriter& value(long number);
+		CborWriter& value(unsigned long number);
+		CborWriter& value(long long number);
+		CborWriter& value(unsigned long long number);
+		CborWriter& value(float number);
+		CborWriter& value(double number);
+		CborWriter& bytes(const void *data, size_t length);
+		CborWriter& null();
+
+		CborWriter& json(const ArduinoJson::JsonVariant& document);
+		CborWriter& json(const JsonObject& object);
+		CborWriter& json(const JsonArray& array);
+
+		/* Output of a writer that fills a buffer */
+		const uint8_t *data() const { return this->_buffer; }
+		/* Bytes accepted so far, including those still buffered */
+		size_t count() const { return this->_count; }
+		bool failed() const { return this->_failed; }
+
+		static constexpr size_t BufferSize = 128;
+		static constexpr size_t MaxDepth = 32;
+
+	private:
+		Sink _sink;
+		uint8_t _internal[BufferSize];
+		uint8_t *_buffer;
+		size_t _capacity;
+		size_t _length;
+		size_t _count;
+		bool _failed;
+
+		size_t _depth;
+		uint32_t _indefinite;
+
+		/* Methods */
+		void write(const void *data, size_t length);
+		void write(uint8_t byte);
+		void head(uint8_t major, uint64_t argument);
+		void push(uint8_t major, bool indefinite, size_t size);
+		void pop();
+	};
+
+	/*
+	 * Decodes CBOR into the JsonVariant model. Strings are copied into the
+	 * JsonBuffer, so the input may be discarded afterwards. Byte strings
+	 * become base64url text and tags are dropped, as RFC 8949 suggests for
+	 * conversion to JSON. Maps may only use text keys.
+	 */
+	class CborReader {
+	public:
+		explicit CborReader(const void *data, size_t length);
+		virtual ~CborReader() = default;
+
+		/* Decodes the next data item, returns false when it is malformed */
+		bool parse(ArduinoJson::JsonBuffer& buffer, ArduinoJson::JsonVariant& result);
+		JsonObject& parseObject(ArduinoJson::JsonBuffer& buffer);
+		JsonArray& parseArray(ArduinoJson::JsonBuffer& buffer);
+
+		size_t position() const { return this->_position; }
+		bool available() const { return this->_position < this->_length; }
+
+		static constexpr size_t MaxDepth = 16;
+
+	private:
+		const uint8_t *_data;
+		size_t _length;
+		size_t _position;
+
+		/* Methods */
+		bool item(ArduinoJson::JsonBuffer& buffer, ArduinoJson::JsonVariant& result, size_t depth);
+		bool argument(uint8_t info, uint64_t& value);
+		bool string(ArduinoJson::JsonBuffer& buffer, uint8_t major, uint8_t info, const char *& result);
+		bool isBreak();
+	};
+}
@@ -0,0 +1,166 @@
+/*
+ * Pull based streaming JSON reader.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stream.h>
+#include <lwiot/function.h>
+
+namespace lwiot
+{
+	/*
+	 * Reads a JSON document from a stream, one event at a time, without
+	 * building a tree. Memory use is fixed: the input is read in small
+	 * blocks and only the current key, scalar and path are kept.
+	 *
+	 * The location of every event is available as a JSON pointer (RFC 6901),
+	 * e.g. "/sensors/0/value". Filters restrict the events to the values at,
+	 * or below, the given pointers; a "*" segment matches any key or index.
+	 * Everything else is skipped while it is read, so long strings outside
+	 * of the filters don't count against the token limit.
+	 *
+	 * next() returns End as soon as the top level value is complete. Data
+	 * after it is kept for the next document, which is read after reset().
+	 */
+	class JsonReader {
+	public:
+		typedef enum {
+			BeginObject,
+			EndObject,
+			BeginArray,
+			EndArray,
+			String,
+			Integer,
+			Float,
+			Boolean,
+			Null,
+			End,
+			Error
+		} Event;
+
+		typedef enum {
+			NoError,
+			SyntaxError,
+			UnexpectedEnd,
+			NestingTooDeep,
+			TokenTooLong,
+			PathTooLong,
+			TooManyFilters
+		} ErrorCode;
+
+		typedef Function<void(Event, const JsonReader&)> Handler;
+
+		explicit JsonReader(Stream& input);
+		JsonReader(const JsonReader&) = delete;
+		virtual ~JsonReader() = default;
+
+		JsonReader& operator=(const JsonReader&) = delete;
+
+		bool addFilter(const char *pointer);
+		void clearFilters();
+		void reset();
+
+		Event next();
+		/* Calls the handler for every event, returns false on a parse error */
+		bool parse(const Handler& handler);
+
+		/* Values of the last event */
+		const char *string() const { return this->_token; }
+		size_t length() const { return this->_length; }
+		int64_t integer() const { return this->_integer; }
+		double number() const { return this->_number; }
+		bool boolean() const { return this->_integer != 0; }
+
+		/* Name of the last member read, the path tells where it is */
+		const char *key() const { return this->_key; }
+		const char *path() const { return this->_path; }
+		size_t depth() const { return this->_depth; }
+
+		ErrorCode error() const { return this->_error; }
+		size_t position() const { return this->_position; }
+
+		static constexpr size_t MaxDepth = 16;
+		static constexpr size_t MaxToken = 128;
+		static constexpr size_t MaxPath = 128;
+		static constexpr size_t MaxFilters = 4;
+		static constexpr size_t ReadSize = 64;
+
+	private:
+		typedef enum {
+			Value,
+			ValueOrEnd,
+			Key,
+			KeyOrEnd,
+			Colon,
+			CommaOrEnd,
+			Done
+		} State;
+
+		typedef enum {
+			Skip,
+			Descend,
+			Emit
+		} Match;
+
+		Stream& _input;
+		State _state;
+		ErrorCode _error;
+		size_t _position;
+
+		uint8_t _rx[ReadSize];
+		size_t _rx_pos;
+		size_t _rx_end;
+		bool _eof;
+
+		size_t _depth;
+		bool _objects[MaxDepth];
+		bool _visible[MaxDepth];
+		uint32_t _index[MaxDepth];
+		uint16_t _segments[MaxDepth];
+		char _path[MaxPath];
+		size_t _path_length;
+
+		char _token[MaxToken];
+		size_t _length;
+		char _key[MaxToken];
+		int64_t _integer;
+		double _number;
+
+		const char *_filters[MaxFilters];
+		size_t _num_filters;
+
+		/* Methods */
+		int peek();
+		int get();
+		int skipSpace();
+		bool fill();
+
+		Event fail(ErrorCode code);
+		bool value(int c, Event& event);
+		void completed();
+
+		bool push(bool object, bool visible);
+		bool close();
+		bool segment(const char *name, size_t length);
+		bool segment(uint32_t index);
+
+		bool readString(char *output, size_t *length);
+		bool readEscape(uint32_t& code);
+		bool readNumber(int c, Event& event);
+		bool readLiteral(const char *literal);
+		bool skipNumber(int c);
+		bool skipValue(int c);
+
+		Match match() const;
+		static Match compare(const char *filter, const char *path);
+	};
+}
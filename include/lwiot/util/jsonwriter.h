@@ -0,0 +1,111 @@
+/*
+ * Streaming JSON writer.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stream.h>
+#include <lwiot/bytebuffer.h>
+#include <lwiot/function.h>
+
+#include <ArduinoJson/Arduino/Printer.hpp>
+
+namespace lwiot
+{
+	/*
+	 * Serializes JSON straight into a sink, through a small fixed buffer,
+	 * instead of into a String first. Documents can be written with the
+	 * builder methods, which take care of the commas, or from a JsonObject,
+	 * JsonArray or JsonVariant using json(). Both can be mixed:
+	 *
+	 *   writer.beginObject();
+	 *   writer.key("sensors").json(array);
+	 *   writer.key("uptime").value(lwiot_tick_ms());
+	 *   writer.endObject();
+	 *   writer.flush();
+	 *
+	 * Once the sink refuses data the writer fails, and everything after
+	 * that is dropped.
+	 */
+	class JsonWriter : public json::Printer {
+	public:
+		/* Returns false when the data could not be accepted */
+		typedef Function<bool(const void *, size_t)> Sink;
+
+		explicit JsonWriter(Stream& output);
+		explicit JsonWriter(ByteBuffer& output);
+		explicit JsonWriter(const Sink& sink);
+		JsonWriter(const JsonWriter&) = delete;
+		~JsonWriter() override;
+
+		JsonWriter& operator=(const JsonWriter&) = delete;
+
+		size_t write(uint8_t c) override;
+		size_t write(const void *data, size_t length);
+		bool flush();
+		void reset();
+
+		JsonWriter& beginObject();
+		JsonWriter& endObject();
+		JsonWriter& beginArray();
+		JsonWriter& endArray();
+		JsonWriter& key(const char *name);
+
+		JsonWriter& value(const char *text);
+		JsonWriter& value(const char *text, size_t length);
+		JsonWriter& value(bool boolean);
+		JsonWriter& value(int number);
+		JsonWriter& value(unsigned int number);
+		JsonWriter& value(long number);
+		JsonWriter& value(unsigned long number);
+		JsonWriter& value(long long number);
+		JsonWriter& value(unsigned long long number);
+		/* Without decimals, the shortest text that reads back the same value */
+		JsonWriter& value(float number);
+		JsonWriter& value(double number);
+		JsonWriter& value(double number, uint8_t decimals);
+		JsonWriter& null();
+
+		/* Writes anything with a printTo(Print&) method, e.g. a JsonObject */
+		template <typename T>
+		JsonWriter& json(const T& document)
+		{
+			this->separate();
+			document.printTo(*this);
+			return *this;
+		}
+
+		/* Bytes accepted so far, including those still buffered */
+		size_t count() const { return this->_count; }
+		bool failed() const { return this->_failed; }
+
+		static constexpr size_t BufferSize = 128;
+		static constexpr size_t MaxDepth = 32;
+
+	private:
+		Sink _sink;
+		char _buffer[BufferSize];
+		size_t _length;
+		size_t _count;
+		bool _failed;
+
+		size_t _depth;
+		uint32_t _first;
+		bool _key;
+
+		/* Methods */
+		void separate();
+		void push(char c);
+		void pop(char c);
+		void string(const char *text, size_t length);
+		void literal(const char *text, size_t length);
+	};
+}
@@ -0,0 +1,49 @@
+/*
+ * Fast number to text conversions.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+
+namespace lwiot
+{
+	/*
+	 * Converts numbers to and from decimal text without going through the
+	 * printf and strtod families. Integers are written two digits at a
+	 * time. Floating point numbers are written in the shortest form that
+	 * reads back to the same value (Grisu2, which rarely needs one digit
+	 * more than strictly required), or with a fixed number of decimals.
+	 *
+	 * Parsing takes the exact path (Clinger) for numbers of up to 15
+	 * significant digits with a small exponent, which covers nearly all
+	 * sensor data. Anything else is left to strtod(), so results are always
+	 * correctly rounded.
+	 *
+	 * The output is always terminated; the return value excludes the
+	 * terminator.
+	 */
+	class NumberConverter {
+	public:
+		/* Enough for any integer and for the shortest form of any double */
+		static constexpr size_t MaxLength = 32;
+
+		static size_t formatInteger(int64_t value, char *output);
+		static size_t formatUnsigned(uint64_t value, char *output);
+		static size_t formatDouble(double value, char *output);
+		static size_t formatFloat(float value, char *output);
+		/* Like "%.*f", numbers too large for the fast path take snprintf() */
+		static size_t formatFixed(double value, uint8_t decimals, char *output, size_t size);
+
+		/* Returns false when no number was found, or an integer overflows */
+		static bool parseInteger(const char *text, int64_t& value, const char **end = nullptr);
+		static bool parseDouble(const char *text, double& value, const char **end = nullptr);
+	};
+}
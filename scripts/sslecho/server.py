@@ -13,18 +13,33 @@ def deal_with_client(connection):
 if __name__ == '__main__':
     print("Starting SSL server...")
     bindsocket = socket.socket()
+    bindsocket.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
     bindsocket.bind(('', 5300))
     bindsocket.listen(5)
 
+    # A single context keeps the session cache and ticket keys, so clients
+    # can resume their sessions.
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.load_cert_chain(certfile="cert.pem", keyfile="key.pem")
+
     while True:
         newsocket, fromaddr = bindsocket.accept()
-        connstream = ssl.wrap_socket(newsocket,
-                                     server_side=True,
-                                     certfile="cert.pem",
-                                     keyfile="key.pem")
-        print("Client connected!")
+
+        try:
+            connstream = context.wrap_socket(newsocket, server_side=True)
+        except (ssl.SSLError, OSError) as e:
+            print("Handshake failed: %s" % e)
+            newsocket.close()
+            continue
+
+        print("Client connected (session reused: %s)" % connstream.session_reused)
         try:
             deal_with_client(connstream)
+        except (ssl.SSLError, OSError):
+            pass
         finally:
-            connstream.shutdown(socket.SHUT_RDWR)
+            try:
+                connstream.shutdown(socket.SHUT_RDWR)
+            except OSError:
+                pass
             connstream.close()
@@ -43,6 +43,54 @@ namespace lwiot
 		fclose(this->_io);
 	}
 
+	File::operator bool() const
+	{
+		return this->_io != nullptr;
+	}
+
+	bool File::seek(size_t offset)
+	{
+		ScopedLock lock(this->_lock.get());
+
+		if(this->_io == nullptr || fseek(this->_io, offset, SEEK_SET) != 0)
+			return false;
+
+		auto size = this->length();
+		this->_available = size > offset ? size - offset : 0;
+
+		return true;
+	}
+
+	size_t File::tell() const
+	{
+		ScopedLock lock(this->_lock.get());
+		return ftell(this->_io);
+	}
+
+	size_t File::size() const
+	{
+		ScopedLock lock(this->_lock.get());
+		return this->length();
+	}
+
+	size_t File::length() const
+	{
+		auto pos = ftell(this->_io);
+		size_t size;
+
+		fseek(this->_io, 0L, SEEK_END);
+		size = ftell(this->_io);
+		fseek(this->_io, pos, SEEK_SET);
+
+		return size;
+	}
+
+	bool File::flush()
+	{
+		ScopedLock lock(this->_lock.get());
+		return fflush(this->_io) == 0;
+	}
+
 	void File::fileModeToString(lwiot::FileMode mode, char *m)
 	{
 		const char *tmp;
@@ -0,0 +1,839 @@
+/*
+ * CBOR (RFC 8949) encoding for JSON documents.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stream.h>
+#include <lwiot/bytebuffer.h>
+#include <lwiot/util/json.h>
+#include <lwiot/util/cbor.h>
+
+#define MAJOR_UNSIGNED 0
+#define MAJOR_NEGATIVE 1
+#define MAJOR_BYTES    2
+#define MAJOR_TEXT     3
+#define MAJOR_ARRAY    4
+#define MAJOR_MAP      5
+#define MAJOR_TAG      6
+#define MAJOR_SIMPLE   7
+
+#define INFO_INDEFINITE 31
+
+#define CBOR_FALSE 0xF4
+#define CBOR_TRUE  0xF5
+#define CBOR_NULL  0xF6
+#define CBOR_HALF  0xF9
+#define CBOR_FLOAT 0xFA
+#define CBOR_DOUBLE 0xFB
+#define CBOR_BREAK 0xFF
+
+namespace lwiot
+{
+	static inline uint64_t load(const uint8_t *bytes, size_t length)
+	{
+		uint64_t value = 0;
+
+		for(size_t idx = 0; idx < length; idx++)
+			value = value << 8 | bytes[idx];
+
+		return value;
+	}
+
+	static inline void store(uint8_t *bytes, uint64_t value, size_t length)
+	{
+		for(size_t idx = length; idx > 0; idx--) {
+			bytes[idx - 1] = static_cast<uint8_t>(value);
+			value >>= 8;
+		}
+	}
+
+	/* Six significant digits always survive a round trip through a float */
+	static inline bool fitsSingle(const char *text)
+	{
+		size_t digits = 0;
+		bool leading = true;
+
+		for(; *text && *text != 'e' && *text != 'E'; text++) {
+			if(*text < '0' || *text > '9')
+				continue;
+
+			if(leading && *text == '0')
+				continue;
+
+			leading = false;
+			digits++;
+		}
+
+		return digits <= 6;
+	}
+
+	CborWriter::CborWriter(void *output, size_t size) : _sink(), _buffer(static_cast<uint8_t *>(output)),
+		_capacity(size), _length(0), _count(0), _failed(false), _depth(0), _indefinite(0)
+	{
+	}
+
+	CborWriter::CborWriter(Stream& output) : CborWriter([&output](const void *data, size_t length) {
+		return output.write(data, length) == static_cast<ssize_t>(length);
+	})
+	{
+	}
+
+	CborWriter::CborWriter(ByteBuffer& output) : CborWriter([&output](const void *data, size_t length) {
+		output.write(data, length);
+		return true;
+	})
+	{
+	}
+
+	CborWriter::CborWriter(const Sink& sink) : _sink(sink), _buffer(_internal), _capacity(BufferSize),
+		_length(0), _count(0), _failed(false), _depth(0), _indefinite(0)
+	{
+	}
+
+	CborWriter::~CborWriter()
+	{
+		this->flush();
+	}
+
+	bool CborWriter::flush()
+	{
+		if(this->_failed)
+			return false;
+
+		if(!this->_sink.valid() || this->_length == 0)
+			return true;
+
+		if(!this->_sink(this->_buffer, this->_length))
+			this->_failed = true;
+
+		this->_length = 0;
+		return !this->_failed;
+	}
+
+	void CborWriter::reset()
+	{
+		this->_length = 0;
+		this->_count = 0;
+		this->_failed = false;
+		this->_depth = 0;
+		this->_indefinite = 0;
+	}
+
+	void CborWriter::write(const void *data, size_t length)
+	{
+		if(this->_failed)
+			return;
+
+		if(this->_length + length > this->_capacity) {
+			if(!this->_sink.valid() || !this->flush()) {
+				this->_failed = true;
+				return;
+			}
+
+			if(length >= this->_capacity) {
+				if(!this->_sink(data, length))
+					this->_failed = true;
+				else
+					this->_count += length;
+
+				return;
+			}
+		}
+
+		memcpy(this->_buffer + this->_length, data, length);
+		this->_length += length;
+		this->_count += length;
+	}
+
+	void CborWriter::write(uint8_t byte)
+	{
+		if(likely(this->_length < this->_capacity && !this->_failed)) {
+			this->_buffer[this->_length++] = byte;
+			this->_count++;
+			return;
+		}
+
+		this->write(&byte, 1);
+	}
+
+	void CborWriter::head(uint8_t major, uint64_t argument)
+	{
+		uint8_t header[9];
+		size_t size;
+
+		major = static_cast<uint8_t>(major << 5);
+
+		if(argument < 24) {
+			this->write(static_cast<uint8_t>(major | argument));
+			return;
+		} else if(argument <= UINT8_MAX) {
+			header[0] = major | 24;
+			size = 1;
+		} else if(argument <= UINT16_MAX) {
+			header[0] = major | 25;
+			size = 2;
+		} else if(argument <= UINT32_MAX) {
+			header[0] = major | 26;
+			size = 4;
+		} else {
+			header[0] = major | 27;
+			size = 8;
+		}
+
+		store(header + 1, argument, size);
+		this->write(header, size + 1);
+	}
+
+	void CborWriter::push(uint8_t major, bool indefinite, size_t size)
+	{
+		if(this->_depth == MaxDepth) {
+			this->_failed = true;
+			return;
+		}
+
+		if(indefinite)
+			this->write(static_cast<uint8_t>(major << 5 | INFO_INDEFINITE));
+		else
+			this->head(major, size);
+
+		if(indefinite)
+			this->_indefinite |= 1U << this->_depth;
+		else
+			this->_indefinite &= ~(1U << this->_depth);
+
+		this->_depth++;
+	}
+
+	void CborWriter::pop()
+	{
+		if(this->_depth == 0) {
+			this->_failed = true;
+			return;
+		}
+
+		this->_depth--;
+
+		if(this->_indefinite & (1U << this->_depth))
+			this->write(static_cast<uint8_t>(CBOR_BREAK));
+	}
+
+	CborWriter& CborWriter::beginObject()
+	{
+		this->push(MAJOR_MAP, true, 0);
+		return *this;
+	}
+
+	CborWriter& CborWriter::beginObject(size_t pairs)
+	{
+		this->push(MAJOR_MAP, false, pairs);
+		return *this;
+	}
+
+	CborWriter& CborWriter::endObject()
+	{
+		this->pop();
+		return *this;
+	}
+
+	CborWriter& CborWriter::beginArray()
+	{
+		this->push(MAJOR_ARRAY, true, 0);
+		return *this;
+	}
+
+	CborWriter& CborWriter::beginArray(size_t elements)
+	{
+		this->push(MAJOR_ARRAY, false, elements);
+		return *this;
+	}
+
+	CborWriter& CborWriter::endArray()
+	{
+		this->pop();
+		return *this;
+	}
+
+	CborWriter& CborWriter::key(const char *name)
+	{
+		return this->value(name);
+	}
+
+	CborWriter& CborWriter::value(const char *text)
+	{
+		if(text == nullptr)
+			return this->null();
+
+		return this->value(text, strlen(text));
+	}
+
+	CborWriter& CborWriter::value(const char *text, size_t length)
+	{
+		this->head(MAJOR_TEXT, length);
+		this->write(text, length);
+		return *this;
+	}
+
+	CborWriter& CborWriter::bytes(const void *data, size_t length)
+	{
+		this->head(MAJOR_BYTES, length);
+		this->write(data, length);
+		return *this;
+	}
+
+	CborWriter& CborWriter::value(bool boolean)
+	{
+		this->write(static_cast<uint8_t>(boolean ? CBOR_TRUE : CBOR_FALSE));
+		return *this;
+	}
+
+	CborWriter& CborWriter::value(int number)
+	{
+		return this->value(static_cast<long long>(number));
+	}
+
+	CborWriter& CborWriter::value(unsigned int number)
+	{
+		return this->value(static_cast<unsigned long long>(number));
+	}
+
+	CborWriter& CborWriter::value(long number)
+	{
+		return this->value(static_cast<long long>(number));
+	}
+
+	CborWriter& CborWriter::value(unsigned long number)
+	{
+		return this->value(static_cast<unsigned long long>(number));
+	}
+
+	CborWriter& CborWriter::value(long long number)
+	{
+		/* Negative integers are stored as -1 - n */
+		if(number < 0)
+			this->head(MAJOR_NEGATIVE, ~static_cast<uint64_t>(number));
+		else
+			this->head(MAJOR_UNSIGNED, static_cast<uint64_t>(number));
+
+		return *this;
+	}
+
+	CborWriter& CborWriter::value(unsigned long long number)
+	{
+		this->head(MAJOR_UNSIGNED, number);
+		return *this;
+	}
+
+	CborWriter& CborWriter::value(float number)
+	{
+		uint8_t encoded[5];
+		uint32_t bits;
+
+		memcpy(&bits, &number, sizeof(bits));
+
+		uint32_t sign = (bits >> 16) & 0x8000;
+		int exponent = static_cast<int>((bits >> 23) & 0xFF);
+		uint32_t mantissa = bits & 0x7FFFFF;
+		int half = -1;
+
+		/* Use a half precision float when nothing is lost, subnormals excepted */
+		if(exponent == 0xFF)
+			half = static_cast<int>(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+		else if(exponent == 0 && mantissa == 0)
+			half = static_cast<int>(sign);
+		else if(exponent - 112 >= 1 && exponent - 112 <= 30 && (mantissa & 0x1FFF) == 0)
+			half = static_cast<int>(sign | static_cast<uint32_t>(exponent - 112) << 10 | mantissa >> 13);
+
+		if(half >= 0) {
+			encoded[0] = CBOR_HALF;
+			store(encoded + 1, static_cast<uint64_t>(half), 2);
+			this->write(encoded, 3);
+		} else {
+			encoded[0] = CBOR_FLOAT;
+			store(encoded + 1, bits, 4);
+			this->write(encoded, 5);
+		}
+
+		return *this;
+	}
+
+	CborWriter& CborWriter::value(double number)
+	{
+		auto single = static_cast<float>(number);
+
+		if(static_cast<double>(single) == number || isnan(number))
+			return this->value(single);
+
+		uint8_t encoded[9];
+		uint64_t bits;
+
+		memcpy(&bits, &number, sizeof(bits));
+		encoded[0] = CBOR_DOUBLE;
+		store(encoded + 1, bits, 8);
+		this->write(encoded, 9);
+
+		return *this;
+	}
+
+	CborWriter& CborWriter::null()
+	{
+		this->write(static_cast<uint8_t>(CBOR_NULL));
+		return *this;
+	}
+
+	CborWriter& CborWriter::json(const JsonObject& object)
+	{
+		if(!object.success())
+			return this->null();
+
+		this->beginObject(object.size());
+
+		for(auto& pair : object) {
+			this->value(pair.key);
+			this->json(pair.value);
+		}
+
+		return this->endObject();
+	}
+
+	CborWriter& CborWriter::json(const JsonArray& array)
+	{
+		if(!array.success())
+			return this->null();
+
+		this->beginArray(array.size());
+
+		for(auto& element : array)
+			this->json(element);
+
+		return this->endArray();
+	}
+
+	CborWriter& CborWriter::json(const ArduinoJson::JsonVariant& document)
+	{
+		if(document.is<JsonObject&>())
+			return this->json(document.asObject());
+
+		if(document.is<JsonArray&>())
+			return this->json(document.asArray());
+
+		if(document.is<const char *>())
+			return this->value(document.as<const char *>());
+
+		if(document.is<bool>())
+			return this->value(document.as<bool>());
+
+		if(document.is<long>())
+			return this->value(document.as<long long>());
+
+		if(document.is<double>()) {
+			auto number = document.as<double>();
+			auto text = document.asString();
+
+			/* Text from the parser tells how precise the number really is */
+			if(text != nullptr && fitsSingle(text) && !isinf(static_cast<float>(number)) &&
+			   (number == 0.0 || fabs(number) >= 1.17549435e-38))
+				return this->value(static_cast<float>(number));
+
+			return this->value(number);
+		}
+
+		return this->null();
+	}
+
+	/*
+	 * Decoder.
+	 */
+
+	/* Fewest decimals that print the number back the way it was encoded */
+	static uint8_t decimals(double value, bool single)
+	{
+		uint8_t limit = single ? 7 : 15;
+		double scale = 1.0;
+
+		for(uint8_t digits = 0; digits < limit; digits++, scale *= 10.0) {
+			double rounded = round(value * scale) / scale;
+
+			if(single ? static_cast<float>(rounded) == static_cast<float>(value) : rounded == value)
+				return digits;
+		}
+
+		return limit;
+	}
+
+	static double half(uint16_t bits)
+	{
+		int exponent = (bits >> 10) & 0x1F;
+		double mantissa = bits & 0x3FF;
+		double value;
+
+		if(exponent == 0)
+			value = ldexp(mantissa, -24);
+		else if(exponent != 31)
+			value = ldexp(mantissa + 1024, exponent - 25);
+		else
+			value = mantissa == 0 ? INFINITY : NAN;
+
+		return bits & 0x8000 ? -value : value;
+	}
+
+	static void base64url(const uint8_t *input, size_t length, char *output)
+	{
+		static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+		size_t idx;
+
+		for(idx = 0; idx + 2 < length; idx += 3) {
+			uint32_t group = input[idx] << 16 | input[idx + 1] << 8 | input[idx + 2];
+
+			*output++ = alphabet[group >> 18];
+			*output++ = alphabet[(group >> 12) & 0x3F];
+			*output++ = alphabet[(group >> 6) & 0x3F];
+			*output++ = alphabet[group & 0x3F];
+		}
+
+		if(idx < length) {
+			uint32_t group = input[idx] << 16;
+
+			if(idx + 1 < length)
+				group |= input[idx + 1] << 8;
+
+			*output++ = alphabet[group >> 18];
+			*output++ = alphabet[(group >> 12) & 0x3F];
+
+			if(idx + 1 < length)
+				*output++ = alphabet[(group >> 6) & 0x3F];
+		}
+
+		*output = '\0';
+	}
+
+	CborReader::CborReader(const void *data, size_t length) : _data(static_cast<const uint8_t *>(data)),
+		_length(length), _position(0)
+	{
+	}
+
+	bool CborReader::parse(ArduinoJson::JsonBuffer& buffer, ArduinoJson::JsonVariant& result)
+	{
+		return this->item(buffer, result, 0);
+	}
+
+	JsonObject& CborReader::parseObject(ArduinoJson::JsonBuffer& buffer)
+	{
+		ArduinoJson::JsonVariant result;
+
+		if(!this->parse(buffer, result) || !result.is<JsonObject&>())
+			return JsonObject::invalid();
+
+		return result.as<JsonObject&>();
+	}
+
+	JsonArray& CborReader::parseArray(ArduinoJson::JsonBuffer& buffer)
+	{
+		ArduinoJson::JsonVariant result;
+
+		if(!this->parse(buffer, result) || !result.is<JsonArray&>())
+			return JsonArray::invalid();
+
+		return result.as<JsonArray&>();
+	}
+
+	bool CborReader::isBreak()
+	{
+		if(this->_position < this->_length && this->_data[this->_position] == CBOR_BREAK) {
+			this->_position++;
+			return true;
+		}
+
+		return false;
+	}
+
+	bool CborReader::argument(uint8_t info, uint64_t& value)
+	{
+		size_t size;
+
+		if(info < 24) {
+			value = info;
+			return true;
+		}
+
+		if(info > 27)
+			return false;
+
+		size = 1U << (info - 24);
+
+		if(this->_length - this->_position < size)
+			return false;
+
+		value = load(this->_data + this->_position, size);
+		this->_position += size;
+
+		return true;
+	}
+
+	bool CborReader::string(ArduinoJson::JsonBuffer& buffer, uint8_t major, uint8_t info, const char *& result)
+	{
+		size_t start = this->_position;
+		size_t total = 0;
+		uint64_t length;
+
+		/* Indefinite strings are chunks of definite ones, measure them first */
+		if(info == INFO_INDEFINITE) {
+			while(!this->isBreak()) {
+				if(this->_position >= this->_length)
+					return false;
+
+				uint8_t initial = this->_data[this->_position++];
+
+				if(initial >> 5 != major || !this->argument(initial & 0x1F, length))
+					return false;
+
+				if(length > this->_length - this->_position)
+					return false;
+
+				this->_position += length;
+				total += length;
+			}
+		} else {
+			if(!this->argument(info, length) || length > this->_length - this->_position)
+				return false;
+
+			total = length;
+			start = this->_position;
+		}
+
+		auto copy = static_cast<char *>(buffer.alloc(total + 1));
+
+		if(copy == nullptr)
+			return false;
+
+		if(info == INFO_INDEFINITE) {
+			size_t offset = 0;
+
+			this->_position = start;
+
+			while(!this->isBreak()) {
+				uint8_t initial = this->_data[this->_position++];
+
+				this->argument(initial & 0x1F, length);
+				memcpy(copy + offset, this->_data + this->_position, length);
+				this->_position += length;
+				offset += length;
+			}
+		} else {
+			memcpy(copy, this->_data + start, total);
+			this->_position += total;
+		}
+
+		copy[total] = '\0';
+
+		if(major == MAJOR_BYTES) {
+			auto text = static_cast<char *>(buffer.alloc((total * 4 + 2) / 3 + 1));
+
+			if(text == nullptr)
+				return false;
+
+			base64url(reinterpret_cast<const uint8_t *>(copy), total, text);
+			copy = text;
+		}
+
+		result = copy;
+		return true;
+	}
+
+	bool CborReader::item(ArduinoJson::JsonBuffer& buffer, ArduinoJson::JsonVariant& result, size_t depth)
+	{
+		uint64_t value;
+
+		if(depth > MaxDepth || this->_position >= this->_length)
+			return false;
+
+		uint8_t initial = this->_data[this->_position++];
+		uint8_t major = initial >> 5;
+		uint8_t info = initial & 0x1F;
+
+		/* Tags are dropped in a loop, a long chain of them can't exhaust the stack */
+		while(major == MAJOR_TAG) {
+			if(!this->argument(info, value) || this->_position >= this->_length)
+				return false;
+
+			initial = this->_data[this->_position++];
+			major = initial >> 5;
+			info = initial & 0x1F;
+		}
+
+		switch(major) {
+		case MAJOR_UNSIGNED:
+			if(!this->argument(info, value))
+				return false;
+
+			if(value > INT64_MAX)
+				result = static_cast<double>(value);
+			else
+				result = static_cast<long long>(value);
+
+			return true;
+
+		case MAJOR_NEGATIVE:
+			if(!this->argument(info, value))
+				return false;
+
+			if(value > INT64_MAX)
+				result = -1.0 - static_cast<double>(value);
+			else
+				result = -1 - static_cast<long long>(value);
+
+			return true;
+
+		case MAJOR_BYTES:
+		case MAJOR_TEXT: {
+			const char *text;
+
+			if(!this->string(buffer, major, info, text))
+				return false;
+
+			result = text;
+			return true;
+		}
+
+		case MAJOR_ARRAY: {
+			auto& array = buffer.createArray();
+			bool indefinite = info == INFO_INDEFINITE;
+
+			if(!array.success() || (!indefinite && !this->argument(info, value)))
+				return false;
+
+			for(uint64_t idx = 0; indefinite || idx < value; idx++) {
+				ArduinoJson::JsonVariant element;
+
+				if(indefinite && this->isBreak())
+					break;
+
+				if(!this->item(buffer, element, depth + 1) || !array.add(element))
+					return false;
+			}
+
+			result = array;
+			return true;
+		}
+
+		case MAJOR_MAP: {
+			auto& object = buffer.createObject();
+			bool indefinite = info == INFO_INDEFINITE;
+
+			if(!object.success() || (!indefinite && !this->argument(info, value)))
+				return false;
+
+			for(uint64_t idx = 0; indefinite || idx < value; idx++) {
+				ArduinoJson::JsonVariant key, element;
+
+				if(indefinite && this->isBreak())
+					break;
+
+				/* Only text keys, null would pass as a string */
+				if(this->_position >= this->_length || (this->_data[this->_position] >> 5) != MAJOR_TEXT)
+					return false;
+
+				if(!this->item(buffer, key, depth + 1) || key.as<const char *>() == nullptr)
+					return false;
+
+				if(!this->item(buffer, element, depth + 1) || !object.set(key.as<const char *>(), element))
+					return false;
+			}
+
+			result = object;
+			return true;
+		}
+
+		default:
+			break;
+		}
+
+		double number;
+
+		switch(info) {
+		case 20:
+			result = false;
+			return true;
+
+		case 21:
+			result = true;
+			return true;
+
+		case 25:
+			if(!this->argument(info, value))
+				return false;
+
+			number = half(static_cast<uint16_t>(value));
+			result = ArduinoJson::JsonVariant(number, decimals(number, true));
+			return true;
+
+		case 26: {
+			float single;
+			uint32_t bits;
+
+			if(!this->argument(info, value))
+				return false;
+
+			bits = static_cast<uint32_t>(value);
+			memcpy(&single, &bits, sizeof(single));
+			number = single;
+			result = ArduinoJson::JsonVariant(number, decimals(number, true));
+			return true;
+		}
+
+		case 27:
+			if(!this->argument(info, value))
+				return false;
+
+			memcpy(&number, &value, sizeof(number));
+			result = ArduinoJson::JsonVariant(number, decimals(number, false));
+			return true;
+
+		case 24:
+			/* Unassigned simple values have no JSON counterpart */
+			if(!this->argument(info, value))
+				return false;
+
+			/* fall through */
+		case 22:
+		case 23:
+			result = static_cast<const char *>(nullptr);
+			return true;
+
+		default:
+			/* Includes a break outside of an indefinite container */
+			if(info < 20)
+				break;
+
+			return false;
+		}
+
+		result = static_cast<const char *>(nullptr);
+		return true;
+	}
+}
+
+#undef MAJOR_UNSIGNED
+#undef MAJOR_NEGATIVE
+#undef MAJOR_BYTES
+#undef MAJOR_TEXT
+#undef MAJOR_ARRAY
+#undef MAJOR_MAP
+#undef MAJOR_TAG
+#undef MAJOR_SIMPLE
+#undef INFO_INDEFINITE
+#undef CBOR_FALSE
+#undef CBOR_TRUE
+#undef CBOR_NULL
+#undef CBOR_HALF
+#undef CBOR_FLOAT
+#undef CBOR_DOUBLE
+#undef CBOR_BREAK
@@ -138,7 +138,7 @@ static inline bool isInRange(char c, char min, char max) {
 
 static inline bool isLetterOrNumber(char c) {
   return isInRange(c, '0', '9') || isInRange(c, 'a', 'z') ||
-         isInRange(c, 'A', 'Z') || c == '-' || c == '.';
+         isInRange(c, 'A', 'Z') || c == '-' || c == '+' || c == '.';
 }
 
 static inline bool isQuote(char c) { return c == '\'' || c == '\"'; }
@@ -0,0 +1,949 @@
+/*
+ * Pull based streaming JSON reader.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stream.h>
+#include <lwiot/util/jsonreader.h>
+#include <lwiot/util/numberconverter.h>
+
+#define WILDCARD '*'
+
+static inline bool is_digit(int c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static inline int hex_value(int c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+
+	if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+
+	if(c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+namespace lwiot
+{
+	JsonReader::JsonReader(Stream& input) : _input(input), _rx_pos(0), _rx_end(0), _num_filters(0)
+	{
+		this->reset();
+	}
+
+	/* Starts on the next document, input that has been buffered already is kept */
+	void JsonReader::reset()
+	{
+		this->_state = Value;
+		this->_error = NoError;
+		this->_position = 0;
+		this->_eof = false;
+		this->_depth = 0;
+		this->_path[0] = '\0';
+		this->_path_length = 0;
+		this->_token[0] = '\0';
+		this->_length = 0;
+		this->_key[0] = '\0';
+		this->_integer = 0;
+		this->_number = 0;
+	}
+
+	/* The pointer is kept, not copied */
+	bool JsonReader::addFilter(const char *pointer)
+	{
+		if(this->_num_filters == MaxFilters) {
+			this->_error = TooManyFilters;
+			return false;
+		}
+
+		this->_filters[this->_num_filters++] = pointer;
+		return true;
+	}
+
+	void JsonReader::clearFilters()
+	{
+		this->_num_filters = 0;
+	}
+
+	/*
+	 * Input.
+	 */
+	bool JsonReader::fill()
+	{
+		if(this->_eof)
+			return false;
+
+		/* Block for a single byte when nothing is buffered, the stream timeout applies */
+		auto available = this->_input.available();
+		size_t length = available == 0 ? 1 : available > ReadSize ? ReadSize : available;
+		auto num = this->_input.read(this->_rx, length);
+
+		if(num <= 0) {
+			this->_eof = true;
+			return false;
+		}
+
+		this->_rx_pos = 0;
+		this->_rx_end = static_cast<size_t>(num);
+
+		return true;
+	}
+
+	inline int JsonReader::peek()
+	{
+		if(this->_rx_pos == this->_rx_end && !this->fill())
+			return -1;
+
+		return this->_rx[this->_rx_pos];
+	}
+
+	inline int JsonReader::get()
+	{
+		auto c = this->peek();
+
+		if(c >= 0) {
+			this->_rx_pos++;
+			this->_position++;
+		}
+
+		return c;
+	}
+
+	int JsonReader::skipSpace()
+	{
+		while(true) {
+			auto c = this->peek();
+
+			if(c != ' ' && c != '\t' && c != '\n' && c != '\r')
+				return c;
+
+			this->get();
+		}
+	}
+
+	/*
+	 * Parser.
+	 */
+	JsonReader::Event JsonReader::fail(ErrorCode code)
+	{
+		if(this->_error == NoError)
+			this->_error = code;
+
+		return Error;
+	}
+
+	JsonReader::Event JsonReader::next()
+	{
+		while(this->_error == NoError) {
+			if(this->_state == Done)
+				return End;
+
+			auto c = this->skipSpace();
+			size_t length;
+
+			if(c < 0)
+				return this->fail(UnexpectedEnd);
+
+			switch(this->_state) {
+			case KeyOrEnd:
+				if(c == '}') {
+					this->get();
+
+					if(this->close())
+						return EndObject;
+
+					break;
+				}
+
+				/* fall through */
+			case Key:
+				if(c != '"')
+					return this->fail(SyntaxError);
+
+				this->get();
+
+				if(!this->readString(this->_key, &length) || !this->segment(this->_key, length))
+					break;
+
+				this->_state = Colon;
+				break;
+
+			case Colon:
+				if(c != ':')
+					return this->fail(SyntaxError);
+
+				this->get();
+				this->_state = Value;
+				break;
+
+			case CommaOrEnd: {
+				auto object = this->_objects[this->_depth - 1];
+
+				this->get();
+
+				if(c == ',') {
+					if(object) {
+						this->_state = Key;
+					} else if(this->segment(++this->_index[this->_depth - 1])) {
+						this->_state = Value;
+					}
+
+					break;
+				}
+
+				if(c != (object ? '}' : ']'))
+					return this->fail(SyntaxError);
+
+				if(this->close())
+					return object ? EndObject : EndArray;
+
+				break;
+			}
+
+			case ValueOrEnd:
+				if(c == ']') {
+					this->get();
+
+					if(this->close())
+						return EndArray;
+
+					break;
+				}
+
+				if(!this->segment(0U))
+					break;
+
+				/* fall through */
+			case Value: {
+				Event event;
+
+				if(this->value(c, event))
+					return event;
+
+				break;
+			}
+
+			default:
+				break;
+			}
+		}
+
+		return Error;
+	}
+
+	bool JsonReader::parse(const Handler& handler)
+	{
+		while(true) {
+			auto event = this->next();
+
+			if(event == Error)
+				return false;
+
+			if(event == End)
+				return true;
+
+			handler(event, *this);
+		}
+	}
+
+	/* Reads the value starting with `c`. Returns true if it has to be reported */
+	bool JsonReader::value(int c, Event& event)
+	{
+		auto visible = this->_depth > 0 && this->_visible[this->_depth - 1] ? Emit : this->match();
+		auto container = c == '{' || c == '[';
+
+		event = Error;
+
+		/* Only containers can lead to a filtered value */
+		if(visible == Skip || (visible == Descend && !container)) {
+			if(this->skipValue(c))
+				this->completed();
+
+			return this->_error != NoError;
+		}
+
+		switch(c) {
+		case '{':
+		case '[':
+			this->get();
+
+			if(!this->push(c == '{', visible == Emit))
+				return true;
+
+			this->_state = c == '{' ? KeyOrEnd : ValueOrEnd;
+			event = c == '{' ? BeginObject : BeginArray;
+			return visible == Emit;
+
+		case '"':
+			this->get();
+
+			if(!this->readString(this->_token, &this->_length))
+				return true;
+
+			event = String;
+			break;
+
+		case 't':
+		case 'f':
+			if(!this->readLiteral(c == 't' ? "true" : "false"))
+				return true;
+
+			this->_integer = c == 't';
+			this->_number = this->_integer;
+			event = Boolean;
+			break;
+
+		case 'n':
+			if(!this->readLiteral("null"))
+				return true;
+
+			event = Null;
+			break;
+
+		default:
+			if(c != '-' && !is_digit(c)) {
+				this->fail(SyntaxError);
+				return true;
+			}
+
+			if(!this->readNumber(c, event))
+				return true;
+
+			break;
+		}
+
+		this->completed();
+		return true;
+	}
+
+	void JsonReader::completed()
+	{
+		this->_state = this->_depth == 0 ? Done : CommaOrEnd;
+	}
+
+	bool JsonReader::push(bool object, bool visible)
+	{
+		if(this->_depth == MaxDepth) {
+			this->fail(NestingTooDeep);
+			return false;
+		}
+
+		this->_objects[this->_depth] = object;
+		this->_visible[this->_depth] = visible;
+		this->_index[this->_depth] = 0;
+		this->_segments[this->_depth] = static_cast<uint16_t>(this->_path_length);
+		this->_depth++;
+
+		return true;
+	}
+
+	/* Pops a container, the path points to it again. Returns whether it was reported */
+	bool JsonReader::close()
+	{
+		this->_depth--;
+
+		auto visible = this->_visible[this->_depth];
+
+		this->_path_length = this->_segments[this->_depth];
+		this->_path[this->_path_length] = '\0';
+		this->completed();
+
+		return visible;
+	}
+
+	/* Replaces the last path segment by a member name */
+	bool JsonReader::segment(const char *name, size_t length)
+	{
+		size_t pos = this->_segments[this->_depth - 1];
+
+		if(pos + 2 > MaxPath) {
+			this->fail(PathTooLong);
+			return false;
+		}
+
+		this->_path[pos++] = '/';
+
+		for(size_t idx = 0; idx < length; idx++) {
+			auto c = name[idx];
+
+			if(pos + 3 > MaxPath) {
+				this->fail(PathTooLong);
+				return false;
+			}
+
+			if(c == '~' || c == '/') {
+				this->_path[pos++] = '~';
+				this->_path[pos++] = c == '~' ? '0' : '1';
+			} else {
+				this->_path[pos++] = c;
+			}
+		}
+
+		this->_path[pos] = '\0';
+		this->_path_length = pos;
+
+		return true;
+	}
+
+	/* Replaces the last path segment by an array index */
+	bool JsonReader::segment(uint32_t index)
+	{
+		char digits[10];
+		size_t num = 0;
+
+		do {
+			digits[num++] = static_cast<char>('0' + index % 10);
+			index /= 10;
+		} while(index > 0);
+
+		size_t pos = this->_segments[this->_depth - 1];
+
+		if(pos + num + 2 > MaxPath) {
+			this->fail(PathTooLong);
+			return false;
+		}
+
+		this->_path[pos++] = '/';
+
+		while(num > 0)
+			this->_path[pos++] = digits[--num];
+
+		this->_path[pos] = '\0';
+		this->_path_length = pos;
+
+		return true;
+	}
+
+	/*
+	 * Reads a string after its opening quote into `output`, UTF-8 encoded.
+	 * Without an output buffer the string is only skipped.
+	 */
+	bool JsonReader::readString(char *output, size_t *length)
+	{
+		size_t num = 0;
+
+		while(true) {
+			auto c = this->get();
+			uint32_t code;
+
+			if(c < 0) {
+				this->fail(UnexpectedEnd);
+				return false;
+			}
+
+			if(c == '"')
+				break;
+
+			if(c < 0x20) {
+				this->fail(SyntaxError);
+				return false;
+			}
+
+			if(c != '\\') {
+				if(output == nullptr)
+					continue;
+
+				if(num + 1 >= MaxToken) {
+					this->fail(TokenTooLong);
+					return false;
+				}
+
+				output[num++] = static_cast<char>(c);
+				continue;
+			}
+
+			c = this->get();
+
+			switch(c) {
+			case '"':
+			case '\\':
+			case '/':
+				code = static_cast<uint32_t>(c);
+				break;
+
+			case 'b':
+				code = '\b';
+				break;
+
+			case 'f':
+				code = '\f';
+				break;
+
+			case 'n':
+				code = '\n';
+				break;
+
+			case 'r':
+				code = '\r';
+				break;
+
+			case 't':
+				code = '\t';
+				break;
+
+			case 'u':
+				if(!this->readEscape(code))
+					return false;
+
+				break;
+
+			default:
+				this->fail(c < 0 ? UnexpectedEnd : SyntaxError);
+				return false;
+			}
+
+			if(output == nullptr)
+				continue;
+
+			if(num + 5 > MaxToken) {
+				this->fail(TokenTooLong);
+				return false;
+			}
+
+			if(code < 0x80) {
+				output[num++] = static_cast<char>(code);
+			} else if(code < 0x800) {
+				output[num++] = static_cast<char>(0xC0 | code >> 6);
+				output[num++] = static_cast<char>(0x80 | (code & 0x3F));
+			} else if(code < 0x10000) {
+				output[num++] = static_cast<char>(0xE0 | code >> 12);
+				output[num++] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+				output[num++] = static_cast<char>(0x80 | (code & 0x3F));
+			} else {
+				output[num++] = static_cast<char>(0xF0 | code >> 18);
+				output[num++] = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+				output[num++] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+				output[num++] = static_cast<char>(0x80 | (code & 0x3F));
+			}
+		}
+
+		if(output != nullptr) {
+			output[num] = '\0';
+			*length = num;
+		}
+
+		return true;
+	}
+
+	/* Reads the hex digits of a \u escape, and the low half of a surrogate pair */
+	bool JsonReader::readEscape(uint32_t& code)
+	{
+		code = 0;
+
+		for(int idx = 0; idx < 4; idx++) {
+			auto value = hex_value(this->get());
+
+			if(value < 0) {
+				this->fail(SyntaxError);
+				return false;
+			}
+
+			code = code << 4 | static_cast<uint32_t>(value);
+		}
+
+		if(code < 0xD800 || code > 0xDFFF)
+			return true;
+
+		uint32_t low = 0;
+
+		if(code > 0xDBFF || this->get() != '\\' || this->get() != 'u') {
+			this->fail(SyntaxError);
+			return false;
+		}
+
+		for(int idx = 0; idx < 4; idx++) {
+			auto value = hex_value(this->get());
+
+			if(value < 0) {
+				this->fail(SyntaxError);
+				return false;
+			}
+
+			low = low << 4 | static_cast<uint32_t>(value);
+		}
+
+		if(low < 0xDC00 || low > 0xDFFF) {
+			this->fail(SyntaxError);
+			return false;
+		}
+
+		code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+		return true;
+	}
+
+	bool JsonReader::readNumber(int c, Event& event)
+	{
+		size_t num = 0;
+		bool integral = true;
+
+		auto put = [this, &num]() {
+			if(num + 1 >= MaxToken) {
+				this->fail(TokenTooLong);
+				return false;
+			}
+
+			this->_token[num++] = static_cast<char>(this->get());
+			return true;
+		};
+
+		auto digits = [this, &put]() {
+			if(!is_digit(this->peek())) {
+				this->fail(SyntaxError);
+				return false;
+			}
+
+			while(is_digit(this->peek())) {
+				if(!put())
+					return false;
+			}
+
+			return true;
+		};
+
+		if(c == '-' && !put())
+			return false;
+
+		if(this->peek() == '0') {
+			if(!put())
+				return false;
+		} else if(!digits()) {
+			return false;
+		}
+
+		if(this->peek() == '.') {
+			integral = false;
+
+			if(!put() || !digits())
+				return false;
+		}
+
+		if(this->peek() == 'e' || this->peek() == 'E') {
+			integral = false;
+
+			if(!put())
+				return false;
+
+			if((this->peek() == '+' || this->peek() == '-') && !put())
+				return false;
+
+			if(!digits())
+				return false;
+		}
+
+		this->_token[num] = '\0';
+		this->_length = num;
+
+		if(integral) {
+			auto negative = this->_token[0] == '-';
+			uint64_t value = 0;
+			uint64_t limit = negative ? static_cast<uint64_t>(INT64_MAX) + 1 : INT64_MAX;
+
+			for(size_t idx = negative; idx < num && integral; idx++) {
+				uint64_t digit = static_cast<uint64_t>(this->_token[idx] - '0');
+
+				if(value > (limit - digit) / 10)
+					integral = false;
+
+				value = value * 10 + digit;
+			}
+
+			if(integral) {
+				this->_integer = negative ? static_cast<int64_t>(0 - value) : static_cast<int64_t>(value);
+				this->_number = static_cast<double>(this->_integer);
+				event = Integer;
+				return true;
+			}
+		}
+
+		/* Fractions, exponents and integers out of range */
+		NumberConverter::parseDouble(this->_token, this->_number);
+		this->_integer = this->_number >= -9.2e18 && this->_number <= 9.2e18 ? static_cast<int64_t>(this->_number) : 0;
+		event = Float;
+
+		return true;
+	}
+
+	bool JsonReader::readLiteral(const char *literal)
+	{
+		for(; *literal != '\0'; literal++) {
+			auto c = this->get();
+
+			if(c != *literal) {
+				this->fail(c < 0 ? UnexpectedEnd : SyntaxError);
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	/* Checks the grammar of a number without storing it */
+	bool JsonReader::skipNumber(int c)
+	{
+		auto digits = [this]() {
+			if(!is_digit(this->peek())) {
+				this->fail(SyntaxError);
+				return false;
+			}
+
+			while(is_digit(this->peek()))
+				this->get();
+
+			return true;
+		};
+
+		if(c == '-')
+			this->get();
+
+		if(this->peek() == '0')
+			this->get();
+		else if(!digits())
+			return false;
+
+		if(this->peek() == '.') {
+			this->get();
+
+			if(!digits())
+				return false;
+		}
+
+		if(this->peek() == 'e' || this->peek() == 'E') {
+			this->get();
+
+			if(this->peek() == '+' || this->peek() == '-')
+				this->get();
+
+			if(!digits())
+				return false;
+		}
+
+		return true;
+	}
+
+	/*
+	 * Skips a value without storing it. Skipped values go through the same
+	 * checks as reported ones, so filters don't change which documents are
+	 * accepted. Only the token length limits don't apply.
+	 */
+	bool JsonReader::skipValue(int c)
+	{
+		/* One bit per open container, set for objects, so brackets have to match */
+		static_assert(MaxDepth <= 32, "Container types don't fit the mask");
+		uint32_t objects = 0;
+		size_t nesting = 0;
+		State state = Value;
+
+		while(true) {
+			if(c < 0) {
+				this->fail(UnexpectedEnd);
+				return false;
+			}
+
+			switch(state) {
+			case KeyOrEnd:
+				if(c == '}') {
+					this->get();
+
+					if(--nesting == 0)
+						return true;
+
+					state = CommaOrEnd;
+					break;
+				}
+
+				/* fall through */
+			case Key:
+				if(c != '"') {
+					this->fail(SyntaxError);
+					return false;
+				}
+
+				this->get();
+
+				if(!this->readString(nullptr, nullptr))
+					return false;
+
+				state = Colon;
+				break;
+
+			case Colon:
+				if(c != ':') {
+					this->fail(SyntaxError);
+					return false;
+				}
+
+				this->get();
+				state = Value;
+				break;
+
+			case CommaOrEnd: {
+				auto object = ((objects >> (nesting - 1)) & 1U) != 0;
+
+				this->get();
+
+				if(c == ',') {
+					state = object ? Key : Value;
+					break;
+				}
+
+				if(c != (object ? '}' : ']')) {
+					this->fail(SyntaxError);
+					return false;
+				}
+
+				if(--nesting == 0)
+					return true;
+
+				break;
+			}
+
+			case ValueOrEnd:
+				if(c == ']') {
+					this->get();
+
+					if(--nesting == 0)
+						return true;
+
+					state = CommaOrEnd;
+					break;
+				}
+
+				/* fall through */
+			case Value:
+				switch(c) {
+				case '{':
+				case '[':
+					if(this->_depth + nesting == MaxDepth) {
+						this->fail(NestingTooDeep);
+						return false;
+					}
+
+					this->get();
+
+					if(c == '{')
+						objects |= 1U << nesting;
+					else
+						objects &= ~(1U << nesting);
+
+					nesting++;
+					state = c == '{' ? KeyOrEnd : ValueOrEnd;
+					c = this->skipSpace();
+					continue;
+
+				case '"':
+					this->get();
+
+					if(!this->readString(nullptr, nullptr))
+						return false;
+
+					break;
+
+				case 't':
+				case 'f':
+					if(!this->readLiteral(c == 't' ? "true" : "false"))
+						return false;
+
+					break;
+
+				case 'n':
+					if(!this->readLiteral("null"))
+						return false;
+
+					break;
+
+				default:
+					if(c != '-' && !is_digit(c)) {
+						this->fail(SyntaxError);
+						return false;
+					}
+
+					if(!this->skipNumber(c))
+						return false;
+
+					break;
+				}
+
+				if(nesting == 0)
+					return true;
+
+				state = CommaOrEnd;
+				break;
+
+			default:
+				break;
+			}
+
+			c = this->skipSpace();
+		}
+	}
+
+	/*
+	 * Filters.
+	 */
+	JsonReader::Match JsonReader::match() const
+	{
+		auto result = Skip;
+
+		if(this->_num_filters == 0)
+			return Emit;
+
+		for(size_t idx = 0; idx < this->_num_filters; idx++) {
+			auto match = compare(this->_filters[idx], this->_path);
+
+			if(match == Emit)
+				return Emit;
+
+			if(match == Descend)
+				result = Descend;
+		}
+
+		return result;
+	}
+
+	/* Compares two JSON pointers segment by segment, both escaped */
+	JsonReader::Match JsonReader::compare(const char *filter, const char *path)
+	{
+		while(true) {
+			if(*filter == '\0')
+				return Emit;
+
+			if(*path == '\0')
+				return Descend;
+
+			/* Both point to a '/' */
+			filter++;
+			path++;
+
+			if(filter[0] == WILDCARD && (filter[1] == '/' || filter[1] == '\0')) {
+				filter++;
+
+				while(*path != '/' && *path != '\0')
+					path++;
+
+				continue;
+			}
+
+			while(*filter != '/' && *filter != '\0') {
+				if(*filter++ != *path++)
+					return Skip;
+			}
+
+			if(*path != '/' && *path != '\0')
+				return Skip;
+		}
+	}
+}
+
+#undef WILDCARD
@@ -11,7 +11,9 @@
 #include <ArduinoJson/JsonObject.hpp>
 
 #include <errno.h>   // for errno
-#include <stdlib.h>  // for strtol, strtod
+#include <limits.h>  // for LONG_MIN, LONG_MAX
+
+#include <lwiot/util/numberconverter.h>
 
 using namespace ArduinoJson::Internals;
 
@@ -63,11 +65,13 @@ bool JsonVariant::is<signed long>() const {
 
   if (_type != JSON_UNPARSED || _content.asString == NULL) return false;
 
-  char *end;
-  errno = 0;
-  strtol(_content.asString, &end, 10);
+  const char *end;
+  int64_t value;
 
-  return *end == '\0' && errno == 0;
+  if (!lwiot::NumberConverter::parseInteger(_content.asString, value, &end))
+    return false;
+
+  return *end == '\0' && value >= LONG_MIN && value <= LONG_MAX;
 }
 
 template <>
@@ -76,9 +80,12 @@ bool JsonVariant::is<double>() const {
 
   if (_type != JSON_UNPARSED || _content.asString == NULL) return false;
 
-  char *end;
+  const char *end;
+  double value;
   errno = 0;
-  strtod(_content.asString, &end);
+
+  if (!lwiot::NumberConverter::parseDouble(_content.asString, value, &end))
+    return false;
 
   return *end == '\0' && errno == 0 && !is<long>();
 }
@@ -0,0 +1,343 @@
+/*
+ * Streaming JSON writer.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stream.h>
+#include <lwiot/bytebuffer.h>
+#include <lwiot/util/jsonwriter.h>
+#include <lwiot/util/numberconverter.h>
+
+namespace lwiot
+{
+	JsonWriter::JsonWriter(Stream& output) : JsonWriter([&output](const void *data, size_t length) {
+		return output.write(data, length) == static_cast<ssize_t>(length);
+	})
+	{
+	}
+
+	JsonWriter::JsonWriter(ByteBuffer& output) : JsonWriter([&output](const void *data, size_t length) {
+		output.write(data, length);
+		return true;
+	})
+	{
+	}
+
+	JsonWriter::JsonWriter(const Sink& sink) : _sink(sink), _length(0), _count(0), _failed(false),
+		_depth(0), _first(0), _key(false)
+	{
+	}
+
+	JsonWriter::~JsonWriter()
+	{
+		this->flush();
+	}
+
+	size_t JsonWriter::write(uint8_t c)
+	{
+		if(this->_failed || (this->_length == BufferSize && !this->flush()))
+			return 0;
+
+		this->_buffer[this->_length++] = static_cast<char>(c);
+		this->_count++;
+		return 1;
+	}
+
+	size_t JsonWriter::write(const void *data, size_t length)
+	{
+		auto bytes = static_cast<const char *>(data);
+		size_t num = length;
+
+		if(this->_failed)
+			return 0;
+
+		if(this->_length + length > BufferSize) {
+			if(!this->flush())
+				return 0;
+
+			/* Large blocks don't benefit from another copy */
+			if(length >= BufferSize) {
+				if(!this->_sink(bytes, length)) {
+					this->_failed = true;
+					return 0;
+				}
+
+				this->_count += length;
+				return length;
+			}
+		}
+
+		memcpy(this->_buffer + this->_length, bytes, num);
+		this->_length += num;
+		this->_count += num;
+
+		return length;
+	}
+
+	bool JsonWriter::flush()
+	{
+		if(this->_failed)
+			return false;
+
+		if(this->_length == 0)
+			return true;
+
+		if(!this->_sink(this->_buffer, this->_length))
+			this->_failed = true;
+
+		this->_length = 0;
+		return !this->_failed;
+	}
+
+	void JsonWriter::reset()
+	{
+		this->_length = 0;
+		this->_count = 0;
+		this->_failed = false;
+		this->_depth = 0;
+		this->_first = 0;
+		this->_key = false;
+	}
+
+	void JsonWriter::separate()
+	{
+		if(this->_key) {
+			this->_key = false;
+			return;
+		}
+
+		if(this->_depth == 0)
+			return;
+
+		uint32_t bit = 1U << (this->_depth - 1);
+
+		if(this->_first & bit)
+			this->_first &= ~bit;
+		else
+			this->write(',');
+	}
+
+	void JsonWriter::push(char c)
+	{
+		this->separate();
+		this->write(c);
+
+		if(this->_depth == MaxDepth) {
+			this->_failed = true;
+			return;
+		}
+
+		this->_depth++;
+		this->_first |= 1U << (this->_depth - 1);
+	}
+
+	void JsonWriter::pop(char c)
+	{
+		if(this->_depth == 0) {
+			this->_failed = true;
+			return;
+		}
+
+		this->_depth--;
+		this->write(c);
+	}
+
+	JsonWriter& JsonWriter::beginObject()
+	{
+		this->push('{');
+		return *this;
+	}
+
+	JsonWriter& JsonWriter::endObject()
+	{
+		this->pop('}');
+		return *this;
+	}
+
+	JsonWriter& JsonWriter::beginArray()
+	{
+		this->push('[');
+		return *this;
+	}
+
+	JsonWriter& JsonWriter::endArray()
+	{
+		this->pop(']');
+		return *this;
+	}
+
+	JsonWriter& JsonWriter::key(const char *name)
+	{
+		this->separate();
+		this->string(name, strlen(name));
+		this->write(':');
+		this->_key = true;
+
+		return *this;
+	}
+
+	void JsonWriter::string(const char *text, size_t length)
+	{
+		static const char hex[] = "0123456789abcdef";
+		size_t start = 0;
+
+		this->write('"');
+
+		for(size_t idx = 0; idx < length; idx++) {
+			auto c = static_cast<uint8_t>(text[idx]);
+			char escape;
+
+			if(c >= 0x20 && c != '"' && c != '\\')
+				continue;
+
+			/* Copy the plain run before the character in one go */
+			this->write(text + start, idx - start);
+			start = idx + 1;
+
+			switch(c) {
+			case '"':  escape = '"'; break;
+			case '\\': escape = '\\'; break;
+			case '\b': escape = 'b'; break;
+			case '\f': escape = 'f'; break;
+			case '\n': escape = 'n'; break;
+			case '\r': escape = 'r'; break;
+			case '\t': escape = 't'; break;
+			default:   escape = 0; break;
+			}
+
+			if(escape) {
+				char sequence[] = { '\\', escape };
+				this->write(sequence, sizeof(sequence));
+			} else {
+				char sequence[] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+				this->write(sequence, sizeof(sequence));
+			}
+		}
+
+		this->write(text + start, length - start);
+		this->write('"');
+	}
+
+	void JsonWriter::literal(const char *text, size_t length)
+	{
+		this->separate();
+		this->write(text, length);
+	}
+
+	JsonWriter& JsonWriter::value(const char *text)
+	{
+		if(text == nullptr)
+			return this->null();
+
+		return this->value(text, strlen(text));
+	}
+
+	JsonWriter& JsonWriter::value(const char *text, size_t length)
+	{
+		this->separate();
+		this->string(text, length);
+		return *this;
+	}
+
+	JsonWriter& JsonWriter::value(bool boolean)
+	{
+		this->separate();
+
+		if(boolean)
+			this->write("true", 4);
+		else
+			this->write("false", 5);
+
+		return *this;
+	}
+
+	JsonWriter& JsonWriter::value(int number)
+	{
+		return this->value(static_cast<long long>(number));
+	}
+
+	JsonWriter& JsonWriter::value(unsigned int number)
+	{
+		return this->value(static_cast<unsigned long long>(number));
+	}
+
+	JsonWriter& JsonWriter::value(long number)
+	{
+		return this->value(static_cast<long long>(number));
+	}
+
+	JsonWriter& JsonWriter::value(unsigned long number)
+	{
+		return this->value(static_cast<unsigned long long>(number));
+	}
+
+	JsonWriter& JsonWriter::value(long long number)
+	{
+		char text[NumberConverter::MaxLength];
+
+		this->literal(text, NumberConverter::formatInteger(number, text));
+		return *this;
+	}
+
+	JsonWriter& JsonWriter::value(unsigned long long number)
+	{
+		char text[NumberConverter::MaxLength];
+
+		this->literal(text, NumberConverter::formatUnsigned(number, text));
+		return *this;
+	}
+
+	/* JSON has no representation for NaN and infinity */
+	JsonWriter& JsonWriter::value(float number)
+	{
+		char text[NumberConverter::MaxLength];
+
+		if(isnan(number) || isinf(number))
+			return this->null();
+
+		this->literal(text, NumberConverter::formatFloat(number, text));
+		return *this;
+	}
+
+	JsonWriter& JsonWriter::value(double number)
+	{
+		char text[NumberConverter::MaxLength];
+
+		if(isnan(number) || isinf(number))
+			return this->null();
+
+		this->literal(text, NumberConverter::formatDouble(number, text));
+		return *this;
+	}
+
+	JsonWriter& JsonWriter::value(double number, uint8_t decimals)
+	{
+		char text[NumberConverter::MaxLength];
+
+		if(isnan(number) || isinf(number))
+			return this->null();
+
+		/* Large numbers would take hundreds of digits */
+		if(fabs(number) >= 1e15)
+			return this->value(number);
+
+		this->literal(text, NumberConverter::formatFixed(number, decimals, text, sizeof(text)));
+		return *this;
+	}
+
+	JsonWriter& JsonWriter::null()
+	{
+		this->separate();
+		this->write("null", 4);
+		return *this;
+	}
+}
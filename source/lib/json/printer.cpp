@@ -10,6 +10,7 @@
 #include <lwiot.h>
 #include <stdint.h>
 
+#include <lwiot/util/numberconverter.h>
 #include <ArduinoJson/Arduino/Printer.hpp>
 
 namespace lwiot { namespace json
@@ -30,13 +31,13 @@ namespace lwiot { namespace json
 
 	size_t Printer::print(ArduinoJson::Internals::JsonFloat value, int digits /* = 2 */)
 	{
-		char tmp[32];
+		char tmp[lwiot::NumberConverter::MaxLength];
 		bool isBigDouble = value > 4294967040.0 || value < -4294967040.0;
 
 		if (isBigDouble) {
-			ARDUINOJSON_SNPRINTF(tmp, sizeof(tmp), "%g", value);
+			lwiot::NumberConverter::formatDouble(value, tmp);
 		} else {
-			ARDUINOJSON_SNPRINTF(tmp, sizeof(tmp), "%.*f", digits, value);
+			lwiot::NumberConverter::formatFixed(value, static_cast<uint8_t>(digits), tmp, sizeof(tmp));
 		}
 
 		return print(tmp);
@@ -44,26 +45,10 @@ namespace lwiot { namespace json
 
 	size_t Printer::print(ArduinoJson::Internals::JsonInteger value)
 	{
-		char buffer[22];
-		size_t n = 0;
-		uint8_t i = 0;
-
-		if (value < 0) {
-			value = -value;
-			n += this->write('-');
-		}
-
-		do {
-			ArduinoJson::Internals::JsonInteger digit = value % 10;
-			value /= 10;
-			buffer[i++] = static_cast<char>(digit >= 0 ? '0' + digit : '0' - digit);
-		} while (value);
+		char buffer[lwiot::NumberConverter::MaxLength];
 
-		while (i > 0) {
-			n += this->write(buffer[--i]);
-		}
-
-		return n;
+		lwiot::NumberConverter::formatInteger(static_cast<int64_t>(value), buffer);
+		return print(buffer);
 	}
 
 	size_t Printer::println()
@@ -6,10 +6,13 @@ SET(JSON_SOURCES
 	lib/json/jsonobject.cpp
 	lib/json/jsonvariant.cpp
 
+	lib/json/cbor.cpp
 	lib/json/comments.cpp
 	lib/json/encoding.cpp
 	lib/json/indentedprint.cpp
 	lib/json/jsonparser.cpp
+	lib/json/jsonreader.cpp
+	lib/json/jsonwriter.cpp
 	lib/json/list.cpp
 	lib/json/prettyfier.cpp
 	lib/json/staticstringbuilder.cpp
@@ -107,16 +107,16 @@ namespace lwiot {
 
 	ssize_t BufferedStream::read(void *buffer, const size_t& length)
 	{
-		auto max = this->length();
+		auto max = this->available();
 		size_t to_read;
 
-		if(this->rd_idx + length > max) {
+		if(length > max) {
 			to_read = max;
 		} else {
 			to_read = length;
 		}
 
-		memcpy((void*)buffer, this->_data, to_read);
+		memcpy((void*)buffer, this->_data + this->rd_idx, to_read);
 		this->rd_idx += to_read;
 
 		return to_read;
@@ -289,12 +289,11 @@ namespace lwiot {
 	void BufferedStream::grow(int num)
 	{
 		uint8_t *buf;
-		auto newsize = num;
+		auto size = this->count();
 
 		Countable::grow(static_cast<size_t>(num));
-		newsize += this->count();
-		buf = (uint8_t*) lwiot_mem_zalloc(newsize);
-		memcpy(buf, this->_data, this->count());
+		buf = (uint8_t*) lwiot_mem_zalloc(this->count());
+		memcpy(buf, this->_data, size);
 		lwiot_mem_free(this->_data);
 		this->_data = buf;
 	}
@@ -15,6 +15,8 @@
 #include <lwiot/types.h>
 #include <lwiot/printer.h>
 
+#include <lwiot/util/numberconverter.h>
+
 extern "C" {
 #include <time.h>
 }
@@ -231,6 +233,11 @@ namespace lwiot
 			base = 10;
 		}
 
+		if(base == 10) {
+			NumberConverter::formatUnsigned(n, buf);
+			return write(buf);
+		}
+
 		do {
 			unsigned long m = n;
 			n /= base;
@@ -241,9 +248,13 @@ namespace lwiot
 		return write(str);
 	}
 
+	/*
+	 * Doubles have no more than 17 significant decimals. Beyond 1e15 not even
+	 * the first decimal is exact, so those are printed in their shortest form.
+	 */
 	size_t Printer::printFloat(double number, uint8_t digits)
 	{
-		size_t n = 0;
+		char buf[NumberConverter::MaxLength + 20];
 
 		if(isnan(number)) {
 			return print("nan");
@@ -251,40 +262,13 @@ namespace lwiot
 		if(isinf(number)) {
 			return print("inf");
 		}
-		if(number > 4294967040.0) {
-			return print("ovf");
-		}
-		if(number < -4294967040.0) {
-			return print("ovf");
-		}
-
-		if(number < 0.0) {
-			n += print('-');
-			number = -number;
-		}
 
-		double rounding = 0.5;
-		for(uint8_t i = 0; i < digits; ++i) {
-			rounding /= 10.0;
+		if(fabs(number) >= 1e15) {
+			NumberConverter::formatDouble(number, buf);
+			return write(buf);
 		}
 
-		number += rounding;
-
-		unsigned long int_part = (unsigned long) number;
-		double remainder = number - (double) int_part;
-		n += print(int_part);
-
-		if(digits > 0) {
-			n += print(".");
-		}
-
-		while(digits-- > 0) {
-			remainder *= 10.0;
-			int to_print = int(remainder);
-			n += print(to_print);
-			remainder -= to_print;
-		}
-
-		return n;
+		NumberConverter::formatFixed(number, digits > 17 ? 17 : digits, buf, sizeof(buf));
+		return write(buf);
 	}
 }
\ No newline at end of file
@@ -7,6 +7,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <lwiot.h>
 
 #include <lwiot/network/stdnet.h>
@@ -14,10 +15,57 @@
 #include <lwiot/network/xbee/xbee.h>
 #include <lwiot/network/xbee/asyncxbee.h>
 
+#define DEFAULT_INFLIGHT 4
+
+static bool correlated(uint8_t api)
+{
+	return api == ZB_TX_STATUS_RESPONSE || api == TX_STATUS_RESPONSE || api == AT_COMMAND_RESPONSE ||
+	       api == REMOTE_AT_COMMAND_RESPONSE;
+}
+
+static bool succeeded(lwiot::XBeeResponse& rx)
+{
+	switch(rx.getApiId()) {
+	case ZB_TX_STATUS_RESPONSE: {
+		lwiot::ZBTxStatusResponse status;
+
+		rx.getZBTxStatusResponse(status);
+		return status.isSuccess();
+	}
+
+	case TX_STATUS_RESPONSE: {
+		lwiot::TxStatusResponse status;
+
+		rx.getTxStatusResponse(status);
+		return status.isSuccess();
+	}
+
+	case AT_COMMAND_RESPONSE: {
+		lwiot::AtCommandResponse response;
+
+		rx.getAtCommandResponse(response);
+		return response.isOk();
+	}
+
+	case REMOTE_AT_COMMAND_RESPONSE: {
+		lwiot::RemoteAtCommandResponse response;
+
+		rx.getRemoteAtCommandResponse(response);
+		return response.isOk();
+	}
+
+	default:
+		return false;
+	}
+}
+
 namespace lwiot
 {
-	AsyncXbee::AsyncXbee() : Thread("axbee"), _lock(false), _running(false)
+	AsyncXbee::AsyncXbee() : Thread("axbee"), _lock(false), _running(false), _head(0), _count(0), _inflight(0),
+		_ids(), _max_inflight(DEFAULT_INFLIGHT), _tx_timeout(DefaultTxTimeout)
 	{
+		for(auto& slot : this->_pending)
+			slot.id = NO_RESPONSE_FRAME_ID;
 	}
 
 	AsyncXbee::AsyncXbee(lwiot::XBee &xb) : AsyncXbee()
@@ -51,8 +99,45 @@ namespace lwiot
 
 	AsyncXbee::~AsyncXbee()
 	{
-		ScopedLock lock(this->_lock);
+		this->end();
+	}
+
+	void AsyncXbee::end()
+	{
+		UniqueLock<Lock> lock(this->_lock);
+
 		this->_running = false;
+		lock.unlock();
+		this->_wakeup.signal();
+		this->stop();
+	}
+
+	void AsyncXbee::setMaxInFlight(size_t max)
+	{
+		UniqueLock<Lock> lock(this->_lock);
+
+		if(max == 0)
+			max = 1;
+
+		this->_max_inflight = max > MaxInFlight ? MaxInFlight : max;
+	}
+
+	void AsyncXbee::setTxTimeout(int tmo)
+	{
+		UniqueLock<Lock> lock(this->_lock);
+		this->_tx_timeout = tmo;
+	}
+
+	size_t AsyncXbee::inFlight() const
+	{
+		UniqueLock<Lock> lock(this->_lock);
+		return this->_inflight;
+	}
+
+	size_t AsyncXbee::queued() const
+	{
+		UniqueLock<Lock> lock(this->_lock);
+		return this->_count;
 	}
 
 	void AsyncXbee::setHandler(const ResponseHandler &handler)
@@ -61,23 +146,219 @@ namespace lwiot
 		this->_handler = handler;
 	}
 
+	/*
+	 * The lock is only held while the queues or the device are touched, so
+	 * requests can be queued while frames are being received and handled.
+	 */
 	void AsyncXbee::run()
 	{
-		while(true) {
-			Thread::sleep(100);
-			UniqueLock<Lock> lock(this->_lock);
+		UniqueLock<Lock> lock(this->_lock);
+
+		while(this->_running) {
+			this->flush();
+			auto received = this->poll(lock);
+			this->expire(lock);
+
+			/* Hand out every frame the decoder has queued before waiting again */
+			if(received)
+				continue;
+
+			/* The serial port can't signal the event, so the wait is bounded */
+			this->_wakeup.wait(lock, PollInterval);
+		}
+
+		this->cancel(lock);
+	}
+
+	uint8_t AsyncXbee::allocate() const
+	{
+		for(int attempt = 0; attempt < 0xFF; attempt++) {
+			auto id = this->_xb.getNextFrameId();
+			auto& word = this->_ids[id / 32];
+			uint32_t bit = 1U << (id % 32);
+
+			if(id == DEFAULT_FRAME_ID || (word & bit) != 0)
+				continue;
+
+			word |= bit;
+			return id;
+		}
+
+		return NO_RESPONSE_FRAME_ID;
+	}
+
+	void AsyncXbee::release(uint8_t id) const
+	{
+		this->_ids[id / 32] &= ~(1U << (id % 32));
+	}
+
+	bool AsyncXbee::enqueue(XBeeRequest &request, const CompletionHandler &handler) const
+	{
+		UniqueLock<Lock> lock(this->_lock);
+
+		if(!this->_running || this->_count == QueueSize)
+			return false;
+
+		auto& tx = this->_queue[(this->_head + this->_count) % QueueSize];
+
+		tx.id = this->allocate();
+		tx.handler = handler;
+		request.setFrameId(tx.id);
+		this->_xb.encode(request, tx.frame);
+		this->_count++;
+		lock.unlock();
+
+		this->_wakeup.signal();
+		return true;
+	}
+
+	bool AsyncXbee::command(const char *cmd, const uint8_t *value, size_t length, const CompletionHandler &handler) const
+	{
+		AtCommandRequest rq((uint8_t *) cmd);
 
-			if(!this->_running || !this->_handler)
+		if(length > 0) {
+			rq.setCommandValue((uint8_t *) value);
+			rq.setCommandValueLength(length);
+		}
+
+		return this->enqueue(rq, handler);
+	}
+
+	/* Writes queued frames for as long as there is room in the outstanding table */
+	void AsyncXbee::flush()
+	{
+		while(this->_count > 0 && this->_inflight < this->_max_inflight) {
+			const Transmission& tx = this->_queue[this->_head];
+			Outstanding *slot = nullptr;
+
+			for(auto& entry : this->_pending) {
+				if(entry.id == NO_RESPONSE_FRAME_ID) {
+					slot = &entry;
+					break;
+				}
+			}
+
+			if(slot == nullptr)
 				break;
 
-			if(this->_xb.readPacket(500)) {
-				XBeeResponse rx;
+			this->_xb._serial->write(tx.frame.data(), tx.frame.index());
+
+			slot->id = tx.id;
+			slot->deadline = lwiot_tick_ms() + this->_tx_timeout;
+			slot->handler = tx.handler;
+
+			this->_head = (this->_head + 1) % QueueSize;
+			this->_count--;
+			this->_inflight++;
+		}
+	}
+
+	/*
+	 * Reads a single frame and hands it to the completion handler of the
+	 * request it answers, or to the response handler. Returns true when a
+	 * frame was received.
+	 */
+	bool AsyncXbee::poll(UniqueLock<Lock> &lock)
+	{
+		uint8_t data[MAX_FRAME_DATA_SIZE];
+		XBeeResponse rx;
+
+		this->_xb.readPacket();
+		auto& response = this->_xb.getResponse();
+
+		if(!response.isAvailable())
+			return false;
+
+		/* The blocking methods may read into the device while the handlers run */
+		memcpy(data, response.getFrameData(), response.getFrameDataLength());
+		this->_xb.getResponse(rx);
+		rx.setFrameData(data);
+		rx.setAvailable(true);
+		this->_xb.resetResponse();
+
+		if(correlated(rx.getApiId()) && rx.getFrameDataLength() > 0 && data[0] != NO_RESPONSE_FRAME_ID) {
+			for(auto& slot : this->_pending) {
+				if(slot.id != data[0])
+					continue;
+
+				CompletionHandler handler(slot.handler);
+				auto success = succeeded(rx);
+
+				this->release(slot.id);
+				slot.id = NO_RESPONSE_FRAME_ID;
+				this->_inflight--;
+
+				lock.unlock();
+				handler(success, rx);
+				lock.lock();
 
-				this->_xb.getResponse(rx);
-				this->_handler(rx);
-				this->_xb.resetResponse();
+				return true;
 			}
 		}
+
+		if(!this->_handler)
+			return true;
+
+		ResponseHandler handler(this->_handler);
+
+		lock.unlock();
+		handler(rx);
+		lock.lock();
+
+		return true;
+	}
+
+	void AsyncXbee::expire(UniqueLock<Lock> &lock)
+	{
+		uint8_t data[1] = { NO_RESPONSE_FRAME_ID };
+		XBeeResponse none;
+		auto now = lwiot_tick_ms();
+
+		none.reset();
+		none.setFrameData(data);
+
+		for(auto& slot : this->_pending) {
+			if(slot.id == NO_RESPONSE_FRAME_ID || now < slot.deadline)
+				continue;
+
+			CompletionHandler handler(slot.handler);
+
+			this->release(slot.id);
+			slot.id = NO_RESPONSE_FRAME_ID;
+			this->_inflight--;
+
+			lock.unlock();
+			handler(false, none);
+			lock.lock();
+		}
+	}
+
+	/* Fails everything that is queued or in flight when the thread stops */
+	void AsyncXbee::cancel(UniqueLock<Lock> &lock)
+	{
+		uint8_t data[1] = { NO_RESPONSE_FRAME_ID };
+		XBeeResponse none;
+
+		none.reset();
+		none.setFrameData(data);
+
+		for(auto& slot : this->_pending)
+			slot.deadline = 0;
+
+		this->expire(lock);
+
+		while(this->_count > 0) {
+			auto& tx = this->_queue[this->_head];
+			CompletionHandler handler(tx.handler);
+
+			this->release(tx.id);
+			this->_head = (this->_head + 1) % QueueSize;
+			this->_count--;
+
+			lock.unlock();
+			handler(false, none);
+			lock.lock();
+		}
 	}
 
 	void AsyncXbee::setNetworkID(uint16_t netid) const
@@ -146,7 +427,6 @@ namespace lwiot
 
 	bool AsyncXbee::transmit(const lwiot::String &data, uint16_t addr) const
 	{
-		UniqueLock<Lock> lock(this->_lock);
 		ZBExplicitTxRequest transmit;
 
 		transmit.setAddress64(0xFFFFFFFFFFFFFFFF);
@@ -157,13 +437,11 @@ namespace lwiot
 		transmit.setFrameId(DEFAULT_FRAME_ID);
 		transmit.setClusterId(DEFAULT_CLUSTER_ID);
 
-		this->_xb.send(transmit);
-		return this->validateTxRequest();
+		return this->send(transmit);
 	}
 
 	bool AsyncXbee::transmit(const lwiot::String &data, uint64_t addr) const
 	{
-		UniqueLock<Lock> lock(this->_lock);
 		ZBExplicitTxRequest transmit;
 
 		transmit.setAddress64(addr);
@@ -174,24 +452,40 @@ namespace lwiot
 		transmit.setFrameId(DEFAULT_FRAME_ID);
 		transmit.setClusterId(DEFAULT_CLUSTER_ID);
 
-		this->_xb.send(transmit);
-		return this->validateTxRequest();
+		return this->send(transmit);
+	}
+
+	static void address(ZBTxRequest& tx, const ZigbeeAddress& addr)
+	{
+		if(addr.is64Bit()) {
+			tx.setAddress64(addr.getAddress64());
+			tx.setAddress16(0xFFFE);
+		} else {
+			tx.setAddress64(0xFFFFFFFFFFFFFFFF);
+			tx.setAddress16(addr.getAddress16());
+		}
 	}
 
 	bool AsyncXbee::transmit(lwiot::ZigbeeAddress addr, const lwiot::ByteBuffer &buffer) const
 	{
-		UniqueLock<Lock> lock(this->_lock);
+		ZBTxRequest tx;
+
+		address(tx, addr);
+		tx.setPayload(buffer.data(), buffer.index());
 
-		this->_xb.send(addr, buffer);
-		return this->validateTxRequest();
+		return this->send(tx);
 	}
 
 	bool AsyncXbee::transmit(lwiot::ZigbeeAddress addr, const lwiot::ByteBuffer &buffer, uint16_t profile, uint16_t cluster) const
 	{
-		UniqueLock<Lock> lock(this->_lock);
+		ZBExplicitTxRequest tx;
+
+		address(tx, addr);
+		tx.setPayload(buffer.data(), buffer.index());
+		tx.setClusterId(cluster);
+		tx.setProfileId(profile);
 
-		this->_xb.send(addr, buffer, profile, cluster);
-		return this->validateTxRequest();
+		return this->send(tx);
 	}
 
 	uint16_t AsyncXbee::getParentAddress() const
@@ -200,12 +494,44 @@ namespace lwiot
 		return this->_xb.getParentAddress();
 	}
 
+	/*
+	 * Blocks until the request completes. Before the thread has been started
+	 * the request is sent directly. Must not be called from a handler.
+	 */
 	bool AsyncXbee::send(lwiot::XBeeRequest &request) const
 	{
 		UniqueLock<Lock> lock(this->_lock);
+		Event completed;
+		bool done = false;
+		bool result = false;
+
+		if(!this->_running) {
+			this->_xb.send(request);
+			return this->validateTxRequest();
+		}
+
+		lock.unlock();
+
+		auto queued = this->enqueue(request, [this, &done, &result, &completed](bool success,
+		                                                                         XBeeResponse& response) {
+			UniqueLock<Lock> guard(this->_lock);
+
+			/* Signalled under the lock, the sender can't see done and destroy the event before that */
+			result = success;
+			done = true;
+			completed.signal();
+		});
+
+		if(!queued)
+			return false;
+
+		lock.lock();
+
+		/* A signal between checking done and waiting is lost, the timeout covers that */
+		while(!done)
+			completed.wait(lock, PollInterval);
 
-		this->_xb.send(request);
-		return this->validateTxRequest();
+		return result;
 	}
 
 	void AsyncXbee::setSleepMode(lwiot::XBee::SleepMode mode) const
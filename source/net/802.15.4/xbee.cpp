@@ -26,9 +26,6 @@ namespace lwiot
 {
 	XBee::XBee() : _response(XBeeResponse())
 	{
-		_pos = 0;
-		_escape = false;
-		_checksumTotal = 0;
 		_nextFrameId = 0;
 
 		_response.init();
@@ -82,14 +79,10 @@ namespace lwiot
 
 	void XBee::copy(const XBee& rhs)
 	{
-		this->_checksumTotal = rhs._checksumTotal;
-		this->_escape = rhs._escape;
 		this->_nextFrameId = rhs._nextFrameId;
-		this->_pos = rhs._pos;
-		this->_checksumTotal = rhs._checksumTotal;
 		this->_response = rhs._response;
-		this->_nextFrameId = rhs._nextFrameId;
 		this->_serial = rhs._serial;
+		this->_decoder.reset();
 
 		memcpy(this->_responseFrameData, rhs._responseFrameData, MAX_FRAME_DATA_SIZE);
 	}
@@ -102,9 +95,6 @@ namespace lwiot
 
 	void XBee::resetResponse()
 	{
-		this->_pos = 0;
-		this->_escape = false;
-		this->_checksumTotal = 0;
 		this->_response.reset();
 	}
 
@@ -176,6 +166,39 @@ namespace lwiot
 		sendByte(checksum, true);
 	}
 
+	/*
+	 * Encodes the request as a complete, escaped API frame, so it can be
+	 * written to the serial port in one go at a later time.
+	 */
+	void XBee::encode(XBeeRequest &request, ByteBuffer &output) const
+	{
+		uint16_t length = request.getFrameDataLength() + 2;
+		uint8_t checksum = request.getApiId() + request.getFrameId();
+
+		auto put = [&output](uint8_t byte) {
+			if(byte == START_BYTE || byte == ESCAPE || byte == XON || byte == XOFF) {
+				output.write(ESCAPE);
+				output.write(byte ^ 0x20);
+			} else {
+				output.write(byte);
+			}
+		};
+
+		output.setIndex(0);
+		output.write(START_BYTE);
+		put(length >> 8);
+		put(length & 0xff);
+		put(request.getApiId());
+		put(request.getFrameId());
+
+		for(int i = 0; i < request.getFrameDataLength(); i++) {
+			put(request.getFrameData(i));
+			checksum += request.getFrameData(i);
+		}
+
+		put(0xff - checksum);
+	}
+
 	void XBee::sendByte(uint8_t byte, bool escape) const
 	{
 		if(escape && (byte == START_BYTE || byte == ESCAPE || byte == XON || byte == XOFF)) {
@@ -208,16 +231,6 @@ namespace lwiot
 		this->_serial = serial;
 	}
 
-	bool XBee::available()
-	{
-		return _serial->available();
-	}
-
-	uint8_t XBee::read()
-	{
-		return _serial->read();
-	}
-
 	void XBee::write(uint8_t val) const
 	{
 		_serial->write(val);
@@ -246,89 +259,34 @@ namespace lwiot
 		}
 	}
 
+	/*
+	 * Frames are decoded from whatever the serial port has buffered and queued
+	 * by the decoder, every call hands out at most one of them.
+	 */
 	void XBee::readPacket()
 	{
 		if(_response.isAvailable() || _response.isError()) {
 			resetResponse();
 		}
 
-		while(available()) {
-			b = read();
-
-			if(_pos > 0 && b == START_BYTE && ATAP == 2) {
-				_response.setErrorCode(UNEXPECTED_START_BYTE);
-				return;
-			}
-
-			if(_pos > 0 && b == ESCAPE) {
-				if(available()) {
-					b = read();
-					b = 0x20 ^ b;
-				} else {
-					_escape = true;
-					continue;
-				}
-			}
-
-			if(this->_escape) {
-				b = 0x20 ^ b;
-				this->_escape = false;
-			}
-
-			if(_pos >= API_ID_INDEX) {
-				_checksumTotal += b;
-			}
-
-			switch(_pos) {
-			case 0:
-				if(b == START_BYTE) {
-					_pos++;
-				}
-
-				break;
-			case 1:
-				_response.setMsbLength(b);
-				_pos++;
-
-				break;
-			case 2:
-				_response.setLsbLength(b);
-				_pos++;
-
-				break;
-			case 3:
-				_response.setApiId(b);
-				_pos++;
-				break;
-
-			default:
-#if MAX_FRAME_DATA_SIZE < UINT8_MAX
-				if(_pos > MAX_FRAME_DATA_SIZE) {
-					_response.setErrorCode(PACKET_EXCEEDS_BYTE_ARRAY_LENGTH);
-					return;
-				}
-#endif
+		if(this->_decoder.frames() == 0)
+			this->_decoder.read(this->_serial.get());
 
-				if(_pos == (_response.getPacketLength() + 3)) {
-					if((_checksumTotal & 0xff) == 0xff) {
-						_response.setChecksum(b);
-						_response.setAvailable(true);
+		auto frame = this->_decoder.front();
 
-						_response.setErrorCode(NO_ERROR);
-					} else {
-						_response.setErrorCode(CHECKSUM_FAILURE);
-					}
+		if(frame == nullptr)
+			return;
 
-					_response.setFrameLength(_pos - 4);
-					_pos = 0;
+		_response.setMsbLength(frame->length >> 8);
+		_response.setLsbLength(frame->length & 0xFF);
+		_response.setApiId(frame->apiId());
+		_response.setFrameLength(frame->frameDataLength());
+		_response.setChecksum(frame->checksum);
+		memcpy(_response.getFrameData(), frame->frameData(), frame->frameDataLength());
 
-					return;
-				} else {
-					_response.getFrameData()[_pos - 4] = b;
-					_pos++;
-				}
-			}
-		}
+		_response.setAvailable(true);
+		_response.setErrorCode(NO_ERROR);
+		this->_decoder.pop();
 	}
 
 	void XBee::setZigbeePro(bool enabled)
@@ -432,6 +390,8 @@ namespace lwiot
 			rq.setCommandValueLength(length);
 		}
 
+		/* Don't mistake a frame that was read before for the reply */
+		this->resetResponse();
 		this->send(rq);
 		System::delay(tmo);
 
@@ -575,12 +535,19 @@ namespace lwiot
 		return this->_max_payload;
 	}
 
+	const XBeeFrameDecoder& XBee::getDecoder() const
+	{
+		return this->_decoder;
+	}
+
 	void XBee::fetchMaxPayloadSize()
 	{
 		uint8_t cmd[] = {'N', 'P'};
 
 		auto result = stl::move(this->sendCommand(cmd, 100));
-		this->_max_payload = result.at(0);
+
+		/* NP is a 16-bit big endian value */
+		this->_max_payload = result.index() > 1 ? result.at(1) : result.at(0);
 	}
 
 	void XBee::enableCoordinator(bool enable)
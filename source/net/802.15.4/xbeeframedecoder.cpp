@@ -0,0 +1,271 @@
+/*
+ * Block oriented XBee API frame decoder.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stream.h>
+
+#include <lwiot/network/xbee/constants.h>
+#include <lwiot/network/xbee/xbeeframedecoder.h>
+
+#define D 0 /* Frame data */
+#define E 1 /* Escape */
+#define S 2 /* Start delimiter */
+
+#define ESCAPE_MASK 0x20
+
+static const uint8_t classes[256] = {
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, E, S, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+};
+
+/* API mode 1 has no escapes */
+static const uint8_t unescaped[256] = {
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, S, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+	D, D, D, D, D, D, D, D, D, D, D, D, D, D, D, D,
+};
+
+namespace lwiot
+{
+	XBeeFrameDecoder::XBeeFrameDecoder(bool escaped) : _classes(escaped ? classes : unescaped), _escaped(escaped),
+		_state(Hunt), _escape(false), _length(0), _pos(0), _checksum(0), _dropping(false), _head(0), _count(0),
+		_errors(0), _dropped(0), _rx_pos(0), _rx_end(0)
+	{
+	}
+
+	void XBeeFrameDecoder::setEscaped(bool escaped)
+	{
+		this->_classes = escaped ? classes : unescaped;
+		this->_escaped = escaped;
+		this->_state = Hunt;
+	}
+
+	void XBeeFrameDecoder::reset()
+	{
+		this->_state = Hunt;
+		this->_escape = false;
+		this->_head = 0;
+		this->_count = 0;
+		this->_rx_pos = 0;
+		this->_rx_end = 0;
+	}
+
+	const XBeeFrame *XBeeFrameDecoder::front() const
+	{
+		if(this->_count == 0)
+			return nullptr;
+
+		return &this->_pool[this->_head];
+	}
+
+	void XBeeFrameDecoder::pop()
+	{
+		if(this->_count == 0)
+			return;
+
+		this->_head = (this->_head + 1) % PoolSize;
+		this->_count--;
+	}
+
+	XBeeFrame& XBeeFrameDecoder::current()
+	{
+		if(this->_dropping)
+			return this->_overflow;
+
+		return this->_pool[(this->_head + this->_count) % PoolSize];
+	}
+
+	void XBeeFrameDecoder::start()
+	{
+		this->_state = LengthMsb;
+		this->_escape = false;
+		this->_pos = 0;
+		this->_checksum = 0;
+		this->_dropping = this->full();
+	}
+
+	void XBeeFrameDecoder::commit(uint8_t checksum)
+	{
+		this->_state = Hunt;
+
+		if(static_cast<uint8_t>(this->_checksum + checksum) != 0xFF) {
+			this->_errors++;
+			return;
+		}
+
+		if(this->_dropping) {
+			this->_dropped++;
+			return;
+		}
+
+		auto& frame = this->current();
+
+		frame.length = this->_length;
+		frame.checksum = checksum;
+		this->_count++;
+	}
+
+	size_t XBeeFrameDecoder::feed(const uint8_t *data, size_t length)
+	{
+		auto table = this->_classes;
+		size_t idx = 0;
+
+		while(idx < length) {
+			uint8_t byte = data[idx++];
+			auto type = table[byte];
+
+			/*
+			 * A start delimiter always starts a new frame, also in the middle of
+			 * another. Without escapes it can only be told apart from data by
+			 * looking for it between frames.
+			 */
+			if(type == S && (this->_escaped || this->_state == Hunt)) {
+				if(this->_state != Hunt)
+					this->_errors++;
+
+				this->start();
+				continue;
+			}
+
+			if(this->_state == Hunt) {
+				auto next = memchr(data + idx, START_BYTE, length - idx);
+
+				idx = next == nullptr ? length : static_cast<const uint8_t*>(next) - data;
+				continue;
+			}
+
+			if(type == E) {
+				this->_escape = true;
+				continue;
+			}
+
+			if(this->_escape) {
+				byte ^= ESCAPE_MASK;
+				this->_escape = false;
+			}
+
+			switch(this->_state) {
+			case LengthMsb:
+				this->_length = static_cast<uint16_t>(byte << 8);
+				this->_state = LengthLsb;
+				break;
+
+			case LengthLsb:
+				this->_length |= byte;
+
+				if(this->_length == 0 || this->_length > MAX_FRAME_DATA_SIZE + 1) {
+					this->_errors++;
+					this->_state = Hunt;
+				} else {
+					this->_state = Body;
+				}
+
+				break;
+
+			case Body: {
+				if(this->_pos == this->_length) {
+					this->commit(byte);
+
+					/* Leave the rest to the caller rather than dropping it */
+					if(this->full())
+						return idx;
+
+					break;
+				}
+
+				auto frame = this->current().data;
+				auto pos = this->_pos;
+				uint8_t sum = this->_checksum + byte;
+
+				frame[pos++] = byte;
+
+				/* Copy the run of unescaped data in one go */
+				while(idx < length && pos < this->_length && table[data[idx]] == D) {
+					byte = data[idx++];
+					frame[pos++] = byte;
+					sum += byte;
+				}
+
+				this->_pos = pos;
+				this->_checksum = sum;
+				break;
+			}
+
+			default:
+				break;
+			}
+		}
+
+		return length;
+	}
+
+	size_t XBeeFrameDecoder::read(Stream& serial)
+	{
+		size_t total = 0;
+
+		/*
+		 * Bytes left in the serial buffer while the pool is full are read on the
+		 * next call. So are bytes read beyond the frame that filled up the pool.
+		 */
+		while(!this->full()) {
+			if(this->_rx_pos == this->_rx_end) {
+				auto available = serial.available();
+
+				if(available == 0)
+					break;
+
+				auto num = serial.read(this->_rx, available > ReadSize ? ReadSize : available);
+
+				if(num <= 0)
+					break;
+
+				this->_rx_pos = 0;
+				this->_rx_end = static_cast<size_t>(num);
+				total += static_cast<size_t>(num);
+			}
+
+			this->_rx_pos += this->feed(this->_rx + this->_rx_pos, this->_rx_end - this->_rx_pos);
+		}
+
+		return total;
+	}
+}
+
+#undef D
+#undef E
+#undef S
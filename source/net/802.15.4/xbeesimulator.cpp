@@ -0,0 +1,593 @@
+/*
+ * Simulated XBee radios.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stream.h>
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/kernel/uniquelock.h>
+#include <lwiot/stl/move.h>
+
+#include <lwiot/network/xbee/constants.h>
+#include <lwiot/network/xbee/xbeeframedecoder.h>
+#include <lwiot/network/xbee/xbeesimulator.h>
+
+#define BROADCAST_ADDRESS64 0x000000000000FFFFULL
+#define UNKNOWN_ADDRESS64   0xFFFFFFFFFFFFFFFFULL
+
+#define AT_OK                0
+#define AT_ERROR             1
+#define AT_INVALID_COMMAND   2
+#define AT_INVALID_PARAMETER 3
+
+#define PAYLOAD_TOO_LARGE 0x74
+
+#define TX_HEADER          13
+#define EXPLICIT_TX_HEADER 19
+#define COMPACT_SIZE       4096
+
+static uint64_t read64(const uint8_t *data)
+{
+	uint64_t value = 0;
+
+	for(int idx = 0; idx < 8; idx++)
+		value = (value << 8) | data[idx];
+
+	return value;
+}
+
+static void write64(uint8_t *data, uint64_t value)
+{
+	for(int idx = 7; idx >= 0; idx--) {
+		data[idx] = static_cast<uint8_t>(value);
+		value >>= 8;
+	}
+}
+
+namespace lwiot
+{
+	XBeeMedium::XBeeMedium(uint32_t seed) : _lock(false), _latency(0), _loss(0), _random(seed == 0 ? 1 : seed),
+		_delivered(0), _lost(0)
+	{
+	}
+
+	void XBeeMedium::setLatency(time_t ms)
+	{
+		UniqueLock<Lock> lock(this->_lock);
+		this->_latency = ms;
+	}
+
+	void XBeeMedium::setLoss(uint8_t percent)
+	{
+		UniqueLock<Lock> lock(this->_lock);
+		this->_loss = percent > 100 ? 100 : percent;
+	}
+
+	size_t XBeeMedium::delivered() const
+	{
+		UniqueLock<Lock> lock(this->_lock);
+		return this->_delivered;
+	}
+
+	size_t XBeeMedium::lost() const
+	{
+		UniqueLock<Lock> lock(this->_lock);
+		return this->_lost;
+	}
+
+	void XBeeMedium::attach(XBeeSimulator *node)
+	{
+		this->_nodes.push_back(node);
+	}
+
+	void XBeeMedium::detach(XBeeSimulator *node)
+	{
+		for(auto iter = this->_nodes.begin(); iter != this->_nodes.end(); ++iter) {
+			if(*iter == node) {
+				this->_nodes.erase(iter);
+				return;
+			}
+		}
+	}
+
+	/* An unknown 64-bit address routes on the 16-bit address, like the radios do */
+	XBeeSimulator *XBeeMedium::find(uint64_t address, uint16_t network) const
+	{
+		for(auto node : this->_nodes) {
+			if(address == UNKNOWN_ADDRESS64 ? node->network() == network : node->address() == address)
+				return node;
+
+			/* The coordinator is always reachable on address 0 */
+			if(address == 0ULL && node->network() == 0)
+				return node;
+		}
+
+		return nullptr;
+	}
+
+	bool XBeeMedium::drop()
+	{
+		if(this->_loss == 0)
+			return false;
+
+		/* Xorshift, so a seed replays the same losses */
+		this->_random ^= this->_random << 13;
+		this->_random ^= this->_random >> 17;
+		this->_random ^= this->_random << 5;
+
+		if(this->_random % 100 >= this->_loss)
+			return false;
+
+		this->_lost++;
+		return true;
+	}
+
+	XBeeSimulator::XBeeSimulator(XBeeMedium& medium, uint64_t address, uint16_t network) : Stream(),
+		_medium(medium), _address(address), _network(network), _read(0), _num_registers(0)
+	{
+		const uint8_t zero[8] = { 0 };
+		const uint8_t my[] = { static_cast<uint8_t>(network >> 8), static_cast<uint8_t>(network) };
+		const uint8_t parent[] = { 0xFF, 0xFE };
+		const uint8_t np[] = { 0x00, MaxPayload };
+		const uint8_t vr[] = { 0x40, 0x5F };
+		const uint8_t sc[] = { 0x7F, 0xFF };
+		const uint8_t ch = 0x0C;
+		const uint8_t nh = 0x1E;
+		const uint8_t ap = ATAP;
+		uint8_t sh[4], sl[4];
+
+		for(int idx = 0; idx < 4; idx++) {
+			sh[idx] = static_cast<uint8_t>(address >> (56 - idx * 8));
+			sl[idx] = static_cast<uint8_t>(address >> (24 - idx * 8));
+		}
+
+		this->define("SH", sh, sizeof(sh), false);
+		this->define("SL", sl, sizeof(sl), false);
+		this->define("MY", my, sizeof(my), false);
+		this->define("MP", parent, sizeof(parent), false);
+		this->define("NP", np, sizeof(np), false);
+		this->define("AI", zero, 1, false);
+		this->define("VR", vr, sizeof(vr), false);
+		this->define("CH", &ch, sizeof(ch), false);
+		this->define("ID", zero, 8, true);
+		this->define("SC", sc, sizeof(sc), true);
+		this->define("ZS", zero, 1, true);
+		this->define("EE", zero, 1, true);
+		this->define("EO", zero, 1, true);
+		this->define("NK", zero, 0, true, true);
+		this->define("KY", zero, 0, true, true);
+		this->define("NI", " ", 1, true);
+		this->define("NH", &nh, sizeof(nh), true);
+		this->define("CE", zero, 1, true);
+		this->define("SM", zero, 1, true);
+		this->define("AP", &ap, sizeof(ap), true);
+		this->define("WR", nullptr, 0, false);
+		this->define("AC", nullptr, 0, false);
+
+		UniqueLock<Lock> lock(medium._lock);
+		medium.attach(this);
+	}
+
+	XBeeSimulator::~XBeeSimulator()
+	{
+		UniqueLock<Lock> lock(this->_medium._lock);
+		this->_medium.detach(this);
+	}
+
+	uint64_t XBeeSimulator::address() const
+	{
+		return this->_address;
+	}
+
+	uint16_t XBeeSimulator::network() const
+	{
+		return this->_network;
+	}
+
+	uint8_t XBeeSimulator::mode() const
+	{
+		UniqueLock<Lock> lock(this->_medium._lock);
+		return this->_decoder.escaped() ? 2 : 1;
+	}
+
+	void XBeeSimulator::define(const char *cmd, const void *value, uint8_t length, bool writable, bool secret)
+	{
+		auto& reg = this->_registers[this->_num_registers++];
+
+		reg.command[0] = cmd[0];
+		reg.command[1] = cmd[1];
+		reg.length = length;
+		reg.writable = writable;
+		reg.secret = secret;
+
+		if(length > 0)
+			memcpy(reg.value, value, length);
+	}
+
+	XBeeSimulator::Register *XBeeSimulator::lookup(const uint8_t *cmd)
+	{
+		for(size_t idx = 0; idx < this->_num_registers; idx++) {
+			auto& reg = this->_registers[idx];
+
+			if(reg.command[0] == cmd[0] && reg.command[1] == cmd[1])
+				return &reg;
+		}
+
+		return nullptr;
+	}
+
+	/*
+	 * Stream interface. Everything written is handed to the frame decoder,
+	 * complete frames are handled before write() returns.
+	 */
+
+	size_t XBeeSimulator::available() const
+	{
+		UniqueLock<Lock> lock(this->_medium._lock);
+
+		this->poll();
+		return this->_output.index() - this->_read;
+	}
+
+	uint8_t XBeeSimulator::read()
+	{
+		uint8_t byte = 0;
+
+		this->read(&byte, sizeof(byte));
+		return byte;
+	}
+
+	ssize_t XBeeSimulator::read(void *output, const size_t& length)
+	{
+		UniqueLock<Lock> lock(this->_medium._lock);
+
+		this->poll();
+
+		auto available = this->_output.index() - this->_read;
+		auto num = length > available ? available : length;
+
+		memcpy(output, this->_output.data() + this->_read, num);
+		this->_read += num;
+
+		if(this->_read == this->_output.index()) {
+			this->_output.setIndex(0);
+			this->_read = 0;
+		} else if(this->_read >= COMPACT_SIZE) {
+			available = this->_output.index() - this->_read;
+
+			memmove(this->_output.data(), this->_output.data() + this->_read, available);
+			this->_output.setIndex(available);
+			this->_read = 0;
+		}
+
+		return num;
+	}
+
+	bool XBeeSimulator::write(uint8_t byte)
+	{
+		return this->write(&byte, sizeof(byte)) == sizeof(byte);
+	}
+
+	ssize_t XBeeSimulator::write(const void *bytes, const size_t& length)
+	{
+		UniqueLock<Lock> lock(this->_medium._lock);
+		auto data = static_cast<const uint8_t*>(bytes);
+		size_t idx = 0;
+
+		/* Frames are handled at every start delimiter, so the decoder pool never overflows */
+		while(idx < length) {
+			auto next = memchr(data + idx + 1, START_BYTE, length - idx - 1);
+			size_t end = next == nullptr ? length : static_cast<const uint8_t*>(next) - data;
+
+			this->_decoder.feed(data + idx, end - idx);
+			idx = end;
+
+			while(this->_decoder.frames() > 0) {
+				this->handle(*this->_decoder.front());
+				this->_decoder.pop();
+			}
+		}
+
+		return length;
+	}
+
+	Stream& XBeeSimulator::operator << (char x)
+	{
+		this->write((uint8_t) x);
+		return *this;
+	}
+
+	Stream& XBeeSimulator::operator << (short x)
+	{
+		this->write((uint8_t) x);
+		return *this;
+	}
+
+	Stream& XBeeSimulator::operator << (int  x)
+	{
+		this->write((uint8_t) x);
+		return *this;
+	}
+
+	Stream& XBeeSimulator::operator << (const long&  x)
+	{
+		this->write((uint8_t) x);
+		return *this;
+	}
+
+	Stream& XBeeSimulator::operator << (const long long&  x)
+	{
+		this->write((uint8_t) x);
+		return *this;
+	}
+
+	Stream& XBeeSimulator::operator << (unsigned char x)
+	{
+		this->write((uint8_t) x);
+		return *this;
+	}
+
+	Stream& XBeeSimulator::operator << (unsigned short x)
+	{
+		this->write((uint8_t) x);
+		return *this;
+	}
+
+	Stream& XBeeSimulator::operator << (unsigned int  x)
+	{
+		this->write((uint8_t) x);
+		return *this;
+	}
+
+	Stream& XBeeSimulator::operator << (const unsigned long&  x)
+	{
+		this->write((uint8_t) x);
+		return *this;
+	}
+
+	Stream& XBeeSimulator::operator << (const unsigned long long&  x)
+	{
+		this->write((uint8_t) x);
+		return *this;
+	}
+
+	Stream& XBeeSimulator::operator << (const double& flt)
+	{
+		this->write((uint8_t*)&flt, sizeof(flt));
+		return *this;
+	}
+
+	Stream& XBeeSimulator::operator << (const float& flt)
+	{
+		this->write((uint8_t*)&flt, sizeof(flt));
+		return *this;
+	}
+
+	Stream& XBeeSimulator::operator << (const String& str)
+	{
+		*this << str.c_str();
+		return *this;
+	}
+
+	Stream& XBeeSimulator::operator << (const char *cstr)
+	{
+		this->write((uint8_t*)cstr, strlen(cstr));
+		return *this;
+	}
+
+	/*
+	 * Radio behaviour. The medium lock is held by the caller.
+	 */
+
+	void XBeeSimulator::handle(const XBeeFrame& frame)
+	{
+		switch(frame.apiId()) {
+		case AT_COMMAND_REQUEST:
+		case AT_COMMAND_QUEUE_REQUEST:
+			this->command(frame);
+			break;
+
+		case ZB_TX_REQUEST:
+		case ZB_EXPLICIT_TX_REQUEST:
+			this->transmit(frame);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	void XBeeSimulator::command(const XBeeFrame& frame)
+	{
+		uint8_t response[5 + MaxValue];
+		auto data = frame.frameData();
+		auto length = frame.frameDataLength();
+		size_t num = 5;
+		bool escaped = this->_decoder.escaped();
+
+		if(length < 3)
+			return;
+
+		auto value = data + 3;
+		size_t size = length - 3;
+		auto reg = this->lookup(data + 1);
+		auto mode = reg != nullptr && reg->command[0] == 'A' && reg->command[1] == 'P';
+
+		response[0] = AT_COMMAND_RESPONSE;
+		response[1] = data[0];
+		response[2] = data[1];
+		response[3] = data[2];
+		response[4] = AT_OK;
+
+		if(reg == nullptr) {
+			response[4] = AT_INVALID_COMMAND;
+		} else if(size > 0) {
+			if(!reg->writable) {
+				response[4] = AT_ERROR;
+			} else if(size > MaxValue || (mode && (value[0] < 1 || value[0] > 2))) {
+				response[4] = AT_INVALID_PARAMETER;
+			} else {
+				memcpy(reg->value, value, size);
+				reg->length = static_cast<uint8_t>(size);
+
+				if(mode)
+					escaped = value[0] == 2;
+			}
+		} else if(!reg->secret) {
+			memcpy(response + num, reg->value, reg->length);
+			num += reg->length;
+		}
+
+		if(data[0] != NO_RESPONSE_FRAME_ID)
+			this->encode(this->_output, response, num);
+
+		/* A new API mode applies to the frames after the response */
+		if(escaped != this->_decoder.escaped())
+			this->_decoder.setEscaped(escaped);
+	}
+
+	void XBeeSimulator::transmit(const XBeeFrame& frame)
+	{
+		uint8_t rx[EXPLICIT_TX_HEADER + MAX_FRAME_DATA_SIZE];
+		auto data = frame.frameData();
+		auto length = frame.frameDataLength();
+		auto explicit_tx = frame.apiId() == ZB_EXPLICIT_TX_REQUEST;
+		size_t header = explicit_tx ? EXPLICIT_TX_HEADER : TX_HEADER;
+		auto& medium = this->_medium;
+
+		if(length < header)
+			return;
+
+		auto id = data[0];
+		auto address = read64(data + 1);
+		auto network = static_cast<uint16_t>(data[9] << 8 | data[10]);
+		auto payload = length - header;
+		auto due = lwiot_tick_ms() + medium._latency;
+
+		if(payload > MaxPayload) {
+			this->status(id, ZB_BROADCAST_ADDRESS, PAYLOAD_TOO_LARGE, due);
+			return;
+		}
+
+		/* API identifier and source addresses, explicit addressing, options and the payload */
+		size_t num = 11;
+
+		rx[0] = explicit_tx ? ZB_EXPLICIT_RX_RESPONSE : ZB_RX_RESPONSE;
+		write64(rx + 1, this->_address);
+		rx[9] = static_cast<uint8_t>(this->_network >> 8);
+		rx[10] = static_cast<uint8_t>(this->_network);
+
+		if(explicit_tx) {
+			memcpy(rx + num, data + 11, 6);
+			num += 6;
+		}
+
+		auto options = num++;
+
+		memcpy(rx + num, data + header, payload);
+		num += payload;
+
+		if(address == BROADCAST_ADDRESS64) {
+			rx[options] = ZB_BROADCAST_PACKET;
+
+			for(auto node : medium._nodes) {
+				if(node == this || medium.drop())
+					continue;
+
+				node->deliver(rx, num, due);
+				medium._delivered++;
+			}
+
+			this->status(id, ZB_BROADCAST_ADDRESS, SUCCESS, due);
+			return;
+		}
+
+		auto node = medium.find(address, network);
+
+		if(node == nullptr) {
+			this->status(id, ZB_BROADCAST_ADDRESS, ADDRESS_NOT_FOUND, due);
+		} else if(node == this) {
+			this->status(id, this->_network, SELF_ADDRESSED, due);
+		} else if(medium.drop()) {
+			this->status(id, node->_network, NETWORK_ACK_FAILURE, due);
+		} else {
+			rx[options] = ZB_PACKET_ACKNOWLEDGED;
+			node->deliver(rx, num, due);
+			medium._delivered++;
+			this->status(id, node->_network, SUCCESS, due);
+		}
+	}
+
+	void XBeeSimulator::status(uint8_t id, uint16_t network, uint8_t delivery, time_t due)
+	{
+		if(id == NO_RESPONSE_FRAME_ID)
+			return;
+
+		const uint8_t frame[] = {
+			ZB_TX_STATUS_RESPONSE, id, static_cast<uint8_t>(network >> 8), static_cast<uint8_t>(network),
+			0, delivery, 0
+		};
+
+		this->deliver(frame, sizeof(frame), due);
+	}
+
+	void XBeeSimulator::deliver(const uint8_t *data, size_t length, time_t due)
+	{
+		if(this->_deliveries.empty() && due <= lwiot_tick_ms()) {
+			this->encode(this->_output, data, length);
+			return;
+		}
+
+		Delivery delivery;
+
+		delivery.due = due;
+		this->encode(delivery.frame, data, length);
+		this->_deliveries.push_back(stl::move(delivery));
+	}
+
+	void XBeeSimulator::poll() const
+	{
+		auto now = lwiot_tick_ms();
+
+		while(!this->_deliveries.empty() && this->_deliveries.front().due <= now) {
+			auto& delivery = this->_deliveries.front();
+
+			this->_output.write(delivery.frame.data(), delivery.frame.index());
+			this->_deliveries.erase(this->_deliveries.begin());
+		}
+	}
+
+	void XBeeSimulator::encode(ByteBuffer& output, const uint8_t *data, size_t length) const
+	{
+		bool escaped = this->_decoder.escaped();
+		uint8_t checksum = 0;
+
+		auto put = [&output, escaped](uint8_t byte) {
+			if(escaped && (byte == START_BYTE || byte == ESCAPE || byte == XON || byte == XOFF)) {
+				output.write(ESCAPE);
+				output.write(byte ^ 0x20);
+			} else {
+				output.write(byte);
+			}
+		};
+
+		output.write(START_BYTE);
+		put(static_cast<uint8_t>(length >> 8));
+		put(static_cast<uint8_t>(length));
+
+		for(size_t idx = 0; idx < length; idx++) {
+			put(data[idx]);
+			checksum += data[idx];
+		}
+
+		put(0xFF - checksum);
+	}
+}
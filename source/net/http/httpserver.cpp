@@ -296,9 +296,13 @@ namespace lwiot
 	}
 
 	void HttpServer::sendContent(const String &content)
+	{
+		this->sendContent(content.c_str(), content.length());
+	}
+
+	void HttpServer::sendContent(const void *data, size_t len)
 	{
 		const char *footer = "\r\n";
-		size_t len = content.length();
 
 		if(_chunked) {
 			auto *chunkSize = (char *) malloc(11);
@@ -312,7 +316,7 @@ namespace lwiot
 				free(chunkSize);
 			}
 		}
-		_currentClientWrite(content.c_str(), len);
+		_currentClientWrite(static_cast<const char *>(data), len);
 		if(_chunked) {
 			_currentClient->write(footer, 2);
 			if(len == 0) {
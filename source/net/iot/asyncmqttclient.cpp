@@ -13,7 +13,6 @@
 #include <lwiot/scopedlock.h>
 
 #include <lwiot/stl/string.h>
-#include <lwiot/stl/map.h>
 
 #include <lwiot/network/asyncmqttclient.h>
 
@@ -25,7 +24,11 @@ namespace lwiot
 {
 	AsyncMqttClient::AsyncMqttClient(int tmo) :
 		MqttClient(), _executor("mqtt"), _lock(false),
-		_running(false), _will_qos(0), _will_retain(false), _clean(true), _tmo(tmo)
+		_running(false), _will_qos(0), _will_retain(false), _clean(true), _tmo(tmo),
+		_outbound(MQTT_MAX_PACKET_SIZE), _coalesce_size(0), _coalesce_latency(DefaultCoalescingLatency), _oldest(0),
+		_backoff(DefaultBackoffMin), _backoff_min(DefaultBackoffMin), _backoff_max(DefaultBackoffMax),
+		_store(nullptr), _replay_batch(DefaultReplayBatch), _replay_interval(DefaultReplayInterval), _last_replay(0),
+		_replay_head(0), _replay_count(0)
 	{
 	}
 
@@ -80,66 +83,264 @@ namespace lwiot
 		this->_running = false;
 
 		lock.unlock();
-		Thread::sleep(200);
-		lock.lock();
-
+		this->_wakeup.signal();
 		this->_executor.stop();
 		this->_executor.join();
+		lock.lock();
+
+		this->flushOutbound();
 		this->disconnect();
 	}
 
 	void AsyncMqttClient::run()
 	{
-		this->_lock.lock();
-		auto running = this->_running;
+		ScopedLock lock(this->_lock);
 
 		this->setCallback([&](const String& topic, const ByteBuffer& buffer) {
 			this->invoke(topic, buffer);
 		});
 
-		this->_lock.unlock();
+		this->setAckCallback([&](uint16_t id) {
+			this->acknowledge(id);
+		});
+
+		while(this->_running) {
+			if(!MqttClient::connected()) {
+				this->reconnect(lock);
+				continue;
+			}
+
+			auto tmo = this->waitTime();
+
+			lock.unlock();
+			auto readable = MqttClient::wait(tmo);
+			lock.lock();
+
+			if(readable && this->hangup())
+				continue;
 
-		while(running) {
-			ScopedLock lock(this->_lock);
+			this->loop();
 
-			while(!MqttClient::connected() && this->_running && this->_id.length() != 0) {
-				lock.unlock();
-				Thread::sleep(100);
-				lock.lock();
+			if(this->flushDue())
+				this->flushOutbound();
 
-				if(!this->reconnect())
-					continue;
+			this->replay();
+		}
+	}
 
-				MqttClient::connect(this->_id, this->_user, this->_pass,
-				                    this->_will_topic, this->_will_qos,
-				                    this->_will_retain, this->_will, this->_clean);
+	/*
+	 * Time the receive loop may block on the connection: until the next keep
+	 * alive deadline or, with write coalescing enabled, until queued packets
+	 * are due. Publishers cannot interrupt a blocking socket wait, so while
+	 * coalescing the latency budget also bounds the wait for a first packet.
+	 */
+	int AsyncMqttClient::waitTime() const
+	{
+		int tmo = this->keepAliveTimeout();
 
-				lock.unlock();
-				Thread::sleep(100);
-				lock.lock();
+		if(tmo > MaxIdleTime)
+			tmo = MaxIdleTime;
 
-				if(MqttClient::connected()) {
-					this->_handlers.clear();
+		if(this->_store != nullptr && this->_store->pending() > 0 && this->_replay_count == 0) {
+			auto elapsed = lwiot_tick_ms() - this->_last_replay;
+			int due = elapsed >= (time_t) this->_replay_interval ? 0 : this->_replay_interval - (int) elapsed;
 
-					lock.unlock();
-					this->_reconnect_handler();
-					Thread::sleep(100);
-					lock.lock();
-				}
+			if(due < tmo)
+				tmo = due;
+		}
 
-				lock.unlock();
-				Thread::sleep(100);
-				lock.lock();
-			}
+		if(this->_coalesce_size == 0)
+			return tmo;
 
-			this->loop();
-			running = this->_running;
+		int due = this->_coalesce_latency;
 
-			lock.unlock();
-			Thread::sleep(100);
+		if(this->_outbound.index() > 0) {
+			auto age = lwiot_tick_ms() - this->_oldest;
+			due = age >= (time_t) due ? 0 : due - (int) age;
+		}
+
+		return due < tmo ? due : tmo;
+	}
+
+	bool AsyncMqttClient::flushDue() const
+	{
+		if(this->_outbound.index() == 0)
+			return false;
+
+		return lwiot_tick_ms() - this->_oldest >= (time_t) this->_coalesce_latency;
+	}
+
+	/*
+	 * Reconnect using exponential back off. Each attempt waits for a random time
+	 * between half and the full back off window, so that a fleet of clients
+	 * dropped by the same broker do not reconnect in lock step.
+	 */
+	void AsyncMqttClient::reconnect(ScopedLock& lock)
+	{
+		if(this->_id.length() == 0) {
+			this->idle(lock, MaxIdleTime);
+			return;
+		}
+
+		auto half = this->_backoff / 2;
+		this->idle(lock, half + rand() % (half + 1));
+
+		if(!this->_running || MqttClient::connected())
+			return;
+
+		if(this->_backoff < this->_backoff_max / 2)
+			this->_backoff *= 2;
+		else
+			this->_backoff = this->_backoff_max;
+
+		if(!MqttClient::reconnect())
+			return;
+
+		if(!MqttClient::connect(this->_id, this->_user, this->_pass, this->_will_topic, this->_will_qos,
+		                        this->_will_retain, this->_will, this->_clean))
+			return;
+
+		this->_backoff = this->_backoff_min;
+		this->_handlers.clear();
+
+		/* Queued packets may refer to topic aliases of the previous connection */
+		if(MqttClient::protocolVersion() == MQTT_V5)
+			this->_outbound.setIndex(0);
+
+		if(this->_store != nullptr) {
+			this->_store->rewind();
+			this->_replay_count = 0;
+		}
+
+		if(!this->_reconnect_handler)
+			return;
+
+		lock.unlock();
+		this->_reconnect_handler();
+		lock.lock();
+	}
+
+	/*
+	 * Sleep for `ms` milliseconds with the lock released, or until stop() or
+	 * connect() wakes us up.
+	 */
+	void AsyncMqttClient::idle(ScopedLock& lock, int ms)
+	{
+		auto start = lwiot_tick_ms();
+
+		while(this->_running) {
+			auto elapsed = lwiot_tick_ms() - start;
+
+			if(elapsed >= (time_t) ms)
+				break;
+
+			auto tmo = ms - (int) elapsed;
+
+			if(this->_wakeup.wait(lock, tmo < MaxIdleTime ? tmo : MaxIdleTime))
+				break;
 		}
 	}
 
+	void AsyncMqttClient::setOfflineStore(MqttStore& store, size_t batch, int interval)
+	{
+		ScopedLock lock(this->_lock);
+
+		this->_store = &store;
+		this->_store->rewind();
+		this->_replay_batch = batch < 1 ? 1 : (batch > MaxReplayBatch ? MaxReplayBatch : batch);
+		this->_replay_interval = interval;
+		this->_replay_count = 0;
+	}
+
+	/*
+	 * Replay stored messages as QoS 1 publishes, at most one batch per interval
+	 * and only once the previous batch has been acknowledged. Records are
+	 * removed from the store by acknowledge().
+	 */
+	void AsyncMqttClient::replay()
+	{
+		String topic;
+		ByteBuffer payload;
+		bool retained;
+		uint16_t id;
+
+		if(this->_store == nullptr || this->_store->pending() == 0 || this->_replay_count != 0)
+			return;
+
+		if(lwiot_tick_ms() - this->_last_replay < (time_t) this->_replay_interval)
+			return;
+
+		this->_last_replay = lwiot_tick_ms();
+		this->flushOutbound();
+
+		while(this->_replay_count < this->_replay_batch && MqttClient::inflight() < MqttClient::receiveMaximum() &&
+		      this->_store->next(topic, payload, retained)) {
+			if(!MqttClient::publish(topic, payload, retained, QOS1, &id)) {
+				this->_store->rewind();
+				this->_replay_count = 0;
+				return;
+			}
+
+			this->_replay_ids[(this->_replay_head + this->_replay_count) % MaxReplayBatch] = id;
+			this->_replay_count++;
+		}
+	}
+
+	void AsyncMqttClient::acknowledge(uint16_t id)
+	{
+		if(this->_replay_count == 0 || this->_replay_ids[this->_replay_head] != id)
+			return;
+
+		this->_replay_head = (this->_replay_head + 1) % MaxReplayBatch;
+		this->_replay_count--;
+		this->_store->pop();
+	}
+
+	void AsyncMqttClient::setReconnectBackoff(int min, int max)
+	{
+		ScopedLock lock(this->_lock);
+
+		this->_backoff_min = min > 1 ? min : 1;
+		this->_backoff_max = max > this->_backoff_min ? max : this->_backoff_min;
+		this->_backoff = this->_backoff_min;
+	}
+
+	void AsyncMqttClient::setWriteCoalescing(size_t size, int latency)
+	{
+		ScopedLock lock(this->_lock);
+
+		this->flushOutbound();
+		this->_coalesce_size = size;
+		this->_coalesce_latency = latency;
+
+		if(size + MQTT_MAX_PACKET_SIZE > this->_outbound.count())
+			this->_outbound = ByteBuffer(size + MQTT_MAX_PACKET_SIZE);
+	}
+
+	bool AsyncMqttClient::flush()
+	{
+		UniqueTryLock<Lock> lock(this->_lock, this->_tmo);
+
+		if(!lock.locked())
+			return false;
+
+		return this->flushOutbound();
+	}
+
+	bool AsyncMqttClient::flushOutbound()
+	{
+		if(this->_outbound.index() == 0)
+			return true;
+
+		if(!MqttClient::connected())
+			return false;
+
+		auto rv = MqttClient::flush(this->_outbound);
+		this->_outbound.setIndex(0);
+
+		return rv;
+	}
+
 	bool AsyncMqttClient::unsubscribe(const lwiot::String &topic)
 	{
 		UniqueTryLock<Lock> lock(this->_lock, this->_tmo);
@@ -147,6 +348,12 @@ namespace lwiot
 		if(!lock.locked())
 			return false;
 
+		auto key = AsyncMqttClient::filter(topic);
+
+		/* Every subscribe() to this topic added a handler */
+		while(this->_handlers.remove(key, Subscription{ topic, AsyncHandler() }))
+			continue;
+
 		return MqttClient::unsubscribe(topic);
 	}
 
@@ -157,7 +364,90 @@ namespace lwiot
 		if(!lock.locked())
 			return false;
 
-		return MqttClient::publish(topic, data, retained);
+		/* Keep messages in order while the store still holds a backlog */
+		if(this->_store != nullptr && (!MqttClient::connected() || this->_store->count() > 0)) {
+			if(MQTT_MAX_PACKET_SIZE < this->packetSize(topic, data.count(), QOS1))
+				return false;
+
+			return this->_store->append(topic, data, retained);
+		}
+
+		if(this->_coalesce_size == 0)
+			return MqttClient::publish(topic, data, retained);
+
+		/* Large payloads are streamed and bypass the outbound queue */
+		if(MQTT_MAX_PACKET_SIZE < this->packetSize(topic, data.count(), QOS0)) {
+			this->flushOutbound();
+			return MqttClient::publish(topic, data, retained);
+		}
+
+		if(!MqttClient::connected())
+			return false;
+
+		if(this->_outbound.index() == 0)
+			this->_oldest = lwiot_tick_ms();
+
+		this->encode(this->_outbound, topic, data, retained);
+
+		if(this->_outbound.index() >= this->_coalesce_size || this->flushDue())
+			return this->flushOutbound();
+
+		return true;
+	}
+
+	bool AsyncMqttClient::publish(const lwiot::String &topic, const lwiot::ByteBuffer &data, bool retained, QoS qos,
+	                              uint16_t *id)
+	{
+		UniqueTryLock<Lock> lock(this->_lock, this->_tmo);
+
+		if(!lock.locked())
+			return false;
+
+		this->flushOutbound();
+		return MqttClient::publish(topic, data, retained, qos, id);
+	}
+
+	bool AsyncMqttClient::publish(const lwiot::String &topic, lwiot::Stream &payload, size_t length, bool retained)
+	{
+		UniqueTryLock<Lock> lock(this->_lock, this->_tmo);
+
+		if(!lock.locked())
+			return false;
+
+		this->flushOutbound();
+		return MqttClient::publish(topic, payload, length, retained);
+	}
+
+	void AsyncMqttClient::setStreamHandler(const StreamHandler& handler)
+	{
+		ScopedLock lock(this->_lock);
+		this->setStreamCallback(handler);
+	}
+
+	void AsyncMqttClient::setProtocolVersion(ProtocolVersion version)
+	{
+		ScopedLock lock(this->_lock);
+		MqttClient::setProtocolVersion(version);
+	}
+
+	/*
+	 * Messages received through a shared subscription ($share/<group>/<filter>)
+	 * carry topics matching <filter>, so that is what handlers are keyed by.
+	 */
+	String AsyncMqttClient::filter(const String& topic)
+	{
+		static constexpr size_t length = sizeof("$share/") - 1;
+		const char *str = topic.c_str();
+
+		if(topic.length() <= length || memcmp(str, "$share/", length) != 0)
+			return topic;
+
+		auto sep = static_cast<const char *>(memchr(str + length, '/', topic.length() - length));
+
+		if(sep == nullptr)
+			return topic;
+
+		return String(sep + 1, topic.length() - (sep + 1 - str));
 	}
 
 	bool AsyncMqttClient::connect(const lwiot::String &id, const lwiot::String &user, const lwiot::String &pass,
@@ -177,6 +467,8 @@ namespace lwiot
 		this->_will_retain = willRetain;
 		this->_will_topic = willTopic;
 		this->_clean = cleanSession;
+		this->_backoff = this->_backoff_min;
+		this->_wakeup.signal();
 
 		return MqttClient::connect(id, user, pass, willTopic, willQos, willRetain, willMessage, cleanSession);
 	}
@@ -188,17 +480,17 @@ namespace lwiot
 		if(!lock.locked())
 			return false;
 
-		this->_handlers.add(topic, stl::move(handler));
+		if(!this->_handlers.add(AsyncMqttClient::filter(topic), Subscription{ topic, handler }))
+			return false;
+
 		return MqttClient::subscribe(topic, qos);
 	}
 
 	void AsyncMqttClient::invoke(const lwiot::String &topic, const lwiot::ByteBuffer &data) const
 	{
-		const AsyncHandler& handler = this->_handlers[topic];
-
-		if(!handler)
-			return;
-
-		handler(data);
+		this->_handlers.match(topic, [&data](const Subscription& subscription) {
+			if(subscription.handler)
+				subscription.handler(data);
+		});
 	}
 }
@@ -0,0 +1,474 @@
+/*
+ * CoAP (RFC 7252) message parser and builder.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/network/coap.h>
+
+#define HEADER_SIZE     4
+#define VERSION         1
+#define PAYLOAD_MARKER  0xFF
+#define NIBBLE_BYTE     13
+#define NIBBLE_WORD     14
+#define NIBBLE_RESERVED 15
+#define OFFSET_BYTE     13
+#define OFFSET_WORD     269
+#define MAX_SZX         6
+
+#define OPTION_DECODED    1
+#define OPTION_END        0
+#define OPTION_MALFORMED -1
+
+static bool extended(const uint8_t *data, size_t length, size_t& pos, uint8_t nibble, uint32_t& value)
+{
+	if(nibble < NIBBLE_BYTE) {
+		value = nibble;
+	} else if(nibble == NIBBLE_BYTE) {
+		if(pos + 1 > length)
+			return false;
+
+		value = data[pos++] + OFFSET_BYTE;
+	} else if(nibble == NIBBLE_WORD) {
+		if(pos + 2 > length)
+			return false;
+
+		value = ((data[pos] << 8) | data[pos + 1]) + OFFSET_WORD;
+		pos += 2;
+	} else {
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Decodes the option at `pos`. Returns OPTION_END at the payload marker or
+ * the end of the message and OPTION_MALFORMED for options that don't fit.
+ */
+static int decode(const uint8_t *data, size_t length, size_t& pos, uint16_t& last, lwiot::CoapOptionValue& option)
+{
+	uint32_t delta, size;
+
+	if(pos >= length || data[pos] == PAYLOAD_MARKER)
+		return OPTION_END;
+
+	auto byte = data[pos++];
+
+	if(!extended(data, length, pos, byte >> 4, delta) || !extended(data, length, pos, byte & 0xF, size))
+		return OPTION_MALFORMED;
+
+	if(last + delta > UINT16_MAX || pos + size > length)
+		return OPTION_MALFORMED;
+
+	last += delta;
+	option.number = last;
+	option.value = data + pos;
+	option.length = static_cast<uint16_t>(size);
+	pos += size;
+
+	return OPTION_DECODED;
+}
+
+namespace lwiot
+{
+	uint32_t CoapOptionValue::toUnsigned() const
+	{
+		uint32_t value = 0;
+
+		for(uint16_t idx = 0; idx < this->length && idx < sizeof(value); idx++)
+			value = (value << 8) | this->value[idx];
+
+		return value;
+	}
+
+	uint32_t CoapBlock::encode() const
+	{
+		return (this->num << 4) | (this->more ? 0x8 : 0) | (this->szx & 0x7);
+	}
+
+	CoapBlock CoapBlock::decode(uint32_t value)
+	{
+		CoapBlock block;
+		uint8_t szx = value & 0x7;
+
+		block.num = value >> 4;
+		block.more = (value & 0x8) != 0;
+		/* Exponent 7 is reserved, treat it as the largest block size */
+		block.szx = szx > MAX_SZX ? MAX_SZX : szx;
+
+		return block;
+	}
+
+	uint8_t CoapBlock::exponent(size_t size)
+	{
+		uint8_t szx = 0;
+
+		while(szx < MAX_SZX && (32U << szx) <= size)
+			szx++;
+
+		return szx;
+	}
+
+	CoapMessage::CoapMessage(const void *data, size_t length) :
+		_data(static_cast<const uint8_t*>(data)), _length(length), _valid(false), _payload(nullptr), _payload_length(0)
+	{
+		this->_valid = this->parse();
+	}
+
+	bool CoapMessage::parse()
+	{
+		CoapOptionValue option;
+		uint16_t last = 0;
+		int rv;
+
+		if(this->_data == nullptr || this->_length < HEADER_SIZE)
+			return false;
+
+		if((this->_data[0] >> 6) != VERSION || this->tokenLength() > CoapBuilder::MaxToken)
+			return false;
+
+		size_t pos = HEADER_SIZE + this->tokenLength();
+
+		if(pos > this->_length)
+			return false;
+
+		/* Empty messages carry nothing but the header */
+		if(this->code() == CoapCode::Empty)
+			return this->_length == HEADER_SIZE;
+
+		while((rv = decode(this->_data, this->_length, pos, last, option)) == OPTION_DECODED);
+
+		if(rv == OPTION_MALFORMED)
+			return false;
+
+		if(pos == this->_length)
+			return true;
+
+		if(this->_data[pos] != PAYLOAD_MARKER || pos + 1 == this->_length)
+			return false;
+
+		this->_payload = this->_data + pos + 1;
+		this->_payload_length = this->_length - pos - 1;
+
+		return true;
+	}
+
+	CoapType CoapMessage::type() const
+	{
+		return static_cast<CoapType>((this->_data[0] >> 4) & 0x3);
+	}
+
+	CoapCode CoapMessage::code() const
+	{
+		return static_cast<CoapCode>(this->_data[1]);
+	}
+
+	uint16_t CoapMessage::id() const
+	{
+		return static_cast<uint16_t>((this->_data[2] << 8) | this->_data[3]);
+	}
+
+	const uint8_t *CoapMessage::token() const
+	{
+		return this->_data + HEADER_SIZE;
+	}
+
+	uint8_t CoapMessage::tokenLength() const
+	{
+		return this->_data[0] & 0xF;
+	}
+
+	bool CoapMessage::request() const
+	{
+		auto code = static_cast<uint8_t>(this->code());
+		return code != 0 && (code >> 5) == 0;
+	}
+
+	bool CoapMessage::empty() const
+	{
+		return this->code() == CoapCode::Empty;
+	}
+
+	bool CoapMessage::next(size_t& pos, uint16_t& last, CoapOptionValue& option) const
+	{
+		if(!this->_valid)
+			return false;
+
+		if(pos == 0)
+			pos = HEADER_SIZE + this->tokenLength();
+
+		return decode(this->_data, this->_length, pos, last, option) == OPTION_DECODED;
+	}
+
+	bool CoapMessage::find(CoapOption number, CoapOptionValue& option) const
+	{
+		size_t pos = 0;
+		uint16_t last = 0;
+
+		while(this->next(pos, last, option)) {
+			if(option.number == static_cast<uint16_t>(number))
+				return true;
+
+			if(option.number > static_cast<uint16_t>(number))
+				break;
+		}
+
+		return false;
+	}
+
+	bool CoapMessage::has(CoapOption number) const
+	{
+		CoapOptionValue option;
+		return this->find(number, option);
+	}
+
+	uint32_t CoapMessage::option(CoapOption number, uint32_t fallback) const
+	{
+		CoapOptionValue option;
+
+		if(!this->find(number, option))
+			return fallback;
+
+		return option.toUnsigned();
+	}
+
+	bool CoapMessage::block(CoapOption number, CoapBlock& block) const
+	{
+		CoapOptionValue option;
+
+		if(!this->find(number, option))
+			return false;
+
+		block = CoapBlock::decode(option.toUnsigned());
+		return true;
+	}
+
+	bool CoapMessage::matches(const char *path) const
+	{
+		CoapOptionValue option;
+		size_t pos = 0;
+		uint16_t last = 0;
+
+		if(path == nullptr)
+			return false;
+
+		while(this->next(pos, last, option)) {
+			if(option.number < static_cast<uint16_t>(CoapOption::UriPath))
+				continue;
+
+			if(option.number > static_cast<uint16_t>(CoapOption::UriPath))
+				break;
+
+			while(*path == '/')
+				path++;
+
+			auto end = strchr(path, '/');
+			size_t length = end == nullptr ? strlen(path) : static_cast<size_t>(end - path);
+
+			if(length != option.length || memcmp(path, option.value, length) != 0)
+				return false;
+
+			path += length;
+		}
+
+		while(*path == '/')
+			path++;
+
+		return *path == '\0';
+	}
+
+	size_t CoapMessage::path(char *output, size_t size) const
+	{
+		CoapOptionValue option;
+		size_t pos = 0, num = 0;
+		uint16_t last = 0;
+
+		if(size == 0)
+			return 0;
+
+		while(this->next(pos, last, option)) {
+			if(option.number != static_cast<uint16_t>(CoapOption::UriPath))
+				continue;
+
+			if(num + 1 + option.length >= size)
+				break;
+
+			output[num++] = '/';
+			memcpy(output + num, option.value, option.length);
+			num += option.length;
+		}
+
+		output[num] = '\0';
+		return num;
+	}
+
+	CoapBuilder::CoapBuilder(void *buffer, size_t capacity) :
+		_buffer(static_cast<uint8_t*>(buffer)), _capacity(capacity), _length(0), _last(0), _payload(false)
+	{
+	}
+
+	bool CoapBuilder::begin(CoapType type, CoapCode code, uint16_t id, const uint8_t *token, uint8_t tkl)
+	{
+		if(tkl > MaxToken || static_cast<size_t>(HEADER_SIZE) + tkl > this->_capacity)
+			return false;
+
+		this->_buffer[0] = static_cast<uint8_t>(VERSION << 6 | static_cast<uint8_t>(type) << 4 | tkl);
+		this->_buffer[1] = static_cast<uint8_t>(code);
+		this->_buffer[2] = id >> 8;
+		this->_buffer[3] = id & 0xFF;
+
+		if(tkl > 0)
+			memcpy(this->_buffer + HEADER_SIZE, token, tkl);
+
+		this->_length = HEADER_SIZE + tkl;
+		this->_last = 0;
+		this->_payload = false;
+
+		return true;
+	}
+
+	bool CoapBuilder::reply(const CoapMessage& request, CoapCode code, uint16_t id)
+	{
+		if(request.type() == CoapType::Confirmable)
+			return this->begin(CoapType::Acknowledgement, code, request.id(), request.token(), request.tokenLength());
+
+		return this->begin(CoapType::NonConfirmable, code, id, request.token(), request.tokenLength());
+	}
+
+	bool CoapBuilder::put(const void *data, size_t length)
+	{
+		if(this->_length + length > this->_capacity)
+			return false;
+
+		memcpy(this->_buffer + this->_length, data, length);
+		this->_length += length;
+
+		return true;
+	}
+
+	/* Returns the nibble for `value` and appends its extended bytes */
+	bool CoapBuilder::extended(uint8_t *nibble, uint32_t value)
+	{
+		uint8_t bytes[2];
+
+		if(value < OFFSET_BYTE) {
+			*nibble = static_cast<uint8_t>(value);
+			return true;
+		}
+
+		if(value < OFFSET_WORD) {
+			*nibble = NIBBLE_BYTE;
+			bytes[0] = static_cast<uint8_t>(value - OFFSET_BYTE);
+			return this->put(bytes, 1);
+		}
+
+		value -= OFFSET_WORD;
+		*nibble = NIBBLE_WORD;
+		bytes[0] = static_cast<uint8_t>(value >> 8);
+		bytes[1] = static_cast<uint8_t>(value);
+
+		return this->put(bytes, 2);
+	}
+
+	bool CoapBuilder::option(CoapOption number, const void *value, size_t length)
+	{
+		auto start = this->_length;
+		auto raw = static_cast<uint16_t>(number);
+		uint8_t delta, size;
+
+		if(this->_length == 0 || this->_payload || raw < this->_last || length > UINT16_MAX - OFFSET_WORD)
+			return false;
+
+		/* The first byte holds both nibbles and is filled in last */
+		if(!this->put("", 1) || !this->extended(&delta, raw - this->_last) ||
+		   !this->extended(&size, static_cast<uint32_t>(length)) || !this->put(value, length)) {
+			this->_length = start;
+			return false;
+		}
+
+		this->_buffer[start] = static_cast<uint8_t>(delta << 4 | size);
+		this->_last = raw;
+
+		return true;
+	}
+
+	bool CoapBuilder::option(CoapOption number, uint32_t value)
+	{
+		uint8_t bytes[sizeof(value)];
+		size_t length = 0;
+
+		/* Unsigned options use the shortest encoding, zero has no bytes at all */
+		for(int shift = 24; shift >= 0; shift -= 8) {
+			auto byte = static_cast<uint8_t>(value >> shift);
+
+			if(length > 0 || byte != 0)
+				bytes[length++] = byte;
+		}
+
+		return this->option(number, bytes, length);
+	}
+
+	bool CoapBuilder::option(CoapOption number, const char *value)
+	{
+		return this->option(number, value, strlen(value));
+	}
+
+	bool CoapBuilder::path(const char *path)
+	{
+		auto start = this->_length;
+		auto last = this->_last;
+
+		while(*path != '\0') {
+			while(*path == '/')
+				path++;
+
+			if(*path == '\0')
+				break;
+
+			auto end = strchr(path, '/');
+			size_t length = end == nullptr ? strlen(path) : static_cast<size_t>(end - path);
+
+			if(!this->option(CoapOption::UriPath, path, length)) {
+				this->_length = start;
+				this->_last = last;
+				return false;
+			}
+
+			path += length;
+		}
+
+		return true;
+	}
+
+	bool CoapBuilder::block(CoapOption number, const CoapBlock& block)
+	{
+		return this->option(number, block.encode());
+	}
+
+	bool CoapBuilder::payload(const void *data, size_t length)
+	{
+		auto start = this->_length;
+		uint8_t marker = PAYLOAD_MARKER;
+
+		if(this->_length == 0 || this->_payload)
+			return false;
+
+		if(length == 0)
+			return true;
+
+		if(!this->put(&marker, 1) || !this->put(data, length)) {
+			this->_length = start;
+			return false;
+		}
+
+		this->_payload = true;
+		return true;
+	}
+}
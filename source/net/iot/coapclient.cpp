@@ -0,0 +1,316 @@
+/*
+ * CoAP (RFC 7252) client.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/log.h>
+
+#include <lwiot/network/udpclient.h>
+#include <lwiot/network/coap.h>
+#include <lwiot/network/coapclient.h>
+
+#define SEPARATE_TIMEOUT 30000
+#define OBSERVE_REGISTER   0
+#define OBSERVE_DEREGISTER 1
+
+static bool success(lwiot::CoapCode code)
+{
+	return (static_cast<uint8_t>(code) >> 5) == 2;
+}
+
+namespace lwiot
+{
+	CoapClient::CoapClient(UdpClient& client) : _udp(client), _confirmable(true), _observing(false)
+	{
+		auto seed = static_cast<uint32_t>(lwiot_tick());
+
+		this->_message_id = static_cast<uint16_t>(seed);
+		this->_token = seed * 2654435761U;
+		this->_udp.setTimeout(1);
+	}
+
+	void CoapClient::setConfirmable(bool confirmable)
+	{
+		this->_confirmable = confirmable;
+	}
+
+	CoapCode CoapClient::get(const char *path, void *output, size_t& length)
+	{
+		return this->request(CoapCode::Get, path, nullptr, 0, output, length);
+	}
+
+	CoapCode CoapClient::post(const char *path, const void *payload, size_t size, void *output, size_t& length,
+	                          int format)
+	{
+		return this->request(CoapCode::Post, path, payload, size, output, length, format);
+	}
+
+	CoapCode CoapClient::put(const char *path, const void *payload, size_t size, void *output, size_t& length,
+	                         int format)
+	{
+		return this->request(CoapCode::Put, path, payload, size, output, length, format);
+	}
+
+	CoapCode CoapClient::remove(const char *path)
+	{
+		size_t length = 0;
+		return this->request(CoapCode::Delete, path, nullptr, 0, nullptr, length);
+	}
+
+	void CoapClient::token(uint8_t *token)
+	{
+		auto value = this->_token++;
+
+		for(uint8_t idx = 0; idx < TokenLength; idx++)
+			token[idx] = static_cast<uint8_t>(value >> (idx * 8));
+	}
+
+	CoapCode CoapClient::request(CoapCode method, const char *path, const void *payload, size_t size,
+	                             void *output, size_t& length, int format)
+	{
+		auto type = this->_confirmable ? CoapType::Confirmable : CoapType::NonConfirmable;
+		auto data = static_cast<const uint8_t*>(payload);
+		auto capacity = length;
+		CoapBlock upload = { 0, false, CoapBlock::exponent(BlockSize) };
+		CoapBlock download = { 0, false, CoapBlock::exponent(BlockSize) };
+		bool uploading = size > upload.size();
+		bool downloading = false;
+		uint8_t token[TokenLength];
+
+		length = 0;
+		this->token(token);
+
+		while(true) {
+			CoapBuilder builder(this->_tx, MaxMessageSize);
+			size_t offset = uploading ? upload.offset() : 0;
+			size_t chunk = uploading ? size - offset : size;
+
+			if(uploading && chunk > upload.size()) {
+				chunk = upload.size();
+				upload.more = true;
+			} else {
+				upload.more = false;
+			}
+
+			if(downloading)
+				chunk = 0;
+
+			builder.begin(type, method, this->_message_id++, token, TokenLength);
+
+			if(!builder.path(path))
+				return CoapCode::Empty;
+
+			if(format >= 0 && chunk > 0)
+				builder.option(CoapOption::ContentFormat, static_cast<uint32_t>(format));
+
+			if(downloading)
+				builder.block(CoapOption::Block2, download);
+			else if(uploading)
+				builder.block(CoapOption::Block1, upload);
+
+			if(uploading && !downloading && upload.num == 0)
+				builder.option(CoapOption::Size1, static_cast<uint32_t>(size));
+
+			if(!builder.payload(data + offset, chunk))
+				return CoapCode::Empty;
+
+			auto num = this->exchange(builder.length());
+
+			if(num < 0)
+				return CoapCode::Empty;
+
+			CoapMessage response(this->_rx, static_cast<size_t>(num));
+			CoapBlock block;
+
+			if(uploading && !downloading && upload.more) {
+				if(response.code() != CoapCode::Continue)
+					return response.code();
+
+				/* The server may ask for smaller blocks */
+				if(response.block(CoapOption::Block1, block) && block.szx < upload.szx) {
+					upload.num = static_cast<uint32_t>((offset + upload.size()) / block.size());
+					upload.szx = block.szx;
+				} else {
+					upload.num++;
+				}
+
+				continue;
+			}
+
+			auto copy = response.payloadLength();
+
+			if(length + copy > capacity)
+				copy = capacity - length;
+
+			if(copy > 0) {
+				memcpy(static_cast<uint8_t*>(output) + length, response.payload(), copy);
+				length += copy;
+			}
+
+			if(!success(response.code()) || !response.block(CoapOption::Block2, block) || !block.more ||
+			   length >= capacity)
+				return response.code();
+
+			download.num = block.num + 1;
+			download.szx = block.szx;
+			downloading = true;
+		}
+	}
+
+	/*
+	 * Sends the message in the transmit buffer and waits for the matching
+	 * response, which is left in the receive buffer.
+	 */
+	ssize_t CoapClient::exchange(size_t length)
+	{
+		CoapMessage request(this->_tx, length);
+		auto attempts = request.type() == CoapType::Confirmable ? MaxRetransmit + 1 : 1;
+		/* The initial timeout is randomised between AckTimeout and 1.5 times AckTimeout */
+		auto timeout = AckTimeout * 1000 + static_cast<time_t>(lwiot_tick_ms() % (AckTimeout * 500));
+		bool acknowledged = false;
+
+		for(int attempt = 0; attempt < attempts; attempt++, timeout *= 2) {
+			if(this->_udp.write(this->_tx, length) != static_cast<ssize_t>(length))
+				return -1;
+
+			auto deadline = lwiot_tick_ms() + timeout;
+
+			while(lwiot_tick_ms() < deadline) {
+				auto num = this->_udp.read(this->_rx, MaxMessageSize);
+
+				if(num <= 0)
+					continue;
+
+				CoapMessage response(this->_rx, static_cast<size_t>(num));
+
+				if(!response.valid() || this->notification(response))
+					continue;
+
+				if(response.type() == CoapType::Reset && response.id() == request.id())
+					return -1;
+
+				if(response.type() == CoapType::Acknowledgement && response.id() == request.id() &&
+				   response.empty()) {
+					/* The response follows separately, stop retransmitting */
+					acknowledged = true;
+					deadline = lwiot_tick_ms() + SEPARATE_TIMEOUT;
+					continue;
+				}
+
+				if(response.request() || response.empty() || response.tokenLength() != request.tokenLength() ||
+				   memcmp(response.token(), request.token(), request.tokenLength()) != 0)
+					continue;
+
+				if(response.type() == CoapType::Acknowledgement && response.id() != request.id())
+					continue;
+
+				if(response.type() == CoapType::Confirmable)
+					this->acknowledge(response.id());
+
+				return num;
+			}
+
+			if(acknowledged)
+				break;
+		}
+
+		return -1;
+	}
+
+	void CoapClient::acknowledge(uint16_t id)
+	{
+		uint8_t buffer[4];
+		CoapBuilder ack(buffer, sizeof(buffer));
+
+		ack.begin(CoapType::Acknowledgement, CoapCode::Empty, id);
+		this->_udp.write(ack.data(), ack.length());
+	}
+
+	bool CoapClient::notification(const CoapMessage& message)
+	{
+		if(!this->_observing || message.request() || message.empty() || message.tokenLength() != TokenLength ||
+		   memcmp(message.token(), this->_observe_token, TokenLength) != 0)
+			return false;
+
+		/* The response to the registration itself is not a notification */
+		if(message.type() == CoapType::Acknowledgement)
+			return false;
+
+		if(message.type() == CoapType::Confirmable)
+			this->acknowledge(message.id());
+
+		/* Notifications without the option or with an error end the observation */
+		if(!message.has(CoapOption::Observe) || !success(message.code()))
+			this->_observing = false;
+
+		this->_handler(message);
+		return true;
+	}
+
+	bool CoapClient::observe(const char *path, const Handler& handler)
+	{
+		CoapBuilder builder(this->_tx, MaxMessageSize);
+
+		this->_observing = false;
+		this->_handler = handler;
+		this->token(this->_observe_token);
+
+		builder.begin(CoapType::Confirmable, CoapCode::Get, this->_message_id++, this->_observe_token, TokenLength);
+
+		if(!builder.option(CoapOption::Observe, static_cast<uint32_t>(OBSERVE_REGISTER)) || !builder.path(path))
+			return false;
+
+		auto num = this->exchange(builder.length());
+
+		if(num < 0)
+			return false;
+
+		CoapMessage response(this->_rx, static_cast<size_t>(num));
+
+		this->_observing = success(response.code()) && response.has(CoapOption::Observe);
+		this->_handler(response);
+
+		return this->_observing;
+	}
+
+	bool CoapClient::cancel(const char *path)
+	{
+		CoapBuilder builder(this->_tx, MaxMessageSize);
+
+		if(!this->_observing)
+			return false;
+
+		this->_observing = false;
+		builder.begin(CoapType::Confirmable, CoapCode::Get, this->_message_id++, this->_observe_token, TokenLength);
+
+		if(!builder.option(CoapOption::Observe, static_cast<uint32_t>(OBSERVE_DEREGISTER)) || !builder.path(path))
+			return false;
+
+		return this->exchange(builder.length()) >= 0;
+	}
+
+	bool CoapClient::process()
+	{
+		if(!this->_observing)
+			return false;
+
+		auto num = this->_udp.read(this->_rx, MaxMessageSize);
+
+		if(num <= 0)
+			return false;
+
+		CoapMessage message(this->_rx, static_cast<size_t>(num));
+
+		if(!message.valid())
+			return false;
+
+		return this->notification(message);
+	}
+}
@@ -0,0 +1,488 @@
+/*
+ * CoAP (RFC 7252) server.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/log.h>
+#include <lwiot/scopedlock.h>
+
+#include <lwiot/network/stdnet.h>
+#include <lwiot/network/udpclient.h>
+#include <lwiot/network/udpserver.h>
+#include <lwiot/network/coap.h>
+#include <lwiot/network/coapserver.h>
+
+#define SEQUENCE_MASK 0xFFFFFF
+#define OBSERVE_REGISTER   0
+#define OBSERVE_DEREGISTER 1
+
+static bool same(const remote_addr_t& a, const remote_addr_t& b)
+{
+	if(a.version != b.version || a.port != b.port)
+		return false;
+
+	if(a.version == 6)
+		return memcmp(a.addr.ip6_addr.ip, b.addr.ip6_addr.ip, sizeof(a.addr.ip6_addr.ip)) == 0;
+
+	return a.addr.ip4_addr.ip == b.addr.ip4_addr.ip;
+}
+
+static bool success(lwiot::CoapCode code)
+{
+	return (static_cast<uint8_t>(code) >> 5) == 2;
+}
+
+/* Critical options are odd numbered and may not be ignored */
+static bool supported(uint16_t number)
+{
+	using lwiot::CoapOption;
+
+	switch(static_cast<CoapOption>(number)) {
+	case CoapOption::IfMatch:
+	case CoapOption::UriHost:
+	case CoapOption::IfNoneMatch:
+	case CoapOption::UriPort:
+	case CoapOption::UriPath:
+	case CoapOption::UriQuery:
+	case CoapOption::Accept:
+	case CoapOption::Block2:
+	case CoapOption::Block1:
+		return true;
+
+	default:
+		return (number & 1) == 0;
+	}
+}
+
+namespace lwiot
+{
+	CoapExchange::CoapExchange(CoapServer& server, const CoapMessage& request, const remote_addr_t& remote,
+	                           uint8_t *buffer, int32_t observe) :
+		_server(server), _request(request), _remote(remote), _buffer(buffer), _length(0), _observe(observe),
+		_enroll(false), _responded(false)
+	{
+	}
+
+	bool CoapExchange::respond(CoapCode code, const void *payload, size_t length, int format)
+	{
+		CoapBuilder builder(this->_buffer, CoapServer::MaxMessageSize);
+		CoapBlock block = { 0, false, CoapBlock::exponent(CoapServer::BlockSize) };
+		CoapBlock requested, upload;
+		auto data = static_cast<const uint8_t*>(payload);
+		auto total = length;
+		bool blockwise = length > block.size();
+
+		if(this->_responded)
+			return false;
+
+		this->_responded = true;
+
+		if(this->_request.block(CoapOption::Block2, requested)) {
+			/* Honour a smaller block size, convert the block number for a larger one */
+			if(requested.szx <= block.szx) {
+				block.szx = requested.szx;
+				block.num = requested.num;
+			} else {
+				block.num = requested.num << (requested.szx - block.szx);
+			}
+
+			blockwise = true;
+		}
+
+		if(blockwise) {
+			if(block.offset() >= total && total > 0) {
+				code = CoapCode::BadOption;
+				data = nullptr;
+				length = total = 0;
+				blockwise = false;
+			} else {
+				auto remaining = total - block.offset();
+
+				data += block.offset();
+				length = remaining > block.size() ? block.size() : remaining;
+				block.more = remaining > block.size();
+			}
+		}
+
+		if(!builder.reply(this->_request, code, this->_server.nextId()))
+			return false;
+
+		if(this->_observe >= 0 && success(code))
+			builder.option(CoapOption::Observe, static_cast<uint32_t>(this->_observe));
+
+		if(format >= 0)
+			builder.option(CoapOption::ContentFormat, static_cast<uint32_t>(format));
+
+		if(blockwise)
+			builder.block(CoapOption::Block2, block);
+
+		/* Block1 uploads are acknowledged block by block */
+		if(this->_request.block(CoapOption::Block1, upload))
+			builder.block(CoapOption::Block1, upload);
+
+		if(blockwise && block.num == 0)
+			builder.option(CoapOption::Size2, static_cast<uint32_t>(total));
+
+		if(!builder.payload(data, length))
+			return false;
+
+		/* Only a successful response makes the client an observer (RFC 7641 section 4.1) */
+		if(this->_enroll)
+			this->_server.enroll(this->_request, this->_remote, success(code));
+
+		this->_length = builder.length();
+		return this->_server.send(this->_remote, builder.data(), builder.length());
+	}
+
+	CoapServer::CoapServer() : Thread("coap-server"), _running(false), _message_id(0), _sequence(0),
+		_enrolling(nullptr), _recent_next(0)
+	{
+		this->_message_id = static_cast<uint16_t>(lwiot_tick());
+		memset(this->_observers, 0, sizeof(this->_observers));
+
+		this->_recent = (Response*) lwiot_mem_zalloc(sizeof(Response) * Duplicates);
+		this->_rx = (uint8_t*) lwiot_mem_zalloc(MaxMessageSize);
+		this->_tx = (uint8_t*) lwiot_mem_zalloc(MaxMessageSize);
+		this->_notification = (uint8_t*) lwiot_mem_zalloc(MaxMessageSize);
+		this->_notification_tx = (uint8_t*) lwiot_mem_zalloc(MaxMessageSize);
+	}
+
+	CoapServer::~CoapServer()
+	{
+		if(this->_udp)
+			this->_udp->close();
+
+		for(auto route : this->_routes)
+			delete route;
+
+		lwiot_mem_free(this->_recent);
+		lwiot_mem_free(this->_rx);
+		lwiot_mem_free(this->_tx);
+		lwiot_mem_free(this->_notification);
+		lwiot_mem_free(this->_notification_tx);
+	}
+
+	void CoapServer::begin(UdpServer *server)
+	{
+		ScopedLock lock(this->_lock);
+
+		this->_udp.reset(server);
+		/* Receives time out every second, which bounds the time end() takes */
+		this->_udp->setTimeout(1);
+		this->_running = true;
+		this->start();
+	}
+
+	void CoapServer::end()
+	{
+		ScopedLock lock(this->_lock);
+
+		this->_running = false;
+		lock.unlock();
+		this->stop();
+		this->_udp->close();
+	}
+
+	void CoapServer::on(const String& path, CoapCode method, const Handler& handler, bool observable)
+	{
+		this->_routes.push_back(new Route(path, method, handler, observable));
+	}
+
+	size_t CoapServer::observers() const
+	{
+		ScopedLock lock(this->_lock);
+		size_t count = 0;
+
+		for(auto& observer : this->_observers) {
+			if(observer.active)
+				count++;
+		}
+
+		return count;
+	}
+
+	bool CoapServer::running() const
+	{
+		ScopedLock lock(this->_lock);
+		return this->_running;
+	}
+
+	uint16_t CoapServer::nextId()
+	{
+		ScopedLock lock(this->_lock);
+		return this->_message_id++;
+	}
+
+	bool CoapServer::send(const remote_addr_t& remote, const uint8_t *data, size_t length)
+	{
+		return this->_udp->sendTo(data, length, remote) == static_cast<ssize_t>(length);
+	}
+
+	void CoapServer::run()
+	{
+		while(this->running()) {
+			remote_addr_t remote;
+			auto num = this->_udp->recvFrom(this->_rx, MaxMessageSize, remote);
+
+			if(num > 0)
+				this->handle(remote, static_cast<size_t>(num));
+		}
+	}
+
+	void CoapServer::handle(const remote_addr_t& remote, size_t length)
+	{
+		CoapMessage message(this->_rx, length);
+		CoapBuilder reset(this->_tx, MaxMessageSize);
+
+		if(!message.valid()) {
+			/* Malformed confirmable messages are rejected with a reset */
+			if(length >= 4 && (this->_rx[0] >> 6) == 1 && message.type() == CoapType::Confirmable) {
+				reset.begin(CoapType::Reset, CoapCode::Empty, message.id());
+				this->send(remote, reset.data(), reset.length());
+			}
+
+			return;
+		}
+
+		switch(message.type()) {
+		case CoapType::Reset:
+			this->cancel(remote, message.id());
+			return;
+
+		case CoapType::Acknowledgement:
+			return;
+
+		default:
+			break;
+		}
+
+		/* Pings and stray responses */
+		if(!message.request()) {
+			if(message.type() == CoapType::Confirmable) {
+				reset.begin(CoapType::Reset, CoapCode::Empty, message.id());
+				this->send(remote, reset.data(), reset.length());
+			}
+
+			return;
+		}
+
+		if(message.type() == CoapType::Confirmable) {
+			auto response = this->recall(remote, message.id());
+
+			if(response != nullptr) {
+				this->send(remote, response->data, response->length);
+				return;
+			}
+		}
+
+		this->dispatch(message, remote);
+	}
+
+	void CoapServer::dispatch(const CoapMessage& request, const remote_addr_t& remote)
+	{
+		CoapExchange exchange(*this, request, remote, this->_tx, -1);
+		CoapOptionValue option;
+		const Route *match = nullptr;
+		bool found = false;
+		size_t pos = 0;
+		uint16_t last = 0;
+
+		while(request.next(pos, last, option)) {
+			if(!supported(option.number)) {
+				exchange.respond(CoapCode::BadOption);
+				break;
+			}
+		}
+
+		if(!exchange.responded()) {
+			for(auto route : this->_routes) {
+				if(!request.matches(route->path.c_str()))
+					continue;
+
+				found = true;
+
+				if(route->method == request.code()) {
+					match = route;
+					break;
+				}
+			}
+
+			if(match == nullptr) {
+				exchange.respond(found ? CoapCode::MethodNotAllowed : CoapCode::NotFound);
+			} else {
+				if(match->observable && request.code() == CoapCode::Get) {
+					exchange._observe = this->observe(request, remote, match);
+					exchange._enroll = exchange._observe >= 0;
+					this->_enrolling = match;
+				}
+
+				match->handler(exchange);
+
+				if(!exchange.responded())
+					exchange.respond(CoapCode::InternalServerError);
+			}
+		}
+
+		if(request.type() == CoapType::Confirmable && exchange._length > 0)
+			this->remember(remote, request.id(), this->_tx, exchange._length);
+	}
+
+	/* The observation this request refers to, or else a free slot */
+	CoapServer::Observer* CoapServer::find(const CoapMessage& request, const remote_addr_t& remote,
+	                                       const Route *route)
+	{
+		for(auto& observer : this->_observers) {
+			if(observer.active && observer.route == route && same(observer.remote, remote) &&
+			   observer.tkl == request.tokenLength() && memcmp(observer.token, request.token(), observer.tkl) == 0)
+				return &observer;
+		}
+
+		for(auto& observer : this->_observers) {
+			if(!observer.active)
+				return &observer;
+		}
+
+		return nullptr;
+	}
+
+	int32_t CoapServer::observe(const CoapMessage& request, const remote_addr_t& remote, const Route *route)
+	{
+		CoapOptionValue option;
+
+		if(!request.find(CoapOption::Observe, option))
+			return -1;
+
+		auto value = option.toUnsigned();
+		ScopedLock lock(this->_lock);
+		auto slot = this->find(request, remote, route);
+
+		if(value == OBSERVE_DEREGISTER) {
+			if(slot != nullptr)
+				slot->active = false;
+
+			return -1;
+		}
+
+		/* Out of observer slots, the request is served as a plain GET */
+		if(value != OBSERVE_REGISTER || slot == nullptr)
+			return -1;
+
+		return static_cast<int32_t>(this->_sequence++ & SEQUENCE_MASK);
+	}
+
+	void CoapServer::enroll(const CoapMessage& request, const remote_addr_t& remote, bool ok)
+	{
+		auto route = this->_enrolling;
+		ScopedLock lock(this->_lock);
+		auto slot = this->find(request, remote, route);
+
+		if(slot == nullptr)
+			return;
+
+		if(!ok) {
+			slot->active = false;
+			return;
+		}
+
+		if(slot->active)
+			return;
+
+		slot->route = route;
+		slot->remote = remote;
+		slot->tkl = request.tokenLength();
+		slot->id = 0;
+		slot->notified = false;
+		slot->active = true;
+		memcpy(slot->token, request.token(), slot->tkl);
+	}
+
+	void CoapServer::cancel(const remote_addr_t& remote, uint16_t id)
+	{
+		ScopedLock lock(this->_lock);
+
+		for(auto& observer : this->_observers) {
+			/* Until the first notification there is no message ID a reset could match */
+			if(observer.active && observer.notified && observer.id == id && same(observer.remote, remote))
+				observer.active = false;
+		}
+	}
+
+	void CoapServer::notify(const String& path)
+	{
+		Observer targets[MaxObservers];
+		size_t count = 0;
+		ScopedLock notifier(this->_notifier);
+
+		this->_lock.lock();
+		for(auto& observer : this->_observers) {
+			if(observer.active && observer.route->path == path)
+				targets[count++] = observer;
+		}
+		this->_lock.unlock();
+
+		for(size_t idx = 0; idx < count; idx++) {
+			auto& target = targets[idx];
+			CoapBuilder builder(this->_notification, MaxMessageSize);
+
+			/* Notifications run the handler on a GET for the observed path */
+			builder.begin(CoapType::NonConfirmable, CoapCode::Get, 0, target.token, target.tkl);
+			builder.path(path.c_str());
+
+			CoapMessage request(builder.data(), builder.length());
+			this->_lock.lock();
+			auto sequence = static_cast<int32_t>(this->_sequence++ & SEQUENCE_MASK);
+			this->_lock.unlock();
+
+			CoapExchange exchange(*this, request, target.remote, this->_notification_tx, sequence);
+			target.route->handler(exchange);
+
+			if(!exchange.responded())
+				continue;
+
+			CoapMessage response(this->_notification_tx, exchange._length);
+			ScopedLock lock(this->_lock);
+
+			for(auto& observer : this->_observers) {
+				if(!observer.active || observer.route != target.route || !same(observer.remote, target.remote) ||
+				   observer.tkl != target.tkl || memcmp(observer.token, target.token, target.tkl) != 0)
+					continue;
+
+				/* An error response ends the observation */
+				observer.id = response.id();
+				observer.notified = true;
+				observer.active = success(response.code());
+			}
+		}
+	}
+
+	void CoapServer::remember(const remote_addr_t& remote, uint16_t id, const uint8_t *data, size_t length)
+	{
+		auto& entry = this->_recent[this->_recent_next];
+
+		entry.remote = remote;
+		entry.id = id;
+		entry.length = length;
+		memcpy(entry.data, data, length);
+
+		this->_recent_next = (this->_recent_next + 1) % Duplicates;
+	}
+
+	const CoapServer::Response *CoapServer::recall(const remote_addr_t& remote, uint16_t id) const
+	{
+		for(size_t idx = 0; idx < Duplicates; idx++) {
+			auto& entry = this->_recent[idx];
+
+			if(entry.length > 0 && entry.id == id && same(entry.remote, remote))
+				return &entry;
+		}
+
+		return nullptr;
+	}
+}
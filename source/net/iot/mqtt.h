@@ -7,6 +7,9 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <stddef.h>
+
 #define MQTTCONNECT     1 << 4  // Client request to connect to Server
 #define MQTTCONNACK     2 << 4  // Connect Acknowledgment
 #define MQTTPUBLISH     3 << 4  // Publish message
@@ -40,6 +43,7 @@
 
 #define MQTT_VERSION_3_1      3
 #define MQTT_VERSION_3_1_1    4
+#define MQTT_VERSION_5        5
 
 #ifndef MQTT_VERSION
 #define MQTT_VERSION MQTT_VERSION_3_1_1
@@ -53,3 +57,159 @@
 #ifndef MQTT_SOCKET_TIMEOUT
 #define MQTT_SOCKET_TIMEOUT 2
 #endif
+
+/* MQTT 5 properties */
+#define MQTT_PROP_PAYLOAD_FORMAT          0x01
+#define MQTT_PROP_MESSAGE_EXPIRY          0x02
+#define MQTT_PROP_CONTENT_TYPE            0x03
+#define MQTT_PROP_RESPONSE_TOPIC          0x08
+#define MQTT_PROP_CORRELATION_DATA        0x09
+#define MQTT_PROP_SUBSCRIPTION_ID         0x0B
+#define MQTT_PROP_SESSION_EXPIRY          0x11
+#define MQTT_PROP_ASSIGNED_CLIENT_ID      0x12
+#define MQTT_PROP_SERVER_KEEP_ALIVE       0x13
+#define MQTT_PROP_AUTH_METHOD             0x15
+#define MQTT_PROP_AUTH_DATA               0x16
+#define MQTT_PROP_REQUEST_PROBLEM_INFO    0x17
+#define MQTT_PROP_WILL_DELAY              0x18
+#define MQTT_PROP_REQUEST_RESPONSE_INFO   0x19
+#define MQTT_PROP_RESPONSE_INFO           0x1A
+#define MQTT_PROP_SERVER_REFERENCE        0x1C
+#define MQTT_PROP_REASON_STRING           0x1F
+#define MQTT_PROP_RECEIVE_MAXIMUM         0x21
+#define MQTT_PROP_TOPIC_ALIAS_MAXIMUM     0x22
+#define MQTT_PROP_TOPIC_ALIAS             0x23
+#define MQTT_PROP_MAXIMUM_QOS             0x24
+#define MQTT_PROP_RETAIN_AVAILABLE        0x25
+#define MQTT_PROP_USER_PROPERTY           0x26
+#define MQTT_PROP_MAXIMUM_PACKET_SIZE     0x27
+#define MQTT_PROP_WILDCARD_SUB_AVAILABLE  0x28
+#define MQTT_PROP_SUB_ID_AVAILABLE        0x29
+#define MQTT_PROP_SHARED_SUB_AVAILABLE    0x2A
+
+/* MQTT 5 reason codes */
+#define MQTT_RC_SUCCESS                   0x00
+#define MQTT_RC_UNSPECIFIED_ERROR         0x80
+#define MQTT_RC_MALFORMED_PACKET          0x81
+#define MQTT_RC_PROTOCOL_ERROR            0x82
+#define MQTT_RC_UNSUPPORTED_VERSION       0x84
+#define MQTT_RC_TOPIC_FILTER_INVALID      0x8F
+#define MQTT_RC_TOPIC_ALIAS_INVALID       0x94
+#define MQTT_RC_RECEIVE_MAXIMUM_EXCEEDED  0x93
+#define MQTT_RC_QOS_NOT_SUPPORTED         0x9B
+
+#define MQTT_SHARE_PREFIX "$share/"
+
+/*
+ * Decode a variable byte integer. Returns false when the encoding is
+ * malformed or runs past `end'.
+ */
+static inline bool mqtt_varint(const uint8_t **pos, const uint8_t *end, uint32_t *value)
+{
+	uint32_t multiplier = 1;
+	uint8_t byte;
+
+	*value = 0;
+
+	do {
+		if(*pos >= end || multiplier > 128 * 128 * 128)
+			return false;
+
+		byte = *(*pos)++;
+		*value += (byte & 0x7F) * multiplier;
+		multiplier *= 128;
+	} while(byte & 0x80);
+
+	return true;
+}
+
+/*
+ * Decode the MQTT 5 property at `pos'. Integer properties are stored in
+ * `value', string and binary properties in `data' and `length'. The second
+ * string of a user property is skipped.
+ */
+static inline bool mqtt_property(const uint8_t **pos, const uint8_t *end, uint8_t *id, uint32_t *value,
+                                 const uint8_t **data, size_t *length)
+{
+	const uint8_t *ptr = *pos;
+	size_t width;
+
+	if(ptr >= end)
+		return false;
+
+	*id = *ptr++;
+	*value = 0;
+	*data = NULL;
+	*length = 0;
+
+	switch(*id) {
+	case MQTT_PROP_PAYLOAD_FORMAT:
+	case MQTT_PROP_REQUEST_PROBLEM_INFO:
+	case MQTT_PROP_REQUEST_RESPONSE_INFO:
+	case MQTT_PROP_MAXIMUM_QOS:
+	case MQTT_PROP_RETAIN_AVAILABLE:
+	case MQTT_PROP_WILDCARD_SUB_AVAILABLE:
+	case MQTT_PROP_SUB_ID_AVAILABLE:
+	case MQTT_PROP_SHARED_SUB_AVAILABLE:
+		width = 1;
+		break;
+
+	case MQTT_PROP_SERVER_KEEP_ALIVE:
+	case MQTT_PROP_RECEIVE_MAXIMUM:
+	case MQTT_PROP_TOPIC_ALIAS_MAXIMUM:
+	case MQTT_PROP_TOPIC_ALIAS:
+		width = 2;
+		break;
+
+	case MQTT_PROP_MESSAGE_EXPIRY:
+	case MQTT_PROP_SESSION_EXPIRY:
+	case MQTT_PROP_WILL_DELAY:
+	case MQTT_PROP_MAXIMUM_PACKET_SIZE:
+		width = 4;
+		break;
+
+	case MQTT_PROP_SUBSCRIPTION_ID:
+		if(!mqtt_varint(&ptr, end, value))
+			return false;
+
+		*pos = ptr;
+		return true;
+
+	case MQTT_PROP_CONTENT_TYPE:
+	case MQTT_PROP_RESPONSE_TOPIC:
+	case MQTT_PROP_CORRELATION_DATA:
+	case MQTT_PROP_ASSIGNED_CLIENT_ID:
+	case MQTT_PROP_AUTH_METHOD:
+	case MQTT_PROP_AUTH_DATA:
+	case MQTT_PROP_RESPONSE_INFO:
+	case MQTT_PROP_SERVER_REFERENCE:
+	case MQTT_PROP_REASON_STRING:
+	case MQTT_PROP_USER_PROPERTY:
+		for(int idx = *id == MQTT_PROP_USER_PROPERTY ? 2 : 1; idx > 0; idx--) {
+			if(end - ptr < 2 || (size_t) (end - ptr - 2) < (size_t) ((ptr[0] << 8) | ptr[1]))
+				return false;
+
+			if(*data == NULL) {
+				*data = ptr + 2;
+				*length = (ptr[0] << 8) | ptr[1];
+			}
+
+			ptr += 2 + ((ptr[0] << 8) | ptr[1]);
+		}
+
+		*pos = ptr;
+		return true;
+
+	default:
+		return false;
+	}
+
+	if((size_t) (end - ptr) < width)
+		return false;
+
+	for(size_t idx = 0; idx < width; idx++)
+		*value = (*value << 8) | ptr[idx];
+
+	*pos = ptr + width;
+	return true;
+}
@@ -0,0 +1,945 @@
+/*
+ * Embedded MQTT broker.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/bytebuffer.h>
+#include <lwiot/scopedlock.h>
+#include <lwiot/uniquepointer.h>
+
+#include <lwiot/network/tcpclient.h>
+#include <lwiot/network/mqttbroker.h>
+
+#include <lwiot/stl/move.h>
+
+#include "mqtt.h"
+
+namespace lwiot
+{
+	static size_t encode_length(uint8_t *output, size_t length)
+	{
+		size_t idx = 0;
+
+		do {
+			output[idx] = length % 128;
+			length /= 128;
+
+			if(length > 0)
+				output[idx] |= 0x80;
+
+			idx++;
+		} while(length > 0);
+
+		return idx;
+	}
+
+	/* Read a length prefixed UTF-8 string or binary field */
+	static bool field(const uint8_t *& pos, const uint8_t *end, const uint8_t *& data, size_t& length)
+	{
+		if(end - pos < 2)
+			return false;
+
+		length = (pos[0] << 8) | pos[1];
+
+		if(static_cast<size_t>(end - pos - 2) < length)
+			return false;
+
+		data = pos + 2;
+		pos += 2 + length;
+
+		return true;
+	}
+
+	/* Skip an MQTT 5 property list, keeping the topic alias if there is one */
+	static bool properties(const uint8_t *& pos, const uint8_t *end, uint16_t *alias)
+	{
+		const uint8_t *data;
+		uint32_t length, value;
+		size_t size;
+		uint8_t id;
+
+		if(!mqtt_varint(&pos, end, &length) || static_cast<size_t>(end - pos) < length)
+			return false;
+
+		end = pos + length;
+
+		while(pos < end) {
+			if(!mqtt_property(&pos, end, &id, &value, &data, &size))
+				return false;
+
+			if(id == MQTT_PROP_TOPIC_ALIAS && alias != nullptr)
+				*alias = static_cast<uint16_t>(value);
+		}
+
+		return true;
+	}
+
+	class MqttBroker::Session {
+	public:
+		explicit Session(MqttBroker& broker, UniquePointer<TcpClient>& client) :
+			_broker(broker), _client(stl::move(client)), _executor("mqtt-session"), _lock(false),
+			_rx(broker._packet_size + MaxHeaderSize, true), _tx(broker._packet_size + MaxHeaderSize, true),
+			_rx_pos(0), _rx_end(0), _packet(nullptr), _next_id(1), _keepalive(0), _version(MQTT_VERSION_3_1_1),
+			_done(false), _users(0), _will_set(false)
+		{
+		}
+
+		void start()
+		{
+			this->_executor.start([this]() {
+				this->run();
+			});
+		}
+
+		void join()
+		{
+			this->_executor.join();
+		}
+
+		bool done() const
+		{
+			ScopedLock lock(this->_lock);
+			return this->_done;
+		}
+
+		/* Routes delivering to this session, guarded by the lock of the broker */
+		void use()
+		{
+			this->_users++;
+		}
+
+		void unuse()
+		{
+			this->_users--;
+		}
+
+		bool used() const
+		{
+			return this->_users > 0;
+		}
+
+		bool deliver(const char *topic, size_t tl, const uint8_t *payload, size_t pl, uint8_t qos, bool retain)
+		{
+			ScopedLock lock(this->_lock);
+			size_t length = 2 + tl + (qos > 0 ? 2 : 0) + (this->_version == MQTT_VERSION_5 ? 1 : 0) + pl;
+			uint8_t *data = this->_tx.data();
+			size_t idx = 0;
+
+			if(!this->_client->connected() || length + MaxHeaderSize > this->_tx.count())
+				return false;
+
+			data[idx++] = MQTTPUBLISH | (qos << 1) | (retain ? 1 : 0);
+			idx += encode_length(data + idx, length);
+			data[idx++] = tl >> 8;
+			data[idx++] = tl & 0xFF;
+			memcpy(data + idx, topic, tl);
+			idx += tl;
+
+			if(qos > 0) {
+				data[idx++] = this->_next_id >> 8;
+				data[idx++] = this->_next_id & 0xFF;
+
+				if(++this->_next_id == 0)
+					this->_next_id = 1;
+			}
+
+			/* Outbound topic aliases are not used, so the property list is empty */
+			if(this->_version == MQTT_VERSION_5)
+				data[idx++] = 0;
+
+			memcpy(data + idx, payload, pl);
+			return this->write(data, idx + pl);
+		}
+
+		static constexpr size_t MaxHeaderSize = 5;
+
+	private:
+		MqttBroker& _broker;
+		UniquePointer<TcpClient> _client;
+		FunctionalThread _executor;
+		mutable Lock _lock;
+
+		ByteBuffer _rx;
+		ByteBuffer _tx;
+		size_t _rx_pos;
+		size_t _rx_end;
+		const uint8_t *_packet;
+		uint16_t _next_id;
+		time_t _keepalive;
+		uint8_t _version;
+		bool _done;
+		size_t _users;
+
+		bool _will_set;
+		Message _will;
+		stl::LinkedList<String> _filters;
+		String _aliases[MqttBroker::MaxTopicAliases];
+
+		void run()
+		{
+			bool connected = false;
+			bool clean = false;
+			time_t last = lwiot_tick_ms();
+			uint8_t header;
+			size_t length;
+
+			this->_client->setTimeout(MqttBroker::SocketTimeout);
+
+			while(this->_broker.running()) {
+				if(this->_rx_pos == this->_rx_end && !this->_client->wait(MqttBroker::MaxIdleTime)) {
+					/* Clients are dropped after one and a half keep alive periods of silence */
+					if(this->_keepalive > 0 && lwiot_tick_ms() - last > this->_keepalive * 1500)
+						break;
+
+					continue;
+				}
+
+				if(!this->receive(header, length))
+					break;
+
+				last = lwiot_tick_ms();
+
+				if(!connected) {
+					if((header & 0xF0) != MQTTCONNECT || !this->connect(length))
+						break;
+
+					connected = true;
+					continue;
+				}
+
+				if(!this->handle(header, length, clean))
+					break;
+			}
+
+			if(connected && !clean && this->_will_set) {
+				auto& will = this->_will;
+
+				if(will.retain)
+					this->_broker.retain(will.topic.c_str(), will.topic.length(), will.payload.data(),
+					                     will.payload.count(), will.qos);
+
+				this->_broker.route(will.topic.c_str(), will.topic.length(), will.payload.data(),
+				                    will.payload.count(), will.qos);
+			}
+
+			this->_broker.release(this, this->_filters);
+
+			ScopedLock lock(this->_lock);
+			this->_client->close();
+			this->_done = true;
+		}
+
+		bool handle(uint8_t header, size_t length, bool& clean)
+		{
+			switch(header & 0xF0) {
+			case MQTTPUBLISH:
+				return this->publish(header, length);
+
+			case MQTTSUBSCRIBE:
+				return header == (MQTTSUBSCRIBE | MQTTQOS1) && this->subscribe(length);
+
+			case MQTTUNSUBSCRIBE:
+				return header == (MQTTUNSUBSCRIBE | MQTTQOS1) && this->unsubscribe(length);
+
+			case MQTTPINGREQ: {
+				static const uint8_t pingresp[] = { MQTTPINGRESP, 0 };
+				return this->send(pingresp, sizeof(pingresp));
+			}
+
+			case MQTTPUBACK:
+				/* Outbound QoS 1 messages are not retransmitted */
+				return length >= 2;
+
+			case MQTTDISCONNECT:
+				/* MQTT 5 clients can ask for their will message to be published anyway */
+				clean = length == 0 || this->_packet[0] != 0x04;
+				return false;
+
+			default:
+				return false;
+			}
+		}
+
+		/*
+		 * Packets are parsed from a receive buffer that is filled with as many bytes
+		 * as the socket has available, so a burst of small packets costs a single read.
+		 */
+		bool fill(size_t length)
+		{
+			auto data = this->_rx.data();
+
+			if(this->_rx_end - this->_rx_pos >= length)
+				return true;
+
+			if(this->_rx_pos + length > this->_rx.count()) {
+				memmove(data, data + this->_rx_pos, this->_rx_end - this->_rx_pos);
+				this->_rx_end -= this->_rx_pos;
+				this->_rx_pos = 0;
+			}
+
+			while(this->_rx_end - this->_rx_pos < length) {
+				auto num = this->_client->read(data + this->_rx_end, this->_rx.count() - this->_rx_end);
+
+				if(num <= 0)
+					return false;
+
+				this->_rx_end += num;
+			}
+
+			return true;
+		}
+
+		bool receive(uint8_t& header, size_t& length)
+		{
+			auto data = this->_rx.data();
+			size_t idx = 1, multiplier = 1;
+			uint8_t byte;
+
+			if(!this->fill(2))
+				return false;
+
+			header = data[this->_rx_pos];
+			length = 0;
+
+			do {
+				if(idx > 4 || !this->fill(idx + 1))
+					return false;
+
+				byte = data[this->_rx_pos + idx++];
+				length += (byte & 0x7F) * multiplier;
+				multiplier *= 128;
+			} while(byte & 0x80);
+
+			if(length > this->_broker._packet_size) {
+				print_dbg("MQTT broker: packet of %u bytes too large, dropping client\n", (unsigned) length);
+				return false;
+			}
+
+			if(!this->fill(idx + length))
+				return false;
+
+			/* fill() may have moved the buffered bytes */
+			this->_packet = this->_rx.data() + this->_rx_pos + idx;
+			this->_rx_pos += idx + length;
+
+			if(this->_rx_pos == this->_rx_end)
+				this->_rx_pos = this->_rx_end = 0;
+
+			return true;
+		}
+
+		bool connect(size_t length)
+		{
+			uint8_t connack[] = {
+				MQTTCONNACK, 2, 0, MQTT_CONNECTED, 6,
+				MQTT_PROP_RECEIVE_MAXIMUM, MqttBroker::ReceiveMaximum >> 8, MqttBroker::ReceiveMaximum & 0xFF,
+				MQTT_PROP_TOPIC_ALIAS_MAXIMUM, MqttBroker::MaxTopicAliases >> 8, MqttBroker::MaxTopicAliases & 0xFF
+			};
+			const uint8_t *pos = this->_packet;
+			const uint8_t *end = pos + length;
+			const uint8_t *data;
+			size_t size;
+
+			if(!field(pos, end, data, size) || end - pos < 4)
+				return false;
+
+			uint8_t level = pos[0];
+			uint8_t flags = pos[1];
+			bool known = (size == 4 && memcmp(data, "MQTT", 4) == 0 &&
+			              (level == MQTT_VERSION_3_1_1 || level == MQTT_VERSION_5)) ||
+			             (size == 6 && memcmp(data, "MQIsdp", 6) == 0 && level == MQTT_VERSION_3_1);
+
+			if(!known) {
+				connack[3] = MQTT_CONNECT_BAD_PROTOCOL;
+				this->send(connack, 4);
+				return false;
+			}
+
+			if(flags & 0x01)
+				return false;
+
+			this->_version = level;
+			this->_keepalive = (pos[2] << 8) | pos[3];
+			pos += 4;
+
+			if(level == MQTT_VERSION_5 && !properties(pos, end, nullptr))
+				return false;
+
+			if(!field(pos, end, data, size))
+				return false;
+
+			if(size == 0 && (flags & 0x02) == 0) {
+				connack[3] = level == MQTT_VERSION_5 ? MQTT_RC_UNSPECIFIED_ERROR : MQTT_CONNECT_BAD_CLIENT_ID;
+				this->send(connack, 4);
+				return false;
+			}
+
+			if(flags & 0x04) {
+				const uint8_t *message;
+				size_t ml;
+
+				if(level == MQTT_VERSION_5 && !properties(pos, end, nullptr))
+					return false;
+
+				if(!field(pos, end, data, size) || !field(pos, end, message, ml))
+					return false;
+
+				this->_will.topic = String(reinterpret_cast<const char *>(data), size);
+				this->_will.payload = ByteBuffer(ml, true);
+				this->_will.payload.write(message, ml);
+				this->_will.qos = (flags >> 3) & 0x3;
+				this->_will.retain = (flags & 0x20) != 0;
+				this->_will_set = this->_will.qos < 2;
+			}
+
+			/* Credentials are accepted without verification */
+			if((flags & 0x80) && !field(pos, end, data, size))
+				return false;
+
+			if((flags & 0x40) && !field(pos, end, data, size))
+				return false;
+
+			if(level != MQTT_VERSION_5)
+				return this->send(connack, 4);
+
+			connack[1] = sizeof(connack) - 2;
+			return this->send(connack, sizeof(connack));
+		}
+
+		bool publish(uint8_t header, size_t length)
+		{
+			const uint8_t *pos = this->_packet;
+			const uint8_t *end = pos + length;
+			const uint8_t *topic;
+			uint8_t qos = (header >> 1) & 0x3;
+			uint16_t id = 0, alias = 0;
+			size_t tl;
+
+			if(qos > 1 || !field(pos, end, topic, tl))
+				return false;
+
+			if(memchr(topic, '+', tl) != nullptr || memchr(topic, '#', tl) != nullptr)
+				return false;
+
+			if(qos > 0) {
+				if(end - pos < 2)
+					return false;
+
+				id = (pos[0] << 8) | pos[1];
+				pos += 2;
+			}
+
+			if(this->_version == MQTT_VERSION_5 && !properties(pos, end, &alias))
+				return false;
+
+			auto name = reinterpret_cast<const char *>(topic);
+
+			/* A topic alias is set by a publish with a topic name and used by publishes without one */
+			if(alias > MqttBroker::MaxTopicAliases)
+				return false;
+
+			if(alias > 0 && tl > 0) {
+				this->_aliases[alias - 1] = String(name, tl);
+			} else if(alias > 0) {
+				auto& known = this->_aliases[alias - 1];
+
+				name = known.c_str();
+				tl = known.length();
+			}
+
+			if(tl == 0)
+				return false;
+
+			if(header & 0x1)
+				this->_broker.retain(name, tl, pos, end - pos, qos);
+
+			this->_broker.route(name, tl, pos, end - pos, qos);
+
+			if(qos == 0)
+				return true;
+
+			uint8_t puback[] = { MQTTPUBACK, 2, static_cast<uint8_t>(id >> 8), static_cast<uint8_t>(id & 0xFF) };
+			return this->send(puback, sizeof(puback));
+		}
+
+		bool subscribe(size_t length)
+		{
+			const uint8_t *pos = this->_packet + 2;
+			const uint8_t *end = this->_packet + length;
+			bool v5 = this->_version == MQTT_VERSION_5;
+			stl::LinkedList<Subscriber> granted;
+			stl::LinkedList<String> filters;
+			const uint8_t *data;
+			size_t size;
+
+			if(length < 2 || (v5 && !properties(pos, end, nullptr)))
+				return false;
+
+			/* MQTT 5 uses the upper bits of the options for no local, retain as published and retain handling */
+			while(pos < end) {
+				if(!field(pos, end, data, size) || pos >= end || (*pos & (v5 ? 0xC0 : 0xFC)) != 0)
+					return false;
+
+				String filter(reinterpret_cast<const char *>(data), size);
+				uint8_t qos = (*pos++ & 0x3) > 0 ? 1 : 0;
+
+				if(!this->_broker.subscribe(this, filter, qos))
+					qos = v5 ? MQTT_RC_TOPIC_FILTER_INVALID : 0x80;
+				else if(!this->subscribed(filter))
+					this->_filters.push_back(filter);
+
+				filters.push_back(stl::move(filter));
+				granted.push_back(Subscriber{ this, qos, 0 });
+			}
+
+			if(granted.size() == 0)
+				return false;
+
+			size_t remaining = 2 + (v5 ? 1 : 0) + granted.size();
+			ByteBuffer suback(MaxHeaderSize + remaining, true);
+			uint8_t fixed[MaxHeaderSize];
+
+			fixed[0] = MQTTSUBACK;
+			suback.write(fixed, 1 + encode_length(fixed + 1, remaining));
+			suback.write(this->_packet, 2);
+
+			if(v5)
+				suback.write(static_cast<uint8_t>(0));
+
+			for(auto& sub : granted)
+				suback.write(sub.qos);
+
+			if(!this->send(suback.data(), suback.index()))
+				return false;
+
+			/* Retained messages follow the SUBACK */
+			auto iter = granted.begin();
+
+			for(auto& filter : filters) {
+				if((*iter).qos < 0x80)
+					this->_broker.replay(this, filter, (*iter).qos);
+
+				++iter;
+			}
+
+			return true;
+		}
+
+		bool unsubscribe(size_t length)
+		{
+			const uint8_t *pos = this->_packet + 2;
+			const uint8_t *end = this->_packet + length;
+			bool v5 = this->_version == MQTT_VERSION_5;
+			const uint8_t *data;
+			size_t size, count = 0;
+
+			if(length < 2 || (v5 && !properties(pos, end, nullptr)))
+				return false;
+
+			while(pos < end) {
+				if(!field(pos, end, data, size))
+					return false;
+
+				String filter(reinterpret_cast<const char *>(data), size);
+				this->_broker.unsubscribe(this, filter);
+				count++;
+
+				for(auto iter = this->_filters.begin(); iter != this->_filters.end(); ++iter) {
+					if(*iter == filter) {
+						this->_filters.erase(iter);
+						break;
+					}
+				}
+			}
+
+			if(!v5) {
+				uint8_t unsuback[] = { MQTTUNSUBACK, 2, this->_packet[0], this->_packet[1] };
+				return this->send(unsuback, sizeof(unsuback));
+			}
+
+			/* An MQTT 5 UNSUBACK carries a reason code per topic filter */
+			ByteBuffer unsuback(MaxHeaderSize + 3 + count, true);
+			uint8_t fixed[MaxHeaderSize];
+
+			fixed[0] = MQTTUNSUBACK;
+			unsuback.write(fixed, 1 + encode_length(fixed + 1, 3 + count));
+			unsuback.write(this->_packet, 2);
+			unsuback.write(static_cast<uint8_t>(0));
+
+			for(size_t idx = 0; idx < count; idx++)
+				unsuback.write(static_cast<uint8_t>(MQTT_RC_SUCCESS));
+
+			return this->send(unsuback.data(), unsuback.index());
+		}
+
+		bool subscribed(const String& filter) const
+		{
+			for(auto& entry : this->_filters) {
+				if(entry == filter)
+					return true;
+			}
+
+			return false;
+		}
+
+		bool send(const void *data, size_t length)
+		{
+			ScopedLock lock(this->_lock);
+			return this->write(data, length);
+		}
+
+		bool write(const void *data, size_t length)
+		{
+			auto bytes = static_cast<const uint8_t *>(data);
+
+			while(length > 0) {
+				auto num = this->_client->write(bytes, length);
+
+				if(num <= 0)
+					return false;
+
+				bytes += num;
+				length -= num;
+			}
+
+			return true;
+		}
+	};
+
+	MqttBroker::MqttBroker(TcpServer& server, size_t packet) : _server(server), _executor("mqtt-broker"), _lock(false),
+		_running(false), _packet_size(packet), _next_member(0)
+	{
+	}
+
+	MqttBroker::~MqttBroker()
+	{
+		this->stop();
+	}
+
+	bool MqttBroker::start()
+	{
+		ScopedLock lock(this->_lock);
+
+		if(this->_running)
+			return false;
+
+		this->_running = true;
+		this->_server.setTimeout(1);
+		this->_executor.start([this]() {
+			this->run();
+		});
+
+		return true;
+	}
+
+	void MqttBroker::stop()
+	{
+		ScopedLock lock(this->_lock);
+
+		if(!this->_running)
+			return;
+
+		this->_running = false;
+		lock.unlock();
+
+		this->_executor.join();
+		this->reap(true);
+	}
+
+	bool MqttBroker::running() const
+	{
+		ScopedLock lock(this->_lock);
+		return this->_running;
+	}
+
+	size_t MqttBroker::sessions() const
+	{
+		ScopedLock lock(this->_lock);
+		size_t count = 0;
+
+		for(auto session : this->_sessions) {
+			if(!session->done())
+				count++;
+		}
+
+		return count;
+	}
+
+	size_t MqttBroker::retained() const
+	{
+		ScopedLock lock(this->_lock);
+		return this->_retained.size();
+	}
+
+	void MqttBroker::run()
+	{
+		while(this->running()) {
+			/* Accepting times out every second, which bounds the time stop() takes */
+			auto client = stl::move(this->_server.accept());
+
+			this->reap(false);
+
+			if(!client || !client->connected())
+				continue;
+
+			auto session = new Session(*this, client);
+
+			ScopedLock lock(this->_lock);
+			this->_sessions.push_back(session);
+			session->start();
+		}
+	}
+
+	void MqttBroker::reap(bool all)
+	{
+		stl::LinkedList<Session*> finished;
+		ScopedLock lock(this->_lock);
+
+		/* A finished session may still be the target of a route in progress */
+		for(auto session : this->_sessions) {
+			if(all || (session->done() && !session->used()))
+				finished.push_back(session);
+		}
+
+		/* Erasing the node an iteration started at would never end that iteration */
+		for(auto session : finished) {
+			for(auto iter = this->_sessions.begin(); iter != this->_sessions.end(); ++iter) {
+				if(*iter == session) {
+					this->_sessions.erase(iter);
+					break;
+				}
+			}
+		}
+
+		lock.unlock();
+
+		/* Routes only run on session threads, none is left once all of them are joined */
+		for(auto session : finished)
+			session->join();
+
+		for(auto session : finished)
+			delete session;
+	}
+
+	/*
+	 * Split a shared subscription ($share/<group>/<filter>) into the index of its
+	 * group and the topic filter. Group indices start at one, zero is used for
+	 * regular subscriptions.
+	 */
+	bool MqttBroker::group(const String& filter, bool create, uint16_t& group, String& topics)
+	{
+		static constexpr size_t length = sizeof(MQTT_SHARE_PREFIX) - 1;
+		const char *str = filter.c_str();
+
+		group = 0;
+
+		if(filter.length() < length || memcmp(str, MQTT_SHARE_PREFIX, length) != 0) {
+			topics = filter;
+			return true;
+		}
+
+		auto sep = static_cast<const char *>(memchr(str + length, '/', filter.length() - length));
+
+		if(sep == nullptr || sep == str + length || sep + 1 == str + filter.length())
+			return false;
+
+		String name(str + length, sep - str - length);
+
+		if(strchr(name.c_str(), '+') != nullptr || strchr(name.c_str(), '#') != nullptr)
+			return false;
+
+		topics = String(sep + 1, filter.length() - (sep + 1 - str));
+
+		for(auto& entry : this->_groups) {
+			group++;
+
+			if(entry == name)
+				return true;
+		}
+
+		group = 0;
+
+		if(!create)
+			return false;
+
+		this->_groups.push_back(stl::move(name));
+		group = this->_groups.size();
+
+		return true;
+	}
+
+	bool MqttBroker::subscribe(Session *session, const String& filter, uint8_t qos)
+	{
+		ScopedLock lock(this->_lock);
+		uint16_t group;
+		String topics;
+
+		if(!this->group(filter, true, group, topics) || !TopicTrie<Subscriber>::validate(topics))
+			return false;
+
+		this->_subscriptions.remove(topics, Subscriber{ session, qos, group });
+		return this->_subscriptions.add(topics, Subscriber{ session, qos, group });
+	}
+
+	void MqttBroker::unsubscribe(Session *session, const String& filter)
+	{
+		ScopedLock lock(this->_lock);
+		uint16_t group;
+		String topics;
+
+		if(this->group(filter, false, group, topics))
+			this->_subscriptions.remove(topics, Subscriber{ session, 0, group });
+	}
+
+	void MqttBroker::release(Session *session, const stl::LinkedList<String>& filters)
+	{
+		ScopedLock lock(this->_lock);
+		uint16_t group;
+		String topics;
+
+		for(auto& filter : filters) {
+			if(this->group(filter, false, group, topics))
+				this->_subscriptions.remove(topics, Subscriber{ session, 0, group });
+		}
+	}
+
+	/*
+	 * Collect the target sessions under the broker lock, but write to them after
+	 * releasing it. A subscriber that stops reading only stalls the publisher,
+	 * not every other session.
+	 */
+	void MqttBroker::route(const char *topic, size_t tl, const uint8_t *payload, size_t pl, uint8_t qos)
+	{
+		ScopedLock lock(this->_lock);
+		stl::Vector<Subscriber> targets;
+
+		/* Overlapping subscriptions of a session receive a single copy, at the highest QoS granted */
+		this->_shared.clear();
+		this->_subscriptions.match(topic, tl, [&](const Subscriber& subscriber) {
+			if(subscriber.group != 0) {
+				this->_shared.pushback(Subscriber{ subscriber.session, subscriber.qos, subscriber.group });
+				return;
+			}
+
+			for(auto& target : targets) {
+				if(target.session != subscriber.session)
+					continue;
+
+				if(subscriber.qos > target.qos)
+					target.qos = subscriber.qos;
+
+				return;
+			}
+
+			targets.pushback(Subscriber{ subscriber.session, subscriber.qos, 0 });
+		});
+
+		/* Every shared subscription group receives one copy, handed to its members in turn */
+		for(size_t idx = 0; idx < this->_shared.size(); idx++) {
+			auto group = this->_shared[idx].group;
+			size_t members = 0;
+			bool seen = false;
+
+			for(size_t prev = 0; prev < idx && !seen; prev++)
+				seen = this->_shared[prev].group == group;
+
+			if(seen)
+				continue;
+
+			for(size_t member = idx; member < this->_shared.size(); member++)
+				members += this->_shared[member].group == group ? 1 : 0;
+
+			auto pick = this->_next_member++ % members;
+
+			for(size_t member = idx; member < this->_shared.size(); member++) {
+				if(this->_shared[member].group != group || pick-- > 0)
+					continue;
+
+				targets.pushback(Subscriber{ this->_shared[member].session, this->_shared[member].qos, group });
+				break;
+			}
+		}
+
+		for(auto& target : targets)
+			target.session->use();
+
+		lock.unlock();
+
+		for(auto& target : targets)
+			target.session->deliver(topic, tl, payload, pl, target.qos < qos ? target.qos : qos, false);
+
+		lock.lock();
+
+		for(auto& target : targets)
+			target.session->unuse();
+	}
+
+	void MqttBroker::retain(const char *topic, size_t tl, const uint8_t *payload, size_t pl, uint8_t qos)
+	{
+		ScopedLock lock(this->_lock);
+
+		for(auto iter = this->_retained.begin(); iter != this->_retained.end(); ++iter) {
+			auto& message = *iter;
+
+			if(message.topic.length() != tl || memcmp(message.topic.c_str(), topic, tl) != 0)
+				continue;
+
+			if(pl == 0) {
+				this->_retained.erase(iter);
+				return;
+			}
+
+			message.payload = ByteBuffer(pl, true);
+			message.payload.write(payload, pl);
+			message.qos = qos;
+			return;
+		}
+
+		/* A retained message with an empty payload only clears the topic */
+		if(pl == 0)
+			return;
+
+		Message message;
+
+		message.topic = String(topic, tl);
+		message.payload = ByteBuffer(pl, true);
+		message.payload.write(payload, pl);
+		message.qos = qos;
+		message.retain = true;
+
+		this->_retained.push_back(stl::move(message));
+	}
+
+	void MqttBroker::replay(Session *session, const String& filter, uint8_t qos)
+	{
+		ScopedLock lock(this->_lock);
+
+		/* Retained messages are not sent for shared subscriptions */
+		if(strncmp(filter.c_str(), MQTT_SHARE_PREFIX, sizeof(MQTT_SHARE_PREFIX) - 1) == 0)
+			return;
+
+		for(auto& message : this->_retained) {
+			if(!MqttBroker::matches(filter, message.topic))
+				continue;
+
+			session->deliver(message.topic.c_str(), message.topic.length(), message.payload.data(),
+			                 message.payload.count(), message.qos < qos ? message.qos : qos, true);
+		}
+	}
+
+	bool MqttBroker::matches(const String& filter, const String& topic)
+	{
+		TopicTrie<bool> trie;
+
+		trie.add(filter, true);
+		return trie.match(topic, [](bool) {}) > 0;
+	}
+}
@@ -51,7 +51,9 @@
 
 namespace lwiot
 {
-	MqttClient::MqttClient() : _stream(nullptr), _state(MQTT_DISCONNECTED), _buffer(MQTT_MAX_PACKET_SIZE, true)
+	MqttClient::MqttClient() : _stream(nullptr), _state(MQTT_DISCONNECTED), _buffer(MQTT_MAX_PACKET_SIZE, true),
+		_payload_remaining(0), _version(MQTT_VERSION), _reason(MQTT_RC_SUCCESS), _receive_max(UINT16_MAX),
+		_inflight(0), _alias_max(0), _alias_count(0)
 	{
 	}
 
@@ -89,32 +91,304 @@ namespace lwiot
 	}
 
 	bool MqttClient::publish(const lwiot::String &topic, const lwiot::ByteBuffer &data, bool retained)
+	{
+		return MqttClient::publish(topic, data, retained, QOS0);
+	}
+
+	bool MqttClient::publish(const lwiot::String &topic, const lwiot::ByteBuffer &data, bool retained, QoS qos,
+	                         uint16_t *id)
 	{
 		auto plength = data.count();
-		auto rv = false;
-		uint8_t header = MQTTPUBLISH;
+		uint16_t msgId = 0;
 
-		if(this->isConnected()) {
-			if(MQTT_MAX_PACKET_SIZE < MQTT_MAX_HEADER_SIZE + 2 + topic.length() + plength)
+		if(qos > QOS1 || !this->isConnected())
+			return false;
+
+		if(MQTT_MAX_PACKET_SIZE < this->packetSize(topic, plength, qos)) {
+			if(qos != QOS0 || !this->beginPublish(topic, plength, retained))
 				return false;
 
-			this->_buffer.reset();
+			this->writePayload(data.data(), plength);
+			return this->endPublish();
+		}
 
-			// Leave room in the buffer for header and variable length field
-			uint16_t length = MQTT_MAX_HEADER_SIZE;
-			length = this->write(topic, length);
+		if(qos == QOS1) {
+			/* Flow control: the server accepts at most receive maximum unacknowledged messages */
+			if(this->_version == MQTT_VERSION_5 && this->_inflight >= this->_receive_max)
+				return false;
+
+			if(++this->_nextMsgId == 0)
+				this->_nextMsgId = 1;
+
+			msgId = this->_nextMsgId;
+		}
+
+		auto length = this->prefix(this->_buffer.data(), topic, plength, retained, qos, msgId);
+
+		memcpy(this->_buffer.data() + length, data.data(), plength);
+
+		if(!this->send(this->_buffer.data(), length + plength))
+			return false;
+
+		if(qos == QOS1) {
+			this->_inflight++;
+
+			if(id)
+				*id = msgId;
+		}
+
+		return true;
+	}
+
+	bool MqttClient::publish(const lwiot::String &topic, lwiot::Stream &payload, size_t length, bool retained)
+	{
+		auto buffer = this->_buffer.data();
+
+		if(!this->beginPublish(topic, length, retained))
+			return false;
+
+		while(this->_payload_remaining > 0) {
+			size_t num = this->_payload_remaining < MQTT_MAX_PACKET_SIZE ? this->_payload_remaining : MQTT_MAX_PACKET_SIZE;
+			auto rc = payload.read(buffer, num);
+
+			if(rc <= 0 || this->writePayload(buffer, rc) != rc)
+				break;
+		}
+
+		return this->endPublish();
+	}
+
+	/*
+	 * Start a PUBLISH packet of which the payload is written by the caller using
+	 * writePayload(). Only the fixed header and the topic pass through the packet
+	 * buffer, so the payload is not bound by MQTT_MAX_PACKET_SIZE.
+	 */
+	bool MqttClient::beginPublish(const lwiot::String &topic, size_t length, bool retained)
+	{
+		auto buffer = this->_buffer.data();
+
+		if(this->_payload_remaining != 0 || !this->isConnected())
+			return false;
+
+		if(MQTT_MAX_PACKET_SIZE < this->packetSize(topic, 0, QOS0))
+			return false;
+
+		if(length > MQTT_MAX_REMAINING_LENGTH - this->packetSize(topic, 0, QOS0))
+			return false;
+
+		auto idx = this->prefix(buffer, topic, length, retained, QOS0, 0);
+
+		if(!this->send(buffer, idx))
+			return false;
+
+		this->_payload_remaining = length;
+		return true;
+	}
+
+	ssize_t MqttClient::writePayload(const void *data, size_t length)
+	{
+		if(length > this->_payload_remaining)
+			length = this->_payload_remaining;
+
+		if(!this->send(data, length))
+			return -1;
+
+		this->_payload_remaining -= length;
+		return length;
+	}
+
+	/*
+	 * The length of a publish is announced up front, so a payload that falls short
+	 * leaves the stream in an undefined state. The connection is dropped instead.
+	 */
+	bool MqttClient::endPublish()
+	{
+		if(this->_payload_remaining == 0)
+			return true;
+
+		this->_payload_remaining = 0;
+		this->_state = MQTT_CONNECTION_LOST;
+		this->_io->close();
+
+		return false;
+	}
+
+	/*
+	 * Append a QoS 0 PUBLISH packet to `output`. Topic aliases are assigned as
+	 * the packet is encoded, so encoded packets must be sent in order.
+	 */
+	size_t MqttClient::encode(ByteBuffer& output, const String& topic, const ByteBuffer& data, bool retained)
+	{
+		size_t start = output.index();
+
+		if(MQTT_MAX_PACKET_SIZE < this->packetSize(topic, 0, QOS0))
+			return 0;
+
+		auto length = this->prefix(this->_buffer.data(), topic, data.count(), retained, QOS0, 0);
+
+		output.write(this->_buffer.data(), length);
+		output.write(data.data(), data.count());
+
+		return output.index() - start;
+	}
+
+	/*
+	 * Upper bound on the size of a PUBLISH packet, including the fixed header.
+	 */
+	size_t MqttClient::packetSize(const String& topic, size_t length, QoS qos) const
+	{
+		size_t size = MQTT_MAX_HEADER_SIZE + 2 + topic.length() + length;
 
-			for(auto i = 0; i < plength; i++) {
-				this->_buffer[length++] = data[i];
+		if(qos > QOS0)
+			size += 2;
+
+		/* Property length and a topic alias */
+		if(this->_version == MQTT_VERSION_5)
+			size += 4;
+
+		return size;
+	}
+
+	/*
+	 * Write the fixed and variable header of a PUBLISH packet with a payload of
+	 * `length` bytes. Returns the number of bytes written.
+	 */
+	size_t MqttClient::prefix(uint8_t *output, const String& topic, size_t length, bool retained, QoS qos, uint16_t id)
+	{
+		size_t tl = topic.length();
+		size_t idx = 1;
+		uint16_t alias = 0;
+		bool known = false;
+
+		if(this->_version == MQTT_VERSION_5) {
+			alias = this->alias(topic, known);
+			length += alias != 0 ? 4 : 1;
+		}
+
+		/* The server already knows the alias, the topic can be left out */
+		if(known)
+			tl = 0;
+
+		length += 2 + tl + (qos > QOS0 ? 2 : 0);
+		output[0] = MQTTPUBLISH | (qos << 1) | (retained ? 1 : 0);
+		idx += MqttClient::encodeLength(output + idx, length);
+		output[idx++] = tl >> 8;
+		output[idx++] = tl & 0xFF;
+		memcpy(output + idx, topic.c_str(), tl);
+		idx += tl;
+
+		if(qos > QOS0) {
+			output[idx++] = id >> 8;
+			output[idx++] = id & 0xFF;
+		}
+
+		if(this->_version != MQTT_VERSION_5)
+			return idx;
+
+		if(alias == 0) {
+			output[idx++] = 0;
+			return idx;
+		}
+
+		output[idx++] = 3;
+		output[idx++] = MQTT_PROP_TOPIC_ALIAS;
+		output[idx++] = alias >> 8;
+		output[idx++] = alias & 0xFF;
+
+		return idx;
+	}
+
+	/*
+	 * Pick the topic alias for `topic`. Topics get an alias while the server
+	 * has aliases to spare. Once all aliases are taken, an alias is only
+	 * reassigned when its topic is cold; the hit counts of all aliases are
+	 * halved on every miss, so topics that become hot later eventually get
+	 * an alias. Returns 0 if the topic is sent without an alias; `known` is
+	 * set when the server already knows the alias.
+	 */
+	uint16_t MqttClient::alias(const String& topic, bool& known)
+	{
+		uint16_t victim = 0;
+
+		known = false;
+
+		if(this->_alias_max == 0 || topic.length() == 0)
+			return 0;
+
+		for(uint16_t idx = 0; idx < this->_alias_count; idx++) {
+			auto& entry = this->_aliases[idx];
+
+			if(entry.topic.length() != topic.length() || entry.topic != topic)
+				continue;
+
+			if(entry.hits < UINT8_MAX)
+				entry.hits++;
+
+			known = true;
+			return idx + 1;
+		}
+
+		if(this->_alias_count < this->_alias_max) {
+			victim = this->_alias_count++;
+		} else {
+			for(uint16_t idx = 1; idx < this->_alias_count; idx++) {
+				if(this->_aliases[idx].hits < this->_aliases[victim].hits)
+					victim = idx;
 			}
 
-			if(retained)
-				header |= 1;
+			if(this->_aliases[victim].hits > 1) {
+				for(uint16_t idx = 0; idx < this->_alias_count; idx++)
+					this->_aliases[idx].hits /= 2;
 
-			rv = this->write(header, length - MQTT_MAX_HEADER_SIZE);
+				return 0;
+			}
 		}
 
-		return rv;
+		this->_aliases[victim].topic = topic;
+		this->_aliases[victim].hits = 1;
+
+		return victim + 1;
+	}
+
+	size_t MqttClient::encodeLength(uint8_t *output, size_t length)
+	{
+		size_t llen = 0;
+		uint8_t digit;
+
+		do {
+			digit = length % 128;
+			length = length / 128;
+
+			if(length > 0)
+				digit |= 0x80;
+
+			output[llen++] = digit;
+		} while(length > 0);
+
+		return llen;
+	}
+
+	bool MqttClient::flush(const ByteBuffer& packets)
+	{
+		return this->send(packets.data(), packets.index());
+	}
+
+	bool MqttClient::send(const void *data, size_t length)
+	{
+		auto ptr = static_cast<const uint8_t*>(data);
+
+		while(length > 0) {
+			auto rc = this->_io->write(ptr, length);
+
+			if(rc <= 0)
+				return false;
+
+			length -= rc;
+			ptr += rc;
+		}
+
+		this->_lastOutActivity = lwiot_tick_ms();
+		return true;
 	}
 
 	bool MqttClient::subscribe(const lwiot::String &topic, lwiot::MqttClient::QoS qos)
@@ -137,6 +411,10 @@ namespace lwiot
 
 			this->_buffer[length++] = (this->_nextMsgId >> 8);
 			this->_buffer[length++] = (this->_nextMsgId & 0xFF);
+
+			if(this->_version == MQTT_VERSION_5)
+				this->_buffer[length++] = 0;
+
 			length = this->write(topic, length);
 			this->_buffer[length++] = qos;
 
@@ -162,6 +440,10 @@ namespace lwiot
 
 			this->_buffer[length++] = (this->_nextMsgId >> 8);
 			this->_buffer[length++] = (this->_nextMsgId & 0xFF);
+
+			if(this->_version == MQTT_VERSION_5)
+				this->_buffer[length++] = 0;
+
 			length = this->write(topic, length);
 			rv = write(MQTTUNSUBSCRIBE | MQTTQOS1, length - MQTT_MAX_HEADER_SIZE);
 		}
@@ -255,7 +537,8 @@ namespace lwiot
 		auto buffer = this->_buffer.data();
 		bool isPublish;
 		uint32_t multiplier = 1;
-		uint16_t length = 0;
+		uint32_t length = 0;
+		uint32_t total;
 		uint8_t digit = 0;
 		uint16_t skip = 0;
 		uint8_t start = 0;
@@ -293,31 +576,270 @@ namespace lwiot
 			skip = (buffer[*data + 1] << 8) + buffer[*data + 2];
 			start = 2;
 
+			if(this->_stream_cb && !this->_stream && *data + 1 + length > MQTT_MAX_PACKET_SIZE)
+				return this->readStream(*data, length);
+
 			if(buffer[0] & MQTTQOS1) {
 				// skip message id
 				skip += 2;
 			}
 		}
 
-		for(uint16_t i = start; i < length; i++) {
+		total = len;
+
+		for(uint32_t i = start; i < length; i++) {
 			if(!this->read(&digit))
 				return 0;
 			if(this->_stream) {
-				if(isPublish && len - *data - 2 > skip) {
+				if(isPublish && total - *data - 2 > skip) {
 					this->_stream->write(digit);
 				}
 			}
-			if(len < MQTT_MAX_PACKET_SIZE) {
-				buffer[len] = digit;
+			if(total < MQTT_MAX_PACKET_SIZE) {
+				buffer[total] = digit;
+			}
+			total++;
+		}
+
+		if(!this->_stream && total > MQTT_MAX_PACKET_SIZE) {
+			total = 0;
+		}
+
+		return total;
+	}
+
+	/*
+	 * Hand the payload of a PUBLISH packet that does not fit the packet buffer to
+	 * the stream callback, one buffer full at a time. The fixed header and the
+	 * topic length have already been read.
+	 */
+	uint16_t MqttClient::readStream(uint8_t llen, uint32_t length)
+	{
+		auto buffer = this->_buffer.data();
+		uint8_t header = buffer[0];
+		uint16_t tl = (buffer[llen + 1] << 8) + buffer[llen + 2];
+		uint32_t remaining = length - 2;
+		uint16_t msgId = 0;
+		size_t offset = 0;
+
+		if(tl > remaining || tl >= MQTT_MAX_PACKET_SIZE || !this->readFully(buffer, tl)) {
+			this->_state = MQTT_CONNECTION_LOST;
+			this->_io->close();
+			return 0;
+		}
+
+		String topic(reinterpret_cast<const char *>(buffer), tl);
+		remaining -= tl;
+
+		if((header & 0x06) == MQTTQOS1) {
+			if(remaining < 2 || !this->readFully(buffer, 2)) {
+				this->_state = MQTT_CONNECTION_LOST;
+				this->_io->close();
+				return 0;
+			}
+
+			msgId = (buffer[0] << 8) + buffer[1];
+			remaining -= 2;
+		}
+
+		if(this->_version == MQTT_VERSION_5) {
+			uint32_t plen = 0;
+			size_t idx = 0;
+			uint16_t alias = 0;
+			const String *resolved;
+
+			/* Read the property length, then the properties themselves */
+			do {
+				if(idx == 4 || remaining == 0 || !this->readFully(buffer + idx, 1)) {
+					this->_state = MQTT_CONNECTION_LOST;
+					this->_io->close();
+					return 0;
+				}
+
+				remaining--;
+			} while(buffer[idx++] & 0x80);
+
+			const uint8_t *pos = buffer;
+			mqtt_varint(&pos, buffer + idx, &plen);
+
+			if(plen > remaining || idx + plen > MQTT_MAX_PACKET_SIZE || !this->readFully(buffer + idx, plen)) {
+				this->_state = MQTT_CONNECTION_LOST;
+				this->_io->close();
+				return 0;
+			}
+
+			remaining -= plen;
+			pos = buffer;
+
+			if(!this->properties(pos, buffer + idx + plen, &alias) ||
+			   !this->resolve(reinterpret_cast<const uint8_t *>(topic.c_str()), tl, alias, resolved)) {
+				this->_state = MQTT_CONNECTION_LOST;
+				this->_io->close();
+				return 0;
+			}
+
+			if(resolved != nullptr)
+				topic = *resolved;
+		}
+
+		auto total = remaining;
+
+		while(remaining > 0) {
+			size_t num = remaining < MQTT_MAX_PACKET_SIZE ? remaining : MQTT_MAX_PACKET_SIZE;
+			auto rc = this->_io->read(buffer, num);
+
+			if(rc <= 0) {
+				this->_state = MQTT_CONNECTION_LOST;
+				this->_io->close();
+				return 0;
+			}
+
+			this->_stream_cb(topic, buffer, rc, offset, total);
+			offset += rc;
+			remaining -= rc;
+		}
+
+		this->_lastInActivity = lwiot_tick_ms();
+
+		if((header & 0x06) == MQTTQOS1) {
+			uint8_t puback[] = { MQTTPUBACK, 2, static_cast<uint8_t>(msgId >> 8), static_cast<uint8_t>(msgId & 0xFF) };
+			this->send(puback, sizeof(puback));
+		}
+
+		return 0;
+	}
+
+	/*
+	 * Hand a PUBLISH packet in the packet buffer to the message callback and
+	 * acknowledge it when it was sent with QoS 1.
+	 */
+	void MqttClient::dispatch(uint8_t llen, uint16_t length)
+	{
+		auto buffer = this->_buffer.data();
+		const uint8_t *pos = buffer + llen + 3;
+		const uint8_t *end = buffer + length;
+		const String *topic = nullptr;
+		uint16_t tl = (buffer[llen + 1] << 8) + buffer[llen + 2];
+		uint16_t msgId = 0;
+		uint16_t alias = 0;
+		bool qos = (buffer[0] & 0x06) == MQTTQOS1;
+
+		if(pos + tl + (qos ? 2 : 0) > end)
+			return;
+
+		const uint8_t *name = pos;
+		pos += tl;
+
+		if(qos) {
+			msgId = (pos[0] << 8) + pos[1];
+			pos += 2;
+		}
+
+		if(this->_version == MQTT_VERSION_5) {
+			if(!this->properties(pos, end, &alias) || !this->resolve(name, tl, alias, topic)) {
+				this->_reason = MQTT_RC_TOPIC_ALIAS_INVALID;
+				this->_state = MQTT_CONNECTION_LOST;
+				this->_io->close();
+				return;
+			}
+		}
+
+		if(this->_cb) {
+			ByteBuffer buf(end - pos);
+			buf.write(pos, end - pos);
+
+			if(topic != nullptr)
+				this->_cb(*topic, buf);
+			else
+				this->_cb(String(reinterpret_cast<const char *>(name), tl), buf);
+		}
+
+		if(qos) {
+			uint8_t puback[] = { MQTTPUBACK, 2, static_cast<uint8_t>(msgId >> 8), static_cast<uint8_t>(msgId & 0xFF) };
+			this->send(puback, sizeof(puback));
+		}
+	}
+
+	/*
+	 * Walk an MQTT 5 property list, advancing `pos` past it. Properties the
+	 * client does not act on are skipped.
+	 */
+	bool MqttClient::properties(const uint8_t *& pos, const uint8_t *end, uint16_t *alias)
+	{
+		const uint8_t *data;
+		uint32_t length, value;
+		size_t size;
+		uint8_t id;
+
+		if(!mqtt_varint(&pos, end, &length) || length > static_cast<uint32_t>(end - pos))
+			return false;
+
+		end = pos + length;
+
+		while(pos < end) {
+			if(!mqtt_property(&pos, end, &id, &value, &data, &size))
+				return false;
+
+			switch(id) {
+			case MQTT_PROP_RECEIVE_MAXIMUM:
+				if(value == 0)
+					return false;
+
+				this->_receive_max = value;
+				break;
+
+			case MQTT_PROP_TOPIC_ALIAS_MAXIMUM:
+				this->_alias_max = value < MaxTopicAliases ? value : MaxTopicAliases;
+				break;
+
+			case MQTT_PROP_TOPIC_ALIAS:
+				if(alias == nullptr || value == 0 || value > MaxTopicAliases)
+					return false;
+
+				*alias = value;
+				break;
+
+			default:
+				break;
 			}
-			len++;
 		}
 
-		if(!this->_stream && len > MQTT_MAX_PACKET_SIZE) {
-			len = 0;
+		return true;
+	}
+
+	/*
+	 * Map a received topic and topic alias to the topic of the message. A
+	 * topic with an alias (re)defines that alias, an empty topic refers to it.
+	 */
+	bool MqttClient::resolve(const uint8_t *topic, uint16_t length, uint16_t alias, const String *& resolved)
+	{
+		resolved = nullptr;
+
+		if(alias == 0)
+			return length != 0;
+
+		auto& entry = this->_inbound_aliases[alias - 1];
+
+		if(length != 0)
+			entry = String(reinterpret_cast<const char *>(topic), length);
+
+		resolved = &entry;
+		return entry.length() != 0;
+	}
+
+	bool MqttClient::readFully(uint8_t *result, size_t length)
+	{
+		while(length > 0) {
+			auto rc = this->_io->read(result, length);
+
+			if(rc <= 0)
+				return false;
+
+			length -= rc;
+			result += rc;
 		}
 
-		return len;
+		return true;
 	}
 
 	bool MqttClient::connect(const lwiot::String &id, const lwiot::String &user, const lwiot::String &pass)
@@ -347,7 +869,7 @@ namespace lwiot
 				uint8_t d[9] = {0x00,0x06,'M','Q','I','s','d','p', MQTT_VERSION};
 #define MQTT_HEADER_VERSION_LENGTH 9
 #elif MQTT_VERSION == MQTT_VERSION_3_1_1
-				uint8_t d[7] = {0x00, 0x04, 'M', 'Q', 'T', 'T', MQTT_VERSION};
+				uint8_t d[7] = {0x00, 0x04, 'M', 'Q', 'T', 'T', this->_version};
 #define MQTT_HEADER_VERSION_LENGTH 7
 #endif
 				for(j = 0; j < MQTT_HEADER_VERSION_LENGTH; j++) {
@@ -376,9 +898,20 @@ namespace lwiot
 				this->_buffer[length++] = ((MQTT_KEEPALIVE) >> 8);
 				this->_buffer[length++] = ((MQTT_KEEPALIVE) & 0xFF);
 
+				if(this->_version == MQTT_VERSION_5) {
+					/* Accept topic aliases from the server */
+					this->_buffer[length++] = 3;
+					this->_buffer[length++] = MQTT_PROP_TOPIC_ALIAS_MAXIMUM;
+					this->_buffer[length++] = MaxTopicAliases >> 8;
+					this->_buffer[length++] = MaxTopicAliases & 0xFF;
+				}
+
 				CHECK_STRING_LENGTH(length, id)
 				length = this->write(id, length);
 				if(willTopic.length() > 0) {
+					if(this->_version == MQTT_VERSION_5)
+						this->_buffer[length++] = 0;
+
 					CHECK_STRING_LENGTH(length, willTopic)
 					length = this->write(willTopic, length);
 					CHECK_STRING_LENGTH(length, willMessage)
@@ -410,14 +943,28 @@ namespace lwiot
 				uint8_t llen;
 				uint16_t len = this->readPacket(&llen);
 
-				if(len == 4) {
-					if(this->_buffer[3] == 0) {
+				/* Topic aliases and flow control state only live as long as the connection */
+				this->_receive_max = UINT16_MAX;
+				this->_inflight = 0;
+				this->_alias_max = 0;
+				this->_alias_count = 0;
+
+				for(auto& topic : this->_inbound_aliases)
+					topic = String();
+
+				if(len >= 4 && (this->_buffer[0] & 0xF0) == MQTTCONNACK) {
+					const uint8_t *pos = this->_buffer.data() + llen + 3;
+					const uint8_t *end = this->_buffer.data() + len;
+
+					this->_reason = this->_buffer[llen + 2];
+
+					if(this->_reason == 0 && (this->_version != MQTT_VERSION_5 || this->properties(pos, end, nullptr))) {
 						this->_lastInActivity = lwiot_tick_ms();
 						this->_pingOutstanding = false;
 						_state = MQTT_CONNECTED;
 						return true;
 					} else {
-						_state = this->_buffer[3];
+						_state = this->_reason != 0 ? this->_reason : MQTT_CONNECT_FAILED;
 					}
 				}
 
@@ -435,24 +982,11 @@ namespace lwiot
 	size_t MqttClient::build(uint8_t header, uint16_t length) const
 	{
 		uint8_t lengthbuf[4];
-		uint8_t digit;
-		uint8_t pos = 0, llen = 0;
-		uint16_t l = length;
-
-		do {
-			digit = l % 128;
-			l = l / 128;
-
-			if(l > 0)
-				digit |= 0x80;
-
-			lengthbuf[pos++] = digit;
-			llen++;
-		} while(l > 0);
+		size_t llen = MqttClient::encodeLength(lengthbuf, length);
 
 		this->_buffer[4 - llen] = header;
 
-		for(int i = 0; i < llen; i++) {
+		for(size_t i = 0; i < llen; i++) {
 			this->_buffer[MQTT_MAX_HEADER_SIZE - llen + i] = lengthbuf[i];
 		}
 
@@ -487,47 +1021,36 @@ namespace lwiot
 			uint8_t llen;
 			uint16_t len = readPacket(&llen);
 			uint16_t msgId = 0;
-			uint8_t *payload;
 
 			if(len > 0) {
 				this->_lastInActivity = t;
 				uint8_t type = this->_buffer[0] & 0xF0;
 				if(type == MQTTPUBLISH) {
-					if(this->_cb) {
-						uint16_t tl = (this->_buffer[llen + 1] << 8) + this->_buffer[llen + 2];
-
-						memmove(this->_buffer.data() + llen + 2, this->_buffer.data() + llen + 3, tl);
-						this->_buffer[llen + 2 + tl] = 0;
-						char *topic = (char *) this->_buffer.data() + llen + 2;
-
-						if((this->_buffer[0] & 0x06) == MQTTQOS1) {
-							msgId = (this->_buffer[llen + 3 + tl] << 8) + this->_buffer[llen + 3 + tl + 1];
-							payload = this->_buffer.data() + llen + 3 + tl + 2;
-							ByteBuffer buf(len - llen - 3 - tl - 2);
-							buf.write(payload, len - llen - 3 - tl - 2);
-
-							this->_cb(topic, buf);
-
-							this->_buffer[0] = MQTTPUBACK;
-							this->_buffer[1] = 2;
-							this->_buffer[2] = (msgId >> 8);
-							this->_buffer[3] = (msgId & 0xFF);
-							this->_io->write(this->_buffer.data(), 4);
-							this->_lastOutActivity = t;
-
-						} else {
-							payload = this->_buffer.data() + llen + 3 + tl;
-							ByteBuffer buf(len - llen - 3 - tl);
-							buf.write(payload, len - llen - 3 - tl);
-							this->_cb(topic, buf);
-						}
-					}
+					this->dispatch(llen, len);
 				} else if(type == MQTTPINGREQ) {
 					this->_buffer[0] = MQTTPINGRESP;
 					this->_buffer[1] = 0;
 					this->_io->write(this->_buffer.data(), 2);
 				} else if(type == MQTTPINGRESP) {
 					this->_pingOutstanding = false;
+				} else if(type == MQTTPUBACK) {
+					msgId = (this->_buffer[llen + 1] << 8) + this->_buffer[llen + 2];
+					this->_reason = len > llen + 3 ? this->_buffer[llen + 3] : MQTT_RC_SUCCESS;
+
+					if(this->_inflight > 0)
+						this->_inflight--;
+
+					if(this->_ack_cb)
+						this->_ack_cb(msgId);
+				} else if(type == MQTTSUBACK) {
+					/* The return code of the last filter is the last byte in both protocol versions */
+					this->_reason = this->_buffer[len - 1];
+				} else if(type == MQTTDISCONNECT) {
+					this->_reason = len > llen + 1 ? this->_buffer[llen + 1] : MQTT_RC_SUCCESS;
+					this->_state = MQTT_CONNECTION_LOST;
+					this->_io->close();
+
+					return false;
 				}
 			} else if(!this->isConnected()) {
 				return false;
@@ -537,6 +1060,49 @@ namespace lwiot
 		return true;
 	}
 
+	/*
+	 * Block until the connection becomes readable or `tmo` milliseconds have
+	 * passed. Only the socket is touched, so the caller does not have to
+	 * serialize this against other client operations.
+	 */
+	bool MqttClient::wait(int tmo)
+	{
+		return this->_io->wait(tmo);
+	}
+
+	/*
+	 * A connection that is still readable without any data pending has been
+	 * closed by the peer.
+	 */
+	bool MqttClient::hangup()
+	{
+		if(!this->isConnected() || this->_io->available() != 0)
+			return false;
+
+		if(!this->_io->wait(0))
+			return false;
+
+		this->_state = MQTT_CONNECTION_LOST;
+		this->_io->close();
+
+		return true;
+	}
+
+	/*
+	 * Time in milliseconds until loop() has to run to keep the connection alive.
+	 */
+	int MqttClient::keepAliveTimeout() const
+	{
+		unsigned long t = lwiot_tick_ms();
+		unsigned long last = this->_lastInActivity < this->_lastOutActivity ? this->_lastInActivity : this->_lastOutActivity;
+		unsigned long elapsed = t - last;
+
+		if(elapsed > MQTT_KEEPALIVE * 1000UL)
+			return 0;
+
+		return MQTT_KEEPALIVE * 1000UL - elapsed + 1;
+	}
+
 	void MqttClient::disconnect()
 	{
 		uint8_t buf[] = {MQTTDISCONNECT, 0};
@@ -551,6 +1117,9 @@ namespace lwiot
 	{
 		bool rc;
 
+		if(!this->_io)
+			return false;
+
 		rc = this->_io->connected();
 
 		if(!rc && this->_state == MQTT_CONNECTED) {
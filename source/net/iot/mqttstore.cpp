@@ -0,0 +1,320 @@
+/*
+ * MQTT store-and-forward message log.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/io/file.h>
+#include <lwiot/network/mqttstore.h>
+
+namespace lwiot
+{
+	static inline void put16(uint8_t *output, uint16_t value)
+	{
+		output[0] = value & 0xFF;
+		output[1] = value >> 8;
+	}
+
+	static inline void put32(uint8_t *output, uint32_t value)
+	{
+		put16(output, value & 0xFFFF);
+		put16(output + 2, value >> 16);
+	}
+
+	static inline uint16_t get16(const uint8_t *input)
+	{
+		return input[0] | (input[1] << 8);
+	}
+
+	static inline uint32_t get32(const uint8_t *input)
+	{
+		return get16(input) | (static_cast<uint32_t>(get16(input + 2)) << 16);
+	}
+
+	MqttFileStore::MqttFileStore(const String& path, size_t capacity) :
+		_capacity(capacity), _head(0), _tail(0), _count(0), _cursor(0), _sent(0)
+	{
+		this->_file.reset(new File(path, FileMode::ReadWriteNoCreate));
+
+		if(*this->_file && this->load())
+			return;
+
+		this->_file.reset(new File(path, FileMode::ReadWrite));
+
+		if(*this->_file)
+			this->clear();
+	}
+
+	MqttFileStore::operator bool() const
+	{
+		return static_cast<bool>(*this->_file);
+	}
+
+	size_t MqttFileStore::count() const
+	{
+		return this->_count;
+	}
+
+	size_t MqttFileStore::pending() const
+	{
+		return this->_count - this->_sent;
+	}
+
+	void MqttFileStore::rewind()
+	{
+		this->_cursor = this->_head;
+		this->_sent = 0;
+	}
+
+	void MqttFileStore::clear()
+	{
+		this->_head = this->_tail = this->_count = 0;
+		this->rewind();
+		this->sync();
+	}
+
+	bool MqttFileStore::append(const String& topic, const ByteBuffer& payload, bool retained)
+	{
+		uint8_t header[RecordHeaderSize];
+		size_t size = RecordHeaderSize + topic.length() + payload.count();
+		uint32_t pos, crc;
+		bool wrap = false;
+
+		if(!*this || size > this->_capacity || topic.length() > UINT16_MAX || payload.count() > UINT16_MAX)
+			return false;
+
+		/* Records handed out by next() await an acknowledgement, they are never evicted */
+		while(!this->reserve(size, pos, wrap)) {
+			if(this->_sent > 0 || !this->pop())
+				return false;
+		}
+
+		put16(header + 4, topic.length());
+		put16(header + 6, payload.count());
+		header[8] = retained ? FlagRetain : 0;
+
+		crc = crc32(0, header + 4, RecordHeaderSize - 4);
+		crc = crc32(crc, topic.c_str(), topic.length());
+		crc = crc32(crc, payload.data(), payload.count());
+		put32(header, crc);
+
+		auto offset = HeaderSize + pos;
+
+		if(!this->write(offset, header, sizeof(header)) ||
+		   !this->write(offset + sizeof(header), topic.c_str(), topic.length()) ||
+		   !this->write(offset + sizeof(header) + topic.length(), payload.data(), payload.count()))
+			return false;
+
+		if(wrap && this->_capacity - this->_tail >= RecordHeaderSize) {
+			memset(header, 0, sizeof(header));
+			header[8] = FlagWrap;
+			this->write(HeaderSize + this->_tail, header, sizeof(header));
+		}
+
+		this->_tail = pos + size;
+		this->_count++;
+
+		return this->sync();
+	}
+
+	bool MqttFileStore::next(String& topic, ByteBuffer& payload, bool& retained)
+	{
+		uint8_t header[RecordHeaderSize];
+		uint32_t pos = this->_cursor;
+
+		if(this->pending() == 0 || !this->locate(pos, header))
+			return false;
+
+		size_t tl = get16(header + 4);
+		size_t pl = get16(header + 6);
+		ByteBuffer record(tl + pl, true);
+
+		if(!this->read(HeaderSize + pos + sizeof(header), record.data(), tl + pl))
+			return false;
+
+		auto crc = crc32(0, header + 4, RecordHeaderSize - 4);
+		crc = crc32(crc, record.data(), tl + pl);
+
+		if(crc != get32(header)) {
+			print_dbg("MQTT store: corrupt record at %u, dropping log\n", pos);
+			this->clear();
+			return false;
+		}
+
+		topic = String(reinterpret_cast<const char *>(record.data()), tl);
+		payload = ByteBuffer(pl, true);
+		payload.write(record.data() + tl, pl);
+		retained = (header[8] & FlagRetain) != 0;
+
+		this->_cursor = pos + sizeof(header) + tl + pl;
+		this->_sent++;
+
+		return true;
+	}
+
+	bool MqttFileStore::pop()
+	{
+		uint8_t header[RecordHeaderSize];
+		uint32_t pos = this->_head;
+
+		if(this->_count == 0 || !this->locate(pos, header))
+			return false;
+
+		this->_head = pos + sizeof(header) + get16(header + 4) + get16(header + 6);
+		this->_count--;
+
+		if(this->_sent > 0)
+			this->_sent--;
+		else
+			this->_cursor = this->_head;
+
+		if(this->_count == 0) {
+			this->_head = this->_tail = 0;
+			this->rewind();
+		}
+
+		return this->sync();
+	}
+
+	/*
+	 * Find room for a record of `size` bytes. Records are contiguous, so when the
+	 * space after the tail is too small the log wraps to the start of the file.
+	 */
+	bool MqttFileStore::reserve(size_t size, uint32_t& pos, bool& wrap) const
+	{
+		wrap = false;
+
+		if(this->_count == 0) {
+			pos = 0;
+			return true;
+		}
+
+		if(this->_tail > this->_head) {
+			if(this->_capacity - this->_tail >= size) {
+				pos = this->_tail;
+				return true;
+			}
+
+			if(this->_head >= size) {
+				pos = 0;
+				wrap = true;
+				return true;
+			}
+
+			return false;
+		}
+
+		if(this->_head - this->_tail >= size) {
+			pos = this->_tail;
+			return true;
+		}
+
+		return false;
+	}
+
+	/*
+	 * Read the header of the record at `pos`, following the wrap marker or a
+	 * tail gap too small to hold a record header.
+	 */
+	bool MqttFileStore::locate(uint32_t& pos, uint8_t *header)
+	{
+		if(this->_capacity - pos < RecordHeaderSize)
+			pos = 0;
+
+		if(!this->read(HeaderSize + pos, header, RecordHeaderSize))
+			return false;
+
+		if((header[8] & FlagWrap) == 0)
+			return true;
+
+		pos = 0;
+		return this->read(HeaderSize, header, RecordHeaderSize);
+	}
+
+	bool MqttFileStore::load()
+	{
+		uint8_t header[HeaderSize];
+
+		if(!this->read(0, header, sizeof(header)))
+			return false;
+
+		if(get32(header) != Magic || get32(header + 16) != crc32(0, header, 16))
+			return false;
+
+		this->_head = get32(header + 4);
+		this->_tail = get32(header + 8);
+		this->_count = get32(header + 12);
+
+		if(this->_head > this->_capacity || this->_tail > this->_capacity)
+			return false;
+
+		this->rewind();
+		return true;
+	}
+
+	bool MqttFileStore::sync()
+	{
+		uint8_t header[HeaderSize];
+
+		put32(header, Magic);
+		put32(header + 4, this->_head);
+		put32(header + 8, this->_tail);
+		put32(header + 12, this->_count);
+		put32(header + 16, crc32(0, header, 16));
+
+		if(!this->write(0, header, sizeof(header)))
+			return false;
+
+		return this->_file->flush();
+	}
+
+	/* Record positions are relative to the end of the log header, file offsets are not */
+	bool MqttFileStore::read(size_t offset, void *data, size_t length)
+	{
+		if(length == 0)
+			return true;
+
+		if(!this->_file->seek(offset))
+			return false;
+
+		return this->_file->read(data, length) == static_cast<ssize_t>(length);
+	}
+
+	bool MqttFileStore::write(size_t offset, const void *data, size_t length)
+	{
+		if(length == 0)
+			return true;
+
+		if(!this->_file->seek(offset))
+			return false;
+
+		return this->_file->write(data, length) == static_cast<ssize_t>(length);
+	}
+
+	uint32_t MqttFileStore::crc32(uint32_t crc, const void *data, size_t length)
+	{
+		static const uint32_t table[16] = {
+			0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+			0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+		};
+		auto bytes = static_cast<const uint8_t *>(data);
+
+		crc = ~crc;
+
+		for(size_t idx = 0; idx < length; idx++) {
+			crc = table[(crc ^ bytes[idx]) & 0x0F] ^ (crc >> 4);
+			crc = table[(crc ^ (bytes[idx] >> 4)) & 0x0F] ^ (crc >> 4);
+		}
+
+		return ~crc;
+	}
+}
@@ -4,13 +4,22 @@ elseif(WIN32)
 	SET(SOCKETS net/sockets/win32.c)
 endif()
 
+if(HAVE_UNISTD_H)
+	SET(MQTT_STORE net/iot/mqttstore.cpp)
+endif()
+
 SET(NET_SOURCES
 	${SOCKETS}
 	net/tcp/tcpclient.cpp
 	net/tcp/sockettcpclient.cpp
 	net/tcp/tcpserver.cpp
 	net/tcp/sockettcpserver.cpp
+	net/tcp/shardedtcpserver.cpp
 	net/tcp/securetcpclient.cpp
+	net/tcp/tlssessioncache.cpp
+	net/tcp/tlsconfig.cpp
+	net/tcp/loopbacktcpclient.cpp
+	net/tcp/loopbacktcpserver.cpp
 
 	net/udp/udpclient.cpp
 	net/udp/udpserver.cpp
@@ -18,11 +27,16 @@ SET(NET_SOURCES
 	net/udp/socketudpserver.cpp
 	net/udp/dnsserver.cpp
 	net/udp/dnsclient.cpp
+	net/udp/loopbackudpclient.cpp
+	net/udp/loopbackudpserver.cpp
 
 	net/util/base64.c
+	net/util/base64codec.cpp
 	net/util/captiveportal.cpp
+	net/util/dnsmessage.cpp
 	net/util/ipaddress.cpp
 	net/util/ntpclient.cpp
+	net/util/loopbacknetwork.cpp
 
 	net/http/httpserver.cpp
 	net/http/mimetable.cpp
@@ -34,4 +48,10 @@ SET(NET_SOURCES
 
 	net/iot/mqttclient.cpp
 	net/iot/asyncmqttclient.cpp
+	net/iot/mqttbroker.cpp
+	net/iot/coap.cpp
+	net/iot/coapserver.cpp
+	net/iot/coapclient.cpp
+
+	${MQTT_STORE}
 )
@@ -5,6 +5,10 @@
  * @email  dev@bietje.net
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "unix_sockets.h"
 
 #include <stdlib.h>
@@ -18,6 +22,7 @@
 #include <lwiot/network/stdnet.h>
 
 #include <sys/ioctl.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <netdb.h>
 #include <arpa/inet.h>
@@ -28,6 +33,13 @@
 #define CONFIG_CLIENT_QUEUE_LENGTH 10
 #endif
 
+/* Server sockets are not inherited by child processes */
+#ifdef SOCK_CLOEXEC
+#define SERVER_SOCKET_FLAGS SOCK_CLOEXEC
+#else
+#define SERVER_SOCKET_FLAGS 0
+#endif
+
 void socket_set_timeout(socket_t* sock, time_t tmo)
 {
 	struct timeval timeout;
@@ -39,6 +51,23 @@ void socket_set_timeout(socket_t* sock, time_t tmo)
 	setsockopt(*sock, SOL_SOCKET, SO_SNDTIMEO, (char*)&timeout, sizeof(timeout));
 }
 
+/*
+ * Block until `sock' is readable, the peer has hung up or `tmo' milliseconds
+ * have passed. Returns false on timeout.
+ */
+bool socket_wait(socket_t* sock, int tmo)
+{
+	struct pollfd fds;
+
+	assert(sock);
+
+	fds.fd = *sock;
+	fds.events = POLLIN;
+	fds.revents = 0;
+
+	return poll(&fds, 1, tmo) > 0;
+}
+
 static bool ip4_connect(socket_t* sock, remote_addr_t* addr)
 {
 	struct sockaddr_in sockaddr;
@@ -214,9 +243,9 @@ socket_t* server_socket_create(socket_type_t type, bool ipv6)
 		domain = PF_INET;
 
 	if(type == SOCKET_DGRAM) {
-		fd = socket(domain, SOCK_DGRAM, 0);
+		fd = socket(domain, SOCK_DGRAM | SERVER_SOCKET_FLAGS, 0);
 	} else {
-		fd = socket(domain, SOCK_STREAM, 0);
+		fd = socket(domain, SOCK_STREAM | SERVER_SOCKET_FLAGS, 0);
 	}
 
 	if(fd < 0) {
@@ -313,23 +342,49 @@ bool server_socket_bind(socket_t* sock, bind_addr_t addr, uint16_t port)
 	}
 }
 
-bool server_socket_listen(socket_t *socket)
+bool server_socket_listen_backlog(socket_t *socket, int backlog)
 {
 	int rv;
 
 	assert(socket);
-	rv = listen(*socket, CONFIG_CLIENT_QUEUE_LENGTH);
+	rv = listen(*socket, backlog);
 
 	return rv < 0 ? false : true;
 }
 
+bool server_socket_listen(socket_t *socket)
+{
+	return server_socket_listen_backlog(socket, CONFIG_CLIENT_QUEUE_LENGTH);
+}
+
+/*
+ * Allow other sockets to bind to the same port. The kernel spreads incoming
+ * connections over all listening sockets bound with this option.
+ */
+bool server_socket_reuse_port(socket_t *socket)
+{
+#ifdef SO_REUSEPORT
+	int enable = 1;
+
+	assert(socket);
+	return setsockopt(*socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == 0;
+#else
+	return false;
+#endif
+}
+
 socket_t* server_socket_accept(socket_t* socket)
 {
 	int sock;
 	socket_t *client;
 
 	assert(socket);
+
+#ifdef SOCK_CLOEXEC
+	sock = accept4(*socket, NULL, NULL, SOCK_CLOEXEC);
+#else
 	sock = accept(*socket, NULL, NULL);
+#endif
 
 	if(sock < 0)
 		return NULL;
@@ -85,6 +85,22 @@ void socket_set_timeout(socket_t *sock, int tmo)
 	setsockopt(*sock, SOL_SOCKET, SO_RCVTIMEO, (char *) &tmo, sizeof(int));
 }
 
+bool socket_wait(socket_t *sock, int tmo)
+{
+	struct timeval timeout;
+	fd_set fds;
+
+	assert(sock);
+
+	FD_ZERO(&fds);
+	FD_SET(*sock, &fds);
+
+	timeout.tv_sec = tmo / 1000;
+	timeout.tv_usec = (tmo % 1000) * 1000;
+
+	return select(0, &fds, NULL, NULL, &timeout) > 0;
+}
+
 ssize_t tcp_socket_send(socket_t* socket, const void* data, size_t length)
 {
 	int fd;
@@ -309,16 +325,27 @@ bool server_socket_bind(socket_t* sock, bind_addr_t addr, uint16_t port)
 	}
 }
 
-bool server_socket_listen(socket_t *socket)
+bool server_socket_listen_backlog(socket_t *socket, int backlog)
 {
 	int rv;
 
 	assert(socket);
-	rv = listen(*socket, CONFIG_CLIENT_QUEUE_LENGTH);
+	rv = listen(*socket, backlog);
 
 	return rv < 0 ? false : true;
 }
 
+bool server_socket_listen(socket_t *socket)
+{
+	return server_socket_listen_backlog(socket, CONFIG_CLIENT_QUEUE_LENGTH);
+}
+
+/* Winsock has no equivalent of SO_REUSEPORT load balancing */
+bool server_socket_reuse_port(socket_t *socket)
+{
+	return false;
+}
+
 socket_t* server_socket_accept(socket_t* socket)
 {
 	int sock;
@@ -0,0 +1,137 @@
+/*
+ * In-process loopback TCP client.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/log.h>
+#include <lwiot/error.h>
+#include <lwiot/stl/string.h>
+
+#include <lwiot/network/stdnet.h>
+#include <lwiot/network/loopbacknetwork.h>
+#include <lwiot/network/loopbacktcpclient.h>
+
+namespace lwiot
+{
+	LoopbackTcpClient::LoopbackTcpClient(LoopbackNetwork& network) :
+		TcpClient(), _network(network), _input(nullptr), _output(nullptr)
+	{
+	}
+
+	LoopbackTcpClient::LoopbackTcpClient(LoopbackNetwork& network, const IPAddress& addr, uint16_t port) :
+		TcpClient(), _network(network), _input(nullptr), _output(nullptr)
+	{
+		this->connect(addr, port);
+	}
+
+	LoopbackTcpClient::LoopbackTcpClient(LoopbackNetwork& network, const SharedPointer<LoopbackConnection>& connection,
+	                                     bool server) : TcpClient(), _network(network), _connection(connection),
+	                                     _input(nullptr), _output(nullptr)
+	{
+		this->attach(server);
+	}
+
+	LoopbackTcpClient::~LoopbackTcpClient()
+	{
+		this->close();
+	}
+
+	LoopbackTcpClient::operator bool() const
+	{
+		return this->connected();
+	}
+
+	bool LoopbackTcpClient::connected() const
+	{
+		return this->_input != nullptr && !this->_input->drained();
+	}
+
+	size_t LoopbackTcpClient::available() const
+	{
+		if(this->_input == nullptr)
+			return 0;
+
+		return this->_input->available();
+	}
+
+	ssize_t LoopbackTcpClient::read(void *output, const size_t& length)
+	{
+		if(this->_input == nullptr)
+			return -EINVALID;
+
+		return this->_input->read(output, length, nullptr, this->_timeout * 1000);
+	}
+
+	ssize_t LoopbackTcpClient::write(const void *bytes, const size_t& length)
+	{
+		if(this->_output == nullptr)
+			return -EINVALID;
+
+		return this->_output->write(bytes, length, this->_local, this->_timeout * 1000);
+	}
+
+	bool LoopbackTcpClient::connect(const IPAddress& addr, uint16_t port)
+	{
+		this->close();
+		this->_connection = this->_network.connect(addr, to_netorders(port));
+
+		if(this->_connection.get() == nullptr)
+			return false;
+
+		this->attach(false);
+		return true;
+	}
+
+	bool LoopbackTcpClient::connect(const String& host, uint16_t port)
+	{
+		/* Nothing to resolve in-process, the host has to be an address */
+		return this->connect(IPAddress::fromString(host), port);
+	}
+
+	void LoopbackTcpClient::close()
+	{
+		if(this->_connection.get() == nullptr)
+			return;
+
+		/* The peer can still read what was sent before the close */
+		this->_output->close();
+		this->_input->close();
+
+		this->_input = nullptr;
+		this->_output = nullptr;
+		this->_connection.reset();
+	}
+
+	bool LoopbackTcpClient::wait(int tmo)
+	{
+		if(this->_input == nullptr)
+			return false;
+
+		return this->_input->wait(tmo);
+	}
+
+	void LoopbackTcpClient::attach(bool server)
+	{
+		auto connection = this->_connection.get();
+
+		if(server) {
+			this->_input = &connection->upstream;
+			this->_output = &connection->downstream;
+			this->_local = connection->server;
+			this->_remote_addr = IPAddress(connection->client);
+			this->_remote_port = connection->client.port;
+		} else {
+			this->_input = &connection->downstream;
+			this->_output = &connection->upstream;
+			this->_local = connection->client;
+			this->_remote_addr = IPAddress(connection->server);
+			this->_remote_port = connection->server.port;
+		}
+	}
+}
@@ -0,0 +1,163 @@
+/*
+ * In-process loopback TCP server.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/log.h>
+#include <lwiot/scopedlock.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/loopbacknetwork.h>
+#include <lwiot/network/loopbacktcpclient.h>
+#include <lwiot/network/loopbacktcpserver.h>
+
+#define MAX_WAIT_SLICE 5
+
+namespace lwiot
+{
+	LoopbackTcpServer::LoopbackTcpServer(LoopbackNetwork& network) :
+		TcpServer(), _network(network), _lock(false), _listening(false), _timeout(0), _backlog(BacklogSize)
+	{
+	}
+
+	LoopbackTcpServer::LoopbackTcpServer(LoopbackNetwork& network, BindAddress addr, uint16_t port) :
+		TcpServer(IPAddress::fromBindAddress(addr), port), _network(network), _lock(false), _listening(false),
+		_timeout(0), _backlog(BacklogSize)
+	{
+	}
+
+	LoopbackTcpServer::LoopbackTcpServer(LoopbackNetwork& network, const IPAddress& addr, uint16_t port) :
+		TcpServer(addr, port), _network(network), _lock(false), _listening(false), _timeout(0), _backlog(BacklogSize)
+	{
+	}
+
+	LoopbackTcpServer::~LoopbackTcpServer()
+	{
+		this->close();
+	}
+
+	bool LoopbackTcpServer::bind() const
+	{
+		ScopedLock lock(this->_lock);
+
+		if(this->_listening)
+			return true;
+
+		/* The network only hands out connections, it never changes the server */
+		auto self = const_cast<LoopbackTcpServer*>(this);
+
+		if(!this->_network.listen(self, this->_bind_addr, this->_bind_port)) {
+			print_dbg("Loopback address already in use!\n");
+			return false;
+		}
+
+		this->_listening = true;
+		return true;
+	}
+
+	bool LoopbackTcpServer::bind(BindAddress addr, uint16_t port)
+	{
+		return this->bind(IPAddress::fromBindAddress(addr), port);
+	}
+
+	bool LoopbackTcpServer::bind(const IPAddress& addr, uint16_t port)
+	{
+		this->close();
+		TcpServer::bind(addr, port);
+
+		return this->bind();
+	}
+
+	void LoopbackTcpServer::connect()
+	{
+	}
+
+	void LoopbackTcpServer::close()
+	{
+		ScopedLock lock(this->_lock);
+
+		if(!this->_listening)
+			return;
+
+		this->_network.unlisten(this);
+		this->_listening = false;
+
+		/* Connections nobody accepted are reset */
+		for(auto& connection : this->_pending) {
+			connection->upstream.close();
+			connection->downstream.close();
+		}
+
+		this->_pending.clear();
+	}
+
+	void LoopbackTcpServer::setTimeout(time_t seconds)
+	{
+		ScopedLock lock(this->_lock);
+		this->_timeout = seconds;
+	}
+
+	void LoopbackTcpServer::setBacklog(int backlog)
+	{
+		ScopedLock lock(this->_lock);
+		this->_backlog = backlog > 0 ? backlog : 1;
+	}
+
+	bool LoopbackTcpServer::wait(int tmo)
+	{
+		ScopedLock lock(this->_lock);
+		auto start = lwiot_tick_ms();
+
+		while(this->_pending.size() == 0) {
+			auto elapsed = lwiot_tick_ms() - start;
+
+			if(elapsed >= tmo)
+				return false;
+
+			this->_event.wait(lock, tmo - elapsed < MAX_WAIT_SLICE ? tmo - elapsed : MAX_WAIT_SLICE);
+		}
+
+		return true;
+	}
+
+	bool LoopbackTcpServer::offer(const SharedPointer<LoopbackConnection>& connection)
+	{
+		ScopedLock lock(this->_lock);
+
+		if(!this->_listening || this->_pending.size() >= this->_backlog)
+			return false;
+
+		this->_pending.push_back(connection);
+		this->_event.signal();
+
+		return true;
+	}
+
+	UniquePointer<TcpClient> LoopbackTcpServer::accept()
+	{
+		UniquePointer<TcpClient> client;
+		ScopedLock lock(this->_lock);
+		auto start = lwiot_tick_ms();
+
+		/* Like a socket without a timeout, zero blocks until a client connects */
+		while(this->_pending.size() == 0) {
+			if(this->_timeout > 0 && lwiot_tick_ms() - start >= this->_timeout * 1000)
+				return client;
+
+			this->_event.wait(lock, MAX_WAIT_SLICE);
+		}
+
+		auto connection = this->_pending.front();
+		this->_pending.erase(this->_pending.begin());
+		lock.unlock();
+
+		client.reset(new LoopbackTcpClient(this->_network, connection, true));
+		return client;
+	}
+}
@@ -11,6 +11,7 @@
 
 #include <lwiot/log.h>
 #include <lwiot/types.h>
+#include <lwiot/bytebuffer.h>
 
 #include <lwiot/network/tcpclient.h>
 #include <lwiot/network/stdnet.h>
@@ -18,22 +19,26 @@
 
 namespace lwiot
 {
-	SecureTcpClient::SecureTcpClient() : TcpClient(), _socket(nullptr), _host("")
+	SecureTcpClient::SecureTcpClient() : TcpClient(), _socket(nullptr), _host(""), _config(nullptr),
+		_resumed(false), _cache(nullptr), _session(1)
 	{
 	}
 
 	SecureTcpClient::SecureTcpClient(const lwiot::IPAddress &addr, uint16_t port, const String& host) :
-		TcpClient(addr, port), _socket(nullptr), _host(host)
+		TcpClient(addr, port), _socket(nullptr), _host(host), _config(nullptr), _resumed(false), _cache(nullptr),
+		_session(1)
 	{
 	}
 
 	SecureTcpClient::SecureTcpClient(const lwiot::SecureTcpClient &other) :
-		TcpClient(other.remote(), other.port()), _socket(nullptr), _host(other._host)
+		TcpClient(other.remote(), other.port()), _socket(nullptr), _host(other._host), _cert(other._cert),
+		_config(other._config), _resumed(false), _cache(other._cache), _session(1)
 	{
 	}
 
 	SecureTcpClient::SecureTcpClient(lwiot::SecureTcpClient &&other) :
-		TcpClient(other.remote(), other.port()), _socket(other._socket), _host(other._host)
+		TcpClient(other.remote(), other.port()), _socket(other._socket), _host(other._host), _cert(other._cert),
+		_config(other._config), _resumed(other._resumed), _cache(other._cache), _session(1)
 	{
 		other._socket = nullptr;
 		other._remote_port = 0;
@@ -53,6 +58,9 @@ namespace lwiot
 		}
 
 		this->_host = client._host;
+		this->_cert = client._cert;
+		this->_config = client._config;
+		this->_cache = client._cache;
 		this->connect(client.remote(), client.port());
 		return *this;
 	}
@@ -67,6 +75,10 @@ namespace lwiot
 		this->_remote_addr = other.remote();
 		this->_remote_port = other.port();
 		this->_socket = other._socket;
+		this->_resumed = other._resumed;
+		this->_cert = other._cert;
+		this->_config = other._config;
+		this->_cache = other._cache;
 
 		other._socket = nullptr;
 		other._remote_port = 0;
@@ -102,13 +114,24 @@ namespace lwiot
 
 	bool SecureTcpClient::connect()
 	{
-		ssl_context_t context = {0,0,0};
+		ssl_context_t context = {0,0,0,0,0,0};
 		remote_addr_t remote;
+		ByteBuffer session;
 
 		this->remote().toRemoteAddress(remote);
 		remote.port = this->port();
 
-		context.root_ca = this->_cert.c_str();
+		if(this->_config != nullptr)
+			this->_config->apply(context);
+		else
+			context.root_ca = this->_cert.c_str();
+
+		auto cached = this->sessions().load(this->_host, this->port(), session);
+
+		if(cached) {
+			context.session = session.data();
+			context.session_length = session.index();
+		}
 
 		this->_socket = secure_socket_create();
 		assert(this->_socket);
@@ -117,17 +140,67 @@ namespace lwiot
 		if(!value) {
 			secure_socket_close(this->_socket);
 			this->_socket = nullptr;
+
+			/* The session might be what the server choked on */
+			if(cached)
+				this->sessions().remove(this->_host, this->port());
+
 			return value;
 		}
 
+		this->_resumed = cached && secure_socket_session_resumed(this->_socket);
+
+		/* Saved after every handshake, a resumed session can come with a fresh ticket */
+		ByteBuffer saved(MaxSessionSize, true);
+		auto length = secure_socket_session_save(this->_socket, saved.data(), saved.count());
+
+		if(length > 0) {
+			session = ByteBuffer(static_cast<size_t>(length), true);
+			session.write(saved.data(), length);
+			this->sessions().store(this->_host, this->port(), session);
+		}
+
 		return value;
 	}
 
+	void SecureTcpClient::setSessionCache(TlsSessionCache &cache)
+	{
+		this->_cache = &cache;
+	}
+
+	TlsSessionCache& SecureTcpClient::sessions()
+	{
+		if(this->_cache != nullptr)
+			return *this->_cache;
+
+		return this->_session;
+	}
+
+	bool SecureTcpClient::resumed() const
+	{
+		return this->_resumed;
+	}
+
 	void SecureTcpClient::setServerCertificate(const lwiot::String &cert)
 	{
 		this->_cert = cert;
 	}
 
+	void SecureTcpClient::setConfig(const TlsConfig &config)
+	{
+		this->_config = &config;
+	}
+
+	const String& SecureTcpClient::serverCertificate() const
+	{
+		return this->_cert;
+	}
+
+	const TlsConfig* SecureTcpClient::config() const
+	{
+		return this->_config;
+	}
+
 	void SecureTcpClient::setServerName(const lwiot::String &host)
 	{
 		this->_host = host;
@@ -188,3 +261,14 @@ namespace lwiot
 		return !(*this == other);
 	}
 }
+
+/* Fallbacks for ports without TLS session resumption */
+extern "C" ssize_t __maybe secure_socket_session_save(secure_socket_t *socket, void *output, size_t length)
+{
+	return -ENOTSUPPORTED;
+}
+
+extern "C" bool __maybe secure_socket_session_resumed(secure_socket_t *socket)
+{
+	return false;
+}
@@ -0,0 +1,141 @@
+/*
+ * Sharded TCP server.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/scopedlock.h>
+#include <lwiot/uniquepointer.h>
+
+#include <lwiot/network/tcpclient.h>
+#include <lwiot/network/sockettcpserver.h>
+#include <lwiot/network/shardedtcpserver.h>
+
+#include <lwiot/stl/move.h>
+
+namespace lwiot
+{
+	ShardedTcpServer::ShardedTcpServer(size_t shards, int backlog) :
+		_lock(false), _count(shards > 0 ? shards : 1), _backlog(backlog), _running(false)
+	{
+	}
+
+	ShardedTcpServer::~ShardedTcpServer()
+	{
+		this->stop();
+		this->release();
+	}
+
+	bool ShardedTcpServer::bind(BindAddress addr, uint16_t port)
+	{
+		return this->bind(IPAddress::fromBindAddress(addr), port);
+	}
+
+	bool ShardedTcpServer::bind(const IPAddress& addr, uint16_t port)
+	{
+		ScopedLock lock(this->_lock);
+
+		if(this->_running || this->_shards.size() > 0)
+			return false;
+
+		for(size_t idx = 0; idx < this->_count; idx++) {
+			auto shard = new Shard(this->_backlog);
+
+			/* Without port reuse a second socket cannot bind, a single shard is all there is */
+			if(!shard->server.setReusePort(true)) {
+				print_dbg("Port reuse not supported, using a single TCP server shard\n");
+				this->_count = 1;
+			}
+
+			if(!shard->server.bind(addr, port)) {
+				delete shard;
+				lock.unlock();
+				this->release();
+
+				return false;
+			}
+
+			this->_shards.push_back(shard);
+		}
+
+		return true;
+	}
+
+	bool ShardedTcpServer::start(const Handler& handler)
+	{
+		ScopedLock lock(this->_lock);
+
+		if(this->_running || this->_shards.size() == 0)
+			return false;
+
+		this->_handler = handler;
+		this->_running = true;
+
+		for(auto shard : this->_shards) {
+			shard->executor.start([this, shard]() {
+				this->run(shard);
+			});
+		}
+
+		return true;
+	}
+
+	void ShardedTcpServer::stop()
+	{
+		ScopedLock lock(this->_lock);
+
+		if(!this->_running)
+			return;
+
+		this->_running = false;
+		lock.unlock();
+
+		/* Workers notice within MaxIdleTime */
+		for(auto shard : this->_shards)
+			shard->executor.join();
+	}
+
+	size_t ShardedTcpServer::shards() const
+	{
+		ScopedLock lock(this->_lock);
+		return this->_shards.size();
+	}
+
+	bool ShardedTcpServer::running() const
+	{
+		ScopedLock lock(this->_lock);
+		return this->_running;
+	}
+
+	void ShardedTcpServer::release()
+	{
+		ScopedLock lock(this->_lock);
+
+		for(auto shard : this->_shards) {
+			shard->server.close();
+			delete shard;
+		}
+
+		this->_shards.clear();
+	}
+
+	void ShardedTcpServer::run(Shard *shard)
+	{
+		while(this->running()) {
+			if(!shard->server.wait(MaxIdleTime))
+				continue;
+
+			auto client = stl::move(shard->server.accept());
+
+			if(!client || !client->connected())
+				continue;
+
+			this->_handler(client);
+		}
+	}
+}
@@ -181,6 +181,14 @@ namespace lwiot
 		this->_socket = nullptr ;
 	}
 
+	bool SocketTcpClient::wait(int tmo)
+	{
+		if(!this->connected())
+			return true;
+
+		return socket_wait(this->_socket, tmo);
+	}
+
 	size_t SocketTcpClient::available() const
 	{
 		return tcp_socket_available(this->_socket);
@@ -202,3 +210,23 @@ namespace lwiot
 		socket_set_timeout(this->_socket, seconds);
 	}
 }
+
+/*
+ * Fallback for socket ports that can't wait for readiness. Pending data is
+ * polled for and the socket is reported ready once the timeout has passed,
+ * so callers fall through to their blocking read or accept. A zero timeout
+ * only probes for pending data.
+ */
+extern "C" bool __maybe socket_wait(socket_t *sock, int tmo)
+{
+	auto start = lwiot_tick_ms();
+
+	while(tcp_socket_available(sock) == 0) {
+		if(lwiot_tick_ms() - start >= (time_t) tmo)
+			return tmo > 0;
+
+		lwiot_sleep(1);
+	}
+
+	return true;
+}
@@ -31,23 +31,26 @@ extern "C" {
 
 namespace lwiot
 {
-	SocketTcpServer::SocketTcpServer() : TcpServer()
+	SocketTcpServer::SocketTcpServer() : TcpServer(), _backlog(BacklogSize), _reuse_port(false)
 	{
 		this->_socket = server_socket_create(SOCKET_STREAM, false);
 	}
 
-	SocketTcpServer::SocketTcpServer(BindAddress addr, uint16_t port) : TcpServer(IPAddress::fromBindAddress(addr), port)
+	SocketTcpServer::SocketTcpServer(BindAddress addr, uint16_t port) : TcpServer(IPAddress::fromBindAddress(addr), port),
+		_backlog(BacklogSize), _reuse_port(false)
 	{
 		this->_socket = server_socket_create(SOCKET_STREAM, this->_bind_addr.isIPv6());
 	}
 
 	SocketTcpServer::SocketTcpServer(SocketTcpServer &&other) noexcept
-		: TcpServer(other._bind_addr, other._bind_port), _socket(other._socket)
+		: TcpServer(other._bind_addr, other._bind_port), _socket(other._socket), _backlog(other._backlog),
+		_reuse_port(other._reuse_port)
 	{
 		other._socket = nullptr;
 	}
 
-	SocketTcpServer::SocketTcpServer(const lwiot::IPAddress &addr, uint16_t port) : TcpServer(addr, port)
+	SocketTcpServer::SocketTcpServer(const lwiot::IPAddress &addr, uint16_t port) : TcpServer(addr, port),
+		_backlog(BacklogSize), _reuse_port(false)
 	{
 		this->_socket = server_socket_create(SOCKET_STREAM, this->_bind_addr.isIPv6());
 	}
@@ -63,6 +66,8 @@ namespace lwiot
 		this->_bind_addr = other._bind_addr;
 		this->_bind_port = other._bind_port;
 		this->_socket = other._socket;
+		this->_backlog = other._backlog;
+		this->_reuse_port = other._reuse_port;
 		other._socket = nullptr;
 
 		return *this;
@@ -111,9 +116,13 @@ namespace lwiot
 		this->_bind_port = port;
 		this->_bind_addr = addr;
 
-		if(this->_socket == nullptr)
+		if(this->_socket == nullptr) {
 			this->connect();
 
+			if(this->_reuse_port)
+				server_socket_reuse_port(this->_socket);
+		}
+
 		return this->bind();
 	}*/
 
@@ -122,6 +131,37 @@ namespace lwiot
 		socket_set_timeout(this->_socket, seconds);
 	}
 
+	void SocketTcpServer::setBacklog(int backlog)
+	{
+		this->_backlog = backlog;
+	}
+
+	/*
+	 * Servers bound to the same port with port reuse enabled each get their own
+	 * accept queue, the kernel spreads new connections over them. Returns false
+	 * when the platform does not support it.
+	 */
+	bool SocketTcpServer::setReusePort(bool enable)
+	{
+		this->_reuse_port = enable;
+
+		if(!enable)
+			return true;
+
+		if(this->_socket == nullptr)
+			this->connect();
+
+		return server_socket_reuse_port(this->_socket);
+	}
+
+	bool SocketTcpServer::wait(int tmo)
+	{
+		if(this->_socket == nullptr)
+			return false;
+
+		return socket_wait(this->_socket, tmo);
+	}
+
 	bool SocketTcpServer::bind(BindAddress addr, uint16_t port)
 	{
 		return this->bind(IPAddress::fromBindAddress(addr), port);
@@ -155,7 +195,7 @@ namespace lwiot
 			return false;
 		}
 
-		rv = server_socket_listen(this->_socket);
+		rv = server_socket_listen_backlog(this->_socket, this->_backlog);
 
 		if(!rv) {
 			print_dbg("Unable to accept client sockets!\n");
@@ -175,3 +215,14 @@ namespace lwiot
 		return wrapped;
 	}
 }
+
+/* Fallbacks for socket ports without a configurable backlog or port reuse */
+extern "C" bool __maybe server_socket_listen_backlog(socket_t *socket, int backlog)
+{
+	return server_socket_listen(socket);
+}
+
+extern "C" bool __maybe server_socket_reuse_port(socket_t *socket)
+{
+	return false;
+}
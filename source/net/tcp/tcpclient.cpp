@@ -68,6 +68,20 @@ namespace lwiot
 		return to_netorders(this->_remote_port);
 	}
 
+	bool TcpClient::wait(int tmo)
+	{
+		auto start = lwiot_tick_ms();
+
+		while(this->connected() && this->available() == 0) {
+			if(lwiot_tick_ms() - start >= (time_t) tmo)
+				return false;
+
+			lwiot_sleep(1);
+		}
+
+		return true;
+	}
+
 	uint8_t TcpClient::read()
 	{
 		uint8_t tmp;
@@ -0,0 +1,56 @@
+/*
+ * Shared TLS configuration.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/types.h>
+
+#include <lwiot/network/stdnet.h>
+#include <lwiot/network/tlsconfig.h>
+
+namespace lwiot
+{
+	TlsConfig::TlsConfig(const String& ca, const String& cert, const String& key) :
+		_ca(ca), _cert(cert), _key(key), _config(nullptr)
+	{
+		ssl_context_t context = {0,0,0,0,0,0};
+
+		this->apply(context);
+		this->_config = secure_config_create(&context);
+	}
+
+	TlsConfig::~TlsConfig()
+	{
+		if(this->_config != nullptr)
+			secure_config_destroy(this->_config);
+	}
+
+	bool TlsConfig::parsed() const
+	{
+		return this->_config != nullptr;
+	}
+
+	void TlsConfig::apply(ssl_context_t& context) const
+	{
+		context.root_ca = this->_ca.c_str();
+		context.client_cert = this->_cert.length() > 0 ? this->_cert.c_str() : nullptr;
+		context.client_key = this->_key.length() > 0 ? this->_key.c_str() : nullptr;
+		context.config = this->_config;
+	}
+}
+
+/* Fallbacks for ports that parse the certificates for every connection */
+extern "C" secure_config_t* __maybe secure_config_create(const ssl_context_t *context)
+{
+	return nullptr;
+}
+
+extern "C" void __maybe secure_config_destroy(secure_config_t *config)
+{
+}
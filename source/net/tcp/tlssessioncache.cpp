@@ -0,0 +1,111 @@
+/*
+ * TLS session cache.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <lwiot.h>
+
+#include <lwiot/bytebuffer.h>
+#include <lwiot/scopedlock.h>
+
+#include <lwiot/network/tlssessioncache.h>
+
+#include <lwiot/stl/move.h>
+
+namespace lwiot
+{
+	TlsSessionCache::TlsSessionCache(size_t capacity, time_t lifetime) :
+		_lock(false), _capacity(capacity), _lifetime(lifetime)
+	{
+	}
+
+	bool TlsSessionCache::load(const String& host, uint16_t port, ByteBuffer& session)
+	{
+		ScopedLock lock(this->_lock);
+		auto now = lwiot_tick_ms();
+
+		for(auto iter = this->_entries.begin(); iter != this->_entries.end(); ++iter) {
+			auto& entry = *iter;
+
+			if(entry.port != port || entry.host != host)
+				continue;
+
+			/* Servers stop accepting sessions after a while, offering a stale one costs a round trip */
+			if(now - entry.stored > this->_lifetime * 1000) {
+				this->_entries.erase(iter);
+				return false;
+			}
+
+			session = entry.session;
+			return true;
+		}
+
+		return false;
+	}
+
+	void TlsSessionCache::store(const String& host, uint16_t port, const ByteBuffer& session)
+	{
+		ScopedLock lock(this->_lock);
+		auto now = lwiot_tick_ms();
+
+		for(auto& entry : this->_entries) {
+			if(entry.port != port || entry.host != host)
+				continue;
+
+			entry.session = session;
+			entry.stored = now;
+			return;
+		}
+
+		if(this->_capacity == 0)
+			return;
+
+		/* A full cache makes room by dropping the oldest session */
+		if(this->_entries.size() >= this->_capacity) {
+			auto oldest = this->_entries.begin();
+
+			for(auto iter = this->_entries.begin(); iter != this->_entries.end(); ++iter) {
+				if((*iter).stored < (*oldest).stored)
+					oldest = iter;
+			}
+
+			this->_entries.erase(oldest);
+		}
+
+		Entry entry;
+
+		entry.host = host;
+		entry.port = port;
+		entry.session = session;
+		entry.stored = now;
+
+		this->_entries.push_back(stl::move(entry));
+	}
+
+	void TlsSessionCache::remove(const String& host, uint16_t port)
+	{
+		ScopedLock lock(this->_lock);
+
+		for(auto iter = this->_entries.begin(); iter != this->_entries.end(); ++iter) {
+			if((*iter).port == port && (*iter).host == host) {
+				this->_entries.erase(iter);
+				break;
+			}
+		}
+	}
+
+	void TlsSessionCache::clear()
+	{
+		ScopedLock lock(this->_lock);
+		this->_entries.clear();
+	}
+
+	size_t TlsSessionCache::size() const
+	{
+		ScopedLock lock(this->_lock);
+		return this->_entries.size();
+	}
+}
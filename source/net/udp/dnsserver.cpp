@@ -5,108 +5,48 @@
  * @email  dev@bietje.net
  */
 
+#include <string.h>
 #include <lwiot.h>
 
 #include <lwiot/network/stdnet.h>
 #include <lwiot/network/udpclient.h>
 #include <lwiot/network/udpserver.h>
+#include <lwiot/network/dnsmessage.h>
 #include <lwiot/network/dnsserver.h>
 
 #include <lwiot/stl/move.h>
 #include <lwiot/bytebuffer.h>
 
-static void setn16(void *pp, int16_t n)
-{
-	char *p = (char*)pp;
-
-	*p++ = (n >> 8);
-	*p = (n & 0xff);
-}
-
-static void setn32(void *pp, int32_t n)
-{
-	char *p = (char*)pp;
-
-	*p++ = (n >> 24) & 0xff;
-	*p++ = (n >> 16) & 0xff;
-	*p++ = (n >> 8) & 0xff;
-	*p = (n & 0xff);
-}
-
-static uint16_t local_ntohs(uint16_t *in)
-{
-	char *p = (char *) in;
-	return ((p[0] << 8) & 0xff00) | (p[1] & 0xff);
-}
-
-static char *label_to_str(char *packet, char *labelPtr, int packetSz, char *res, int resMaxLen)
-{
-	int i, j, k;
-	char *endPtr = NULL;
-	i = 0;
-	do {
-		if((*labelPtr & 0xC0) == 0) {
-			j = *labelPtr++;
-			if(i < resMaxLen && i != 0)
-				res[i++] = '.';
-
-			for(k = 0; k < j; k++) {
-				if((labelPtr - packet) > packetSz)
-					return NULL;
-				if(i < resMaxLen)
-					res[i++] = *labelPtr++;
-			}
-		} else if((*labelPtr & 0xC0) == 0xC0) {
-			endPtr = labelPtr + 2;
-			int offset = local_ntohs(((uint16_t *) labelPtr)) & 0x3FFF;
-			if(offset > packetSz)
-				return NULL;
-
-			labelPtr = &packet[offset];
-		}
-
-		if((labelPtr - packet) > packetSz)
-			return NULL;
-	} while(*labelPtr != 0);
-
-	res[i] = 0;
-	if(endPtr == NULL)
-		endPtr = labelPtr + 1;
-	return endPtr;
-}
-
-static char *str_to_label(char *str, char *label, int maxLen)
-{
-	char *len = label;
-	char *p = label + 1;
-	while(1) {
-		if(*str == '.' || *str == 0) {
-			*len = ((p - len) - 1);
-			len = p;
-			p++;
-			if(*str == 0)
-				break;
-			str++;
-		} else {
-			*p++ = *str++;
-		}
-	}
-	*len = 0;
-	return p;
-}
-
 namespace lwiot
 {
-
-	DnsServer::DnsServer() : Thread("dns-server")
+	DnsServer::DnsServer(size_t workers) : Thread("dns-server"), _buckets(nullptr), _bucket_count(0), _hosts(0),
+		_running(false), _worker_count(workers > 0 ? workers : 1)
 	{
 		this->_udp_msg = (char*) lwiot_mem_zalloc(DNS_LEN);
+		this->_udp_reply = (char*) lwiot_mem_zalloc(DNS_LEN);
 	}
 
 	DnsServer::~DnsServer()
 	{
-		this->_udp->close();
+		if(this->_udp)
+			this->_udp->close();
+
+		for(size_t idx = 0; idx < this->_bucket_count; idx++) {
+			auto host = this->_buckets[idx];
+
+			while(host != nullptr) {
+				auto next = host->next;
+				delete host;
+				host = next;
+			}
+		}
+
+		for(auto worker : this->_workers)
+			delete worker;
+
+		lwiot_mem_free(this->_buckets);
 		lwiot_mem_free(this->_udp_msg);
+		lwiot_mem_free(this->_udp_reply);
 	}
 
 	void DnsServer::end()
@@ -116,6 +56,10 @@ namespace lwiot
 		this->_running = false;
 		lock.unlock();
 		this->stop();
+
+		for(auto worker : this->_workers)
+			worker->thread.stop();
+
 		this->_udp->close();
 	}
 
@@ -123,8 +67,19 @@ namespace lwiot
 	{
 		ScopedLock lock(this->_lock);
 
+		/* Receives time out every second, which bounds the time end() takes */
+		this->_udp->setTimeout(1);
 		this->_running = true;
 		this->start();
+
+		while(this->_workers.size() + 1 < this->_worker_count)
+			this->_workers.push_back(new Worker());
+
+		for(auto worker : this->_workers) {
+			worker->thread.start([this, worker]() {
+				this->serve(worker->msg, worker->reply);
+			});
+		}
 	}
 
 	void DnsServer::begin(lwiot::UdpServer *server)
@@ -138,156 +93,144 @@ namespace lwiot
 
 	void DnsServer::map(const lwiot::String &hostname, const lwiot::IPAddress &addr)
 	{
-		this->_table.add(hostname, addr);
-	}
+		ScopedLock lock(this->_lock);
+		auto hash = DnsName::hash(hostname.c_str());
+		uint32_t raw = addr;
+		Host *host = nullptr;
+
+		if(this->_bucket_count > 0) {
+			for(host = this->_buckets[hash & (this->_bucket_count - 1)]; host != nullptr; host = host->next) {
+				if(host->hash == hash && host->name.equalsIgnoreCase(hostname))
+					break;
+			}
+		}
 
-	void DnsServer::run()
-	{
-		size_t num;
-		bool running_;
+		if(host == nullptr) {
+			if(this->_hosts >= this->_bucket_count)
+				this->grow();
 
-		this->_lock.lock();
-		running_ = this->_running;
-		this->_lock.unlock();
+			auto& bucket = this->_buckets[hash & (this->_bucket_count - 1)];
 
-		while(running_) {
-			Thread::yield();
-			ScopedLock lock(this->_lock);
-			memset(this->_udp_msg, 0, DNS_LEN);
-			num = DNS_LEN;
+			host = new Host();
+			host->name = hostname;
+			host->hash = hash;
+			host->next = bucket;
+			bucket = host;
+			this->_hosts++;
+		}
 
-			this->_udp->setTimeout(1);
-			auto client = this->_udp->recv(this->_udp_msg, num);
+		/* Type A, class IN, TTL 0 and four bytes of address */
+		const uint8_t record[] = {
+			0, QTYPE_A, 0, QCLASS_IN, 0, 0, 0, 0, 0, 4
+		};
 
-			if(client)
-				this->respond(*client, this->_udp_msg, num);
+		memcpy(host->record, record, sizeof(record));
+		memcpy(host->record + sizeof(record), &raw, sizeof(raw));
+	}
 
-			running_ = this->_running;
-		}
+	size_t DnsServer::size() const
+	{
+		ScopedLock lock(this->_lock);
+		return this->_hosts;
 	}
 
-	void DnsServer::respond(lwiot::UdpClient &client, DnsHeader *hdr, lwiot::DnsReplyCode drc)
+	void DnsServer::grow()
 	{
-		hdr->rcode = static_cast<uint8_t>(drc);
-		hdr->flags |= FLAG_QR;
+		auto count = this->_bucket_count > 0 ? this->_bucket_count * 2 : MinBuckets;
+		auto buckets = (Host**) lwiot_mem_zalloc(count * sizeof(Host*));
 
-		hdr->ancount = 0;
-		hdr->arcount = 0;
-		hdr->nscount = 0;
-		hdr->qdcount = 0;
+		for(size_t idx = 0; idx < this->_bucket_count; idx++) {
+			auto host = this->_buckets[idx];
 
-		client.write(hdr, sizeof(*hdr));
-	}
+			while(host != nullptr) {
+				auto next = host->next;
+				auto& bucket = buckets[host->hash & (count - 1)];
 
-	void DnsServer::respond(UdpClient &client, char *data, const size_t &length)
-	{
-		int i;
-		uint32_t addr;
-		uint8_t *ipaddr;
-		lwiot::ByteBuffer replybuffer(DNS_LEN);
-		lwiot::ByteBuffer buffer(DNS_LEN);
+				host->next = bucket;
+				bucket = host;
+				host = next;
+			}
+		}
 
-		char *rawbuffer = (char *) buffer.data();
-		char *rawreply = (char *) replybuffer.data();
-		char *rend = rawreply + length;
-		char *p = data;
+		lwiot_mem_free(this->_buckets);
+		this->_buckets = buckets;
+		this->_bucket_count = count;
+	}
 
-		ipaddr = (uint8_t*)&addr;
+	bool DnsServer::running() const
+	{
+		ScopedLock lock(this->_lock);
+		return this->_running;
+	}
 
-		DnsHeader *hdr = (DnsHeader *) p;
-		DnsHeader *rhdr = (DnsHeader *) rawreply;
-		p += sizeof(DnsHeader);
+	void DnsServer::run()
+	{
+		this->serve(this->_udp_msg, this->_udp_reply);
+	}
 
-		if(length > DNS_LEN)
-			return;
+	/*
+	 * Every worker drains the socket with its own buffers, queries are only
+	 * serialised on the table lookup.
+	 */
+	void DnsServer::serve(char *msg, char *reply)
+	{
+		while(this->running()) {
+			remote_addr_t remote;
+			auto num = this->_udp->recvFrom(msg, DNS_LEN, remote);
 
-		if(length < sizeof(DnsHeader))
-			return;
+			if(num > 0)
+				this->respond(remote, msg, static_cast<size_t>(num), reply);
+		}
+	}
 
-		if(hdr->ancount || hdr->nscount || hdr->arcount)
-			return;
+	bool DnsServer::answer(DnsBuilder& builder, const DnsName& name) const
+	{
+		ScopedLock lock(this->_lock);
+		auto hash = name.hash();
 
-		if(hdr->flags & FLAG_TC)
-			return;
+		if(this->_bucket_count == 0)
+			return false;
 
-		memcpy(rawreply, data, length);
-		rhdr->flags |= FLAG_QR;
+		for(auto host = this->_buckets[hash & (this->_bucket_count - 1)]; host != nullptr; host = host->next) {
+			if(host->hash == hash && name.equals(host->name)) {
+				builder.answer(name, host->record, sizeof(host->record));
+				return true;
+			}
+		}
 
-		for(i = 0; i < local_ntohs(&hdr->qdcount); i++) {
-			DnsQuestionFooter *qf;
+		return false;
+	}
 
-			p = label_to_str(data, p, length, rawbuffer, DNS_LEN);
-			if(p == nullptr)
-				return;
+	void DnsServer::respond(const remote_addr_t& remote, char *data, const size_t &length, char *buffer)
+	{
+		static const uint8_t ns[] = { 2, 'n', 's', 0 };
+		static const uint8_t uri[] = { 0, 10, 0, 1, 'h', 't', 't', 'p', ':', '/', '/', 'l', 'w', 'i', 'o', 't', '.', 'n', 'e', 't' };
+		DnsMessage query(data, length);
+		DnsBuilder reply(buffer, DNS_LEN);
+		DnsQuestion question;
 
-			qf = (DnsQuestionFooter *) p;
-			p += sizeof(DnsQuestionFooter);
-			print_dbg("DNS: Q (type 0x%X class 0x%X) for %s\n",
-					local_ntohs(&qf->type), local_ntohs(&qf->q_class), rawbuffer);
-			stl::String record(rawbuffer);
+		if(!query.valid() || query.answers() || query.authorities() || query.additionals() || query.truncated())
+			return;
 
-			if(local_ntohs(&qf->type) == QTYPE_A) {
-				DnsResourceFooter *rf;
+		if(!reply.reply(query))
+			return;
 
-				if(!this->_table.contains(record)) {
-					DnsServer::respond(client, hdr, DnsReplyCode::NonExistentDomain);
-					return;
+		while(query.next(question)) {
+			if(question.type == QTYPE_A) {
+				if(!this->answer(reply, question.name)) {
+					reply.error(query, DnsReplyCode::NonExistentDomain);
+					break;
 				}
-
-				addr = this->_table.at(record);
-				rend = str_to_label(rawbuffer, rend, DNS_LEN - (rend - rawreply));
-				rf = (DnsResourceFooter *) rend;
-
-				if(rend == NULL)
-					return;
-
-				rend += sizeof(DnsResourceFooter);
-				setn16(&rf->type, QTYPE_A);
-				setn16(&rf->r_class, QCLASS_IN);
-				setn32(&rf->ttl, 0);
-				setn16(&rf->rdlength, 4);
-				*rend++ = ipaddr[0];
-				*rend++ = ipaddr[1];
-				*rend++ = ipaddr[2];
-				*rend++ = ipaddr[3];
-				setn16(&rhdr->ancount, local_ntohs(&rhdr->ancount) + 1);
-			} else if(local_ntohs(&qf->type) == QTYPE_NS) {
-				DnsResourceFooter *rf;
-
-				rend = str_to_label(rawbuffer, rend, DNS_LEN - (rend - rawreply)); //Add the label
-				rf = (DnsResourceFooter *) rend;
-				rend += sizeof(DnsResourceFooter);
-				setn16(&rf->type, QTYPE_NS);
-				setn16(&rf->r_class, QCLASS_IN);
-				setn16(&rf->ttl, 0);
-				setn16(&rf->rdlength, 4);
-				*rend++ = 2;
-				*rend++ = 'n';
-				*rend++ = 's';
-				*rend++ = 0;
-				setn16(&rhdr->ancount, local_ntohs(&rhdr->ancount) + 1);
-			} else if(local_ntohs(&qf->type) == QTYPE_URI) {
-				DnsResourceFooter *rf;
-				DnsUriHdr *uh;
-
-				rend = str_to_label(rawbuffer, rend, DNS_LEN - (rend - rawreply));
-				rf = (DnsResourceFooter *) rend;
-				rend += sizeof(DnsResourceFooter);
-				uh = (DnsUriHdr *) rend;
-				rend += sizeof(DnsUriHdr);
-
-				setn16(&rf->type, QTYPE_URI);
-				setn16(&rf->r_class, QCLASS_URI);
-				setn16(&rf->ttl, 0);
-				setn16(&rf->rdlength, 4 + 16);
-				setn16(&uh->prio, 10);
-				setn16(&uh->weight, 1);
-				memcpy(rend, "http://lwiot.net", 16);
-				rend += 16;
-				setn16(&rhdr->ancount, local_ntohs(&rhdr->ancount) + 1);
+			} else if(question.type == QTYPE_NS) {
+				reply.answer(question.name, QTYPE_NS, QCLASS_IN, 0, ns, sizeof(ns));
+			} else if(question.type == QTYPE_URI) {
+				reply.answer(question.name, QTYPE_URI, QCLASS_URI, 0, uri, sizeof(uri));
 			}
 		}
 
-		client.write(rawreply, static_cast<size_t>(rend - rawreply));
+		if(query.malformed())
+			return;
+
+		this->_udp->sendTo(reply.data(), reply.length(), remote);
 	}
 }
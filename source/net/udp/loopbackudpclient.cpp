@@ -0,0 +1,117 @@
+/*
+ * In-process loopback UDP client.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/log.h>
+#include <lwiot/error.h>
+#include <lwiot/stl/string.h>
+
+#include <lwiot/network/stdnet.h>
+#include <lwiot/network/loopbacknetwork.h>
+#include <lwiot/network/loopbackudpclient.h>
+
+namespace lwiot
+{
+	LoopbackUdpClient::LoopbackUdpClient(LoopbackNetwork& network) :
+		UdpClient(), _network(network), _inbox(nullptr), _noclose(false), _local()
+	{
+	}
+
+	LoopbackUdpClient::LoopbackUdpClient(LoopbackNetwork& network, const IPAddress& addr, uint16_t port) :
+		UdpClient(addr, port), _network(network), _inbox(nullptr), _noclose(false), _local()
+	{
+	}
+
+	LoopbackUdpClient::LoopbackUdpClient(LoopbackNetwork& network, const IPAddress& addr, uint16_t port,
+	                                     LoopbackPipe* inbox, const remote_addr_t& local) :
+		UdpClient(addr, port), _network(network), _inbox(inbox), _noclose(true), _local(local)
+	{
+	}
+
+	LoopbackUdpClient::~LoopbackUdpClient()
+	{
+		this->close();
+	}
+
+	void LoopbackUdpClient::begin()
+	{
+		this->close();
+	}
+
+	void LoopbackUdpClient::begin(const stl::String& host, uint16_t port)
+	{
+		this->begin(IPAddress::fromString(host), port);
+	}
+
+	void LoopbackUdpClient::begin(const IPAddress& addr, uint16_t port)
+	{
+		this->_host = "";
+		this->_remote = addr;
+		this->_port = to_netorders(port);
+		this->begin();
+	}
+
+	bool LoopbackUdpClient::init()
+	{
+		if(this->_inbox != nullptr)
+			return true;
+
+		/* Replies need somewhere to go, bind to an ephemeral port like a socket would */
+		auto inbox = new LoopbackPipe(this->_network.capacity(), true);
+		auto addr = IPAddress::fromBindAddress(BIND_ADDR_LB);
+		auto port = this->_network.ephemeral();
+
+		if(!this->_network.attach(inbox, addr, port)) {
+			delete inbox;
+			return false;
+		}
+
+		addr.toRemoteAddress(this->_local);
+		this->_local.port = port;
+		this->_inbox = inbox;
+		this->_noclose = false;
+
+		return true;
+	}
+
+	void LoopbackUdpClient::close()
+	{
+		if(this->_noclose || this->_inbox == nullptr)
+			return;
+
+		this->_network.detach(this->_inbox);
+		delete this->_inbox;
+		this->_inbox = nullptr;
+	}
+
+	ssize_t LoopbackUdpClient::write(const void *bytes, const size_t& length)
+	{
+		if(!this->init())
+			return -EINVALID;
+
+		return this->_network.send(this->address(), this->port(), this->_local, bytes, length);
+	}
+
+	ssize_t LoopbackUdpClient::read(void *output, const size_t& length)
+	{
+		if(!this->init())
+			return -EINVALID;
+
+		return this->_inbox->read(output, length, nullptr, this->_timeout * 1000);
+	}
+
+	size_t LoopbackUdpClient::available() const
+	{
+		if(this->_inbox == nullptr)
+			return 0;
+
+		return this->_inbox->available();
+	}
+}
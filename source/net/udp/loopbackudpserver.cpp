@@ -0,0 +1,113 @@
+/*
+ * In-process loopback UDP server.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/log.h>
+#include <lwiot/error.h>
+
+#include <lwiot/network/stdnet.h>
+#include <lwiot/network/loopbacknetwork.h>
+#include <lwiot/network/loopbackudpclient.h>
+#include <lwiot/network/loopbackudpserver.h>
+
+namespace lwiot
+{
+	LoopbackUdpServer::LoopbackUdpServer(LoopbackNetwork& network) :
+		UdpServer(), _network(network), _inbox(network.capacity(), true), _bound(false), _timeout(0)
+	{
+	}
+
+	LoopbackUdpServer::LoopbackUdpServer(LoopbackNetwork& network, bind_addr_t addr, uint16_t port) :
+		UdpServer(IPAddress::fromBindAddress(addr), port), _network(network), _inbox(network.capacity(), true),
+		_bound(false), _timeout(0)
+	{
+	}
+
+	LoopbackUdpServer::LoopbackUdpServer(LoopbackNetwork& network, const IPAddress& addr, uint16_t port) :
+		UdpServer(addr, port), _network(network), _inbox(network.capacity(), true), _bound(false), _timeout(0)
+	{
+	}
+
+	LoopbackUdpServer::~LoopbackUdpServer()
+	{
+		this->close();
+	}
+
+	void LoopbackUdpServer::close()
+	{
+		if(!this->_bound)
+			return;
+
+		this->_network.detach(&this->_inbox);
+		this->_bound = false;
+	}
+
+	bool LoopbackUdpServer::bind(bind_addr_t addr, uint16_t port)
+	{
+		return this->bind(IPAddress::fromBindAddress(addr), port);
+	}
+
+	bool LoopbackUdpServer::bind(const IPAddress& addr, uint16_t port)
+	{
+		this->close();
+		UdpServer::bind(addr, port);
+
+		return this->bind();
+	}
+
+	bool LoopbackUdpServer::bind()
+	{
+		if(this->_bound)
+			return true;
+
+		this->_bound = this->_network.attach(&this->_inbox, this->address(), this->port());
+		return this->_bound;
+	}
+
+	void LoopbackUdpServer::setTimeout(int tmo)
+	{
+		this->_timeout = tmo;
+	}
+
+	ssize_t LoopbackUdpServer::recvFrom(void *buffer, size_t length, remote_addr_t& remote)
+	{
+		return this->_inbox.read(buffer, length, &remote, this->_timeout * 1000);
+	}
+
+	ssize_t LoopbackUdpServer::sendTo(const void *buffer, size_t length, const remote_addr_t& remote)
+	{
+		remote_addr_t local;
+
+		this->address().toRemoteAddress(local);
+		local.port = this->port();
+
+		return this->_network.send(IPAddress(remote), remote.port, local, buffer, length);
+	}
+
+	UniquePointer<UdpClient> LoopbackUdpServer::recv(void *buffer, size_t& length)
+	{
+		remote_addr_t remote, local;
+		UniquePointer<UdpClient> client;
+
+		auto num = this->recvFrom(buffer, length, remote);
+
+		if(num < 0)
+			return client;
+
+		length = static_cast<size_t>(num);
+		this->address().toRemoteAddress(local);
+		local.port = this->port();
+
+		/* Replies leave from the address and port the request was sent to */
+		client.reset(new LoopbackUdpClient(this->_network, IPAddress(remote), to_hostorders(remote.port),
+		                                   &this->_inbox, local));
+		return client;
+	}
+}
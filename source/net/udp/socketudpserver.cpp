@@ -80,13 +80,31 @@ namespace lwiot
 		socket_set_timeout(this->_socket, tmo);
 	}
 
+	ssize_t SocketUdpServer::recvFrom(void *buffer, size_t length, remote_addr_t& remote)
+	{
+		if(this->_socket == nullptr)
+			return -EINVALID;
+
+		remote.version = this->address().version();
+		return udp_recv_from(this->_socket, buffer, length, &remote);
+	}
+
+	ssize_t SocketUdpServer::sendTo(const void *buffer, size_t length, const remote_addr_t& remote)
+	{
+		remote_addr_t addr = remote;
+
+		if(this->_socket == nullptr)
+			return -EINVALID;
+
+		return udp_send_to(this->_socket, buffer, length, &addr);
+	}
+
 	UniquePointer<UdpClient> SocketUdpServer::recv(void *buffer, size_t& length)
 	{
 		remote_addr_t remote;
 		UniquePointer<UdpClient> client;
 
-		remote.version = this->address().version();
-		auto num = udp_recv_from(this->_socket, buffer, length, &remote);
+		auto num = this->recvFrom(buffer, length, remote);
 		if(num < 0)
 			return client;
 
@@ -0,0 +1,496 @@
+/*
+ * Table driven base64 codec.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/error.h>
+#include <lwiot/stream.h>
+#include <lwiot/bytebuffer.h>
+#include <lwiot/network/base64codec.h>
+
+/* Without -mssse3 the vector code is compiled for SSSE3 anyway and picked at runtime */
+#if defined(__SSSE3__)
+#define HAVE_SSSE3_CODEC
+#define SSSE3_TARGET
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_SSSE3_CODEC
+#define SSSE3_RUNTIME
+#define SSSE3_TARGET __attribute__((target("ssse3")))
+#endif
+
+#ifdef HAVE_SSSE3_CODEC
+#include <tmmintrin.h>
+#endif
+
+#define XX 0xFF /* Not in the alphabet */
+#define PAD '='
+
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const uint8_t values[256] = {
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, 62, XX, XX, XX, 63,
+	52, 53, 54, 55, 56, 57, 58, 59, 60, 61, XX, XX, XX, XX, XX, XX,
+	XX,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+	15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, XX, XX, XX, XX, XX,
+	XX, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+	41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+	XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+};
+
+#ifdef HAVE_SSSE3_CODEC
+/*
+ * Vector code after W. Mula and D. Lemire, "Faster Base64 Encoding and
+ * Decoding using AVX2 Instructions". Encoding reads 16 bytes and uses 12.
+ */
+SSSE3_TARGET static inline void encode_block(const uint8_t *input, char *output)
+{
+	auto in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input));
+
+	/* Spread every 3 bytes over 4 lanes and move the 6 bit groups in place */
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+	auto hi = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+	auto lo = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+	auto indices = _mm_or_si128(hi, lo);
+
+	/* Map every index range onto the offset to its ASCII character */
+	auto range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+	auto upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+	const auto offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+	                                   '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+	range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+	auto out = _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+
+	_mm_storeu_si128(reinterpret_cast<__m128i *>(output), out);
+}
+
+/* Decodes 16 characters into 12 bytes, unless one of them is not in the alphabet */
+SSSE3_TARGET static inline bool decode_block(const uint8_t *input, uint8_t *output)
+{
+	const auto lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+	                                  0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+	const auto lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+	                                  0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const auto lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const auto nibble = _mm_set1_epi8(0x0F);
+
+	auto in = _mm_loadu_si128(reinterpret_cast<const __m128i *>(input));
+	auto hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), nibble);
+	auto lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(in, nibble));
+	auto hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+
+	if(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0)
+		return false;
+
+	auto slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+	auto sextets = _mm_add_epi8(in, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(slash, hi_nibbles)));
+
+	/* Pack four 6 bit groups into three bytes, per 32 bit lane */
+	auto pairs = _mm_maddubs_epi16(sextets, _mm_set1_epi32(0x01400140));
+	auto words = _mm_madd_epi16(pairs, _mm_set1_epi32(0x00011000));
+	auto out = _mm_shuffle_epi8(words, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+	uint32_t tail = static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_srli_si128(out, 8)));
+
+	_mm_storel_epi64(reinterpret_cast<__m128i *>(output), out);
+	memcpy(output + 8, &tail, sizeof(tail));
+
+	return true;
+}
+
+/* Returns the number of input bytes encoded, a multiple of 12 */
+SSSE3_TARGET static size_t encode_blocks(const uint8_t *input, size_t length, char *output)
+{
+	size_t done = 0;
+
+	for(; length - done >= 16; done += 12, output += 16)
+		encode_block(input + done, output);
+
+	return done;
+}
+
+/* Returns the number of characters decoded, a multiple of 16, or -EINVALID */
+SSSE3_TARGET static ssize_t decode_blocks(const uint8_t *input, size_t length, uint8_t *output)
+{
+	size_t done = 0;
+
+	for(; length - done >= 16; done += 16, output += 12) {
+		if(!decode_block(input + done, output))
+			return -EINVALID;
+	}
+
+	return static_cast<ssize_t>(done);
+}
+
+static bool vectorized()
+{
+#ifdef SSSE3_RUNTIME
+	static const bool supported = __builtin_cpu_supports("ssse3");
+	return supported;
+#else
+	return true;
+#endif
+}
+#endif
+
+namespace lwiot
+{
+	size_t Base64::encode(const void *input, size_t length, char *output)
+	{
+		auto src = static_cast<const uint8_t *>(input);
+		auto dst = output;
+
+#ifdef HAVE_SSSE3_CODEC
+		if(vectorized()) {
+			auto num = encode_blocks(src, length, dst);
+
+			src += num;
+			dst += num / 3 * 4;
+			length -= num;
+		}
+#endif
+
+		for(; length >= 3; length -= 3) {
+			uint32_t word = static_cast<uint32_t>(src[0]) << 16 | src[1] << 8 | src[2];
+
+			dst[0] = alphabet[word >> 18];
+			dst[1] = alphabet[(word >> 12) & 0x3F];
+			dst[2] = alphabet[(word >> 6) & 0x3F];
+			dst[3] = alphabet[word & 0x3F];
+
+			src += 3;
+			dst += 4;
+		}
+
+		if(length > 0) {
+			uint32_t word = static_cast<uint32_t>(src[0]) << 16;
+
+			if(length == 2)
+				word |= src[1] << 8;
+
+			dst[0] = alphabet[word >> 18];
+			dst[1] = alphabet[(word >> 12) & 0x3F];
+			dst[2] = length == 2 ? alphabet[(word >> 6) & 0x3F] : PAD;
+			dst[3] = PAD;
+			dst += 4;
+		}
+
+		return static_cast<size_t>(dst - output);
+	}
+
+	ssize_t Base64::decode(const char *input, size_t length, void *output)
+	{
+		auto src = reinterpret_cast<const uint8_t *>(input);
+		auto dst = static_cast<uint8_t *>(output);
+
+		if(length % 4 != 0)
+			return -EINVALID;
+
+		if(length == 0)
+			return 0;
+
+		/* Padding can only appear in the last group, which is decoded on its own */
+		auto last = src + length - 4;
+
+#ifdef HAVE_SSSE3_CODEC
+		if(vectorized()) {
+			auto num = decode_blocks(src, last - src, dst);
+
+			if(num < 0)
+				return -EINVALID;
+
+			src += num;
+			dst += num / 4 * 3;
+		}
+#endif
+
+		for(; src < last; src += 4, dst += 3) {
+			uint32_t a = values[src[0]], b = values[src[1]], c = values[src[2]], d = values[src[3]];
+
+			if(unlikely((a | b | c | d) & 0x80))
+				return -EINVALID;
+
+			uint32_t word = a << 18 | b << 12 | c << 6 | d;
+
+			dst[0] = static_cast<uint8_t>(word >> 16);
+			dst[1] = static_cast<uint8_t>(word >> 8);
+			dst[2] = static_cast<uint8_t>(word);
+		}
+
+		uint32_t a = values[src[0]], b = values[src[1]];
+		uint32_t c = src[2] == PAD && src[3] == PAD ? 0 : values[src[2]];
+		uint32_t d = src[3] == PAD ? 0 : values[src[3]];
+		size_t num = src[3] != PAD ? 3 : src[2] != PAD ? 2 : 1;
+		uint32_t word = a << 18 | b << 12 | c << 6 | d;
+
+		/* Bits beyond the last byte must be zero for the encoding to be canonical */
+		if((a | b | c | d) & 0x80 || (word & (0xFFFFFF >> (num * 8))) != 0)
+			return -EINVALID;
+
+		dst[0] = static_cast<uint8_t>(word >> 16);
+
+		if(num > 1)
+			dst[1] = static_cast<uint8_t>(word >> 8);
+
+		if(num > 2)
+			dst[2] = static_cast<uint8_t>(word);
+
+		return dst - static_cast<uint8_t *>(output) + static_cast<ssize_t>(num);
+	}
+
+	void Base64::encode(const ByteBuffer& input, ByteBuffer& output)
+	{
+		char chunk[Base64Encoder::ChunkSize];
+		auto data = input.data();
+		size_t length = input.index();
+
+		while(length > 0) {
+			size_t num = length > sizeof(chunk) / 4 * 3 ? sizeof(chunk) / 4 * 3 : length;
+
+			output.write(chunk, Base64::encode(data, num, chunk));
+			data += num;
+			length -= num;
+		}
+	}
+
+	bool Base64::decode(const ByteBuffer& input, ByteBuffer& output)
+	{
+		uint8_t chunk[Base64Encoder::ChunkSize / 4 * 3];
+		auto data = reinterpret_cast<const char *>(input.data());
+		size_t length = input.index();
+		auto index = output.index();
+
+		if(length % 4 != 0)
+			return false;
+
+		while(length > 0) {
+			size_t num = length > Base64Encoder::ChunkSize ? Base64Encoder::ChunkSize : length;
+			auto decoded = Base64::decode(data, num, chunk);
+
+			/* Padding in an earlier chunk is caught, it cannot be followed by more groups */
+			if(decoded < 0 || (data[num - 1] == PAD && length > num)) {
+				output.setIndex(index);
+				return false;
+			}
+
+			output.write(chunk, static_cast<size_t>(decoded));
+			data += num;
+			length -= num;
+		}
+
+		return true;
+	}
+
+	/*
+	 * Streaming encoder.
+	 */
+	Base64Encoder::Base64Encoder(Stream& output) : _output(output), _num_pending(0), _count(0), _failed(false)
+	{
+	}
+
+	void Base64Encoder::reset()
+	{
+		this->_num_pending = 0;
+		this->_count = 0;
+		this->_failed = false;
+	}
+
+	bool Base64Encoder::flush(const uint8_t *data, size_t length)
+	{
+		size_t num = Base64::encode(data, length, this->_chunk);
+
+		if(this->_output.write(this->_chunk, num) != static_cast<ssize_t>(num)) {
+			this->_failed = true;
+			return false;
+		}
+
+		this->_count += num;
+		return true;
+	}
+
+	bool Base64Encoder::write(const void *data, size_t length)
+	{
+		auto input = static_cast<const uint8_t *>(data);
+
+		if(this->_failed)
+			return false;
+
+		if(this->_num_pending > 0) {
+			while(this->_num_pending < sizeof(this->_pending) && length > 0) {
+				this->_pending[this->_num_pending++] = *input++;
+				length--;
+			}
+
+			if(this->_num_pending < sizeof(this->_pending))
+				return true;
+
+			this->_num_pending = 0;
+
+			if(!this->flush(this->_pending, sizeof(this->_pending)))
+				return false;
+		}
+
+		while(length >= 3) {
+			size_t num = length / 3 * 3;
+
+			if(num > ChunkSize / 4 * 3)
+				num = ChunkSize / 4 * 3;
+
+			if(!this->flush(input, num))
+				return false;
+
+			input += num;
+			length -= num;
+		}
+
+		memcpy(this->_pending, input, length);
+		this->_num_pending = length;
+
+		return true;
+	}
+
+	bool Base64Encoder::write(const ByteBuffer& buffer)
+	{
+		return this->write(buffer.data(), buffer.index());
+	}
+
+	bool Base64Encoder::finish()
+	{
+		if(this->_failed)
+			return false;
+
+		if(this->_num_pending == 0)
+			return true;
+
+		auto num = this->_num_pending;
+
+		this->_num_pending = 0;
+		return this->flush(this->_pending, num);
+	}
+
+	/*
+	 * Streaming decoder.
+	 */
+	Base64Decoder::Base64Decoder(Stream& output) : _output(output), _num_pending(0), _count(0), _failed(false),
+		_padded(false)
+	{
+	}
+
+	void Base64Decoder::reset()
+	{
+		this->_num_pending = 0;
+		this->_count = 0;
+		this->_failed = false;
+		this->_padded = false;
+	}
+
+	bool Base64Decoder::fail()
+	{
+		this->_failed = true;
+		return false;
+	}
+
+	bool Base64Decoder::flush(const char *data, size_t length)
+	{
+		if(this->_padded)
+			return this->fail();
+
+		auto num = Base64::decode(data, length, this->_chunk);
+
+		if(num < 0)
+			return this->fail();
+
+		this->_padded = data[length - 1] == PAD;
+
+		if(this->_output.write(this->_chunk, static_cast<size_t>(num)) != num)
+			return this->fail();
+
+		this->_count += static_cast<size_t>(num);
+		return true;
+	}
+
+	bool Base64Decoder::write(const char *data, size_t length)
+	{
+		if(this->_failed)
+			return false;
+
+		if(length == 0)
+			return true;
+
+		if(this->_padded)
+			return this->fail();
+
+		if(this->_num_pending > 0) {
+			while(this->_num_pending < sizeof(this->_pending) && length > 0) {
+				this->_pending[this->_num_pending++] = *data++;
+				length--;
+			}
+
+			if(this->_num_pending < sizeof(this->_pending))
+				return true;
+
+			this->_num_pending = 0;
+
+			if(!this->flush(this->_pending, sizeof(this->_pending)))
+				return false;
+		}
+
+		while(length >= 4) {
+			size_t num = length / 4 * 4;
+
+			if(num > ChunkSize)
+				num = ChunkSize;
+
+			if(!this->flush(data, num))
+				return false;
+
+			data += num;
+			length -= num;
+		}
+
+		if(length > 0 && this->_padded)
+			return this->fail();
+
+		memcpy(this->_pending, data, length);
+		this->_num_pending = length;
+
+		return true;
+	}
+
+	bool Base64Decoder::write(const ByteBuffer& buffer)
+	{
+		return this->write(reinterpret_cast<const char *>(buffer.data()), buffer.index());
+	}
+
+	/* Fails when the input ended halfway a group */
+	bool Base64Decoder::finish()
+	{
+		if(this->_failed)
+			return false;
+
+		if(this->_num_pending != 0)
+			return this->fail();
+
+		return true;
+	}
+}
+
+#undef XX
+#undef PAD
@@ -14,102 +14,24 @@
 
 #include <lwiot/network/udpclient.h>
 #include <lwiot/network/udpserver.h>
+#include <lwiot/network/dnsmessage.h>
 #include <lwiot/network/captiveportal.h>
 #include <lwiot/stl/move.h>
 
-static void setn16(void *pp, int16_t n)
-{
-	char *p = (char*)pp;
-
-	*p++ = (n >> 8);
-	*p = (n & 0xff);
-}
-
-static void setn32(void *pp, int32_t n)
-{
-	char *p = (char*)pp;
-
-	*p++ = (n >> 24) & 0xff;
-	*p++ = (n >> 16) & 0xff;
-	*p++ = (n >> 8) & 0xff;
-	*p = (n & 0xff);
-}
-
-
-static uint16_t local_ntohs(uint16_t *in)
-{
-	char *p = (char *) in;
-	return ((p[0] << 8) & 0xff00) | (p[1] & 0xff);
-}
-
-static char *label_to_str(char *packet, char *labelPtr, int packetSz, char *res, int resMaxLen)
-{
-	int i, j, k;
-	char *endPtr = NULL;
-	i = 0;
-	do {
-		if((*labelPtr & 0xC0) == 0) {
-			j = *labelPtr++;
-			if(i < resMaxLen && i != 0)
-				res[i++] = '.';
-
-			for(k = 0; k < j; k++) {
-				if((labelPtr - packet) > packetSz)
-					return NULL;
-				if(i < resMaxLen)
-					res[i++] = *labelPtr++;
-			}
-		} else if((*labelPtr & 0xC0) == 0xC0) {
-			endPtr = labelPtr + 2;
-			int offset = local_ntohs(((uint16_t *) labelPtr)) & 0x3FFF;
-			if(offset > packetSz)
-				return NULL;
-
-			labelPtr = &packet[offset];
-		}
-
-		if((labelPtr - packet) > packetSz)
-			return NULL;
-	} while(*labelPtr != 0);
-
-	res[i] = 0;
-	if(endPtr == NULL)
-		endPtr = labelPtr + 1;
-	return endPtr;
-}
-
-static char *str_to_label(char *str, char *label, int maxLen)
-{
-	char *len = label;
-	char *p = label + 1;
-	while(1) {
-		if(*str == '.' || *str == 0) {
-			*len = ((p - len) - 1);
-			len = p;
-			p++;
-			if(*str == 0)
-				break;
-			str++;
-		} else {
-			*p++ = *str++;
-		}
-	}
-	*len = 0;
-	return p;
-}
-
 namespace lwiot
 {
 	CaptivePortal::CaptivePortal(const IPAddress& addr, const IPAddress& captor, uint16_t port, UdpServer* server) :
 		Thread("cp", nullptr), _lock(false), _udp(server), _captor(captor), _running(false), _bind_addr(addr), _port(port)
 	{
 		this->udp_msg = (char*) lwiot_mem_zalloc(DNS_LEN);
+		this->udp_reply = (char*) lwiot_mem_zalloc(DNS_LEN);
 	}
 
 	CaptivePortal::~CaptivePortal()
 	{
 		this->_udp->close();
 		lwiot_mem_free(this->udp_msg);
+		lwiot_mem_free(this->udp_reply);
 	}
 
 	void CaptivePortal::end()
@@ -146,104 +68,40 @@ namespace lwiot
 		this->begin();
 	}
 
-	void CaptivePortal::respond(lwiot::UdpClient &client, char *data, const size_t &length)
+	void CaptivePortal::respond(const remote_addr_t& remote, char *data, const size_t &length)
 	{
-		int i;
-		char *buff = (char *) lwiot_mem_zalloc(DNS_LEN);
-		char *reply = (char *) lwiot_mem_zalloc(DNS_LEN);
-		char *rend = reply + length;
-		char *p = data;
-		uint32_t addr;
-		uint8_t *ipaddr;
-
-		addr = this->_captor;
-		ipaddr = (uint8_t*)&addr;
-
-		DnsHeader *hdr = (DnsHeader *) p;
-		DnsHeader *rhdr = (DnsHeader *) reply;
-		p += sizeof(DnsHeader);
-
-		if(length > DNS_LEN)
-			goto finish;
-
-		if(length < sizeof(DnsHeader))
-			goto finish;
-
-		if(hdr->ancount || hdr->nscount || hdr->arcount)
-			goto finish;
-
-		if(hdr->flags & FLAG_TC)
-			goto finish;
-
-		memcpy(reply, data, length);
-		rhdr->flags |= FLAG_QR;
-		for(i = 0; i < local_ntohs(&hdr->qdcount); i++) {
-			p = label_to_str(data, p, length, buff, DNS_LEN);
-			if(p == nullptr)
-				goto finish;
-
-			DnsQuestionFooter *qf = (DnsQuestionFooter *) p;
-			p += sizeof(DnsQuestionFooter);
-			print_dbg("DNS: Q (type 0x%X class 0x%X) for %s\n", local_ntohs(&qf->type), local_ntohs(&qf->q_class), buff);
-			if(local_ntohs(&qf->type) == QTYPE_A) {
-				rend = str_to_label(buff, rend, DNS_LEN - (rend - reply));
-				if(rend == NULL)
-					goto finish;
-				DnsResourceFooter *rf = (DnsResourceFooter *) rend;
-				rend += sizeof(DnsResourceFooter);
-				setn16(&rf->type, QTYPE_A);
-				setn16(&rf->r_class, QCLASS_IN);
-				setn32(&rf->ttl, 0);
-				setn16(&rf->rdlength, 4);
-				*rend++ = ipaddr[0];
-				*rend++ = ipaddr[1];
-				*rend++ = ipaddr[2];
-				*rend++ = ipaddr[3];
-				setn16(&rhdr->ancount, local_ntohs(&rhdr->ancount) + 1);
-			} else if(local_ntohs(&qf->type) == QTYPE_NS) {
-				rend = str_to_label(buff, rend, DNS_LEN - (rend - reply)); //Add the label
-				DnsResourceFooter *rf = (DnsResourceFooter *) rend;
-				rend += sizeof(DnsResourceFooter);
-				setn16(&rf->type, QTYPE_NS);
-				setn16(&rf->r_class, QCLASS_IN);
-				setn16(&rf->ttl, 0);
-				setn16(&rf->rdlength, 4);
-				*rend++ = 2;
-				*rend++ = 'n';
-				*rend++ = 's';
-				*rend++ = 0;
-				setn16(&rhdr->ancount, local_ntohs(&rhdr->ancount) + 1);
-			} else if(local_ntohs(&qf->type) == QTYPE_URI) {
-				rend = str_to_label(buff, rend, DNS_LEN - (rend - reply));
-				DnsResourceFooter *rf = (DnsResourceFooter *) rend;
-				rend += sizeof(DnsResourceFooter);
-				DnsUriHdr *uh = (DnsUriHdr *) rend;
-				rend += sizeof(DnsUriHdr);
-				setn16(&rf->type, QTYPE_URI);
-				setn16(&rf->r_class, QCLASS_URI);
-				setn16(&rf->ttl, 0);
-				setn16(&rf->rdlength, 4 + 16);
-				setn16(&uh->prio, 10);
-				setn16(&uh->weight, 1);
-				memcpy(rend, "http://lwiot.net", 16);
-				rend += 16;
-				setn16(&rhdr->ancount, local_ntohs(&rhdr->ancount) + 1);
-			}
+		static const uint8_t ns[] = { 2, 'n', 's', 0 };
+		static const uint8_t uri[] = { 0, 10, 0, 1, 'h', 't', 't', 'p', ':', '/', '/', 'l', 'w', 'i', 'o', 't', '.', 'n', 'e', 't' };
+		DnsMessage query(data, length);
+		DnsBuilder reply(this->udp_reply, DNS_LEN);
+		DnsQuestion question;
+		uint32_t addr = this->_captor;
+
+		if(!query.valid() || query.answers() || query.authorities() || query.additionals() || query.truncated())
+			return;
+
+		if(!reply.reply(query))
+			return;
+
+		/* Every name resolves to the captor */
+		while(query.next(question)) {
+			if(question.type == QTYPE_A)
+				reply.answer(question.name, QTYPE_A, QCLASS_IN, 0, &addr, sizeof(addr));
+			else if(question.type == QTYPE_NS)
+				reply.answer(question.name, QTYPE_NS, QCLASS_IN, 0, ns, sizeof(ns));
+			else if(question.type == QTYPE_URI)
+				reply.answer(question.name, QTYPE_URI, QCLASS_URI, 0, uri, sizeof(uri));
 		}
 
-		client.write(reply, static_cast<size_t>(rend - reply));
-
-finish:
-		if(buff != nullptr)
-			lwiot_mem_free(buff);
+		if(query.malformed())
+			return;
 
-		if(reply != nullptr)
-			lwiot_mem_free(reply);
+		this->_udp->sendTo(reply.data(), reply.length(), remote);
 	}
 
 	void CaptivePortal::run()
 	{
-		size_t num;
+		ssize_t num;
 		bool running_;
 
 		this->_lock.lock();
@@ -253,14 +111,13 @@ finish:
 		while(running_) {
 			Thread::yield();
 			ScopedLock lock(this->_lock);
-			memset(udp_msg, 0, DNS_LEN);
-			num = DNS_LEN;
+			remote_addr_t remote;
 
 			this->_udp->setTimeout(10000);
-			auto client = this->_udp->recv(udp_msg, num);
+			num = this->_udp->recvFrom(udp_msg, DNS_LEN, remote);
 
-			if(client)
-				this->respond(*client, udp_msg, num);
+			if(num > 0)
+				this->respond(remote, udp_msg, static_cast<size_t>(num));
 
 			running_ = this->_running;
 		}
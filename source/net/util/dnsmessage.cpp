@@ -0,0 +1,488 @@
+/*
+ * DNS message parser and builder.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/stl/string.h>
+
+#include <lwiot/network/dns.h>
+#include <lwiot/network/dnsmessage.h>
+
+#define HEADER_SIZE    12
+#define POINTER_MASK   0xC0
+#define MAX_POINTER    0x3FFF
+#define FNV_OFFSET     2166136261U
+#define FNV_PRIME      16777619U
+
+static inline uint8_t lower(uint8_t c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline uint32_t fnv(uint32_t hash, uint8_t c)
+{
+	return (hash ^ c) * FNV_PRIME;
+}
+
+namespace lwiot
+{
+	DnsName::DnsName() : _packet(nullptr), _length(0), _offset(0)
+	{
+	}
+
+	DnsName::DnsName(const uint8_t *packet, size_t length, size_t offset) :
+		_packet(packet), _length(length), _offset(offset)
+	{
+	}
+
+	/*
+	 * Returns the label at `pos` and moves past it, a zero length label ends the
+	 * name. Compression pointers may only point backwards, which rules out loops.
+	 */
+	bool DnsName::label(size_t& pos, size_t& hops, const uint8_t*& data, size_t& length) const
+	{
+		while(pos < this->_length) {
+			auto byte = this->_packet[pos];
+
+			if((byte & POINTER_MASK) == POINTER_MASK) {
+				if(pos + 1 >= this->_length || ++hops > MaxLength / 2)
+					return false;
+
+				size_t target = ((byte & ~POINTER_MASK) << 8) | this->_packet[pos + 1];
+
+				if(target >= pos)
+					return false;
+
+				pos = target;
+				continue;
+			}
+
+			/* The other label types never made it past experimental */
+			if((byte & POINTER_MASK) != 0 || pos + 1 + byte > this->_length)
+				return false;
+
+			data = this->_packet + pos + 1;
+			length = byte;
+			pos += 1 + byte;
+
+			return true;
+		}
+
+		return false;
+	}
+
+	bool DnsName::skip(const uint8_t *packet, size_t length, size_t& pos)
+	{
+		size_t total = 0;
+
+		while(pos < length) {
+			auto byte = packet[pos];
+
+			if((byte & POINTER_MASK) == POINTER_MASK) {
+				if(pos + 2 > length)
+					return false;
+
+				pos += 2;
+				return true;
+			}
+
+			if((byte & POINTER_MASK) != 0)
+				return false;
+
+			pos += 1 + byte;
+
+			if(byte == 0)
+				return true;
+
+			total += 1 + byte;
+
+			if(total > MaxLength)
+				return false;
+		}
+
+		return false;
+	}
+
+	bool DnsName::equals(const char *name) const
+	{
+		size_t pos = this->_offset, hops = 0, total = 0, length;
+		const uint8_t *data;
+
+		if(this->_packet == nullptr || name == nullptr)
+			return false;
+
+		while(this->label(pos, hops, data, length)) {
+			if(length == 0)
+				return *name == '\0' || (name[0] == '.' && name[1] == '\0');
+
+			if(total > 0 && *name++ != '.')
+				return false;
+
+			total += length + 1;
+
+			if(total > MaxLength)
+				return false;
+
+			for(size_t idx = 0; idx < length; idx++, name++) {
+				if(*name == '\0' || lower(*name) != lower(data[idx]))
+					return false;
+			}
+		}
+
+		return false;
+	}
+
+	bool DnsName::equals(const String& name) const
+	{
+		return this->equals(name.c_str());
+	}
+
+	uint32_t DnsName::hash() const
+	{
+		size_t pos = this->_offset, hops = 0, total = 0, length;
+		const uint8_t *data;
+		uint32_t hash = FNV_OFFSET;
+
+		if(this->_packet == nullptr)
+			return hash;
+
+		while(this->label(pos, hops, data, length) && length > 0) {
+			if(total > 0)
+				hash = fnv(hash, '.');
+
+			total += length + 1;
+
+			if(total > MaxLength)
+				break;
+
+			for(size_t idx = 0; idx < length; idx++)
+				hash = fnv(hash, lower(data[idx]));
+		}
+
+		return hash;
+	}
+
+	uint32_t DnsName::hash(const char *name)
+	{
+		uint32_t hash = FNV_OFFSET;
+
+		for(; *name != '\0'; name++) {
+			if(name[0] == '.' && name[1] == '\0')
+				break;
+
+			hash = fnv(hash, lower(*name));
+		}
+
+		return hash;
+	}
+
+	size_t DnsName::toString(char *output, size_t size) const
+	{
+		size_t pos = this->_offset, hops = 0, num = 0, length;
+		const uint8_t *data;
+
+		if(this->_packet == nullptr || size == 0)
+			return 0;
+
+		while(this->label(pos, hops, data, length)) {
+			if(length == 0) {
+				output[num] = '\0';
+				return num;
+			}
+
+			if(num > 0)
+				output[num++] = '.';
+
+			if(num + length >= size || num + length > MaxLength)
+				break;
+
+			memcpy(output + num, data, length);
+			num += length;
+		}
+
+		output[0] = '\0';
+		return 0;
+	}
+
+	String DnsName::toString() const
+	{
+		char buffer[MaxLength + 1];
+
+		this->toString(buffer, sizeof(buffer));
+		return String(buffer);
+	}
+
+	DnsMessage::DnsMessage(const void *data, size_t length) :
+		_data(static_cast<const uint8_t*>(data)), _length(length), _pos(HEADER_SIZE), _index(0), _malformed(false)
+	{
+	}
+
+	bool DnsMessage::valid() const
+	{
+		return this->_data != nullptr && this->_length >= HEADER_SIZE;
+	}
+
+	uint16_t DnsMessage::field(size_t offset) const
+	{
+		return static_cast<uint16_t>((this->_data[offset] << 8) | this->_data[offset + 1]);
+	}
+
+	uint16_t DnsMessage::id() const
+	{
+		return this->field(0);
+	}
+
+	bool DnsMessage::response() const
+	{
+		return (this->_data[2] & FLAG_QR) != 0;
+	}
+
+	bool DnsMessage::truncated() const
+	{
+		return (this->_data[2] & FLAG_TC) != 0;
+	}
+
+	uint8_t DnsMessage::opcode() const
+	{
+		return (this->_data[2] >> 3) & 0xF;
+	}
+
+	DnsReplyCode DnsMessage::rcode() const
+	{
+		return static_cast<DnsReplyCode>(this->_data[3] & 0xF);
+	}
+
+	uint16_t DnsMessage::questions() const
+	{
+		return this->field(4);
+	}
+
+	uint16_t DnsMessage::answers() const
+	{
+		return this->field(6);
+	}
+
+	uint16_t DnsMessage::authorities() const
+	{
+		return this->field(8);
+	}
+
+	uint16_t DnsMessage::additionals() const
+	{
+		return this->field(10);
+	}
+
+	size_t DnsMessage::records() const
+	{
+		return this->questions() + this->answers() + this->authorities() + this->additionals();
+	}
+
+	bool DnsMessage::next(DnsQuestion& question)
+	{
+		if(!this->valid() || this->_malformed || this->_index >= this->questions())
+			return false;
+
+		auto start = this->_pos;
+
+		if(!DnsName::skip(this->_data, this->_length, this->_pos) || this->_pos + 4 > this->_length) {
+			this->_malformed = true;
+			return false;
+		}
+
+		question.name = DnsName(this->_data, this->_length, start);
+		question.type = this->field(this->_pos);
+		question.qclass = this->field(this->_pos + 2);
+		this->_pos += 4;
+		this->_index++;
+
+		return true;
+	}
+
+	bool DnsMessage::next(DnsResource& resource)
+	{
+		DnsQuestion question;
+
+		/* Resource records follow the questions */
+		while(this->_index < this->questions()) {
+			if(!this->next(question))
+				return false;
+		}
+
+		if(!this->valid() || this->_malformed || this->_index >= this->records())
+			return false;
+
+		auto start = this->_pos;
+
+		if(!DnsName::skip(this->_data, this->_length, this->_pos) || this->_pos + 10 > this->_length) {
+			this->_malformed = true;
+			return false;
+		}
+
+		resource.name = DnsName(this->_data, this->_length, start);
+		resource.type = this->field(this->_pos);
+		resource.rclass = this->field(this->_pos + 2);
+		resource.ttl = static_cast<uint32_t>(this->field(this->_pos + 4)) << 16 | this->field(this->_pos + 6);
+		resource.length = this->field(this->_pos + 8);
+		this->_pos += 10;
+
+		if(this->_pos + resource.length > this->_length) {
+			this->_malformed = true;
+			return false;
+		}
+
+		resource.data = this->_data + this->_pos;
+		this->_pos += resource.length;
+		this->_index++;
+
+		return true;
+	}
+
+	DnsBuilder::DnsBuilder(void *buffer, size_t capacity) :
+		_buffer(static_cast<uint8_t*>(buffer)), _capacity(capacity), _length(0), _query(nullptr), _questions(0)
+	{
+	}
+
+	bool DnsBuilder::reply(const DnsMessage& query, DnsReplyCode code)
+	{
+		size_t pos = HEADER_SIZE;
+
+		if(!query.valid())
+			return false;
+
+		for(uint16_t idx = 0; idx < query.questions(); idx++) {
+			if(!DnsName::skip(query._data, query._length, pos) || pos + 4 > query._length)
+				return false;
+
+			pos += 4;
+		}
+
+		if(pos > this->_capacity)
+			return false;
+
+		memcpy(this->_buffer, query._data, pos);
+		this->_buffer[2] |= FLAG_QR;
+		this->_buffer[3] = (this->_buffer[3] & 0xF0) | static_cast<uint8_t>(code);
+		memset(this->_buffer + 6, 0, HEADER_SIZE - 6);
+
+		this->_length = pos;
+		this->_query = query._data;
+		this->_questions = pos;
+
+		return true;
+	}
+
+	bool DnsBuilder::error(const DnsMessage& query, DnsReplyCode code)
+	{
+		if(!query.valid() || this->_capacity < HEADER_SIZE)
+			return false;
+
+		memcpy(this->_buffer, query._data, HEADER_SIZE);
+		this->_buffer[2] |= FLAG_QR;
+		this->_buffer[3] = static_cast<uint8_t>(code);
+		memset(this->_buffer + 4, 0, HEADER_SIZE - 4);
+
+		this->_length = HEADER_SIZE;
+		this->_query = nullptr;
+		this->_questions = 0;
+
+		return true;
+	}
+
+	bool DnsBuilder::answer(const DnsName& name, uint16_t type, uint16_t rclass, uint32_t ttl,
+	                        const void *data, uint16_t length)
+	{
+		auto start = this->_length;
+
+		if(start < HEADER_SIZE)
+			return false;
+
+		if(!this->name(name) || !this->put16(type) || !this->put16(rclass) || !this->put32(ttl) ||
+		   !this->put16(length) || !this->put(data, length)) {
+			this->_length = start;
+			return false;
+		}
+
+		this->count();
+		return true;
+	}
+
+	bool DnsBuilder::answer(const DnsName& name, const uint8_t *record, size_t length)
+	{
+		auto start = this->_length;
+
+		if(start < HEADER_SIZE)
+			return false;
+
+		if(!this->name(name) || !this->put(record, length)) {
+			this->_length = start;
+			return false;
+		}
+
+		this->count();
+		return true;
+	}
+
+	bool DnsBuilder::answer(const DnsQuestion& question, uint32_t ttl, const void *data, uint16_t length)
+	{
+		return this->answer(question.name, question.type, question.qclass, ttl, data, length);
+	}
+
+	void DnsBuilder::count()
+	{
+		uint16_t count = static_cast<uint16_t>((this->_buffer[6] << 8) | this->_buffer[7]) + 1;
+
+		this->_buffer[6] = count >> 8;
+		this->_buffer[7] = count & 0xFF;
+	}
+
+	bool DnsBuilder::put(const void *data, size_t length)
+	{
+		if(this->_length + length > this->_capacity)
+			return false;
+
+		memcpy(this->_buffer + this->_length, data, length);
+		this->_length += length;
+
+		return true;
+	}
+
+	bool DnsBuilder::put16(uint16_t value)
+	{
+		uint8_t bytes[] = { static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value) };
+		return this->put(bytes, sizeof(bytes));
+	}
+
+	bool DnsBuilder::put32(uint32_t value)
+	{
+		return this->put16(value >> 16) && this->put16(value & 0xFFFF);
+	}
+
+	bool DnsBuilder::name(const DnsName& name)
+	{
+		size_t pos = name._offset, hops = 0, length;
+		const uint8_t *data;
+
+		/* Names from the copied question section are already in the buffer */
+		if(name._packet == this->_query && name._offset < this->_questions && name._offset <= MAX_POINTER)
+			return this->put16(static_cast<uint16_t>(POINTER_MASK << 8 | name._offset));
+
+		while(name.label(pos, hops, data, length)) {
+			uint8_t prefix = static_cast<uint8_t>(length);
+
+			if(!this->put(&prefix, 1) || !this->put(data, length))
+				return false;
+
+			if(length == 0)
+				return true;
+		}
+
+		return false;
+	}
+}
@@ -0,0 +1,469 @@
+/*
+ * In-process loopback network.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/types.h>
+#include <lwiot/error.h>
+#include <lwiot/scopedlock.h>
+
+#include <lwiot/kernel/thread.h>
+
+#include <lwiot/network/stdnet.h>
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/loopbacknetwork.h>
+#include <lwiot/network/loopbacktcpserver.h>
+
+#define MAX_WAIT_SLICE 5
+#define FIRST_EPHEMERAL_PORT 49152
+
+namespace lwiot
+{
+	LoopbackPipe::LoopbackPipe(size_t capacity, bool datagram) :
+		_lock(false), _ring(capacity, true), _head(0), _used(0), _offset(0), _datagram(datagram), _closed(false),
+		_link{0, 0, 0.0, LoopbackNetwork::DefaultRetransmit}, _busy(0), _last(0), _seed(1)
+	{
+	}
+
+	void LoopbackPipe::setLink(const LoopbackLink& link, uint32_t seed)
+	{
+		ScopedLock lock(this->_lock);
+
+		this->_link = link;
+		this->_seed = seed != 0 ? seed : 1;
+	}
+
+	ssize_t LoopbackPipe::write(const void *data, size_t length, const remote_addr_t& source, int tmo)
+	{
+		ScopedLock lock(this->_lock);
+		auto bytes = static_cast<const uint8_t*>(data);
+		auto deadline = lwiot_tick() + static_cast<time_t>(tmo) * 1000;
+		size_t written = 0;
+
+		if(this->_closed)
+			return -EINVALID;
+
+		if(this->_datagram) {
+			if(length + sizeof(Record) > this->_ring.count())
+				return -ENOMEMORY;
+
+			/* A full receive buffer drops the datagram, the sender never knows */
+			if(length + sizeof(Record) <= this->_ring.count() - this->_used)
+				this->push(data, length, source);
+
+			return length;
+		}
+
+		while(written < length) {
+			auto space = this->_ring.count() - this->_used;
+
+			if(this->_closed)
+				break;
+
+			if(space <= sizeof(Record)) {
+				if(tmo == FOREVER)
+					deadline = lwiot_tick() + MAX_WAIT_SLICE * 1000;
+
+				if(!this->sleep(lock, deadline, deadline))
+					break;
+
+				continue;
+			}
+
+			size_t num = length - written;
+
+			if(num > space - sizeof(Record))
+				num = space - sizeof(Record);
+
+			this->push(bytes + written, num, source);
+			written += num;
+		}
+
+		if(written == 0 && length > 0)
+			return this->_closed ? -EINVALID : -ETMO;
+
+		return written;
+	}
+
+	ssize_t LoopbackPipe::read(void *output, size_t length, remote_addr_t* source, int tmo)
+	{
+		ScopedLock lock(this->_lock);
+		auto bytes = static_cast<uint8_t*>(output);
+		auto deadline = lwiot_tick() + static_cast<time_t>(tmo) * 1000;
+		Record record;
+		size_t done = 0;
+
+		while(!this->arrived(record, lwiot_tick())) {
+			if(this->_used == 0 && this->_closed)
+				return this->_datagram ? -EINVALID : 0;
+
+			if(tmo == FOREVER)
+				deadline = lwiot_tick() + MAX_WAIT_SLICE * 1000;
+
+			if(!this->sleep(lock, deadline, this->_used > 0 ? record.arrival : deadline))
+				return -ETMO;
+		}
+
+		if(source != nullptr)
+			*source = record.source;
+
+		if(this->_datagram) {
+			done = length < record.length ? length : record.length;
+			this->copyOut(this->_head + sizeof(Record), output, done);
+			this->pop(sizeof(Record) + record.length);
+			this->_event.signal();
+
+			return done;
+		}
+
+		do {
+			size_t num = length - done;
+
+			if(num > record.length - this->_offset)
+				num = record.length - this->_offset;
+
+			this->copyOut(this->_head + sizeof(Record) + this->_offset, bytes + done, num);
+			done += num;
+			this->_offset += num;
+
+			if(this->_offset == record.length) {
+				this->pop(sizeof(Record) + record.length);
+				this->_offset = 0;
+			}
+		} while(done < length && this->arrived(record, lwiot_tick()));
+
+		this->_event.signal();
+		return done;
+	}
+
+	size_t LoopbackPipe::available() const
+	{
+		ScopedLock lock(this->_lock);
+		auto now = lwiot_tick();
+		auto pos = this->_head;
+		size_t used = this->_used;
+		size_t num = 0;
+
+		while(used > 0) {
+			Record record;
+
+			this->copyOut(pos, &record, sizeof(record));
+
+			if(record.arrival > now)
+				break;
+
+			num += record.length;
+			pos += sizeof(record) + record.length;
+			used -= sizeof(record) + record.length;
+		}
+
+		return num - this->_offset;
+	}
+
+	bool LoopbackPipe::wait(int tmo)
+	{
+		ScopedLock lock(this->_lock);
+		auto deadline = lwiot_tick() + static_cast<time_t>(tmo) * 1000;
+		Record record;
+
+		while(!this->arrived(record, lwiot_tick())) {
+			if(this->_closed)
+				return this->_used > 0;
+
+			if(!this->sleep(lock, deadline, this->_used > 0 ? record.arrival : deadline))
+				return false;
+		}
+
+		return true;
+	}
+
+	void LoopbackPipe::close()
+	{
+		ScopedLock lock(this->_lock);
+
+		this->_closed = true;
+		this->_event.signal();
+	}
+
+	bool LoopbackPipe::closed() const
+	{
+		ScopedLock lock(this->_lock);
+		return this->_closed;
+	}
+
+	bool LoopbackPipe::drained() const
+	{
+		ScopedLock lock(this->_lock);
+		return this->_closed && this->_used == 0;
+	}
+
+	void LoopbackPipe::copyIn(size_t pos, const void *data, size_t length)
+	{
+		auto size = this->_ring.count();
+		auto bytes = static_cast<const uint8_t*>(data);
+
+		pos %= size;
+		auto first = length < size - pos ? length : size - pos;
+
+		memcpy(this->_ring.data() + pos, bytes, first);
+		memcpy(this->_ring.data(), bytes + first, length - first);
+	}
+
+	void LoopbackPipe::copyOut(size_t pos, void *output, size_t length) const
+	{
+		auto size = this->_ring.count();
+		auto bytes = static_cast<uint8_t*>(output);
+
+		pos %= size;
+		auto first = length < size - pos ? length : size - pos;
+
+		memcpy(bytes, this->_ring.data() + pos, first);
+		memcpy(bytes + first, this->_ring.data(), length - first);
+	}
+
+	void LoopbackPipe::push(const void *data, size_t length, const remote_addr_t& source)
+	{
+		Record record;
+		auto now = lwiot_tick();
+		auto start = now > this->_busy ? now : this->_busy;
+
+		/* The link is busy until the last byte has been clocked out */
+		if(this->_link.bandwidth > 0)
+			start += static_cast<time_t>(length) * 1000000 / this->_link.bandwidth;
+
+		this->_busy = start;
+		record.arrival = start + this->_link.latency;
+
+		if(this->lost()) {
+			if(this->_datagram)
+				return;
+
+			record.arrival += this->_link.retransmit;
+		}
+
+		/* Records leave the ring in order, a late one holds up the ones behind it */
+		if(record.arrival < this->_last)
+			record.arrival = this->_last;
+
+		record.length = length;
+		record.source = source;
+		this->_last = record.arrival;
+
+		auto tail = this->_head + this->_used;
+		this->copyIn(tail, &record, sizeof(record));
+		this->copyIn(tail + sizeof(record), data, length);
+		this->_used += sizeof(record) + length;
+		this->_event.signal();
+	}
+
+	void LoopbackPipe::pop(size_t length)
+	{
+		this->_head = (this->_head + length) % this->_ring.count();
+		this->_used -= length;
+	}
+
+	bool LoopbackPipe::arrived(Record& record, time_t now) const
+	{
+		if(this->_used == 0)
+			return false;
+
+		this->copyOut(this->_head, &record, sizeof(record));
+		return record.arrival <= now;
+	}
+
+	bool LoopbackPipe::sleep(ScopedLock& guard, time_t deadline, time_t until)
+	{
+		auto now = lwiot_tick();
+
+		if(now >= deadline)
+			return false;
+
+		auto remaining = (until < deadline ? until : deadline) - now;
+
+		/* The event has millisecond resolution, spin for anything shorter */
+		if(remaining < 1000) {
+			guard.unlock();
+			Thread::yield();
+			guard.lock();
+		} else {
+			this->_event.wait(guard, remaining / 1000 < MAX_WAIT_SLICE ? static_cast<int>(remaining / 1000) : MAX_WAIT_SLICE);
+		}
+
+		return true;
+	}
+
+	bool LoopbackPipe::lost()
+	{
+		if(this->_link.loss <= 0.0)
+			return false;
+
+		/* Xorshift keeps the loss pattern reproducible for a given seed */
+		this->_seed ^= this->_seed << 13;
+		this->_seed ^= this->_seed >> 17;
+		this->_seed ^= this->_seed << 5;
+
+		return this->_seed < this->_link.loss * UINT32_MAX;
+	}
+
+	LoopbackNetwork::LoopbackNetwork(size_t capacity, uint32_t seed) :
+		_lock(false), _link{0, 0, 0.0, DefaultRetransmit}, _capacity(capacity), _seed(seed), _next_port(FIRST_EPHEMERAL_PORT)
+	{
+	}
+
+	void LoopbackNetwork::setLink(const LoopbackLink& link)
+	{
+		ScopedLock lock(this->_lock);
+		this->_link = link;
+	}
+
+	size_t LoopbackNetwork::capacity() const
+	{
+		return this->_capacity;
+	}
+
+	bool LoopbackNetwork::listen(LoopbackTcpServer* server, const IPAddress& addr, uint16_t port)
+	{
+		ScopedLock lock(this->_lock);
+
+		if(this->find(addr, port, true) != nullptr)
+			return false;
+
+		this->_endpoints.push_back(Endpoint{ addr, port, server, nullptr });
+		return true;
+	}
+
+	void LoopbackNetwork::unlisten(LoopbackTcpServer* server)
+	{
+		ScopedLock lock(this->_lock);
+
+		for(auto iter = this->_endpoints.begin(); iter != this->_endpoints.end(); ++iter) {
+			if((*iter).server == server) {
+				this->_endpoints.erase(iter);
+				return;
+			}
+		}
+	}
+
+	SharedPointer<LoopbackConnection> LoopbackNetwork::connect(const IPAddress& addr, uint16_t port)
+	{
+		SharedPointer<LoopbackConnection> connection;
+		ScopedLock lock(this->_lock);
+		auto endpoint = this->find(addr, port, true);
+
+		if(endpoint == nullptr)
+			return connection;
+
+		connection.reset(new LoopbackConnection(this->_capacity));
+		this->configure(connection->upstream);
+		this->configure(connection->downstream);
+
+		IPAddress::fromBindAddress(BIND_ADDR_LB).toRemoteAddress(connection->client);
+		connection->client.port = to_netorders(this->_next_port++);
+
+		if(this->_next_port == 0)
+			this->_next_port = FIRST_EPHEMERAL_PORT;
+		addr.toRemoteAddress(connection->server);
+		connection->server.port = port;
+
+		auto server = endpoint->server;
+		lock.unlock();
+
+		/* A full backlog refuses the connection */
+		if(!server->offer(connection))
+			connection.reset();
+
+		return connection;
+	}
+
+	bool LoopbackNetwork::attach(LoopbackPipe* inbox, const IPAddress& addr, uint16_t port)
+	{
+		ScopedLock lock(this->_lock);
+
+		if(this->find(addr, port, false) != nullptr)
+			return false;
+
+		this->configure(*inbox);
+		this->_endpoints.push_back(Endpoint{ addr, port, nullptr, inbox });
+
+		return true;
+	}
+
+	void LoopbackNetwork::detach(LoopbackPipe* inbox)
+	{
+		ScopedLock lock(this->_lock);
+
+		for(auto iter = this->_endpoints.begin(); iter != this->_endpoints.end(); ++iter) {
+			if((*iter).inbox == inbox) {
+				this->_endpoints.erase(iter);
+				return;
+			}
+		}
+	}
+
+	ssize_t LoopbackNetwork::send(const IPAddress& addr, uint16_t port, const remote_addr_t& source,
+	                              const void *data, size_t length)
+	{
+		ScopedLock lock(this->_lock);
+		auto endpoint = this->find(addr, port, false);
+
+		/* Like UDP, sending to a port nobody listens on goes unnoticed */
+		if(endpoint == nullptr)
+			return length;
+
+		return endpoint->inbox->write(data, length, source, FOREVER);
+	}
+
+	uint16_t LoopbackNetwork::ephemeral()
+	{
+		ScopedLock lock(this->_lock);
+		auto port = this->_next_port++;
+
+		if(this->_next_port == 0)
+			this->_next_port = FIRST_EPHEMERAL_PORT;
+
+		return to_netorders(port);
+	}
+
+	LoopbackNetwork::Endpoint* LoopbackNetwork::find(const IPAddress& addr, uint16_t port, bool stream)
+	{
+		for(auto& endpoint : this->_endpoints) {
+			if(endpoint.port != port || (stream ? endpoint.server == nullptr : endpoint.inbox == nullptr))
+				continue;
+
+			if(matches(endpoint.addr, addr))
+				return &endpoint;
+		}
+
+		return nullptr;
+	}
+
+	void LoopbackNetwork::configure(LoopbackPipe& pipe)
+	{
+		/* Every pipe gets its own, but reproducible, loss pattern */
+		this->_seed = this->_seed * 1103515245U + 12345U;
+		pipe.setLink(this->_link, this->_seed);
+	}
+
+	bool LoopbackNetwork::matches(const IPAddress& bound, const IPAddress& addr)
+	{
+		remote_addr_t lhs, rhs;
+
+		bound.toRemoteAddress(lhs);
+		addr.toRemoteAddress(rhs);
+
+		if(lhs.version != rhs.version)
+			return false;
+
+		if(lhs.version == 4)
+			return lhs.addr.ip4_addr.ip == 0 || rhs.addr.ip4_addr.ip == 0 || lhs.addr.ip4_addr.ip == rhs.addr.ip4_addr.ip;
+
+		return memcmp(lhs.addr.ip6_addr.ip, rhs.addr.ip6_addr.ip, sizeof(lhs.addr.ip6_addr.ip)) == 0;
+	}
+}
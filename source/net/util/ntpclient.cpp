@@ -7,84 +7,330 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <lwiot.h>
 
+#include <lwiot/kernel/thread.h>
+
 #include <lwiot/network/udpclient.h>
 #include <lwiot/network/ipaddress.h>
 #include <lwiot/network/ntpclient.h>
 
-#include <lwiot/stl/referencewrapper.h>
-
 namespace lwiot
 {
-	NtpClient::NtpClient() : _current_epoch(0UL), _last_update(0UL)
+	NtpClient::NtpClient() : _servers(), _count(0), _samples(DefaultSamples), _synchronized(false),
+		_base(0), _base_tick(0), _slew(0), _drift(0.0), _error(0), _error_tick(0), _offset(0), _delay(0)
 	{
 	}
 
-	NtpClient::NtpClient(lwiot::UdpClient &client) :
-		_client(client), _current_epoch(0ULL), _last_update(0ULL)
+	NtpClient::NtpClient(lwiot::UdpClient &client) : NtpClient()
 	{
+		this->addServer(client);
 	}
 
 	void NtpClient::begin(lwiot::UdpClient &client)
 	{
-		this->_client = client;
+		this->addServer(client);
 		this->begin();
 	}
 
 	void NtpClient::begin()
 	{
-		this->_client->begin();
-		this->_client->setTimeout(2);
+		for(size_t idx = 0; idx < this->_count; idx++) {
+			this->_servers[idx].client->begin();
+			this->_servers[idx].client->setTimeout(2);
+		}
 	}
 
-	void NtpClient::sendRequest() const
+	bool NtpClient::addServer(UdpClient& client)
 	{
-		ByteBuffer buffer(NtpClient::NTP_PACKET_SIZE, true);
+		for(size_t idx = 0; idx < this->_count; idx++) {
+			if(this->_servers[idx].client == &client)
+				return true;
+		}
+
+		if(this->_count == MaxServers)
+			return false;
+
+		this->_servers[this->_count++] = Server{ &client, false, 0, 0 };
+		return true;
+	}
 
-		buffer[0] = 0b11100011;
-		buffer[1] = 0;
-		buffer[2] = 6;
-		buffer[3] = 0xEC;
+	void NtpClient::setSamples(uint8_t samples)
+	{
+		this->_samples = samples > 0 ? samples : 1;
+	}
 
-		/* Bytes 4 through 11 are zero. Initialised by the constructor */
-		buffer[12]  = 49;
-		buffer[13]  = 0x4E;
-		buffer[14]  = 49;
-		buffer[15] = 52;
+	/* Timestamps are kept in microseconds since the UNIX epoch */
+	void NtpClient::encode(int64_t time, uint8_t *output)
+	{
+		auto seconds = static_cast<uint32_t>(time / 1000000 + NtpClient::SEVENTY_YEARS);
+		auto fraction = static_cast<uint32_t>((static_cast<uint64_t>(time % 1000000) << 32) / 1000000);
 
-		this->_client->write(buffer.data(), NtpClient::NTP_PACKET_SIZE);
+		for(int idx = 0; idx < 4; idx++) {
+			output[idx] = static_cast<uint8_t>(seconds >> (24 - idx * 8));
+			output[idx + 4] = static_cast<uint8_t>(fraction >> (24 - idx * 8));
+		}
 	}
 
-#define merge(h, l) ((h << 8) | l)
+	int64_t NtpClient::decode(const uint8_t *input)
+	{
+		uint64_t seconds = 0, fraction = 0;
+
+		for(int idx = 0; idx < 4; idx++) {
+			seconds = (seconds << 8) | input[idx];
+			fraction = (fraction << 8) | input[idx + 4];
+		}
+
+		/* Era 1 starts in 2036, see RFC 4330 section 3 */
+		if(seconds < 0x80000000ULL)
+			seconds += 0x100000000ULL;
+
+		return static_cast<int64_t>(seconds - NtpClient::SEVENTY_YEARS) * 1000000 +
+			static_cast<int64_t>((fraction * 1000000 + 0x80000000ULL) >> 32);
+	}
+
+	/* See RFC 4330 section 8 */
+	void NtpClient::kiss(Server& server, const uint8_t *code) const
+	{
+		if(memcmp(code, "DENY", 4) == 0 || memcmp(code, "RSTR", 4) == 0) {
+			server.denied = true;
+			return;
+		}
+
+		if(memcmp(code, "RATE", 4) != 0)
+			return;
+
+		if(server.backoff == 0)
+			server.backoff = NtpClient::MinBackoff;
+		else if(server.backoff < NtpClient::MaxBackoff)
+			server.backoff *= 2;
+
+		server.holdoff = lwiot_tick() + server.backoff;
+	}
+
+	bool NtpClient::exchange(Server& server, Sample& sample) const
+	{
+		auto& client = *server.client;
+
+		uint8_t request[NtpClient::NTP_PACKET_SIZE];
+		uint8_t reply[NtpClient::NTP_PACKET_SIZE];
+		ssize_t rv;
+		time_t tick;
+
+		memset(request, 0, sizeof(request));
+		request[0] = 0b11100011;
+		request[1] = 0;
+		request[2] = 6;
+		request[3] = 0xEC;
+
+		request[12] = 49;
+		request[13] = 0x4E;
+		request[14] = 49;
+		request[15] = 52;
+
+		/* T1, the server echoes it as the originate timestamp */
+		auto t1 = this->now(lwiot_tick());
+		encode(t1, request + 40);
+
+		if(client.write(request, sizeof(request)) != static_cast<ssize_t>(sizeof(request)))
+			return false;
+
+		/* Late replies to an earlier request carry a different originate timestamp */
+		do {
+			rv = client.read(reply, sizeof(reply));
+			tick = lwiot_tick();
+
+			if(rv <= 0)
+				return false;
+		} while(rv < NtpClient::NTP_PACKET_SIZE || memcmp(reply + 24, request + 40, 8) != 0);
+
+		auto t4 = this->now(tick);
+
+		if((reply[0] & 0x7) != 4)
+			return false;
+
+		/* A kiss-o'-death carries its code in the reference ID */
+		if(reply[1] == 0) {
+			this->kiss(server, reply + 12);
+			return false;
+		}
+
+		/* Synchronized servers only */
+		if((reply[0] >> 6) == 3 || reply[1] > 15)
+			return false;
+
+		server.backoff = 0;
+
+		auto t2 = decode(reply + 32);
+		auto t3 = decode(reply + 40);
+
+		sample.offset = ((t2 - t1) + (t3 - t4)) / 2;
+		sample.delay = (t4 - t1) - (t3 - t2);
+
+		return sample.delay >= 0;
+	}
 
-#define UPDATE_DELAY 500
 	bool NtpClient::update()
 	{
-		ByteBuffer buffer(NtpClient::NTP_PACKET_SIZE, true);
-		uint32_t hi, lo, result;
+		Sample selected[MaxServers];
+		Sample best[MaxServers];
+		bool active[MaxServers];
+		uint8_t valid[MaxServers];
+		size_t found = 0;
+		auto tick = lwiot_tick();
+
+		for(size_t idx = 0; idx < this->_count; idx++) {
+			auto& server = this->_servers[idx];
+
+			active[idx] = !server.denied && static_cast<int64_t>(tick - server.holdoff) >= 0;
+			valid[idx] = 0;
+		}
+
+		/* Like iburst, samples of one server are spaced rather than sent back-to-back */
+		for(uint8_t num = 0; num < this->_samples; num++) {
+			bool pending = false;
 
-		this->sendRequest();
+			for(size_t idx = 0; idx < this->_count; idx++)
+				pending = pending || active[idx];
 
-		if(unlikely(this->_client->read(buffer.data(), buffer.count()) <= 0))
+			if(!pending)
+				break;
+
+			if(num > 0)
+				lwiot::Thread::sleep(NtpClient::BurstInterval / 1000);
+
+			for(size_t idx = 0; idx < this->_count; idx++) {
+				Sample sample;
+
+				if(!active[idx])
+					continue;
+
+				if(!this->exchange(this->_servers[idx], sample)) {
+					active[idx] = false;
+					continue;
+				}
+
+				/* The sample with the lowest delay suffers least from queueing */
+				if(valid[idx] == 0 || sample.delay < best[idx].delay)
+					best[idx] = sample;
+
+				valid[idx]++;
+			}
+		}
+
+		for(size_t idx = 0; idx < this->_count; idx++) {
+			if(valid[idx] == 0)
+				continue;
+
+			size_t pos = found++;
+
+			for(; pos > 0 && selected[pos - 1].offset > best[idx].offset; pos--)
+				selected[pos] = selected[pos - 1];
+
+			selected[pos] = best[idx];
+		}
+
+		if(found == 0)
 			return false;
 
-		this->_last_update = lwiot_tick_ms() - UPDATE_DELAY;
-		hi = merge(buffer[40], buffer[41]);
-		lo = merge(buffer[42], buffer[43]);
-		result = (hi << 16) | lo;
-		this->_current_epoch = result - NtpClient::SEVENTY_YEARS;
+		/* The median outvotes a single falseticker */
+		auto chosen = &selected[found / 2];
+
+		if(found % 2 == 0 && selected[found / 2 - 1].delay < chosen->delay)
+			chosen = &selected[found / 2 - 1];
+
+		this->_offset = chosen->offset;
+		this->_delay = chosen->delay;
+		this->discipline(chosen->offset, lwiot_tick());
 
 		return true;
 	}
 
+	int64_t NtpClient::remaining(time_t tick) const
+	{
+		auto limit = static_cast<int64_t>((tick - this->_base_tick) * NtpClient::MaxSlew);
+
+		if(this->_slew > limit)
+			return this->_slew - limit;
+
+		if(this->_slew < -limit)
+			return this->_slew + limit;
+
+		return 0;
+	}
+
+	int64_t NtpClient::now(time_t tick) const
+	{
+		int64_t elapsed = tick - this->_base_tick;
+
+		return this->_base + elapsed + static_cast<int64_t>(elapsed * this->_drift) +
+			this->_slew - this->remaining(tick);
+	}
+
+	void NtpClient::discipline(int64_t offset, time_t tick)
+	{
+		auto current = this->now(tick);
+
+		if(!this->_synchronized || llabs(offset) >= NtpClient::StepThreshold) {
+			this->_base = current + offset;
+			this->_base_tick = tick;
+			this->_slew = 0;
+			this->_error = 0;
+			this->_error_tick = tick;
+			this->_synchronized = true;
+			return;
+		}
+
+		/* Whatever the previous correction doesn't explain is frequency error */
+		this->_error += offset - this->remaining(tick);
+		auto interval = tick - this->_error_tick;
+
+		if(interval >= NtpClient::DriftInterval) {
+			/* Only half of it, so a single noisy interval can't throw the estimate off */
+			this->_drift += static_cast<double>(this->_error) / interval / 2.0;
+
+			if(this->_drift > NtpClient::MaxDrift)
+				this->_drift = NtpClient::MaxDrift;
+			else if(this->_drift < -NtpClient::MaxDrift)
+				this->_drift = -NtpClient::MaxDrift;
+
+			this->_error = 0;
+			this->_error_tick = tick;
+		}
+
+		this->_base = current;
+		this->_base_tick = tick;
+		this->_slew = offset;
+	}
+
 	time_t NtpClient::time() const
 	{
-		time_t rv;
+		return static_cast<time_t>(this->now(lwiot_tick()) / 1000000);
+	}
 
-		rv = lwiot_tick_ms() - this->_last_update;
-		rv /= 1000;
-		rv += this->_current_epoch;
-		return rv;
+	uint64_t NtpClient::milliseconds() const
+	{
+		return static_cast<uint64_t>(this->now(lwiot_tick()) / 1000);
+	}
+
+	bool NtpClient::synchronized() const
+	{
+		return this->_synchronized;
+	}
+
+	int64_t NtpClient::offset() const
+	{
+		return this->_offset;
+	}
+
+	int64_t NtpClient::delay() const
+	{
+		return this->_delay;
+	}
+
+	double NtpClient::drift() const
+	{
+		return this->_drift * 1e6;
 	}
 }
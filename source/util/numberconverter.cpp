@@ -0,0 +1,653 @@
+/*
+ * Fast number to text conversions.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/util/numberconverter.h>
+
+#define SIGNIFICAND_MASK UINT64_C(0x000FFFFFFFFFFFFF)
+#define EXPONENT_MASK    UINT64_C(0x7FF0000000000000)
+#define HIDDEN_BIT       UINT64_C(0x0010000000000000)
+#define SIGNIFICAND_SIZE 52
+#define EXPONENT_BIAS    (0x3FF + SIGNIFICAND_SIZE)
+
+#define FLOAT_HIDDEN_BIT    UINT64_C(0x800000)
+#define FLOAT_EXPONENT_BIAS (0x7F + 23)
+
+namespace lwiot
+{
+	static const char pairs[] =
+		"00010203040506070809"
+		"10111213141516171819"
+		"20212223242526272829"
+		"30313233343536373839"
+		"40414243444546474849"
+		"50515253545556575859"
+		"60616263646566676869"
+		"70717273747576777879"
+		"80818283848586878889"
+		"90919293949596979899";
+
+	static const uint32_t powers32[] = {
+		1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+	};
+
+	static const uint64_t powers64[] = {
+		UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000), UINT64_C(10000), UINT64_C(100000),
+		UINT64_C(1000000), UINT64_C(10000000), UINT64_C(100000000), UINT64_C(1000000000),
+		UINT64_C(10000000000), UINT64_C(100000000000), UINT64_C(1000000000000), UINT64_C(10000000000000),
+		UINT64_C(100000000000000), UINT64_C(1000000000000000), UINT64_C(10000000000000000),
+		UINT64_C(100000000000000000), UINT64_C(1000000000000000000), UINT64_C(10000000000000000000)
+	};
+
+	static const double powers[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	/* 10^k for k = -348, -340, ..., 340 as normalized 64 bit significands */
+	static const uint64_t cached_significands[] = {
+		UINT64_C(0xfa8fd5a0081c0288), UINT64_C(0xbaaee17fa23ebf76), UINT64_C(0x8b16fb203055ac76),
+		UINT64_C(0xcf42894a5dce35ea), UINT64_C(0x9a6bb0aa55653b2d), UINT64_C(0xe61acf033d1a45df),
+		UINT64_C(0xab70fe17c79ac6ca), UINT64_C(0xff77b1fcbebcdc4f), UINT64_C(0xbe5691ef416bd60c),
+		UINT64_C(0x8dd01fad907ffc3c), UINT64_C(0xd3515c2831559a83), UINT64_C(0x9d71ac8fada6c9b5),
+		UINT64_C(0xea9c227723ee8bcb), UINT64_C(0xaecc49914078536d), UINT64_C(0x823c12795db6ce57),
+		UINT64_C(0xc21094364dfb5637), UINT64_C(0x9096ea6f3848984f), UINT64_C(0xd77485cb25823ac7),
+		UINT64_C(0xa086cfcd97bf97f4), UINT64_C(0xef340a98172aace5), UINT64_C(0xb23867fb2a35b28e),
+		UINT64_C(0x84c8d4dfd2c63f3b), UINT64_C(0xc5dd44271ad3cdba), UINT64_C(0x936b9fcebb25c996),
+		UINT64_C(0xdbac6c247d62a584), UINT64_C(0xa3ab66580d5fdaf6), UINT64_C(0xf3e2f893dec3f126),
+		UINT64_C(0xb5b5ada8aaff80b8), UINT64_C(0x87625f056c7c4a8b), UINT64_C(0xc9bcff6034c13053),
+		UINT64_C(0x964e858c91ba2655), UINT64_C(0xdff9772470297ebd), UINT64_C(0xa6dfbd9fb8e5b88f),
+		UINT64_C(0xf8a95fcf88747d94), UINT64_C(0xb94470938fa89bcf), UINT64_C(0x8a08f0f8bf0f156b),
+		UINT64_C(0xcdb02555653131b6), UINT64_C(0x993fe2c6d07b7fac), UINT64_C(0xe45c10c42a2b3b06),
+		UINT64_C(0xaa242499697392d3), UINT64_C(0xfd87b5f28300ca0e), UINT64_C(0xbce5086492111aeb),
+		UINT64_C(0x8cbccc096f5088cc), UINT64_C(0xd1b71758e219652c), UINT64_C(0x9c40000000000000),
+		UINT64_C(0xe8d4a51000000000), UINT64_C(0xad78ebc5ac620000), UINT64_C(0x813f3978f8940984),
+		UINT64_C(0xc097ce7bc90715b3), UINT64_C(0x8f7e32ce7bea5c70), UINT64_C(0xd5d238a4abe98068),
+		UINT64_C(0x9f4f2726179a2245), UINT64_C(0xed63a231d4c4fb27), UINT64_C(0xb0de65388cc8ada8),
+		UINT64_C(0x83c7088e1aab65db), UINT64_C(0xc45d1df942711d9a), UINT64_C(0x924d692ca61be758),
+		UINT64_C(0xda01ee641a708dea), UINT64_C(0xa26da3999aef774a), UINT64_C(0xf209787bb47d6b85),
+		UINT64_C(0xb454e4a179dd1877), UINT64_C(0x865b86925b9bc5c2), UINT64_C(0xc83553c5c8965d3d),
+		UINT64_C(0x952ab45cfa97a0b3), UINT64_C(0xde469fbd99a05fe3), UINT64_C(0xa59bc234db398c25),
+		UINT64_C(0xf6c69a72a3989f5c), UINT64_C(0xb7dcbf5354e9bece), UINT64_C(0x88fcf317f22241e2),
+		UINT64_C(0xcc20ce9bd35c78a5), UINT64_C(0x98165af37b2153df), UINT64_C(0xe2a0b5dc971f303a),
+		UINT64_C(0xa8d9d1535ce3b396), UINT64_C(0xfb9b7cd9a4a7443c), UINT64_C(0xbb764c4ca7a44410),
+		UINT64_C(0x8bab8eefb6409c1a), UINT64_C(0xd01fef10a657842c), UINT64_C(0x9b10a4e5e9913129),
+		UINT64_C(0xe7109bfba19c0c9d), UINT64_C(0xac2820d9623bf429), UINT64_C(0x80444b5e7aa7cf85),
+		UINT64_C(0xbf21e44003acdd2d), UINT64_C(0x8e679c2f5e44ff8f), UINT64_C(0xd433179d9c8cb841),
+		UINT64_C(0x9e19db92b4e31ba9), UINT64_C(0xeb96bf6ebadf77d9), UINT64_C(0xaf87023b9bf0ee6b),
+	};
+
+	static const int16_t cached_exponents[] = {
+		-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+		-954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+		-688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+		-422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+		-157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+		109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+		375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+		641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+		907, 933, 960, 986, 1013, 1039, 1066,
+	};
+
+	/*
+	 * Grisu2, after Florian Loitsch, "Printing Floating-Point Numbers Quickly
+	 * and Accurately with Integers" (PLDI 2010).
+	 */
+	struct DiyFp {
+		uint64_t f;
+		int e;
+
+		DiyFp(uint64_t significand, int exponent) : f(significand), e(exponent)
+		{
+		}
+
+		explicit DiyFp(float value)
+		{
+			uint32_t bits;
+
+			memcpy(&bits, &value, sizeof(bits));
+
+			int biased = static_cast<int>((bits >> 23) & 0xFF);
+			uint64_t significand = bits & 0x7FFFFF;
+
+			if(biased != 0) {
+				this->f = significand + FLOAT_HIDDEN_BIT;
+				this->e = biased - FLOAT_EXPONENT_BIAS;
+			} else {
+				this->f = significand;
+				this->e = 1 - FLOAT_EXPONENT_BIAS;
+			}
+		}
+
+		explicit DiyFp(double value)
+		{
+			uint64_t bits;
+
+			memcpy(&bits, &value, sizeof(bits));
+
+			int biased = static_cast<int>((bits & EXPONENT_MASK) >> SIGNIFICAND_SIZE);
+			uint64_t significand = bits & SIGNIFICAND_MASK;
+
+			if(biased != 0) {
+				this->f = significand + HIDDEN_BIT;
+				this->e = biased - EXPONENT_BIAS;
+			} else {
+				this->f = significand;
+				this->e = 1 - EXPONENT_BIAS;
+			}
+		}
+
+		DiyFp operator-(const DiyFp& rhs) const
+		{
+			return DiyFp(this->f - rhs.f, this->e);
+		}
+
+		/* Upper 64 bits of the product, rounded */
+		DiyFp operator*(const DiyFp& rhs) const
+		{
+			const uint64_t mask = 0xFFFFFFFF;
+			uint64_t a = this->f >> 32, b = this->f & mask;
+			uint64_t c = rhs.f >> 32, d = rhs.f & mask;
+			uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+			uint64_t tmp = (bd >> 32) + (ad & mask) + (bc & mask);
+
+			tmp += UINT64_C(1) << 31;
+			return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), this->e + rhs.e + 64);
+		}
+
+		DiyFp normalize() const
+		{
+			DiyFp result = *this;
+
+			while(!(result.f & (UINT64_C(1) << 63))) {
+				result.f <<= 1;
+				result.e--;
+			}
+
+			return result;
+		}
+
+		/* The halfway points to the neighbouring values */
+		void boundaries(uint64_t hidden, DiyFp& minus, DiyFp& plus) const
+		{
+			plus = DiyFp((this->f << 1) + 1, this->e - 1).normalize();
+
+			if(this->f == hidden)
+				minus = DiyFp((this->f << 2) - 1, this->e - 2);
+			else
+				minus = DiyFp((this->f << 1) - 1, this->e - 1);
+
+			minus.f <<= minus.e - plus.e;
+			minus.e = plus.e;
+		}
+	};
+
+	static DiyFp cachedPower(int e, int& k)
+	{
+		double dk = (-61 - e) * 0.30102999566398114 + 347;
+		int exponent = static_cast<int>(dk);
+
+		if(dk - exponent > 0.0)
+			exponent++;
+
+		unsigned index = static_cast<unsigned>((exponent >> 3) + 1);
+
+		k = -(-348 + static_cast<int>(index) * 8);
+		return DiyFp(cached_significands[index], cached_exponents[index]);
+	}
+
+	static void grisuRound(char *buffer, int length, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+	{
+		while(rest < wp_w && delta - rest >= ten_kappa &&
+		      (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+			buffer[length - 1]--;
+			rest += ten_kappa;
+		}
+	}
+
+	static int countDigits(uint32_t value)
+	{
+		int digits = 1;
+
+		while(digits < 10 && value >= powers32[digits])
+			digits++;
+
+		return digits;
+	}
+
+	static int digitGen(const DiyFp& w, const DiyFp& mp, uint64_t delta, char *buffer, int& k)
+	{
+		const DiyFp one(UINT64_C(1) << -mp.e, mp.e);
+		const DiyFp wp_w = mp - w;
+		auto p1 = static_cast<uint32_t>(mp.f >> -one.e);
+		uint64_t p2 = mp.f & (one.f - 1);
+		int kappa = countDigits(p1);
+		int length = 0;
+
+		while(kappa > 0) {
+			uint32_t digit = p1 / powers32[kappa - 1];
+
+			p1 %= powers32[kappa - 1];
+
+			if(digit || length)
+				buffer[length++] = static_cast<char>('0' + digit);
+
+			kappa--;
+
+			uint64_t rest = (static_cast<uint64_t>(p1) << -one.e) + p2;
+
+			if(rest <= delta) {
+				k += kappa;
+				grisuRound(buffer, length, delta, rest, static_cast<uint64_t>(powers32[kappa]) << -one.e, wp_w.f);
+				return length;
+			}
+		}
+
+		while(true) {
+			p2 *= 10;
+			delta *= 10;
+
+			auto digit = static_cast<char>(p2 >> -one.e);
+
+			if(digit || length)
+				buffer[length++] = static_cast<char>('0' + digit);
+
+			p2 &= one.f - 1;
+			kappa--;
+
+			if(p2 < delta) {
+				k += kappa;
+				grisuRound(buffer, length, delta, p2, one.f, -kappa < 20 ? wp_w.f * powers64[-kappa] : 0);
+				return length;
+			}
+		}
+	}
+
+	static int grisu2(const DiyFp& v, uint64_t hidden, char *buffer, int& k)
+	{
+		DiyFp minus(0, 0), plus(0, 0);
+
+		v.boundaries(hidden, minus, plus);
+
+		const DiyFp c_mk = cachedPower(plus.e, k);
+		const DiyFp w = v.normalize() * c_mk;
+		DiyFp wp = plus * c_mk;
+		DiyFp wm = minus * c_mk;
+
+		wm.f++;
+		wp.f--;
+
+		return digitGen(w, wp, wp.f - wm.f, buffer, k);
+	}
+
+	static size_t exponent(int value, char *output)
+	{
+		size_t length = 1;
+
+		output[0] = 'e';
+
+		if(value < 0) {
+			output[length++] = '-';
+			value = -value;
+		}
+
+		return length + NumberConverter::formatUnsigned(static_cast<uint64_t>(value), output + length);
+	}
+
+	/* Places the decimal point in the digits of 0.d1d2...dn * 10^kk */
+	static size_t prettify(char *buffer, int length, int k)
+	{
+		int kk = length + k;
+
+		if(length <= kk && kk <= 21) {
+			/* 1234e7 -> 12340000000 */
+			for(int idx = length; idx < kk; idx++)
+				buffer[idx] = '0';
+
+			buffer[kk] = '\0';
+			return static_cast<size_t>(kk);
+		} else if(0 < kk && kk <= 21) {
+			/* 1234e-2 -> 12.34 */
+			memmove(buffer + kk + 1, buffer + kk, static_cast<size_t>(length - kk));
+			buffer[kk] = '.';
+			buffer[length + 1] = '\0';
+			return static_cast<size_t>(length + 1);
+		} else if(-6 < kk && kk <= 0) {
+			/* 1234e-6 -> 0.001234 */
+			int offset = 2 - kk;
+
+			memmove(buffer + offset, buffer, static_cast<size_t>(length));
+			buffer[0] = '0';
+			buffer[1] = '.';
+
+			for(int idx = 2; idx < offset; idx++)
+				buffer[idx] = '0';
+
+			buffer[length + offset] = '\0';
+			return static_cast<size_t>(length + offset);
+		} else if(length == 1) {
+			/* 1e30 */
+			return 1 + exponent(kk - 1, buffer + 1);
+		}
+
+		/* 1234e30 -> 1.234e33 */
+		memmove(buffer + 2, buffer + 1, static_cast<size_t>(length - 1));
+		buffer[1] = '.';
+		return static_cast<size_t>(length + 1) + exponent(kk - 1, buffer + length + 1);
+	}
+
+	size_t NumberConverter::formatUnsigned(uint64_t value, char *output)
+	{
+		char digits[20];
+		size_t idx = sizeof(digits);
+
+		while(value >= 100) {
+			auto pair = static_cast<size_t>(value % 100) * 2;
+
+			value /= 100;
+			digits[--idx] = pairs[pair + 1];
+			digits[--idx] = pairs[pair];
+		}
+
+		if(value >= 10) {
+			auto pair = static_cast<size_t>(value) * 2;
+
+			digits[--idx] = pairs[pair + 1];
+			digits[--idx] = pairs[pair];
+		} else {
+			digits[--idx] = static_cast<char>('0' + value);
+		}
+
+		size_t length = sizeof(digits) - idx;
+
+		memcpy(output, digits + idx, length);
+		output[length] = '\0';
+
+		return length;
+	}
+
+	size_t NumberConverter::formatInteger(int64_t value, char *output)
+	{
+		if(value >= 0)
+			return formatUnsigned(static_cast<uint64_t>(value), output);
+
+		output[0] = '-';
+		return 1 + formatUnsigned(0 - static_cast<uint64_t>(value), output + 1);
+	}
+
+	static size_t special(double value, char *output)
+	{
+		const char *text = isnan(value) ? "nan" : (value < 0 ? "-inf" : "inf");
+		size_t length = strlen(text);
+
+		memcpy(output, text, length + 1);
+		return length;
+	}
+
+	size_t NumberConverter::formatDouble(double value, char *output)
+	{
+		size_t sign = 0;
+		int k = 0;
+
+		if(isnan(value) || isinf(value))
+			return special(value, output);
+
+		if(signbit(value)) {
+			output[sign++] = '-';
+			value = -value;
+		}
+
+		if(value == 0.0) {
+			output[sign] = '0';
+			output[sign + 1] = '\0';
+			return sign + 1;
+		}
+
+		int length = grisu2(DiyFp(value), HIDDEN_BIT, output + sign, k);
+		return sign + prettify(output + sign, length, k);
+	}
+
+	size_t NumberConverter::formatFloat(float value, char *output)
+	{
+		size_t sign = 0;
+		int k = 0;
+
+		if(isnan(value) || isinf(value))
+			return special(value, output);
+
+		if(signbit(value)) {
+			output[sign++] = '-';
+			value = -value;
+		}
+
+		if(value == 0.0f) {
+			output[sign] = '0';
+			output[sign + 1] = '\0';
+			return sign + 1;
+		}
+
+		/* The same digits, within the narrower boundaries of a float */
+		int length = grisu2(DiyFp(value), FLOAT_HIDDEN_BIT, output + sign, k);
+		return sign + prettify(output + sign, length, k);
+	}
+
+	size_t NumberConverter::formatFixed(double value, uint8_t decimals, char *output, size_t size)
+	{
+		char text[MaxLength];
+		size_t length = 0;
+
+		if(size == 0)
+			return 0;
+
+		if(isnan(value) || isinf(value)) {
+			length = special(value, text);
+		} else if(decimals > 9 || fabs(value) >= 1e15) {
+			int num = snprintf(output, size, "%.*f", decimals, value);
+
+			if(num < 0)
+				return 0;
+
+			return static_cast<size_t>(num) < size ? static_cast<size_t>(num) : size - 1;
+		} else {
+			auto magnitude = fabs(value);
+			auto integral = static_cast<uint64_t>(magnitude);
+			double part = magnitude - static_cast<double>(integral);
+			double scaled = part * powers[decimals];
+			auto fraction = static_cast<uint64_t>(scaled);
+			double rest = scaled - static_cast<double>(fraction);
+
+			if(rest == 0.5) {
+				/* Only the rounding error of the product tells on which side the value is */
+				double error = fma(part, powers[decimals], -scaled);
+				uint64_t last = decimals ? fraction : integral;
+
+				/* Exact ties round to even, like printf() */
+				if(error > 0 || (error == 0 && (last & 1)))
+					fraction++;
+			} else if(rest > 0.5) {
+				fraction++;
+			}
+
+			if(fraction >= powers32[decimals]) {
+				fraction -= powers32[decimals];
+				integral++;
+			}
+
+			if(signbit(value))
+				text[length++] = '-';
+
+			length += formatUnsigned(integral, text + length);
+
+			if(decimals > 0) {
+				text[length++] = '.';
+
+				for(size_t idx = decimals; idx > 0; idx--) {
+					text[length + idx - 1] = static_cast<char>('0' + fraction % 10);
+					fraction /= 10;
+				}
+
+				length += decimals;
+			}
+		}
+
+		if(length >= size)
+			length = size - 1;
+
+		memcpy(output, text, length);
+		output[length] = '\0';
+
+		return length;
+	}
+
+	bool NumberConverter::parseInteger(const char *text, int64_t& value, const char **end)
+	{
+		auto start = text;
+		bool negative = false;
+		uint64_t result = 0;
+
+		if(*text == '-' || *text == '+')
+			negative = *text++ == '-';
+
+		uint64_t limit = negative ? static_cast<uint64_t>(INT64_MAX) + 1 : INT64_MAX;
+		auto digits = text;
+
+		for(; *text >= '0' && *text <= '9'; text++) {
+			auto digit = static_cast<uint64_t>(*text - '0');
+
+			if(result > (limit - digit) / 10)
+				return false;
+
+			result = result * 10 + digit;
+		}
+
+		if(text == digits) {
+			if(end)
+				*end = start;
+
+			return false;
+		}
+
+		if(end)
+			*end = text;
+
+		value = negative ? static_cast<int64_t>(0 - result) : static_cast<int64_t>(result);
+		return true;
+	}
+
+	bool NumberConverter::parseDouble(const char *text, double& value, const char **end)
+	{
+		auto start = text;
+		bool negative = false;
+		uint64_t mantissa = 0;
+		int significant = 0;
+		int scale = 0;
+		bool digits = false;
+
+		if(*text == '-' || *text == '+')
+			negative = *text++ == '-';
+
+		for(; *text >= '0' && *text <= '9'; text++) {
+			digits = true;
+
+			if(significant < 19) {
+				mantissa = mantissa * 10 + static_cast<uint64_t>(*text - '0');
+				significant += mantissa != 0;
+			} else {
+				scale++;
+				significant++;
+			}
+		}
+
+		if(*text == '.') {
+			for(text++; *text >= '0' && *text <= '9'; text++) {
+				digits = true;
+
+				if(significant < 19) {
+					mantissa = mantissa * 10 + static_cast<uint64_t>(*text - '0');
+					significant += mantissa != 0;
+					scale--;
+				} else {
+					significant++;
+				}
+			}
+		}
+
+		if(!digits) {
+			if(end)
+				*end = start;
+
+			return false;
+		}
+
+		if(*text == 'e' || *text == 'E') {
+			auto mark = text++;
+			bool below = false;
+			int power = 0;
+
+			if(*text == '-' || *text == '+')
+				below = *text++ == '-';
+
+			if(*text < '0' || *text > '9') {
+				text = mark;
+			} else {
+				for(; *text >= '0' && *text <= '9'; text++) {
+					if(power < 10000)
+						power = power * 10 + (*text - '0');
+				}
+
+				scale += below ? -power : power;
+			}
+		}
+
+		/* Exact when both the digits and the power of ten fit a double */
+		if(significant <= 19 && mantissa <= (UINT64_C(1) << 53) && scale >= -22 && scale <= 22 + 15) {
+			auto result = static_cast<double>(mantissa);
+			bool exact = true;
+
+			if(scale < 0) {
+				result /= powers[-scale];
+			} else if(scale > 22) {
+				result *= powers[scale - 22];
+				exact = result < 9007199254740992.0;
+				result *= powers[22];
+			} else {
+				result *= powers[scale];
+			}
+
+			if(exact) {
+				if(end)
+					*end = text;
+
+				value = negative ? -result : result;
+				return true;
+			}
+		}
+
+		char *stop;
+
+		value = strtod(start, &stop);
+
+		if(end)
+			*end = stop;
+
+		return true;
+	}
+}
+
+#undef SIGNIFICAND_MASK
+#undef EXPONENT_MASK
+#undef HIDDEN_BIT
+#undef SIGNIFICAND_SIZE
+#undef EXPONENT_BIAS
+#undef FLOAT_HIDDEN_BIT
+#undef FLOAT_EXPONENT_BIAS
@@ -28,6 +28,7 @@
 
 #include <lwiot/lwiot.h>
 #include <lwiot/stl/string.h>
+#include <lwiot/util/numberconverter.h>
 
 #ifdef WIN32
 #pragma warning (disable : 4244)
@@ -44,6 +45,12 @@ namespace lwiot
 				copy(cstr, strlen(cstr));
 		}
 
+		String::String(const char *cstr, size_t length) : buffer(nullptr), capacity(0), len(0)
+		{
+			this->init();
+			this->copy(reinterpret_cast<const uint8_t*>(cstr), length);
+		}
+
 		String::String(const lwiot::ByteBuffer &buf) : buffer(nullptr), capacity(0), len(0)
 		{
 			this->init();
@@ -136,8 +143,7 @@ namespace lwiot
 			init();
 			char buf[33];
 
-			UNUSED(decimalPlaces);
-			sprintf(buf, "%f", (double) value);
+			NumberConverter::formatFixed(value, decimalPlaces, buf, sizeof(buf));
 			*this = buf;
 		}
 
@@ -146,8 +152,7 @@ namespace lwiot
 			init();
 			char buf[33];
 
-			UNUSED(decimalPlaces);
-			sprintf(buf, "%f", value);
+			NumberConverter::formatFixed(value, decimalPlaces, buf, sizeof(buf));
 			*this = buf;
 		}
 
@@ -384,17 +389,17 @@ namespace lwiot
 		unsigned char String::concat(float num)
 		{
 			char buf[33];
+			auto length = NumberConverter::formatFixed(num, 6, buf, sizeof(buf));
 
-			sprintf(buf, "%f", (double) num);
-			return concat(buf, (unsigned int) strlen(buf));
+			return concat(buf, (unsigned int) length);
 		}
 
 		unsigned char String::concat(double num)
 		{
 			char buf[33];
+			auto length = NumberConverter::formatFixed(num, 6, buf, sizeof(buf));
 
-			sprintf(buf, "%f", num);
-			return concat(buf, (unsigned int) strlen(buf));
+			return concat(buf, (unsigned int) length);
 		}
 
 		/*********************************************/
@@ -847,9 +852,18 @@ namespace lwiot
 
 		double String::toDouble() const
 		{
-			if(buffer)
-				return atof(buffer);
-			return 0;
+			double value = 0;
+			const char *text = buffer;
+
+			if(text == nullptr)
+				return 0;
+
+			/* Like atof(), leading white space is skipped */
+			while(isspace(static_cast<unsigned char>(*text)))
+				text++;
+
+			NumberConverter::parseDouble(text, value);
+			return value;
 		}
 
 		bool String::equalsConstantTime(const lwiot::String &s2) const
@@ -0,0 +1,148 @@
+/*
+ * Base64 throughput benchmark.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bufferedstream.h>
+
+#include <lwiot/network/base64.h>
+#include <lwiot/network/base64codec.h>
+
+/* Roughly 64 MB of input per measurement */
+#define VOLUME (64UL * 1024UL * 1024UL)
+
+/* Discards what is written, so only the codec is measured */
+class Sink : public lwiot::BufferedStream {
+public:
+	using lwiot::BufferedStream::write;
+
+	ssize_t write(const void *bytes, const size_t& length) override
+	{
+		return length;
+	}
+};
+
+static void report(const char *name, size_t size, time_t start, size_t iterations)
+{
+	auto seconds = (lwiot_tick() - start) / 1000000.0;
+	auto mb = static_cast<double>(size) * iterations / (1024.0 * 1024.0);
+
+	printf("[%s, %lu B] %lu runs in %.3f s: %.1f MB/s\n", name, static_cast<unsigned long>(size),
+	       static_cast<unsigned long>(iterations), seconds, mb / seconds);
+}
+
+static void bench(size_t size)
+{
+	auto data = static_cast<uint8_t *>(lwiot_mem_alloc(size));
+	auto text = static_cast<char *>(lwiot_mem_alloc(base64_encode_expected_len(size) + 1));
+	auto output = static_cast<char *>(lwiot_mem_alloc(size + 1));
+	size_t iterations = VOLUME / size;
+	size_t length = 0;
+
+	for(size_t idx = 0; idx < size; idx++)
+		data[idx] = static_cast<uint8_t>(rand());
+
+	/* libb64 */
+	auto start = lwiot_tick();
+
+	for(size_t idx = 0; idx < iterations; idx++) {
+		base64_encodestate state;
+
+		base64_init_encodestate_nonewlines(&state);
+		length = base64_encode_block((const char *) data, size, text, &state);
+		length += base64_encode_blockend(text + length, &state);
+	}
+
+	report("base64_encode_block", size, start, iterations);
+	start = lwiot_tick();
+
+	int decoded = 0;
+
+	for(size_t idx = 0; idx < iterations; idx++)
+		decoded = base64_decode_chars(text, length, output);
+
+	report("base64_decode_chars", size, start, iterations);
+	assert(decoded == static_cast<int>(size));
+
+	/* Table driven codec */
+	start = lwiot_tick();
+
+	for(size_t idx = 0; idx < iterations; idx++)
+		length = lwiot::Base64::encode(data, size, text);
+
+	report("Base64::encode", size, start, iterations);
+	start = lwiot_tick();
+
+	ssize_t num = 0;
+
+	for(size_t idx = 0; idx < iterations; idx++)
+		num = lwiot::Base64::decode(text, length, output);
+
+	report("Base64::decode", size, start, iterations);
+	assert(num == static_cast<ssize_t>(size));
+	assert(memcmp(output, data, size) == 0);
+
+	/* Streaming, written in 1 KB pieces */
+	Sink stream;
+	lwiot::Base64Encoder encoder(stream);
+	lwiot::Base64Decoder decoder(stream);
+
+	start = lwiot_tick();
+
+	for(size_t idx = 0; idx < iterations; idx++) {
+		encoder.reset();
+
+		for(size_t offset = 0; offset < size; offset += 1024)
+			encoder.write(data + offset, size - offset > 1024 ? 1024 : size - offset);
+
+		encoder.finish();
+	}
+
+	report("Base64Encoder", size, start, iterations);
+	assert(!encoder.failed());
+	start = lwiot_tick();
+
+	for(size_t idx = 0; idx < iterations; idx++) {
+		decoder.reset();
+
+		for(size_t offset = 0; offset < length; offset += 1024)
+			decoder.write(text + offset, length - offset > 1024 ? 1024 : length - offset);
+
+		decoder.finish();
+	}
+
+	report("Base64Decoder", size, start, iterations);
+	assert(!decoder.failed());
+
+	lwiot_mem_free(data);
+	lwiot_mem_free(text);
+	lwiot_mem_free(output);
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+#ifdef __SSSE3__
+	printf("Base64 codec built with SSSE3\n");
+#endif
+
+	bench(64);
+	bench(4096);
+	bench(1024 * 1024);
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
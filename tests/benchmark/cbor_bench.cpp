@@ -0,0 +1,165 @@
+/*
+ * CBOR versus JSON telemetry benchmark.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/test.h>
+#include <lwiot/util/json.h>
+#include <lwiot/util/jsonwriter.h>
+#include <lwiot/util/cbor.h>
+
+#define ITERATIONS 20000
+#define READINGS 16
+
+struct Reading {
+	const char *sensor;
+	float value;
+	uint32_t time;
+};
+
+static Reading readings[READINGS];
+
+static void report(const char *name, size_t size, time_t start, size_t iterations)
+{
+	auto seconds = (lwiot_tick() - start) / 1000000.0;
+
+	printf("[%s, %lu B] %lu runs in %.3f s: %.0f documents/s, %.1f MB/s\n", name, static_cast<unsigned long>(size),
+	       static_cast<unsigned long>(iterations), seconds, iterations / seconds,
+	       static_cast<double>(size) * iterations / (1024.0 * 1024.0) / seconds);
+}
+
+/* The same code produces either format */
+template <typename Writer>
+static void build(Writer& writer)
+{
+	writer.beginObject();
+	writer.key("device").value("node-12");
+	writer.key("seq").value(4711);
+	writer.key("readings").beginArray();
+
+	for(auto& reading : readings) {
+		writer.beginObject();
+		writer.key("sensor").value(reading.sensor);
+		writer.key("value").value(reading.value);
+		writer.key("time").value(reading.time);
+		writer.endObject();
+	}
+
+	writer.endArray();
+	writer.endObject();
+}
+
+int main(int argc, char **argv)
+{
+	static const char *sensors[] = { "temperature", "humidity", "pressure", "battery" };
+	static char json[2048];
+	static char copy[2048];
+	static uint8_t cbor[1024];
+	size_t json_size, cbor_size = 0;
+
+	lwiot_init();
+
+	for(int idx = 0; idx < READINGS; idx++) {
+		readings[idx].sensor = sensors[idx % 4];
+		readings[idx].value = static_cast<float>(rand() % 10000) / 100.0f;
+		readings[idx].time = 1700000000U + idx * 60;
+	}
+
+	/* Through the JsonVariant model */
+	lwiot::DynamicJsonBuffer buffer;
+	auto& root = buffer.createObject();
+
+	root["device"] = "node-12";
+	root["seq"] = 4711;
+	auto& array = root.createNestedArray("readings");
+
+	for(auto& reading : readings) {
+		auto& object = array.createNestedObject();
+
+		object["sensor"] = reading.sensor;
+		object["value"] = reading.value;
+		object["time"] = reading.time;
+	}
+
+	auto start = lwiot_tick();
+
+	for(int idx = 0; idx < ITERATIONS; idx++)
+		json_size = root.printTo(json, sizeof(json));
+
+	report("JSON printTo", json_size, start, ITERATIONS);
+	start = lwiot_tick();
+
+	for(int idx = 0; idx < ITERATIONS; idx++) {
+		lwiot::CborWriter writer(cbor, sizeof(cbor));
+
+		writer.json(root);
+		cbor_size = writer.count();
+	}
+
+	report("CBOR from JsonVariant", cbor_size, start, ITERATIONS);
+	start = lwiot_tick();
+
+	bool parsed = true;
+
+	for(int idx = 0; idx < ITERATIONS; idx++) {
+		lwiot::StaticJsonBuffer<4096> document;
+
+		/* The parser works in place */
+		memcpy(copy, json, json_size + 1);
+		parsed = parsed && document.parseObject(copy).success();
+	}
+
+	report("JSON parseObject", json_size, start, ITERATIONS);
+	assert(parsed);
+	start = lwiot_tick();
+
+	for(int idx = 0; idx < ITERATIONS; idx++) {
+		lwiot::StaticJsonBuffer<4096> document;
+		lwiot::CborReader reader(cbor, cbor_size);
+
+		parsed = parsed && reader.parseObject(document).success();
+	}
+
+	report("CBOR to JsonVariant", cbor_size, start, ITERATIONS);
+	assert(parsed);
+
+	/* Straight from the readings */
+	size_t size = 0;
+	start = lwiot_tick();
+
+	for(int idx = 0; idx < ITERATIONS; idx++) {
+		lwiot::JsonWriter writer([&](const void *data, size_t length) {
+			return true;
+		});
+
+		build(writer);
+		writer.flush();
+		size = writer.count();
+	}
+
+	report("JsonWriter builder", size, start, ITERATIONS);
+	start = lwiot_tick();
+
+	for(int idx = 0; idx < ITERATIONS; idx++) {
+		lwiot::CborWriter writer(cbor, sizeof(cbor));
+
+		build(writer);
+		size = writer.count();
+	}
+
+	report("CborWriter builder", size, start, ITERATIONS);
+	printf("CBOR is %.0f%% of the JSON size\n", 100.0 * cbor_size / json_size);
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+/*
+ * DNS server queries per second benchmark.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+
+#include <lwiot/network/dns.h>
+#include <lwiot/network/dnsmessage.h>
+#include <lwiot/network/dnsserver.h>
+#include <lwiot/network/loopbacknetwork.h>
+#include <lwiot/network/loopbackudpclient.h>
+#include <lwiot/network/loopbackudpserver.h>
+
+#define ITERATIONS 1000000
+#define QUERIES    20000
+#define RECORDS    64
+
+static size_t query(uint8_t *buffer, uint16_t id, const char *host)
+{
+	static const uint8_t header[] = { 0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	size_t length = sizeof(header);
+	size_t label = length++;
+
+	memcpy(buffer, header, sizeof(header));
+	buffer[0] = id >> 8;
+	buffer[1] = id & 0xFF;
+
+	for(; *host != '\0'; host++) {
+		if(*host == '.') {
+			buffer[label] = length - label - 1;
+			label = length++;
+		} else {
+			buffer[length++] = *host;
+		}
+	}
+
+	buffer[label] = length - label - 1;
+	buffer[length++] = 0;
+
+	const uint8_t footer[] = { 0x00, QTYPE_A, 0x00, QCLASS_IN };
+	memcpy(buffer + length, footer, sizeof(footer));
+
+	return length + sizeof(footer);
+}
+
+static void report(const char *name, time_t start, int count)
+{
+	auto seconds = (lwiot_tick() - start) / 1000000.0;
+	printf("[%s] %i queries in %.3f s: %.0f queries/s\n", name, count, seconds, count / seconds);
+}
+
+/* Parsing and answering only, without any transport */
+static void bench_message()
+{
+	uint8_t request[DNS_LEN];
+	uint8_t response[DNS_LEN];
+	const uint8_t addr[] = { 10, 0, 0, 1 };
+	auto length = query(request, 1, "device-42.lwiot.local");
+	size_t total = 0;
+
+	auto start = lwiot_tick();
+
+	for(int idx = 0; idx < ITERATIONS; idx++) {
+		lwiot::DnsMessage message(request, length);
+		lwiot::DnsBuilder builder(response, sizeof(response));
+		lwiot::DnsQuestion question;
+
+		builder.reply(message);
+
+		while(message.next(question)) {
+			if(question.name.equals("device-42.lwiot.local"))
+				builder.answer(question, 0, addr, sizeof(addr));
+		}
+
+		total += builder.length();
+	}
+
+	report("DnsMessage + DnsBuilder", start, ITERATIONS);
+	assert(total == ITERATIONS * (length + 16));
+}
+
+/* Sequential queries against a DnsServer on the loopback network */
+static void bench_server()
+{
+	lwiot::LoopbackNetwork network;
+	lwiot::DnsServer dns;
+	auto udp = new lwiot::LoopbackUdpServer(network, BIND_ADDR_ANY, DNS_SERVER_PORT);
+	uint8_t request[DNS_LEN];
+	uint8_t response[DNS_LEN];
+	char host[32];
+	int answered = 0;
+
+	for(int idx = 0; idx < RECORDS; idx++) {
+		snprintf(host, sizeof(host), "device-%i.lwiot.local", idx);
+		dns.map(host, lwiot::IPAddress(10, 0, 0, idx));
+	}
+
+	udp->bind();
+	dns.begin(udp);
+
+	lwiot::LoopbackUdpClient client(network, lwiot::IPAddress(127, 0, 0, 1), DNS_SERVER_PORT);
+	client.setTimeout(1);
+
+	auto start = lwiot_tick();
+
+	for(int idx = 0; idx < QUERIES; idx++) {
+		snprintf(host, sizeof(host), "device-%i.lwiot.local", idx % RECORDS);
+		auto length = query(request, idx, host);
+
+		client.write(request, length);
+
+		if(client.read(response, sizeof(response)) > 0)
+			answered++;
+	}
+
+	report("DnsServer over loopback", start, answered);
+	dns.end();
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	bench_message();
+	bench_server();
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
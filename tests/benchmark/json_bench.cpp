@@ -0,0 +1,294 @@
+/*
+ * JSON parse and serialize benchmark.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/test.h>
+#include <lwiot/util/json.h>
+#include <lwiot/util/jsonwriter.h>
+
+#define ITERATIONS 5000
+#define CAPACITY 16384
+
+/* Keeps track of what the dynamic buffers take from the heap */
+struct HeapUsage {
+	size_t allocations;
+	size_t current;
+	size_t peak;
+};
+
+static HeapUsage heap;
+
+class CountingAllocator {
+public:
+	void *allocate(size_t size)
+	{
+		auto block = static_cast<Header *>(lwiot_mem_alloc(sizeof(Header) + size));
+
+		if(block == nullptr)
+			return nullptr;
+
+		block->size = size;
+		heap.allocations++;
+		heap.current += size;
+
+		if(heap.current > heap.peak)
+			heap.peak = heap.current;
+
+		return block + 1;
+	}
+
+	void deallocate(void *pointer)
+	{
+		auto block = static_cast<Header *>(pointer) - 1;
+
+		heap.current -= block->size;
+		lwiot_mem_free(block);
+	}
+
+private:
+	union Header {
+		size_t size;
+		max_align_t alignment;
+	};
+};
+
+typedef ArduinoJson::Internals::BlockJsonBuffer<CountingAllocator> CountingJsonBuffer;
+
+struct Payload {
+	const char *name;
+	char text[8192];
+	size_t length;
+};
+
+static Payload payloads[3];
+
+template <typename Func>
+static void generate(Payload& payload, const char *name, Func build)
+{
+	payload.name = name;
+	payload.length = 0;
+
+	lwiot::JsonWriter writer([&payload](const void *data, size_t length) {
+		if(payload.length + length >= sizeof(payload.text))
+			return false;
+
+		memcpy(payload.text + payload.length, data, length);
+		payload.length += length;
+		return true;
+	});
+
+	build(writer);
+	writer.flush();
+
+	assert(!writer.failed());
+	payload.text[payload.length] = '\0';
+}
+
+/* A device configuration as it is stored in flash */
+static void config(lwiot::JsonWriter& writer)
+{
+	static const char *types[] = { "bme280", "sht31", "ccs811", "veml7700" };
+
+	writer.beginObject();
+	writer.key("device").beginObject();
+	writer.key("name").value("node-12");
+	writer.key("id").value("a4cf12f3e1b0");
+	writer.key("firmware").value("1.4.2");
+	writer.endObject();
+
+	writer.key("wifi").beginObject();
+	writer.key("ssid").value("iot-lab");
+	writer.key("password").value("correct horse battery staple");
+	writer.key("dhcp").value(false);
+	writer.key("address").value("192.168.1.20");
+	writer.key("gateway").value("192.168.1.1");
+	writer.key("dns").beginArray().value("192.168.1.1").value("9.9.9.9").endArray();
+	writer.endObject();
+
+	writer.key("mqtt").beginObject();
+	writer.key("host").value("broker.example.com");
+	writer.key("port").value(8883);
+	writer.key("tls").value(true);
+	writer.key("keepalive").value(60);
+	writer.key("topics").beginArray();
+	writer.value("sensors/node-12/temperature").value("sensors/node-12/humidity");
+	writer.value("sensors/node-12/air").value("commands/node-12/#");
+	writer.endArray();
+	writer.endObject();
+
+	writer.key("sensors").beginArray();
+
+	for(int idx = 0; idx < 4; idx++) {
+		writer.beginObject();
+		writer.key("type").value(types[idx]);
+		writer.key("address").value(0x40 + idx);
+		writer.key("interval").value(30 * (idx + 1));
+		writer.key("enabled").value(idx != 3);
+		writer.key("offset").value(-0.25 * idx, 2);
+		writer.endObject();
+	}
+
+	writer.endArray();
+	writer.endObject();
+}
+
+/* A batch of readings waiting to be published */
+static void telemetry(lwiot::JsonWriter& writer)
+{
+	static const char *sensors[] = { "temperature", "humidity", "pressure", "battery" };
+
+	writer.beginObject();
+	writer.key("device").value("node-12");
+	writer.key("seq").value(4711);
+	writer.key("readings").beginArray();
+
+	for(int idx = 0; idx < 48; idx++) {
+		writer.beginObject();
+		writer.key("sensor").value(sensors[idx % 4]);
+		writer.key("value").value((rand() % 10000) / 100.0, 2);
+		writer.key("time").value(1700000000U + idx * 15);
+		writer.endObject();
+	}
+
+	writer.endArray();
+	writer.endObject();
+}
+
+/* Matrices and arrays nested close to the parser limit */
+static void nested(lwiot::JsonWriter& writer)
+{
+	writer.beginObject();
+	writer.key("calibration").beginArray();
+
+	for(int row = 0; row < 16; row++) {
+		writer.beginArray();
+
+		for(int column = 0; column < 16; column++)
+			writer.value(row * 16 + column);
+
+		writer.endArray();
+	}
+
+	writer.endArray();
+	writer.key("tree");
+
+	for(int depth = 0; depth < 8; depth++)
+		writer.beginArray().value(depth);
+
+	for(int depth = 0; depth < 8; depth++)
+		writer.endArray();
+
+	writer.endObject();
+}
+
+static void report(const char *payload, const char *name, size_t bytes, time_t start)
+{
+	auto seconds = (lwiot_tick() - start) / 1000000.0;
+
+	printf("[%s, %s] %.0f documents/s, %.1f MB/s", payload, name, ITERATIONS / seconds,
+	       static_cast<double>(bytes) * ITERATIONS / (1024.0 * 1024.0) / seconds);
+}
+
+static void run(const Payload& payload)
+{
+	static char copy[sizeof(payload.text)];
+	static char output[sizeof(payload.text)];
+	size_t used = 0;
+	bool parsed = true;
+
+	/* Static buffer: the used size is the capacity this payload needs */
+	auto start = lwiot_tick();
+
+	for(int idx = 0; idx < ITERATIONS; idx++) {
+		lwiot::StaticJsonBuffer<CAPACITY> document;
+
+		/* The parser works in place */
+		memcpy(copy, payload.text, payload.length + 1);
+		parsed = parsed && document.parseObject(copy).success();
+		used = document.size();
+	}
+
+	report(payload.name, "static parse", payload.length, start);
+	printf(", buffer %lu B\n", static_cast<unsigned long>(used));
+	assert(parsed);
+
+	/* Dynamic buffer: blocks double in size, starting at 256 bytes */
+	heap = HeapUsage();
+	start = lwiot_tick();
+
+	for(int idx = 0; idx < ITERATIONS; idx++) {
+		CountingJsonBuffer buffer;
+
+		memcpy(copy, payload.text, payload.length + 1);
+		parsed = parsed && buffer.parseObject(copy).success();
+		used = buffer.size();
+	}
+
+	report(payload.name, "dynamic parse", payload.length, start);
+	printf(", buffer %lu B, %.1f allocations, heap peak %lu B\n", static_cast<unsigned long>(used),
+	       static_cast<double>(heap.allocations) / ITERATIONS, static_cast<unsigned long>(heap.peak));
+	assert(parsed && heap.current == 0);
+
+	/* Serializing the parsed tree, which allocates nothing */
+	lwiot::StaticJsonBuffer<CAPACITY> document;
+
+	memcpy(copy, payload.text, payload.length + 1);
+	auto& root = document.parseObject(copy);
+	size_t length = 0;
+
+	start = lwiot_tick();
+
+	for(int idx = 0; idx < ITERATIONS; idx++)
+		length = root.printTo(output, sizeof(output));
+
+	report(payload.name, "printTo", length, start);
+	printf(", %lu B\n", static_cast<unsigned long>(length));
+	assert(length == root.measureLength());
+	start = lwiot_tick();
+
+	for(int idx = 0; idx < ITERATIONS; idx++)
+		length = root.prettyPrintTo(output, sizeof(output));
+
+	report(payload.name, "prettyPrintTo", length, start);
+	printf(", %lu B\n", static_cast<unsigned long>(length));
+	start = lwiot_tick();
+
+	for(int idx = 0; idx < ITERATIONS; idx++) {
+		lwiot::JsonWriter writer([](const void *data, size_t length) {
+			return true;
+		});
+
+		writer.json(root);
+		writer.flush();
+		length = writer.count();
+	}
+
+	report(payload.name, "JsonWriter", length, start);
+	printf(", %lu B\n", static_cast<unsigned long>(length));
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	generate(payloads[0], "config", config);
+	generate(payloads[1], "telemetry", telemetry);
+	generate(payloads[2], "nested", nested);
+
+	for(auto& payload : payloads)
+		run(payload);
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -0,0 +1,305 @@
+/*
+ * MQTT end-to-end benchmark against the embedded broker.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/kernel/thread.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/mqttclient.h>
+#include <lwiot/network/asyncmqttclient.h>
+#include <lwiot/network/mqttbroker.h>
+#include <lwiot/network/sockettcpserver.h>
+#include <lwiot/network/sockettcpclient.h>
+
+#define MESSAGES 50000
+#define SAMPLES  5000
+#define PAYLOAD_SIZE 32
+
+/*
+ * Every heap allocation in the process is counted, so the allocations per
+ * message include the publisher, the broker and the subscriber.
+ */
+#ifdef __GLIBC__
+extern "C" {
+	extern void *__libc_malloc(size_t size);
+	extern void *__libc_calloc(size_t num, size_t size);
+	extern void *__libc_realloc(void *ptr, size_t size);
+
+	static volatile unsigned long allocations = 0;
+
+	void *malloc(size_t size)
+	{
+		__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+		return __libc_malloc(size);
+	}
+
+	void *calloc(size_t num, size_t size)
+	{
+		__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+		return __libc_calloc(num, size);
+	}
+
+	void *realloc(void *ptr, size_t size)
+	{
+		__atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+		return __libc_realloc(ptr, size);
+	}
+}
+
+#define ALLOCATIONS() __atomic_load_n(&allocations, __ATOMIC_RELAXED)
+#else
+#define ALLOCATIONS() 0UL
+#endif
+
+/* Counts the bytes a client puts on the wire */
+class CountingClient : public lwiot::SocketTcpClient {
+public:
+	CountingClient(const lwiot::IPAddress& addr, uint16_t port) : SocketTcpClient(addr, port), _written(0)
+	{
+	}
+
+	using SocketTcpClient::write;
+
+	ssize_t write(const void *bytes, const size_t& length) override
+	{
+		auto num = SocketTcpClient::write(bytes, length);
+
+		if(num > 0)
+			this->_written += num;
+
+		return num;
+	}
+
+	size_t written() const
+	{
+		return this->_written;
+	}
+
+private:
+	size_t _written;
+};
+
+static int compare(const void *a, const void *b)
+{
+	auto x = *static_cast<const time_t*>(a);
+	auto y = *static_cast<const time_t*>(b);
+
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void connect(lwiot::AsyncMqttClient& mqtt, lwiot::TcpClient& client, const char *id)
+{
+	mqtt.start(client);
+
+	if(!mqtt.connect(id, "", "")) {
+		printf("Unable to connect %s to the broker!\n", id);
+		exit(-EXIT_FAILURE);
+	}
+}
+
+static void report(const char *name, time_t start, unsigned long allocs, int received)
+{
+	auto seconds = (lwiot_tick() - start) / 1000000.0;
+
+	printf("[%s] %i/%i messages in %.3f s: %.0f msg/s, %.2f allocations/msg\n", name, received, MESSAGES, seconds,
+	       received / seconds, (double) allocs / MESSAGES);
+}
+
+static void bench_direct(uint16_t port, lwiot::ByteBuffer& payload)
+{
+	lwiot::SocketTcpClient subclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::SocketTcpClient pubclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::AsyncMqttClient subscriber;
+	lwiot::MqttClient publisher;
+	volatile int received = 0;
+
+	connect(subscriber, subclient, "bench-subscriber");
+	subscriber.subscribe("bench/+/temperature", [&](const lwiot::ByteBuffer& data) {
+		received = received + 1;
+	});
+
+	publisher.begin(pubclient);
+
+	if(!publisher.connect("bench-publisher", "", "")) {
+		printf("Unable to connect the publisher to the broker!\n");
+		exit(-EXIT_FAILURE);
+	}
+
+	auto allocs = ALLOCATIONS();
+	auto start = lwiot_tick();
+
+	for(int idx = 0; idx < MESSAGES; idx++)
+		publisher.publish("bench/kitchen/temperature", payload, false);
+
+	for(int tries = 0; received < MESSAGES && tries < 3000; tries++)
+		lwiot::Thread::sleep(10);
+
+	report("MqttClient, QoS 0", start, ALLOCATIONS() - allocs, received);
+
+	publisher.disconnect();
+	subscriber.stop();
+}
+
+static void bench_async(uint16_t port, lwiot::ByteBuffer& payload)
+{
+	lwiot::SocketTcpClient subclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::SocketTcpClient pubclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::AsyncMqttClient subscriber;
+	lwiot::AsyncMqttClient publisher;
+	volatile int received = 0;
+
+	connect(subscriber, subclient, "bench-subscriber");
+	subscriber.subscribe("bench/#", [&](const lwiot::ByteBuffer& data) {
+		received = received + 1;
+	});
+
+	publisher.setWriteCoalescing(lwiot::MqttClient::MQTT_MAX_PACKET_SIZE);
+	connect(publisher, pubclient, "bench-publisher");
+
+	auto allocs = ALLOCATIONS();
+	auto start = lwiot_tick();
+
+	for(int idx = 0; idx < MESSAGES; idx++)
+		publisher.publish("bench/kitchen/temperature", payload, false);
+
+	publisher.flush();
+
+	for(int tries = 0; received < MESSAGES && tries < 3000; tries++)
+		lwiot::Thread::sleep(10);
+
+	report("AsyncMqttClient, coalesced, QoS 0", start, ALLOCATIONS() - allocs, received);
+
+	publisher.stop();
+	subscriber.stop();
+}
+
+static void bench_latency(uint16_t port)
+{
+	lwiot::SocketTcpClient subclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::SocketTcpClient pubclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::AsyncMqttClient subscriber;
+	lwiot::MqttClient publisher;
+	lwiot::ByteBuffer stamp(sizeof(time_t), true);
+	static time_t samples[SAMPLES];
+	volatile int received = 0;
+
+	/* The publish time travels in the payload, so the subscriber measures the one way latency */
+	connect(subscriber, subclient, "bench-subscriber");
+	subscriber.subscribe("bench/latency", [&](const lwiot::ByteBuffer& data) {
+		time_t sent;
+
+		memcpy(&sent, data.data(), sizeof(sent));
+		samples[received] = lwiot_tick() - sent;
+		received = received + 1;
+	});
+
+	publisher.begin(pubclient);
+
+	if(!publisher.connect("bench-publisher", "", "")) {
+		printf("Unable to connect the publisher to the broker!\n");
+		exit(-EXIT_FAILURE);
+	}
+
+	for(int idx = 0; idx < SAMPLES; idx++) {
+		time_t now = lwiot_tick();
+
+		stamp.setIndex(0);
+		stamp.write(&now, sizeof(now));
+		publisher.publish("bench/latency", stamp, false);
+
+		for(int tries = 0; received <= idx && tries < 100000; tries++)
+			lwiot::Thread::yield();
+	}
+
+	publisher.disconnect();
+	subscriber.stop();
+
+	qsort(samples, received, sizeof(samples[0]), compare);
+
+	printf("[latency] %i messages: p50 %lu us, p90 %lu us, p99 %lu us, p99.9 %lu us, max %lu us\n", received,
+	       (unsigned long) samples[received / 2], (unsigned long) samples[received * 90 / 100],
+	       (unsigned long) samples[received * 99 / 100], (unsigned long) samples[received * 999 / 1000],
+	       (unsigned long) samples[received - 1]);
+}
+
+static void bench_bandwidth(uint16_t port, lwiot::ByteBuffer& payload, lwiot::MqttClient::ProtocolVersion version)
+{
+	lwiot::SocketTcpClient subclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	CountingClient pubclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::AsyncMqttClient subscriber;
+	lwiot::MqttClient publisher;
+	volatile int received = 0;
+
+	connect(subscriber, subclient, "bench-subscriber");
+	subscriber.subscribe("site/+/sensor/+/temperature", [&](const lwiot::ByteBuffer& data) {
+		received = received + 1;
+	});
+
+	publisher.setProtocolVersion(version);
+	publisher.begin(pubclient);
+
+	if(!publisher.connect("bench-publisher", "", "")) {
+		printf("Unable to connect the publisher to the broker!\n");
+		exit(-EXIT_FAILURE);
+	}
+
+	auto written = pubclient.written();
+
+	for(int idx = 0; idx < SAMPLES; idx++)
+		publisher.publish("site/3f2a9c1e-5b7d-4e2f-8a6c-0d9e1b4f7a3c/sensor/42/temperature", payload, false);
+
+	for(int tries = 0; received < SAMPLES && tries < 3000; tries++)
+		lwiot::Thread::sleep(10);
+
+	printf("[%s] %i/%i messages, %.1f bytes/msg on the wire\n",
+	       version == lwiot::MqttClient::MQTT_V5 ? "MQTT 5, topic aliases" : "MQTT 3.1.1", received, SAMPLES,
+	       (double) (pubclient.written() - written) / SAMPLES);
+
+	publisher.disconnect();
+	subscriber.stop();
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	lwiot::SocketTcpServer server;
+	lwiot::ByteBuffer payload(PAYLOAD_SIZE, true);
+	uint16_t port = 18900;
+
+	while(!server.bind(BIND_ADDR_LB, port))
+		port++;
+
+	for(int idx = 0; idx < PAYLOAD_SIZE; idx++)
+		payload.write((uint8_t)('a' + idx % 26));
+
+	lwiot::MqttBroker broker(server);
+	broker.start();
+
+	bench_direct(port, payload);
+	bench_async(port, payload);
+	bench_latency(port);
+	bench_bandwidth(port, payload, lwiot::MqttClient::MQTT_V3_1_1);
+	bench_bandwidth(port, payload, lwiot::MqttClient::MQTT_V5);
+
+	broker.stop();
+	server.close();
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
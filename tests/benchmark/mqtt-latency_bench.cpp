@@ -0,0 +1,160 @@
+/*
+ * MQTT command round trip latency benchmark, through the embedded broker.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/kernel/thread.h>
+#include <lwiot/kernel/event.h>
+#include <lwiot/kernel/functionalthread.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/asyncmqttclient.h>
+#include <lwiot/network/mqttbroker.h>
+#include <lwiot/network/sockettcpserver.h>
+#include <lwiot/network/sockettcpclient.h>
+#include <lwiot/network/loopbacknetwork.h>
+#include <lwiot/network/loopbacktcpserver.h>
+#include <lwiot/network/loopbacktcpclient.h>
+
+#define COMMANDS 500
+
+static int compare(const void *a, const void *b)
+{
+	auto x = *static_cast<const time_t*>(a);
+	auto y = *static_cast<const time_t*>(b);
+
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/* The controller publishes a command, the device answers it with an acknowledgement */
+static void bench_latency(const char *name, lwiot::TcpClient& devclient, lwiot::TcpClient& ctlclient)
+{
+	lwiot::AsyncMqttClient device, controller;
+	lwiot::FunctionalThread responder("responder");
+	lwiot::Event command, acked;
+	time_t samples[COMMANDS];
+	volatile int commands = 0, acks = 0;
+
+	device.start(devclient);
+	controller.start(ctlclient);
+
+	if(!device.connect("lwiot-bench-device", "", "") || !controller.connect("lwiot-bench-controller", "", "")) {
+		printf("[%s] Unable to connect to the broker!\n", name);
+		exit(-EXIT_FAILURE);
+	}
+
+	device.subscribe("cmd", [&](const lwiot::ByteBuffer& payload) {
+		commands = commands + 1;
+		command.signal();
+	});
+
+	controller.subscribe("ack", [&](const lwiot::ByteBuffer& payload) {
+		acks = acks + 1;
+		acked.signal();
+	});
+
+	/* Subscriptions are not acknowledged synchronously */
+	lwiot::Thread::sleep(100);
+
+	responder.start([&]() {
+		for(int idx = 0; idx < COMMANDS; idx++) {
+			for(int tries = 0; commands <= idx && tries < 200; tries++)
+				command.wait(10);
+
+			device.publish("ack", "pong", false);
+		}
+	});
+
+	for(int idx = 0; idx < COMMANDS; idx++) {
+		auto start = lwiot_tick();
+
+		controller.publish("cmd", "ping", false);
+
+		for(int tries = 0; acks <= idx && tries < 200; tries++)
+			acked.wait(10);
+
+		samples[idx] = lwiot_tick() - start;
+	}
+
+	responder.join();
+	device.stop();
+	controller.stop();
+	assert(acks == COMMANDS);
+
+	qsort(samples, COMMANDS, sizeof(samples[0]), compare);
+
+	time_t total = 0;
+
+	for(auto sample : samples)
+		total += sample;
+
+	printf("[%s] %i command round trips: avg %lu us, p50 %lu us, p99 %lu us, max %lu us\n", name, COMMANDS,
+	       (unsigned long) (total / COMMANDS), (unsigned long) samples[COMMANDS / 2],
+	       (unsigned long) samples[COMMANDS * 99 / 100], (unsigned long) samples[COMMANDS - 1]);
+}
+
+static void bench_sockets()
+{
+	lwiot::SocketTcpServer server;
+	lwiot::MqttBroker broker(server);
+	uint16_t port = 18860;
+
+	/* Ports of a previous run may linger in TIME_WAIT */
+	while(!server.bind(BIND_ADDR_LB, port))
+		port++;
+
+	if(!broker.start()) {
+		printf("[sockets] Unable to start the broker!\n");
+		exit(-EXIT_FAILURE);
+	}
+
+	lwiot::SocketTcpClient device(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::SocketTcpClient controller(lwiot::IPAddress(127, 0, 0, 1), port);
+
+	bench_latency("sockets", device, controller);
+	broker.stop();
+	server.close();
+}
+
+/* Without the network stack of the OS, only the clients and the broker remain */
+static void bench_loopback()
+{
+	lwiot::LoopbackNetwork network;
+	lwiot::LoopbackTcpServer server(network, BIND_ADDR_ANY, 1883);
+	lwiot::MqttBroker broker(server);
+
+	if(!server.bind() || !broker.start()) {
+		printf("[loopback] Unable to start the broker!\n");
+		exit(-EXIT_FAILURE);
+	}
+
+	lwiot::LoopbackTcpClient device(network, lwiot::IPAddress(127, 0, 0, 1), 1883);
+	lwiot::LoopbackTcpClient controller(network, lwiot::IPAddress(127, 0, 0, 1), 1883);
+
+	bench_latency("loopback", device, controller);
+	broker.stop();
+	server.close();
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+	bench_sockets();
+	bench_loopback();
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+/*
+ * MQTT publish throughput benchmark, through the embedded broker.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/kernel/thread.h>
+#include <lwiot/kernel/event.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/asyncmqttclient.h>
+#include <lwiot/network/mqttbroker.h>
+#include <lwiot/network/sockettcpserver.h>
+#include <lwiot/network/sockettcpclient.h>
+
+#define MESSAGES 20000
+#define PAYLOAD_SIZE 32
+
+/* Ports of a previous run may linger in TIME_WAIT */
+static uint16_t bind(lwiot::SocketTcpServer& server, uint16_t port)
+{
+	while(!server.bind(BIND_ADDR_LB, port))
+		port++;
+
+	return port;
+}
+
+static void bench_publish(const char *name, uint16_t port, size_t coalesce)
+{
+	lwiot::SocketTcpServer server;
+	lwiot::MqttBroker broker(server);
+	lwiot::AsyncMqttClient mqtt, subscriber;
+	lwiot::ByteBuffer payload(PAYLOAD_SIZE, true);
+	lwiot::Event done;
+	volatile int received = 0;
+
+	for(int idx = 0; idx < PAYLOAD_SIZE; idx++)
+		payload.write((uint8_t)('a' + idx % 26));
+
+	port = bind(server, port);
+
+	if(!broker.start()) {
+		printf("[%s] Unable to start the broker!\n", name);
+		exit(-EXIT_FAILURE);
+	}
+
+	lwiot::SocketTcpClient subclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::SocketTcpClient client(lwiot::IPAddress(127, 0, 0, 1), port);
+
+	subscriber.start(subclient);
+	mqtt.setWriteCoalescing(coalesce);
+	mqtt.start(client);
+
+	if(!subscriber.connect("lwiot-bench-sub", "", "") || !mqtt.connect("lwiot-bench", "", "")) {
+		printf("[%s] Unable to connect to the broker!\n", name);
+		exit(-EXIT_FAILURE);
+	}
+
+	subscriber.subscribe("bench/#", [&](const lwiot::ByteBuffer& message) {
+		received = received + 1;
+
+		if(received == MESSAGES)
+			done.signal();
+	});
+
+	/* The subscription is not acknowledged synchronously */
+	lwiot::Thread::sleep(100);
+
+	auto start = lwiot_tick();
+	auto failed = 0;
+
+	for(int idx = 0; idx < MESSAGES; idx++) {
+		if(!mqtt.publish("bench/sensor/0/temperature", payload, false))
+			failed++;
+	}
+
+	mqtt.flush();
+
+	for(int tries = 0; received != MESSAGES && tries < 1000; tries++)
+		done.wait(10);
+
+	assert(failed == 0);
+
+	auto end = lwiot_tick();
+	auto seconds = (end - start) / 1000000.0;
+
+	printf("[%s] %i messages in %.3f s: %.0f msg/s\n", name, received, seconds, received / seconds);
+
+	mqtt.stop();
+	subscriber.stop();
+	broker.stop();
+	server.close();
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	bench_publish("direct", 18830, 0);
+	bench_publish("coalesced (1 KiB)", 18840, 1024);
+	bench_publish("coalesced (4 KiB)", 18850, 4096);
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+/*
+ * MQTT store-and-forward replay benchmark.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/kernel/thread.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/asyncmqttclient.h>
+#include <lwiot/network/mqttbroker.h>
+#include <lwiot/network/mqttstore.h>
+#include <lwiot/network/sockettcpserver.h>
+#include <lwiot/network/sockettcpclient.h>
+
+#define MESSAGES 2000
+#define STORE_PATH "mqtt-replay_bench.log"
+
+static void bench_replay(size_t batch, int interval)
+{
+	lwiot::SocketTcpServer server;
+	lwiot::MqttBroker broker(server);
+	lwiot::AsyncMqttClient mqtt;
+	lwiot::ByteBuffer payload(32, true);
+	uint16_t port = 18880;
+
+	remove(STORE_PATH);
+	lwiot::MqttFileStore store(STORE_PATH, 256 * 1024);
+
+	for(int idx = 0; idx < 32; idx++)
+		payload.write((uint8_t)('a' + idx % 26));
+
+	/* The client is offline: everything goes to the store */
+	mqtt.setOfflineStore(store, batch, interval);
+
+	auto start = lwiot_tick();
+
+	for(int idx = 0; idx < MESSAGES; idx++) {
+		if(!mqtt.publish("bench/offline/telemetry", payload, false)) {
+			printf("Unable to store message %i!\n", idx);
+			exit(-EXIT_FAILURE);
+		}
+	}
+
+	auto stored = (lwiot_tick() - start) / 1000000.0;
+
+	while(!server.bind(BIND_ADDR_LB, port))
+		port++;
+
+	if(!broker.start()) {
+		printf("Unable to start the broker!\n");
+		exit(-EXIT_FAILURE);
+	}
+
+	lwiot::SocketTcpClient client(lwiot::IPAddress(127, 0, 0, 1), port);
+	mqtt.start(client);
+
+	if(!mqtt.connect("lwiot-bench", "", "")) {
+		printf("Unable to connect to the broker!\n");
+		exit(-EXIT_FAILURE);
+	}
+
+	start = lwiot_tick();
+
+	while(store.count() > 0 && lwiot_tick() - start < 30000000)
+		lwiot::Thread::sleep(1);
+
+	auto seconds = (lwiot_tick() - start) / 1000000.0;
+	/* Records leave the store once the broker acknowledged them */
+	auto replayed = MESSAGES - static_cast<int>(store.count());
+
+	printf("[batch %u, %i ms] stored %i messages at %.0f msg/s, replayed %i at %.0f msg/s (%u left)\n",
+	       (unsigned) batch, interval, MESSAGES, MESSAGES / stored, replayed, replayed / seconds,
+	       (unsigned) store.count());
+
+	mqtt.stop();
+	broker.stop();
+	server.close();
+	remove(STORE_PATH);
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	bench_replay(8, 1);
+	bench_replay(32, 1);
+	bench_replay(32, 10);
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -0,0 +1,135 @@
+/*
+ * MQTT large payload streaming benchmark.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/io/file.h>
+
+#include <lwiot/kernel/thread.h>
+#include <lwiot/kernel/event.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/asyncmqttclient.h>
+#include <lwiot/network/mqttbroker.h>
+#include <lwiot/network/sockettcpserver.h>
+#include <lwiot/network/sockettcpclient.h>
+
+#define PAYLOAD_SIZE (1024 * 1024)
+#define PAYLOAD_FILE "mqtt-stream_bench.bin"
+
+static uint32_t checksum(const uint8_t *data, size_t length, uint32_t sum)
+{
+	for(size_t idx = 0; idx < length; idx++)
+		sum = sum * 31 + data[idx];
+
+	return sum;
+}
+
+static void store(const lwiot::ByteBuffer& payload)
+{
+	lwiot::File file(PAYLOAD_FILE, lwiot::FileMode::Write);
+	file.write(payload.data(), payload.count());
+}
+
+static void bench_stream()
+{
+	lwiot::SocketTcpServer server;
+	/* The broker holds a complete packet before routing it */
+	lwiot::MqttBroker broker(server, PAYLOAD_SIZE + 1024);
+	lwiot::AsyncMqttClient mqtt;
+	lwiot::ByteBuffer payload(PAYLOAD_SIZE, true);
+	lwiot::Event done;
+	volatile size_t received = 0;
+	uint32_t sum = 0, expected;
+	uint16_t port = 18870;
+
+	for(int idx = 0; idx < PAYLOAD_SIZE; idx++)
+		payload.write((uint8_t) rand());
+
+	expected = checksum(payload.data(), PAYLOAD_SIZE, 0);
+
+	while(!server.bind(BIND_ADDR_LB, port))
+		port++;
+
+	if(!broker.start()) {
+		printf("Unable to start the broker!\n");
+		exit(-EXIT_FAILURE);
+	}
+
+	lwiot::SocketTcpClient client(lwiot::IPAddress(127, 0, 0, 1), port);
+
+	mqtt.setStreamHandler([&](const lwiot::String& topic, const uint8_t *data, size_t length, size_t offset,
+	                          size_t total) {
+		sum = checksum(data, length, sum);
+		received = offset + length;
+
+		if(received == total)
+			done.signal();
+	});
+
+	mqtt.start(client);
+
+	if(!mqtt.connect("lwiot-bench", "", "")) {
+		printf("Unable to connect to the broker!\n");
+		exit(-EXIT_FAILURE);
+	}
+
+	/* The payload arrives through the stream handler, the broker routes it back to its publisher */
+	mqtt.subscribe("bench/snapshot", [](const lwiot::ByteBuffer& payload) {
+	});
+
+	lwiot::Thread::sleep(100);
+
+	auto start = lwiot_tick();
+	auto ok = mqtt.publish("bench/snapshot", payload, false);
+
+	for(int tries = 0; ok && received != PAYLOAD_SIZE && tries < 500; tries++)
+		done.wait(10);
+
+	auto seconds = (lwiot_tick() - start) / 1000000.0;
+
+	printf("[ByteBuffer] %s: %lu bytes routed back in %.3f s: %.1f MiB/s\n", ok && sum == expected ? "ok" : "FAILED",
+	       (unsigned long) received, seconds, received / seconds / (1024 * 1024));
+
+	store(payload);
+	lwiot::File file(PAYLOAD_FILE, lwiot::FileMode::Read);
+
+	sum = 0;
+	received = 0;
+	start = lwiot_tick();
+	ok = mqtt.publish("bench/snapshot", file, file.available(), false);
+
+	for(int tries = 0; ok && received != PAYLOAD_SIZE && tries < 500; tries++)
+		done.wait(10);
+
+	seconds = (lwiot_tick() - start) / 1000000.0;
+
+	printf("[File] %s: %lu bytes routed back in %.3f s: %.1f MiB/s\n", ok && sum == expected ? "ok" : "FAILED",
+	       (unsigned long) received, seconds, received / seconds / (1024 * 1024));
+
+	remove(PAYLOAD_FILE);
+	mqtt.stop();
+	broker.stop();
+	server.close();
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+	bench_stream();
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
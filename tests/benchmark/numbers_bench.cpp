@@ -0,0 +1,175 @@
+/*
+ * Number conversion benchmark over sensor values.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/test.h>
+#include <lwiot/util/json.h>
+#include <lwiot/util/numberconverter.h>
+
+#define VALUES 4096
+#define ROUNDS 250
+#define BATCH 32
+
+using lwiot::NumberConverter;
+
+static double values[VALUES];
+static int64_t integers[VALUES];
+static char texts[VALUES][NumberConverter::MaxLength];
+
+static void report(const char *name, time_t start)
+{
+	auto seconds = (lwiot_tick() - start) / 1000000.0;
+	auto count = static_cast<double>(VALUES) * ROUNDS;
+
+	printf("[%s] %.0f conversions in %.3f s: %.1f ns each\n", name, count, seconds, seconds * 1e9 / count);
+}
+
+/* Temperatures, humidity, pressure and coordinates at their usual resolution */
+static void generate()
+{
+	for(int idx = 0; idx < VALUES; idx++) {
+		switch(idx % 4) {
+		case 0:
+			values[idx] = (rand() % 7000 - 2000) / 100.0;
+			break;
+
+		case 1:
+			values[idx] = (rand() % 1000) / 10.0;
+			break;
+
+		case 2:
+			values[idx] = 950.0 + (rand() % 10000) / 100.0;
+			break;
+
+		default:
+			values[idx] = (rand() % 180000000 - 90000000) / 1000000.0;
+			break;
+		}
+
+		integers[idx] = 1700000000LL + rand();
+	}
+}
+
+int main(int argc, char **argv)
+{
+	char text[64];
+	size_t length = 0;
+
+	lwiot_init();
+	generate();
+
+	/* Formatting */
+	auto start = lwiot_tick();
+
+	for(int round = 0; round < ROUNDS; round++)
+		for(auto value : values)
+			length += snprintf(text, sizeof(text), "%.2f", value);
+
+	report("snprintf %.2f", start);
+	start = lwiot_tick();
+
+	for(int round = 0; round < ROUNDS; round++)
+		for(auto value : values)
+			length += NumberConverter::formatFixed(value, 2, text, sizeof(text));
+
+	report("formatFixed, 2 decimals", start);
+	start = lwiot_tick();
+
+	for(int round = 0; round < ROUNDS; round++)
+		for(auto value : values)
+			length += snprintf(text, sizeof(text), "%.17g", value);
+
+	report("snprintf %.17g", start);
+	start = lwiot_tick();
+
+	for(int round = 0; round < ROUNDS; round++)
+		for(auto value : values)
+			length += NumberConverter::formatDouble(value, text);
+
+	report("formatDouble, shortest", start);
+	start = lwiot_tick();
+
+	for(int round = 0; round < ROUNDS; round++)
+		for(auto value : integers)
+			length += snprintf(text, sizeof(text), "%lld", static_cast<long long>(value));
+
+	report("snprintf %lld", start);
+	start = lwiot_tick();
+
+	for(int round = 0; round < ROUNDS; round++)
+		for(auto value : integers)
+			length += NumberConverter::formatInteger(value, text);
+
+	report("formatInteger", start);
+
+	/* Parsing the shortest forms back */
+	double sum = 0.0;
+
+	for(int idx = 0; idx < VALUES; idx++)
+		NumberConverter::formatDouble(values[idx], texts[idx]);
+
+	start = lwiot_tick();
+
+	for(int round = 0; round < ROUNDS; round++)
+		for(auto& entry : texts)
+			sum += strtod(entry, nullptr);
+
+	report("strtod", start);
+	start = lwiot_tick();
+
+	for(int round = 0; round < ROUNDS; round++) {
+		for(auto& entry : texts) {
+			double value = 0;
+
+			NumberConverter::parseDouble(entry, value);
+			sum -= value;
+		}
+	}
+
+	report("parseDouble", start);
+	assert(sum > -1.0 && sum < 1.0);
+
+	/* A batch of readings, printed and read back */
+	lwiot::DynamicJsonBuffer buffer;
+	auto& array = buffer.createArray();
+	static char json[BATCH * 16];
+	static char copy[BATCH * 16];
+
+	for(int idx = 0; idx < BATCH; idx++)
+		array.add(values[idx], 6);
+
+	start = lwiot_tick();
+
+	for(int round = 0; round < ROUNDS * VALUES / BATCH; round++)
+		length += array.printTo(json, sizeof(json));
+
+	report("JsonArray printTo", start);
+	start = lwiot_tick();
+
+	for(int round = 0; round < ROUNDS * VALUES / BATCH; round++) {
+		lwiot::StaticJsonBuffer<BATCH * 16> document;
+
+		/* The parser works in place */
+		memcpy(copy, json, sizeof(copy));
+
+		for(auto element : document.parseArray(copy))
+			sum += element.as<double>();
+	}
+
+	report("JsonArray parse and as<double>", start);
+	printf("%lu characters written\n", static_cast<unsigned long>(length));
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -0,0 +1,120 @@
+/*
+ * TLS handshake benchmark against the scripts/sslecho server.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/securetcpclient.h>
+#include <lwiot/network/tlssessioncache.h>
+#include <lwiot/network/tlsconfig.h>
+
+#define HANDSHAKES 50
+
+static const char *cert =
+		"-----BEGIN CERTIFICATE-----\n" \
+  "MIIDjDCCAnSgAwIBAgIJALeLmnGMkGgXMA0GCSqGSIb3DQEBCwUAMFsxCzAJBgNV\n" \
+  "BAYTAk5MMRYwFAYDVQQIDA1Ob29yZC1CcmFiYW50MQ4wDAYDVQQHDAVCcmVkYTEO\n" \
+  "MAwGA1UECgwFbHdJb1QxFDASBgNVBAMMC2x3aW90LmxvY2FsMB4XDTE4MTIzMDE1\n" \
+  "MzAxNFoXDTI4MTIyNzE1MzAxNFowWzELMAkGA1UEBhMCTkwxFjAUBgNVBAgMDU5v\n" \
+  "b3JkLUJyYWJhbnQxDjAMBgNVBAcMBUJyZWRhMQ4wDAYDVQQKDAVsd0lvVDEUMBIG\n" \
+  "A1UEAwwLbHdpb3QubG9jYWwwggEiMA0GCSqGSIb3DQEBAQUAA4IBDwAwggEKAoIB\n" \
+  "AQCoTOZJd1rbu883vCmV3zK+VCwpFmzoO/yrnEKzOudU3Mf3pdfA0Fr4x51TyKK+\n" \
+  "QumnD3j0C3ZwCEfoQTo/eiOKnRKyNcKM/wfMgDZsvaENSCINomrpvFjkMMKb0XuQ\n" \
+  "swefOOTlp7kmBTpxi7wora3EhU3b1wNm0EDY8c71bj4MwtY+nqqyKRDOaFRzNhy0\n" \
+  "ulr23XJ6iJI8Caq61h2K0t//IJT8pc0F61/FLXrYZr1Yw1f1GG9Ecr5zvJJQgfqN\n" \
+  "YjmuMhQwmoDNkhWYKs5y87ywO1cWR/xmJITVlv4XKaHY5KQGO1lnBu8GLka+/1xi\n" \
+  "K+MOVlO025DfiiSDu75/lAHvAgMBAAGjUzBRMB0GA1UdDgQWBBQIap4O5ELEDHUS\n" \
+  "jpouinxRWFUXJTAfBgNVHSMEGDAWgBQIap4O5ELEDHUSjpouinxRWFUXJTAPBgNV\n" \
+  "HRMBAf8EBTADAQH/MA0GCSqGSIb3DQEBCwUAA4IBAQCOhyfvnHRVAoH2Tu5sE5SX\n" \
+  "Rs3vdWooj3Sa+EhdunlAEcnsQ4VgZ6zGkUtxCuUgV3v+Mv6n1XbOPP/HjvTCFJnh\n" \
+  "hd+ja4qF5qLD/RU0tgJMqVqgRH87cMMAhSzxYsrWF/Hg4fDtfR+qalTWGYfwgHAy\n" \
+  "+M77thkzt1eKn2QosKNrvPp4xJH2MNC6M1zFH+cD2IEmBqRzZ0vOa6QnMRk7/K+0\n" \
+  "8Wokv5E3nAs8hdTSy/Tr0MBv8RCrJH4Oyri83oF8zP7BV36NtPHIsyXmqOGfo7QC\n" \
+  "JlBkySmXkFsDjma8VKoO17byGJffCLiTgudMe0O8x7RLaUZu09ujIyNs25sCVhsn\n" \
+  "-----END CERTIFICATE-----";
+
+static int compare(const void *a, const void *b)
+{
+	auto x = *static_cast<const time_t*>(a);
+	auto y = *static_cast<const time_t*>(b);
+
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void bench_handshake(const char *name, const lwiot::TlsConfig *config, bool resume)
+{
+	lwiot::TlsSessionCache cache;
+	lwiot::String crt(cert);
+	static time_t samples[HANDSHAKES];
+	int resumed = 0;
+
+	for(int idx = 0; idx < HANDSHAKES; idx++) {
+		lwiot::SecureTcpClient client(lwiot::IPAddress(127, 0, 0, 1), 5300, "lwiot.local");
+		char data[] = "ping";
+		char readback[sizeof(data)];
+
+		/* A full handshake every time unless the session of the last connection is kept */
+		if(!resume)
+			cache.clear();
+
+		/* Without a shared configuration the certificate is parsed for every connection */
+		if(config != nullptr)
+			client.setConfig(*config);
+		else
+			client.setServerCertificate(crt);
+
+		client.setSessionCache(cache);
+
+		auto start = lwiot_tick();
+
+		if(!client.connect()) {
+			printf("Unable to connect to the SSL echo server (scripts/sslecho/server.py)!\n");
+			exit(-EXIT_FAILURE);
+		}
+
+		samples[idx] = lwiot_tick() - start;
+		resumed += client.resumed() ? 1 : 0;
+
+		client.write(data, sizeof(data));
+		client.read(readback, sizeof(readback));
+		client.close();
+	}
+
+	qsort(samples, HANDSHAKES, sizeof(samples[0]), compare);
+
+	time_t total = 0;
+
+	for(auto sample : samples)
+		total += sample;
+
+	printf("[%s] %i handshakes, %i resumed: avg %lu us, p50 %lu us, max %lu us\n", name, HANDSHAKES, resumed,
+	       (unsigned long) (total / HANDSHAKES), (unsigned long) samples[HANDSHAKES / 2],
+	       (unsigned long) samples[HANDSHAKES - 1]);
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	lwiot::TlsConfig config(cert);
+
+	printf("Shared TLS configuration %s\n", config.parsed() ? "pre-parsed" : "parsed per connection");
+
+	bench_handshake("full", nullptr, false);
+	bench_handshake("full, shared config", &config, false);
+	bench_handshake("resumed, shared config", &config, true);
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+/*
+ * XBee driver frames per second benchmark, on simulated radios.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/kernel/lock.h>
+#include <lwiot/kernel/thread.h>
+#include <lwiot/kernel/uniquelock.h>
+
+#include <lwiot/network/xbee/xbee.h>
+#include <lwiot/network/xbee/asyncxbee.h>
+#include <lwiot/network/xbee/xbeesimulator.h>
+
+#define FRAMES       50000
+#define ASYNC_FRAMES 500
+#define PAYLOAD      64
+
+#define COORDINATOR 0x0013A20040000001ULL
+#define ROUTER      0x0013A20040000002ULL
+
+static uint8_t payload[PAYLOAD];
+
+static void report(const char *name, time_t start, int count)
+{
+	auto seconds = (lwiot_tick() - start) / 1000000.0;
+	printf("[%s] %i frames in %.3f s: %.0f frames/s\n", name, count, seconds, count / seconds);
+}
+
+/* Encoding, routing and decoding on the calling thread */
+static void bench_driver()
+{
+	lwiot::XBeeMedium medium;
+	lwiot::XBeeSimulator coordinator(medium, COORDINATOR, 0x0000);
+	lwiot::XBeeSimulator router(medium, ROUTER, 0x1234);
+	lwiot::XBee a, b;
+	lwiot::ZBTxRequest tx;
+	int received = 0;
+
+	a.setSerial(coordinator);
+	b.setSerial(router);
+	tx.setAddress64(ROUTER);
+	tx.setAddress16(0xFFFE);
+	tx.setPayload(payload, sizeof(payload));
+
+	auto start = lwiot_tick();
+
+	for(int idx = 0; idx < FRAMES; idx++) {
+		tx.setFrameId(a.getNextFrameId());
+		a.send(tx);
+
+		a.readPacket();
+		b.readPacket();
+
+		if(b.getResponse().isAvailable())
+			received++;
+	}
+
+	report("XBee send + readPacket", start, received);
+	assert(received == FRAMES);
+}
+
+/* AsyncXbee with a number of frames in flight, 1 being the blocking transmit() */
+static void bench_async(size_t inflight)
+{
+	lwiot::XBeeMedium medium;
+	lwiot::XBeeSimulator coordinator(medium, COORDINATOR, 0x0000);
+	lwiot::XBeeSimulator router(medium, ROUTER, 0x1234);
+	lwiot::AsyncXbee a(coordinator), b(router);
+	lwiot::ZBTxRequest tx;
+	lwiot::Lock lock(false);
+	int received = 0;
+	int completed = 0;
+	char name[48];
+
+	a.begin([](lwiot::XBeeResponse& response) { });
+	b.begin([&](lwiot::XBeeResponse& response) {
+		lwiot::UniqueLock<lwiot::Lock> guard(lock);
+		received++;
+	});
+
+	a.setMaxInFlight(inflight);
+	tx.setAddress64(ROUTER);
+	tx.setAddress16(0xFFFE);
+	tx.setPayload(payload, sizeof(payload));
+
+	auto start = lwiot_tick();
+
+	for(int idx = 0; idx < ASYNC_FRAMES; idx++) {
+		if(inflight == 1) {
+			if(a.send(tx))
+				completed++;
+
+			continue;
+		}
+
+		while(!a.enqueue(tx, [&](bool success, lwiot::XBeeResponse& response) {
+			lwiot::UniqueLock<lwiot::Lock> guard(lock);
+
+			if(success)
+				completed++;
+		})) {
+			lwiot::Thread::yield();
+		}
+	}
+
+	while(true) {
+		lwiot::UniqueLock<lwiot::Lock> guard(lock);
+
+		if(completed == ASYNC_FRAMES && received == ASYNC_FRAMES)
+			break;
+
+		guard.unlock();
+		lwiot::Thread::yield();
+	}
+
+	snprintf(name, sizeof(name), "AsyncXbee, %u in flight", static_cast<unsigned>(inflight));
+	report(name, start, ASYNC_FRAMES);
+
+	a.end();
+	b.end();
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	for(size_t idx = 0; idx < sizeof(payload); idx++)
+		payload[idx] = static_cast<uint8_t>(idx);
+
+	bench_driver();
+	bench_async(1);
+	bench_async(4);
+	bench_async(lwiot::AsyncXbee::MaxInFlight);
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
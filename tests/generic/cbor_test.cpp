@@ -0,0 +1,239 @@
+/*
+ * CBOR codec unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+#include <lwiot/stl/string.h>
+#include <lwiot/util/json.h>
+#include <lwiot/util/cbor.h>
+
+static size_t unhex(const char *text, uint8_t *output)
+{
+	size_t length = strlen(text) / 2;
+
+	for(size_t idx = 0; idx < length; idx++) {
+		unsigned int byte;
+
+		sscanf(text + idx * 2, "%2x", &byte);
+		output[idx] = static_cast<uint8_t>(byte);
+	}
+
+	return length;
+}
+
+static bool encoded(const lwiot::CborWriter& writer, const char *hex)
+{
+	uint8_t expected[64];
+	auto length = unhex(hex, expected);
+
+	return !writer.failed() && writer.count() == length && memcmp(writer.data(), expected, length) == 0;
+}
+
+/* Vectors from RFC 8949, appendix A */
+static void test_encoding()
+{
+	uint8_t buffer[64];
+
+#define CHECK(expr, hex) do { \
+	lwiot::CborWriter writer(buffer, sizeof(buffer)); \
+	writer.expr; \
+	assert(encoded(writer, hex)); \
+} while(0)
+
+	CHECK(value(0), "00");
+	CHECK(value(23), "17");
+	CHECK(value(24), "1818");
+	CHECK(value(100), "1864");
+	CHECK(value(1000), "1903e8");
+	CHECK(value(1000000), "1a000f4240");
+	CHECK(value(1000000000000LL), "1b000000e8d4a51000");
+	CHECK(value(18446744073709551615ULL), "1bffffffffffffffff");
+	CHECK(value(-1), "20");
+	CHECK(value(-1000), "3903e7");
+	CHECK(value(0.0), "f90000");
+	CHECK(value(-0.0), "f98000");
+	CHECK(value(1.5), "f93e00");
+	CHECK(value(65504.0), "f97bff");
+	CHECK(value(100000.0), "fa47c35000");
+	CHECK(value(1.1), "fb3ff199999999999a");
+	CHECK(value(1.0 / 0.0), "f97c00");
+	CHECK(value(false), "f4");
+	CHECK(value(true), "f5");
+	CHECK(null(), "f6");
+	CHECK(value(""), "60");
+	CHECK(value("IETF"), "6449455446");
+	CHECK(value("\xc3\xbc"), "62c3bc");
+	CHECK(bytes("\x01\x02\x03\x04", 4), "4401020304");
+	CHECK(beginArray(3).value(1).value(2).value(3).endArray(), "83010203");
+	CHECK(beginArray().value(1).beginArray(2).value(2).value(3).endArray().endArray(), "9f01820203ff");
+	CHECK(beginObject(2).key("a").value(1).key("b").beginArray().value(2).value(3).endArray().endObject(),
+	      "a261610161629f0203ff");
+
+#undef CHECK
+
+	/* A full buffer fails the writer rather than overflowing it */
+	lwiot::CborWriter small(buffer, 4);
+
+	small.value("too long");
+	assert(small.failed());
+	assert(!small.flush());
+}
+
+static void test_sink()
+{
+	lwiot::ByteBuffer output(16, true);
+
+	{
+		lwiot::CborWriter writer(output);
+
+		writer.beginArray();
+
+		for(int idx = 0; idx < 1000; idx++)
+			writer.value(idx);
+
+		writer.endArray();
+		assert(writer.flush());
+		assert(writer.count() == output.index());
+	}
+
+	lwiot::CborReader reader(output.data(), output.index());
+	lwiot::DynamicJsonBuffer buffer;
+	auto& array = reader.parseArray(buffer);
+
+	assert(array.success());
+	assert(array.size() == 1000);
+	assert(array[999].as<int>() == 999);
+	assert(!reader.available());
+}
+
+static void test_documents()
+{
+	const char json[] = "{\"device\":\"node \\\"12\\\"\",\"seq\":-4200,\"big\":9007199254740993,\"online\":true,"
+	                    "\"error\":null,\"readings\":[{\"sensor\":\"temp\",\"value\":21.46},"
+	                    "{\"sensor\":\"rh\",\"value\":48.5},{\"sensor\":\"pressure\",\"value\":1013.25}],"
+	                    "\"location\":[48.75608,2.302038],\"precise\":3.14159265358979,\"empty\":{},\"none\":[]}";
+	lwiot::DynamicJsonBuffer buffer;
+	auto& root = buffer.parseObject(json);
+	uint8_t output[256];
+
+	assert(root.success());
+
+	lwiot::CborWriter writer(output, sizeof(output));
+
+	writer.json(root);
+	assert(!writer.failed());
+	assert(writer.count() < strlen(json));
+
+	lwiot::DynamicJsonBuffer decoded;
+	lwiot::CborReader reader(writer.data(), writer.count());
+	auto& copy = reader.parseObject(decoded);
+	lwiot::stl::String original, result;
+
+	assert(copy.success());
+	assert(reader.position() == writer.count());
+
+	root.printTo(original);
+	copy.printTo(result);
+	assert(original == result);
+
+	/* Short decimals are stored as floats, the rest as doubles */
+	assert(copy["readings"][0]["value"].as<float>() == 21.46f);
+	assert(copy["precise"].as<double>() == 3.14159265358979);
+	assert(copy["big"].as<long long>() == 9007199254740993LL);
+}
+
+static void test_decoding()
+{
+	struct Vector {
+		const char *hex;
+		const char *json;
+	} vectors[] = {
+		{ "7f657374726561646d696e67ff", "\"streaming\"" },
+		{ "5f42010243030405ff", "\"AQIDBAU\"" },
+		{ "4401020304", "\"AQIDBA\"" },
+		{ "c11a514b67b0", "1363896240" },
+		{ "f93c00", "1" },
+		{ "f9c400", "-4" },
+		{ "fa47c35000", "100000" },
+		{ "3bffffffffffffffff", "-18446744073709552000" },
+		{ "f7", "null" },
+		{ "bf61610161629f0203ffff", "{\"a\":1,\"b\":[2,3]}" },
+		{ "a2616101616282f5f4", "{\"a\":1,\"b\":[true,false]}" },
+	};
+
+	for(auto& vector : vectors) {
+		uint8_t data[64];
+		auto length = unhex(vector.hex, data);
+		lwiot::CborReader reader(data, length);
+		lwiot::DynamicJsonBuffer buffer;
+		ArduinoJson::JsonVariant result;
+		lwiot::stl::String text;
+
+		assert(reader.parse(buffer, result));
+		assert(reader.position() == length);
+
+		/* Compare through an array, bare variants don't print themselves */
+		auto& array = buffer.createArray();
+
+		array.add(result);
+		array.printTo(text);
+		assert(strncmp(text.c_str() + 1, vector.json, strlen(vector.json)) == 0);
+	}
+
+	const char *invalid[] = {
+		"18", "1a0000", "1c", "ff", "62c3", "a10102", "9f01", "5f6161ff", "81818181818181818181818181818181818100", "c6", "a2616100f600", "a1420102f5",
+	};
+
+	for(auto hex : invalid) {
+		uint8_t data[64];
+		auto length = unhex(hex, data);
+		lwiot::CborReader reader(data, length);
+		lwiot::DynamicJsonBuffer buffer;
+		ArduinoJson::JsonVariant result;
+
+		assert(!reader.parse(buffer, result));
+	}
+
+	/* A long chain of tags doesn't nest, it only wraps a single null */
+	static uint8_t chain[100001];
+	lwiot::DynamicJsonBuffer buffer;
+	ArduinoJson::JsonVariant result;
+
+	memset(chain, 0xC6, sizeof(chain) - 1);
+	chain[sizeof(chain) - 1] = 0xF6;
+
+	lwiot::CborReader tagged(chain, sizeof(chain));
+	assert(tagged.parse(buffer, result));
+	assert(tagged.position() == sizeof(chain));
+	assert(result.as<const char *>() == nullptr);
+
+	lwiot::CborReader truncated(chain, sizeof(chain) - 1);
+	assert(!truncated.parse(buffer, result));
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	test_encoding();
+	test_sink();
+	test_documents();
+	test_decoding();
+
+	print_dbg("CBOR test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
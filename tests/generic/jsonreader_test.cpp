@@ -0,0 +1,272 @@
+/*
+ * Streaming JSON reader unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/test.h>
+#include <lwiot/bufferedstream.h>
+#include <lwiot/util/jsonreader.h>
+
+/* Hands out at most a few bytes per read, like a slow socket */
+class Trickle : public lwiot::BufferedStream {
+public:
+	explicit Trickle(const char *data)
+	{
+		this->write(data, strlen(data));
+	}
+
+	ssize_t read(void *output, const size_t& length) override
+	{
+		size_t num = length > 3 ? 3 : length;
+		return lwiot::BufferedStream::read(output, num);
+	}
+};
+
+static const char document[] =
+	"{ \"name\": \"kitchen\\/\\u00e9\\ud83d\\ude00\", \"id\": -42, \"big\": 18446744073709551616,\n"
+	"  \"sensors\": [ { \"type\": \"temp\", \"value\": 21.5 }, { \"type\": \"rh\", \"value\": 4.2e1 } ],\n"
+	"  \"a/b\": { \"c~d\": [ true, false, null ] }, \"empty\": {}, \"none\": [] }";
+
+static void test_events()
+{
+	Trickle input(document);
+	lwiot::JsonReader reader(input);
+
+	struct Expected {
+		lwiot::JsonReader::Event event;
+		const char *path;
+	} expected[] = {
+		{ lwiot::JsonReader::BeginObject, "" },
+		{ lwiot::JsonReader::String, "/name" },
+		{ lwiot::JsonReader::Integer, "/id" },
+		{ lwiot::JsonReader::Float, "/big" },
+		{ lwiot::JsonReader::BeginArray, "/sensors" },
+		{ lwiot::JsonReader::BeginObject, "/sensors/0" },
+		{ lwiot::JsonReader::String, "/sensors/0/type" },
+		{ lwiot::JsonReader::Float, "/sensors/0/value" },
+		{ lwiot::JsonReader::EndObject, "/sensors/0" },
+		{ lwiot::JsonReader::BeginObject, "/sensors/1" },
+		{ lwiot::JsonReader::String, "/sensors/1/type" },
+		{ lwiot::JsonReader::Float, "/sensors/1/value" },
+		{ lwiot::JsonReader::EndObject, "/sensors/1" },
+		{ lwiot::JsonReader::EndArray, "/sensors" },
+		{ lwiot::JsonReader::BeginObject, "/a~1b" },
+		{ lwiot::JsonReader::BeginArray, "/a~1b/c~0d" },
+		{ lwiot::JsonReader::Boolean, "/a~1b/c~0d/0" },
+		{ lwiot::JsonReader::Boolean, "/a~1b/c~0d/1" },
+		{ lwiot::JsonReader::Null, "/a~1b/c~0d/2" },
+		{ lwiot::JsonReader::EndArray, "/a~1b/c~0d" },
+		{ lwiot::JsonReader::EndObject, "/a~1b" },
+		{ lwiot::JsonReader::BeginObject, "/empty" },
+		{ lwiot::JsonReader::EndObject, "/empty" },
+		{ lwiot::JsonReader::BeginArray, "/none" },
+		{ lwiot::JsonReader::EndArray, "/none" },
+		{ lwiot::JsonReader::EndObject, "" },
+		{ lwiot::JsonReader::End, "" },
+	};
+
+	for(auto& entry : expected) {
+		auto event = reader.next();
+
+		assert(event == entry.event);
+		assert(strcmp(reader.path(), entry.path) == 0);
+
+		if(strcmp(entry.path, "/name") == 0) {
+			assert(strcmp(reader.string(), "kitchen/\xC3\xA9\xF0\x9F\x98\x80") == 0);
+			assert(strcmp(reader.key(), "name") == 0);
+		} else if(strcmp(entry.path, "/id") == 0) {
+			assert(reader.integer() == -42);
+		} else if(strcmp(entry.path, "/big") == 0) {
+			assert(reader.number() > 1.8e19);
+		} else if(strcmp(entry.path, "/sensors/1/value") == 0) {
+			assert(reader.number() == 42.0);
+		} else if(strcmp(entry.path, "/a~1b/c~0d/0") == 0) {
+			assert(reader.boolean());
+		}
+	}
+
+	assert(reader.next() == lwiot::JsonReader::End);
+	assert(reader.error() == lwiot::JsonReader::NoError);
+	assert(reader.position() == sizeof(document) - 1);
+}
+
+static void test_filters()
+{
+	char large[512];
+	char json[2 * sizeof(large) + 128];
+
+	memset(large, 'x', sizeof(large) - 1);
+	large[sizeof(large) - 1] = '\0';
+	snprintf(json, sizeof(json), "{\"blob\":\"%s\",\"sensors\":[{\"value\":1,\"x\":\"%s\"},{\"value\":2}],\"name\":\"n\"}",
+	         large, large);
+
+	lwiot::BufferedStream input;
+	lwiot::JsonReader reader(input);
+	int64_t sum = 0;
+	int events = 0;
+
+	input.write(json, strlen(json));
+
+	/* Strings beyond the token limit are fine as long as they are filtered out */
+	assert(reader.addFilter("/sensors/*/value"));
+	assert(reader.addFilter("/name"));
+
+	auto result = reader.parse([&](lwiot::JsonReader::Event event, const lwiot::JsonReader& r) {
+		events++;
+
+		if(event == lwiot::JsonReader::Integer)
+			sum += r.integer();
+		else
+			assert(event == lwiot::JsonReader::String && strcmp(r.string(), "n") == 0);
+	});
+
+	assert(result);
+	assert(events == 3 && sum == 3);
+
+	/* Skipped values still have to be well formed, whether they are filtered out or not */
+	const char *skipped[] = {
+		"{\"skip\":{\"a\":1]}", "{\"skip\":[1,{\"a\":[2}]]}", "{\"skip\":[1,]}", "{\"skip\":{a:1}}",
+		"{\"skip\":[tru]}", "{\"skip\":[01]}", "{\"skip\":[1 2]}", "{\"skip\":{\"a\" 1}}", "{\"skip\":{\"a\":1,}}",
+		"{\"skip\":[-]}", "{\"skip\":[1.]}", "{\"skip\":[\"\\x\"]}",
+	};
+
+	for(auto text : skipped) {
+		for(int filter = 0; filter < 2; filter++) {
+			lwiot::BufferedStream stream;
+			lwiot::JsonReader filtered(stream);
+
+			stream.write(text, strlen(text));
+
+			if(filter)
+				filtered.addFilter("/keep");
+
+			assert(!filtered.parse([](lwiot::JsonReader::Event event, const lwiot::JsonReader& r) {
+			}));
+			assert(filtered.error() == lwiot::JsonReader::SyntaxError);
+		}
+	}
+
+	lwiot::BufferedStream valid;
+	lwiot::JsonReader kept(valid);
+	const char document[] = "{\"skip\":{\"a\":[1,-2.5e3,true,null,\"s\",{},[]],\"b\":{\"c\":0}},\"keep\":7}";
+
+	valid.write(document, sizeof(document) - 1);
+	kept.addFilter("/keep");
+	events = 0;
+
+	assert(kept.parse([&](lwiot::JsonReader::Event event, const lwiot::JsonReader& r) {
+		assert(event == lwiot::JsonReader::Integer && r.integer() == 7);
+		events++;
+	}));
+	assert(events == 1);
+
+	lwiot::BufferedStream deep;
+	lwiot::JsonReader limited(deep);
+	const char nested[] = "{\"skip\":[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]}";
+
+	deep.write(nested, sizeof(nested) - 1);
+	limited.addFilter("/name");
+	assert(!limited.parse([](lwiot::JsonReader::Event event, const lwiot::JsonReader& r) {
+	}));
+	assert(limited.error() == lwiot::JsonReader::NestingTooDeep);
+
+	/* A filter on a container reports everything inside of it */
+	lwiot::BufferedStream second;
+	lwiot::JsonReader subtree(second);
+	const char text[] = "{\"a\":{\"b\":[1,{\"c\":2}]},\"d\":3}";
+
+	second.write(text, sizeof(text) - 1);
+	subtree.addFilter("/a/b");
+	events = 0;
+
+	assert(subtree.parse([&](lwiot::JsonReader::Event event, const lwiot::JsonReader& r) {
+		assert(strncmp(r.path(), "/a/b", 4) == 0);
+		events++;
+	}));
+
+	assert(events == 6);
+
+	/* Unless filtered out, the token limit applies */
+	lwiot::BufferedStream third;
+	lwiot::JsonReader unfiltered(third);
+
+	third.write(json, strlen(json));
+	assert(unfiltered.next() == lwiot::JsonReader::BeginObject);
+	assert(unfiltered.next() == lwiot::JsonReader::Error);
+	assert(unfiltered.error() == lwiot::JsonReader::TokenTooLong);
+}
+
+static lwiot::JsonReader::ErrorCode parse(const char *json)
+{
+	lwiot::BufferedStream input;
+	lwiot::JsonReader reader(input);
+
+	input.write(json, strlen(json));
+
+	while(true) {
+		auto event = reader.next();
+
+		if(event == lwiot::JsonReader::End || event == lwiot::JsonReader::Error)
+			return reader.error();
+	}
+}
+
+static void test_errors()
+{
+	const char *invalid[] = {
+		"{\"a\":1,}", "{\"a\" 1}", "[1 2]", "[tru]", "{1:2}", "[01]", "[1.]", "[-]", "[\"\\x\"]",
+		"[\"\\ud800\"]", "{\"a\":1]", "\"tab\there\"",
+	};
+
+	for(auto json : invalid)
+		assert(parse(json) == lwiot::JsonReader::SyntaxError);
+
+	assert(parse("{\"a\":[1,2") == lwiot::JsonReader::UnexpectedEnd);
+	assert(parse("\"open") == lwiot::JsonReader::UnexpectedEnd);
+	assert(parse("") == lwiot::JsonReader::UnexpectedEnd);
+	assert(parse("[[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]]") == lwiot::JsonReader::NestingTooDeep);
+	assert(parse("[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]") == lwiot::JsonReader::NoError);
+	assert(parse(" 12 ") == lwiot::JsonReader::NoError);
+}
+
+static void test_documents()
+{
+	const char text[] = "{\"seq\":1} {\"seq\":2}";
+	lwiot::BufferedStream input;
+	lwiot::JsonReader reader(input);
+
+	input.write(text, sizeof(text) - 1);
+
+	for(int64_t seq = 1; seq <= 2; seq++) {
+		assert(reader.next() == lwiot::JsonReader::BeginObject);
+		assert(reader.next() == lwiot::JsonReader::Integer && reader.integer() == seq);
+		assert(reader.next() == lwiot::JsonReader::EndObject);
+		assert(reader.next() == lwiot::JsonReader::End);
+		reader.reset();
+	}
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	test_events();
+	test_filters();
+	test_errors();
+	test_documents();
+
+	print_dbg("JSON reader test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
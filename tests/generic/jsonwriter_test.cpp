@@ -0,0 +1,150 @@
+/*
+ * Streaming JSON writer unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+#include <lwiot/stl/string.h>
+#include <lwiot/util/json.h>
+#include <lwiot/util/jsonwriter.h>
+
+static bool equals(const lwiot::ByteBuffer& buffer, const char *text)
+{
+	return buffer.index() == strlen(text) && memcmp(buffer.data(), text, buffer.index()) == 0;
+}
+
+static void test_builder()
+{
+	lwiot::ByteBuffer output(16, true);
+	lwiot::JsonWriter writer(output);
+
+	writer.beginObject();
+	writer.key("name").value("kitchen \"1\"\n\x01");
+	writer.key("id").value(-42);
+	writer.key("big").value(18446744073709551615ULL);
+	writer.key("min").value(static_cast<long long>(-9223372036854775807LL - 1));
+	writer.key("temp").value(21.456, 2);
+	writer.key("rh").value(40.5, 1);
+	writer.key("lat").value(48.75608);
+	writer.key("lon").value(2.302038f);
+	writer.key("tiny").value(1e-7);
+	writer.key("nan").value(0.0 / 0.0);
+	writer.key("list").beginArray();
+	writer.value(true).value(false).null();
+	writer.beginObject().endObject();
+	writer.beginArray().endArray();
+	writer.endArray();
+	writer.key("none").value(static_cast<const char *>(nullptr));
+	writer.endObject();
+
+	assert(writer.flush());
+	assert(!writer.failed());
+	assert(equals(output, "{\"name\":\"kitchen \\\"1\\\"\\n\\u0001\",\"id\":-42,\"big\":18446744073709551615,"
+	                      "\"min\":-9223372036854775808,\"temp\":21.46,\"rh\":40.5,"
+	                      "\"lat\":48.75608,\"lon\":2.302038,\"tiny\":1e-7,\"nan\":null,"
+	                      "\"list\":[true,false,null,{},[]],\"none\":null}"));
+	assert(writer.count() == output.index());
+}
+
+static void test_documents()
+{
+	lwiot::DynamicJsonBuffer buffer;
+	auto& root = buffer.parseObject("{\"sensor\":\"gps\",\"time\":1351824120,\"data\":[48.75,2.30]}");
+	lwiot::stl::String expected;
+
+	assert(root.success());
+	root.printTo(expected);
+
+	/* A document on its own matches printTo() */
+	lwiot::ByteBuffer output(16, true);
+	lwiot::JsonWriter writer(output);
+
+	writer.json(root);
+	assert(writer.flush());
+	assert(equals(output, expected.c_str()));
+
+	/* ... and can be nested into a document that is built by hand */
+	lwiot::ByteBuffer nested(16, true);
+	lwiot::JsonWriter second(nested);
+
+	second.beginArray().json(root).json(root["data"]).value(1).endArray();
+	assert(second.flush());
+
+	lwiot::stl::String text;
+	text += "[";
+	text += expected;
+	text += ",[48.75,2.30],1]";
+	assert(equals(nested, text.c_str()));
+}
+
+static void test_sink()
+{
+	size_t calls = 0;
+	size_t total = 0;
+	size_t largest = 0;
+
+	lwiot::JsonWriter writer([&](const void *data, size_t length) {
+		calls++;
+		total += length;
+		largest = length > largest ? length : largest;
+		return true;
+	});
+
+	writer.beginArray();
+
+	for(int idx = 0; idx < 1000; idx++)
+		writer.value(idx);
+
+	writer.endArray();
+	assert(writer.flush());
+
+	/* Output leaves in buffer sized pieces, not per token */
+	assert(total == writer.count());
+	assert(largest <= lwiot::JsonWriter::BufferSize);
+	assert(calls <= total / (lwiot::JsonWriter::BufferSize / 2) + 1);
+
+	/* Once the sink refuses data, nothing else goes out */
+	size_t accepted = 0;
+	lwiot::JsonWriter failing([&](const void *data, size_t length) {
+		if(accepted > 0)
+			return false;
+
+		accepted += length;
+		return true;
+	});
+
+	failing.beginArray();
+
+	for(int idx = 0; idx < 1000; idx++)
+		failing.value("some text to fill the buffer");
+
+	failing.endArray();
+	assert(!failing.flush());
+	assert(failing.failed());
+	assert(accepted > 0 && accepted <= lwiot::JsonWriter::BufferSize);
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	test_builder();
+	test_documents();
+	test_sink();
+
+	print_dbg("JSON writer test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/*
+ * MQTT store-and-forward log unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/io/file.h>
+#include <lwiot/network/mqttstore.h>
+
+#define STORE_PATH "mqttstore_test.log"
+
+static lwiot::ByteBuffer message(int idx)
+{
+	char text[32];
+	auto length = snprintf(text, sizeof(text), "message %i", idx);
+	lwiot::ByteBuffer buffer(length, true);
+
+	buffer.write(text, length);
+	return buffer;
+}
+
+static bool check(lwiot::MqttStore& store, int idx)
+{
+	lwiot::String topic;
+	lwiot::ByteBuffer payload;
+	bool retained;
+
+	if(!store.next(topic, payload, retained))
+		return false;
+
+	return topic == "test/store" && payload == message(idx) && retained == (idx % 2 == 0);
+}
+
+static void test_replay()
+{
+	lwiot::MqttFileStore store(STORE_PATH, 1024);
+
+	assert(store);
+	assert(store.count() == 0);
+
+	for(int idx = 0; idx < 10; idx++)
+		assert(store.append("test/store", message(idx), idx % 2 == 0));
+
+	assert(store.count() == 10);
+	assert(store.pending() == 10);
+
+	assert(check(store, 0));
+	assert(check(store, 1));
+	assert(store.pending() == 8);
+
+	/* Unacknowledged records are replayed again after a rewind */
+	store.rewind();
+	assert(check(store, 0));
+	assert(store.pop());
+	assert(check(store, 1));
+	assert(check(store, 2));
+	assert(store.pop());
+	assert(store.count() == 8);
+	assert(store.pending() == 7);
+}
+
+static void test_persistence()
+{
+	lwiot::MqttFileStore store(STORE_PATH, 1024);
+
+	/* test_replay() left records 2 - 9 behind */
+	assert(store.count() == 8);
+	assert(check(store, 2));
+
+	while(store.count() > 0)
+		assert(store.pop());
+
+	assert(store.pending() == 0);
+}
+
+static void test_wrap()
+{
+	lwiot::MqttFileStore store(STORE_PATH, 256);
+
+	/* A full ring evicts its oldest records, so it always holds the latest count() records */
+	for(int idx = 0; idx < 100; idx++) {
+		assert(store.append("test/store", message(idx % 10), idx % 2 == 0));
+		assert(store.count() <= 256 / 28);
+
+		if(idx % 3 == 0) {
+			store.rewind();
+			assert(check(store, (idx + 1 - store.count()) % 10));
+			assert(store.pop());
+		}
+	}
+
+	store.rewind();
+
+	for(int idx = 100 - store.count(); idx < 100; idx++) {
+		assert(check(store, idx % 10));
+		assert(store.pop());
+	}
+
+	assert(store.count() == 0);
+}
+
+static void test_full_replay()
+{
+	lwiot::MqttFileStore store(STORE_PATH, 256);
+	int idx;
+
+	for(idx = 0; store.count() < 256 / 28; idx++)
+		assert(store.append("test/store", message(idx), idx % 2 == 0));
+
+	/* Records 0 and 1 are in flight and may not be evicted to make room */
+	assert(check(store, 0));
+	assert(check(store, 1));
+	assert(!store.append("test/store", message(idx), idx % 2 == 0));
+
+	/* The acknowledgements still match the records that were sent */
+	assert(store.pop());
+	assert(store.pop());
+	assert(check(store, 2));
+
+	store.rewind();
+	assert(store.append("test/store", message(idx), idx % 2 == 0));
+	assert(check(store, 2));
+	assert(store.pop());
+
+	while(store.count() > 0)
+		assert(store.pop());
+}
+
+static void test_corruption()
+{
+	lwiot::String topic;
+	lwiot::ByteBuffer payload;
+	bool retained;
+	uint8_t byte = 'X';
+
+	lwiot::MqttFileStore *store = new lwiot::MqttFileStore(STORE_PATH, 1024);
+	assert(store->append("test/store", message(0), true));
+	delete store;
+
+	lwiot::File *file = new lwiot::File(STORE_PATH, lwiot::FileMode::ReadWriteNoCreate);
+	assert(file->seek(20 + 9 + 3));
+	assert(file->write(&byte, 1) == 1);
+	delete file;
+
+	store = new lwiot::MqttFileStore(STORE_PATH, 1024);
+	assert(store->count() == 1);
+	assert(!store->next(topic, payload, retained));
+	assert(store->count() == 0);
+	delete store;
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	remove(STORE_PATH);
+	test_replay();
+	test_persistence();
+
+	remove(STORE_PATH);
+	test_wrap();
+	test_full_replay();
+	test_corruption();
+	remove(STORE_PATH);
+
+	print_dbg("MQTT store test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -0,0 +1,222 @@
+/*
+ * Number conversion unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/printer.h>
+#include <lwiot/stl/string.h>
+#include <lwiot/util/numberconverter.h>
+
+using lwiot::NumberConverter;
+
+static void test_integers()
+{
+	char text[NumberConverter::MaxLength];
+	int64_t value;
+	const char *end;
+
+	assert(NumberConverter::formatInteger(0, text) == 1 && strcmp(text, "0") == 0);
+	assert(NumberConverter::formatInteger(-7, text) == 2 && strcmp(text, "-7") == 0);
+	assert(NumberConverter::formatInteger(INT64_MIN, text) == 20 && strcmp(text, "-9223372036854775808") == 0);
+	assert(NumberConverter::formatUnsigned(UINT64_MAX, text) == 20 && strcmp(text, "18446744073709551615") == 0);
+	assert(NumberConverter::formatUnsigned(1000000, text) == 7 && strcmp(text, "1000000") == 0);
+
+	assert(NumberConverter::parseInteger("-9223372036854775808", value) && value == INT64_MIN);
+	assert(NumberConverter::parseInteger("+42,", value, &end) && value == 42 && *end == ',');
+	assert(!NumberConverter::parseInteger("9223372036854775808", value));
+	assert(!NumberConverter::parseInteger("-", value, &end) && *end == '-');
+}
+
+static void test_shortest()
+{
+	struct {
+		double value;
+		const char *text;
+	} doubles[] = {
+		{ 0.0, "0" }, { -0.0, "-0" }, { 1.0, "1" }, { 21.46, "21.46" }, { 0.1, "0.1" }, { -48.75608, "-48.75608" },
+		{ 0.001234, "0.001234" }, { 1e-7, "1e-7" }, { 1e21, "1e21" }, { 123456789012345680000.0, "123456789012345680000" },
+		{ 5e-324, "5e-324" }, { 1.7976931348623157e308, "1.7976931348623157e308" }, { 1.5e300, "1.5e300" },
+	};
+	char text[NumberConverter::MaxLength];
+
+	for(auto& entry : doubles) {
+		NumberConverter::formatDouble(entry.value, text);
+		assert(strcmp(text, entry.text) == 0);
+	}
+
+	NumberConverter::formatFloat(21.46f, text);
+	assert(strcmp(text, "21.46") == 0);
+	NumberConverter::formatFloat(3.4028235e38f, text);
+	assert(strcmp(text, "3.4028235e38") == 0);
+	NumberConverter::formatDouble(NAN, text);
+	assert(strcmp(text, "nan") == 0);
+
+	/* Everything reads back to the same bits */
+	for(int idx = 0; idx < 100000; idx++) {
+		uint64_t bits = static_cast<uint64_t>(rand()) << 42 ^ static_cast<uint64_t>(rand()) << 21 ^ rand();
+		double value, back;
+		float single, narrow;
+
+		memcpy(&value, &bits, sizeof(value));
+
+		if(isnan(value) || isinf(value))
+			continue;
+
+		NumberConverter::formatDouble(value, text);
+		assert(NumberConverter::parseDouble(text, back) && back == value);
+		assert(strtod(text, nullptr) == value);
+
+		single = static_cast<float>(rand() % 1000000) / 1000.0f;
+		NumberConverter::formatFloat(single, text);
+		narrow = strtof(text, nullptr);
+		assert(narrow == single);
+	}
+}
+
+static void test_fixed()
+{
+	const double values[] = {
+		0.0, -0.0, 0.125, 0.375, 2.5, 3.5, 0.05, 21.455, 21.46, -1013.255, 999.9999999, 4294967295.5, 1e14 + 0.5,
+		1e300, -3.14159265358979,
+	};
+	char text[64], expected[64];
+
+	for(auto value : values) {
+		for(uint8_t decimals = 0; decimals <= 10; decimals++) {
+			NumberConverter::formatFixed(value, decimals, text, sizeof(text));
+			snprintf(expected, sizeof(expected), "%.*f", decimals, value);
+			assert(strcmp(text, expected) == 0);
+		}
+	}
+
+	/* Output is cut off to the buffer */
+	assert(NumberConverter::formatFixed(123.456, 2, text, 4) == 3 && strcmp(text, "123") == 0);
+}
+
+static void test_parsing()
+{
+	const char *texts[] = {
+		"0", "-0", "21.46", "1e3", "1E-3", "-4.2e+1", "0.000001234", "9007199254740993", "123456789012345678901234",
+		"1e22", "3e37", "1.7976931348623157e308", "2.2250738585072014e-308", "4.9e-324", "0.1e-400", "1e400",
+		"1.", ".5",
+	};
+
+	for(auto text : texts) {
+		const char *end;
+		double value;
+
+		assert(NumberConverter::parseDouble(text, value, &end));
+		assert(*end == '\0');
+		assert(value == strtod(text, nullptr));
+	}
+
+	const char *end;
+	double value;
+
+	assert(NumberConverter::parseDouble("12.5e", value, &end) && value == 12.5 && *end == 'e');
+	assert(!NumberConverter::parseDouble("-.e1", value, &end));
+	assert(!NumberConverter::parseDouble("nan", value));
+}
+
+static void test_strings()
+{
+	lwiot::stl::String text(21.456);
+	lwiot::stl::String precise(-3.14159265358979, 5);
+	lwiot::stl::String concatenated("t=");
+
+	assert(text == "21.46");
+	assert(precise == "-3.14159");
+
+	concatenated += 21.5;
+	assert(concatenated == "t=21.500000");
+	assert(lwiot::stl::String(" 1013.25").toDouble() == 1013.25);
+}
+
+class TextPrinter : public lwiot::Printer {
+public:
+	explicit TextPrinter() : _length(0)
+	{
+		this->_text[0] = '\0';
+	}
+
+	using lwiot::Printer::write;
+
+	size_t write(uint8_t byte) override
+	{
+		if(this->_length + 1 >= sizeof(this->_text))
+			return 0;
+
+		this->_text[this->_length++] = static_cast<char>(byte);
+		this->_text[this->_length] = '\0';
+		return 1;
+	}
+
+	bool printed(const char *expected)
+	{
+		auto result = strcmp(this->_text, expected) == 0;
+
+		this->_length = 0;
+		this->_text[0] = '\0';
+		return result;
+	}
+
+private:
+	char _text[64];
+	size_t _length;
+};
+
+static void test_printer()
+{
+	TextPrinter printer;
+
+	printer.print(4711UL);
+	assert(printer.printed("4711"));
+	printer.print(-1234567890L);
+	assert(printer.printed("-1234567890"));
+	printer.print(255, 16);
+	assert(printer.printed("FF"));
+
+	/* Correctly rounded, and no longer "ovf" beyond 32 bits */
+	printer.print(21.456);
+	assert(printer.printed("21.46"));
+	printer.print(0.125, 2);
+	assert(printer.printed("0.12"));
+	printer.print(-3.14159265358979, 5);
+	assert(printer.printed("-3.14159"));
+	printer.print(5000000000.5, 1);
+	assert(printer.printed("5000000000.5"));
+	printer.print(1e21, 2);
+	assert(printer.printed("1e21"));
+	printer.print(NAN);
+	assert(printer.printed("nan"));
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	test_integers();
+	test_shortest();
+	test_fixed();
+	test_parsing();
+	test_strings();
+	test_printer();
+
+	print_dbg("Number converter test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+/*
+ * MQTT topic trie unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/types.h>
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+
+#include <lwiot/network/topictrie.h>
+
+static int count(const lwiot::TopicTrie<int>& trie, const char *topic, int *sum = nullptr)
+{
+	int total = 0;
+	auto matches = trie.match(topic, [&total](const int& value) {
+		total += value;
+	});
+
+	if(sum)
+		*sum = total;
+
+	return matches;
+}
+
+static void test_validate()
+{
+	using Trie = lwiot::TopicTrie<int>;
+
+	assert(Trie::validate("a/b/c"));
+	assert(Trie::validate("a/+/c"));
+	assert(Trie::validate("+"));
+	assert(Trie::validate("#"));
+	assert(Trie::validate("a/#"));
+	assert(Trie::validate("+/+/#"));
+
+	assert(!Trie::validate(""));
+	assert(!Trie::validate("a/b#"));
+	assert(!Trie::validate("a/#/c"));
+	assert(!Trie::validate("a+/b"));
+	assert(!Trie::validate("a/+b"));
+}
+
+static void test_match()
+{
+	lwiot::TopicTrie<int> trie;
+	int sum;
+
+	assert(trie.add("site/1/sensor/temp", 1));
+	assert(trie.add("site/+/sensor/temp", 2));
+	assert(trie.add("site/#", 4));
+	assert(trie.add("site/1/sensor/+", 8));
+	assert(trie.add("#", 16));
+	assert(trie.add("site/1/sensor/temp", 32));
+	assert(!trie.add("site/#/temp", 64));
+	assert(trie.size() == 6);
+
+	assert(count(trie, "site/1/sensor/temp", &sum) == 6);
+	assert(sum == 63);
+
+	assert(count(trie, "site/2/sensor/temp", &sum) == 3);
+	assert(sum == 22);
+
+	assert(count(trie, "site", &sum) == 2);
+	assert(sum == 20);
+
+	assert(count(trie, "other/topic", &sum) == 1);
+	assert(sum == 16);
+
+	assert(count(trie, "$SYS/broker/uptime") == 0);
+	assert(trie.add("$SYS/#", 128));
+	assert(count(trie, "$SYS/broker/uptime", &sum) == 1);
+	assert(sum == 128);
+
+	assert(trie.remove("site/1/sensor/temp"));
+	assert(!trie.contains("site/1/sensor/temp"));
+	assert(trie.contains("site/1/sensor/+"));
+	assert(count(trie, "site/1/sensor/temp", &sum) == 4);
+	assert(sum == 30);
+
+	assert(!trie.remove("does/not/exist"));
+	trie.clear();
+	assert(trie.size() == 0);
+	assert(count(trie, "site/1/sensor/temp") == 0);
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	test_validate();
+	test_match();
+	print_dbg("Topic trie test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
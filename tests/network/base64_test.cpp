@@ -0,0 +1,187 @@
+/*
+ * Base64 codec unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+#include <lwiot/error.h>
+#include <lwiot/bufferedstream.h>
+
+#include <lwiot/network/base64.h>
+#include <lwiot/network/base64codec.h>
+
+/* RFC 4648 test vectors */
+static const char *vectors[][2] = {
+	{ "", "" },
+	{ "f", "Zg==" },
+	{ "fo", "Zm8=" },
+	{ "foo", "Zm9v" },
+	{ "foob", "Zm9vYg==" },
+	{ "fooba", "Zm9vYmE=" },
+	{ "foobar", "Zm9vYmFy" },
+};
+
+static void test_vectors()
+{
+	char encoded[16];
+	char decoded[16];
+
+	for(auto& vector : vectors) {
+		auto length = strlen(vector[0]);
+
+		assert(lwiot::Base64::encode(vector[0], length, encoded) == strlen(vector[1]));
+		assert(memcmp(encoded, vector[1], strlen(vector[1])) == 0);
+		assert(lwiot::Base64::decode(vector[1], strlen(vector[1]), decoded) == static_cast<ssize_t>(length));
+		assert(memcmp(decoded, vector[0], length) == 0);
+	}
+}
+
+static void test_blocks()
+{
+	uint8_t data[300];
+	char encoded[lwiot::Base64::encodedLength(sizeof(data))];
+	char expected[base64_encode_expected_len(sizeof(data)) + 1];
+	uint8_t decoded[sizeof(data)];
+
+	for(size_t idx = 0; idx < sizeof(data); idx++)
+		data[idx] = static_cast<uint8_t>(idx * 7 + 3);
+
+	/* Every length, so each block size and tail goes through the fast paths */
+	for(size_t length = 0; length <= sizeof(data); length++) {
+		base64_encodestate state;
+
+		base64_init_encodestate_nonewlines(&state);
+		auto num = base64_encode_block((const char *) data, length, expected, &state);
+		num += base64_encode_blockend(expected + num, &state);
+
+		assert(lwiot::Base64::encode(data, length, encoded) == static_cast<size_t>(num));
+		assert(memcmp(encoded, expected, num) == 0);
+		assert(lwiot::Base64::decode(encoded, num, decoded) == static_cast<ssize_t>(length));
+		assert(memcmp(decoded, data, length) == 0);
+	}
+}
+
+static void test_strict()
+{
+	const char *invalid[] = {
+		"Zg", "Zg=", "Zm9vY", "Z===", "Zm=v", "Zh==", "Zm9=", "Zm9v\n", "Zm 9", "=Zm9",
+		"Zg==Zm9v", "Zm9v-_==", "Zm9vYmFyZm9vYmFyZm9vYmFyZm9vYm*y",
+	};
+	uint8_t output[48];
+
+	for(auto input : invalid)
+		assert(lwiot::Base64::decode(input, strlen(input), output) == -EINVALID);
+
+	/* Bytes outside of the alphabet in the middle of a long block */
+	char encoded[64];
+	uint8_t data[45] = { 0 };
+	auto num = lwiot::Base64::encode(data, sizeof(data), encoded);
+
+	for(size_t idx = 0; idx < num; idx++) {
+		auto saved = encoded[idx];
+
+		encoded[idx] = '\x80';
+		assert(lwiot::Base64::decode(encoded, num, output) == -EINVALID);
+		encoded[idx] = '.';
+		assert(lwiot::Base64::decode(encoded, num, output) == -EINVALID);
+		encoded[idx] = saved;
+	}
+
+	assert(lwiot::Base64::decode(encoded, num, output) == sizeof(data));
+}
+
+static void test_buffers()
+{
+	lwiot::ByteBuffer input(16), encoded(8), decoded(8);
+	uint8_t data[1000];
+
+	for(size_t idx = 0; idx < sizeof(data); idx++)
+		data[idx] = static_cast<uint8_t>(idx);
+
+	input.write(data, sizeof(data));
+	lwiot::Base64::encode(input, encoded);
+	assert(encoded.index() == lwiot::Base64::encodedLength(sizeof(data)));
+	assert(lwiot::Base64::decode(encoded, decoded));
+	assert(decoded.index() == sizeof(data) && memcmp(decoded.data(), data, sizeof(data)) == 0);
+
+	/* Padding in the middle is refused and leaves the output as it was */
+	lwiot::ByteBuffer padded(8);
+
+	padded.write("Zg==", 4);
+	padded.write(encoded.data(), encoded.index());
+	assert(!lwiot::Base64::decode(padded, decoded));
+	assert(decoded.index() == sizeof(data));
+}
+
+static void test_streams()
+{
+	lwiot::BufferedStream encoded, decoded;
+	lwiot::Base64Encoder encoder(encoded);
+	lwiot::Base64Decoder decoder(decoded);
+	uint8_t data[1000];
+	char text[lwiot::Base64::encodedLength(sizeof(data))];
+
+	for(size_t idx = 0; idx < sizeof(data); idx++)
+		data[idx] = static_cast<uint8_t>(idx * 3);
+
+	/* Uneven pieces, so groups are split across writes */
+	for(size_t idx = 0, step = 1; idx < sizeof(data); idx += step, step = step % 7 + 1)
+		assert(encoder.write(data + idx, idx + step > sizeof(data) ? sizeof(data) - idx : step));
+
+	assert(encoder.finish());
+	assert(encoder.count() == sizeof(text));
+	assert(encoded.read(text, sizeof(text)) == sizeof(text));
+
+	for(size_t idx = 0, step = 1; idx < sizeof(text); idx += step, step = step % 5 + 1)
+		assert(decoder.write(text + idx, idx + step > sizeof(text) ? sizeof(text) - idx : step));
+
+	assert(decoder.finish());
+	assert(decoder.count() == sizeof(data));
+
+	uint8_t output[sizeof(data)];
+
+	assert(decoded.read(output, sizeof(output)) == sizeof(output));
+	assert(memcmp(output, data, sizeof(data)) == 0);
+
+	/* Truncated input, data after the padding and bad characters */
+	decoder.reset();
+	assert(decoder.write("Zm9vYg", 6));
+	assert(!decoder.finish());
+	assert(decoder.failed());
+
+	decoder.reset();
+	assert(decoder.write("Zg=", 3));
+	assert(decoder.write("=", 1));
+	assert(!decoder.write("Zm9v", 4));
+
+	decoder.reset();
+	assert(!decoder.write("Zm9v!m9v", 8));
+	assert(!decoder.write("Zm9v", 4));
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	test_vectors();
+	test_blocks();
+	test_strict();
+	test_buffers();
+	test_streams();
+
+	print_dbg("Base64 test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -0,0 +1,301 @@
+/*
+ * CoAP message, server and client unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+
+#include <lwiot/network/coap.h>
+#include <lwiot/network/coapserver.h>
+#include <lwiot/network/coapclient.h>
+#include <lwiot/network/loopbacknetwork.h>
+#include <lwiot/network/loopbackudpclient.h>
+#include <lwiot/network/loopbackudpserver.h>
+
+#define LARGE_SIZE 2000
+
+static const lwiot::IPAddress localhost(127, 0, 0, 1);
+static uint8_t large[LARGE_SIZE];
+static uint8_t uploaded[LARGE_SIZE];
+static size_t uploaded_length;
+static int counter;
+
+static void test_message()
+{
+	uint8_t buffer[128];
+	const uint8_t token[] = { 1, 2, 3 };
+	lwiot::CoapBuilder builder(buffer, sizeof(buffer));
+	lwiot::CoapOptionValue option;
+	lwiot::CoapBlock block;
+	char path[32];
+
+	assert(builder.begin(lwiot::CoapType::Confirmable, lwiot::CoapCode::Put, 0x1234, token, sizeof(token)));
+	assert(builder.path("/sensors/temperature"));
+	assert(builder.option(lwiot::CoapOption::ContentFormat, 50U));
+	assert(builder.block(lwiot::CoapOption::Block1, lwiot::CoapBlock{ 3, true, 2 }));
+	assert(builder.option(lwiot::CoapOption::Size1, 1000U));
+	/* Options out of order are refused */
+	assert(!builder.option(lwiot::CoapOption::UriPath, "late"));
+	assert(builder.payload("21.5", 4));
+
+	lwiot::CoapMessage message(builder.data(), builder.length());
+	assert(message.valid());
+	assert(message.type() == lwiot::CoapType::Confirmable);
+	assert(message.code() == lwiot::CoapCode::Put);
+	assert(message.request());
+	assert(message.id() == 0x1234);
+	assert(message.tokenLength() == 3 && memcmp(message.token(), token, 3) == 0);
+	assert(message.matches("/sensors/temperature"));
+	assert(message.matches("sensors/temperature/"));
+	assert(!message.matches("/sensors"));
+	assert(!message.matches("/sensors/temperature/max"));
+	assert(message.path(path, sizeof(path)) == 20 && strcmp(path, "/sensors/temperature") == 0);
+	assert(message.option(lwiot::CoapOption::ContentFormat, 0) == 50);
+	assert(message.option(lwiot::CoapOption::Size1, 0) == 1000);
+	assert(message.block(lwiot::CoapOption::Block1, block));
+	assert(block.num == 3 && block.more && block.size() == 64 && block.offset() == 192);
+	assert(!message.find(lwiot::CoapOption::Block2, option));
+	assert(message.payloadLength() == 4 && memcmp(message.payload(), "21.5", 4) == 0);
+
+	/* Truncated options and empty payloads after the marker are malformed */
+	lwiot::CoapMessage truncated(buffer, 10);
+	assert(!truncated.valid());
+	buffer[builder.length() - 5] = 0xFF;
+	lwiot::CoapMessage marker(buffer, builder.length() - 4);
+	assert(!marker.valid());
+
+	/* Options whose extended length or value runs past the end of the message */
+	const uint8_t extended[] = { 0x40, 0x01, 0x12, 0x34, 0xB1, 0x61, 0x1D };
+	lwiot::CoapMessage length(extended, sizeof(extended));
+	assert(!length.valid());
+	const uint8_t value[] = { 0x40, 0x01, 0x12, 0x34, 0xB1, 0x61, 0x13 };
+	lwiot::CoapMessage overrun(value, sizeof(value));
+	assert(!overrun.valid());
+	lwiot::CoapMessage complete(extended, sizeof(extended) - 1);
+	assert(complete.valid() && complete.matches("/a"));
+
+	assert(lwiot::CoapBlock::exponent(512) == 5);
+	assert(lwiot::CoapBlock::exponent(100) == 2);
+	assert(lwiot::CoapBlock::exponent(4096) == 6);
+}
+
+static void setup(lwiot::CoapServer& server)
+{
+	server.on("/hello", lwiot::CoapCode::Get, [](lwiot::CoapExchange& exchange) {
+		counter++;
+		exchange.respond(lwiot::CoapCode::Content, "world", 5, lwiot::CoapExchange::TextPlain);
+	});
+
+	server.on("/large", lwiot::CoapCode::Get, [](lwiot::CoapExchange& exchange) {
+		exchange.respond(lwiot::CoapCode::Content, large, sizeof(large), lwiot::CoapExchange::OctetStream);
+	});
+
+	server.on("/upload", lwiot::CoapCode::Put, [](lwiot::CoapExchange& exchange) {
+		lwiot::CoapBlock block = { 0, false, 0 };
+		auto& request = exchange.request();
+
+		request.block(lwiot::CoapOption::Block1, block);
+		assert(block.offset() + request.payloadLength() <= sizeof(uploaded));
+		memcpy(uploaded + block.offset(), request.payload(), request.payloadLength());
+		uploaded_length = block.offset() + request.payloadLength();
+
+		exchange.respond(block.more ? lwiot::CoapCode::Continue : lwiot::CoapCode::Changed);
+	});
+
+	server.on("/counter", lwiot::CoapCode::Get, [](lwiot::CoapExchange& exchange) {
+		char value[16];
+		auto length = snprintf(value, sizeof(value), "%i", counter);
+
+		exchange.respond(lwiot::CoapCode::Content, value, length, lwiot::CoapExchange::TextPlain);
+	}, true);
+
+	server.on("/offline", lwiot::CoapCode::Get, [](lwiot::CoapExchange& exchange) {
+		exchange.respond(lwiot::CoapCode::ServiceUnavailable);
+	}, true);
+}
+
+static void test_requests(lwiot::LoopbackNetwork& network)
+{
+	lwiot::LoopbackUdpClient udp(network, localhost, COAP_PORT);
+	lwiot::CoapClient client(udp);
+	uint8_t buffer[LARGE_SIZE];
+	size_t length = sizeof(buffer);
+
+	assert(client.get("/hello", buffer, length) == lwiot::CoapCode::Content);
+	assert(length == 5 && memcmp(buffer, "world", 5) == 0);
+
+	client.setConfirmable(false);
+	length = sizeof(buffer);
+	assert(client.get("hello", buffer, length) == lwiot::CoapCode::Content);
+	assert(length == 5);
+	client.setConfirmable(true);
+
+	length = sizeof(buffer);
+	assert(client.get("/missing", buffer, length) == lwiot::CoapCode::NotFound);
+	assert(client.remove("/hello") == lwiot::CoapCode::MethodNotAllowed);
+
+	/* Block-wise download */
+	length = sizeof(buffer);
+	assert(client.get("/large", buffer, length) == lwiot::CoapCode::Content);
+	assert(length == LARGE_SIZE && memcmp(buffer, large, LARGE_SIZE) == 0);
+
+	/* A short output buffer truncates the transfer */
+	length = 100;
+	assert(client.get("/large", buffer, length) == lwiot::CoapCode::Content);
+	assert(length == 100);
+
+	/* Block-wise upload */
+	length = sizeof(buffer);
+	assert(client.put("/upload", large, 1500, buffer, length) == lwiot::CoapCode::Changed);
+	assert(uploaded_length == 1500 && memcmp(uploaded, large, 1500) == 0);
+}
+
+static void test_duplicates(lwiot::LoopbackNetwork& network)
+{
+	lwiot::LoopbackUdpClient udp(network, localhost, COAP_PORT);
+	uint8_t request[32], first[64], second[64];
+	lwiot::CoapBuilder builder(request, sizeof(request));
+
+	udp.setTimeout(1);
+	builder.begin(lwiot::CoapType::Confirmable, lwiot::CoapCode::Get, 0x4242, nullptr, 0);
+	builder.path("/hello");
+
+	auto count = counter;
+	assert(udp.write(request, builder.length()) == (ssize_t) builder.length());
+	auto num = udp.read(first, sizeof(first));
+	assert(udp.write(request, builder.length()) == (ssize_t) builder.length());
+	assert(udp.read(second, sizeof(second)) == num);
+
+	/* The retransmission is answered from the cache */
+	assert(counter == count + 1);
+	assert(memcmp(first, second, num) == 0);
+
+	lwiot::CoapMessage response(first, num);
+	assert(response.type() == lwiot::CoapType::Acknowledgement && response.id() == 0x4242);
+
+	/* An empty confirmable message is a ping, answered with a reset */
+	builder.begin(lwiot::CoapType::Confirmable, lwiot::CoapCode::Empty, 0x4343);
+	udp.write(request, builder.length());
+	num = udp.read(first, sizeof(first));
+	lwiot::CoapMessage pong(first, num);
+	assert(pong.valid() && pong.type() == lwiot::CoapType::Reset && pong.id() == 0x4343);
+}
+
+static void test_observe(lwiot::LoopbackNetwork& network, lwiot::CoapServer& server)
+{
+	lwiot::LoopbackUdpClient udp(network, localhost, COAP_PORT);
+	lwiot::CoapClient client(udp);
+	int notifications = 0;
+	char last[16];
+
+	assert(client.observe("/counter", [&](const lwiot::CoapMessage& message) {
+		notifications++;
+		memcpy(last, message.payload(), message.payloadLength());
+		last[message.payloadLength()] = '\0';
+	}));
+
+	assert(notifications == 1);
+	assert(server.observers() == 1);
+
+	counter = 41;
+	server.notify("/counter");
+	assert(client.process());
+	assert(notifications == 2 && strcmp(last, "41") == 0);
+
+	counter++;
+	server.notify("/counter");
+	assert(client.process());
+	assert(strcmp(last, "42") == 0);
+
+	assert(client.cancel("/counter"));
+	assert(server.observers() == 0);
+}
+
+static lwiot::CoapMessage exchange(lwiot::LoopbackUdpClient& udp, const char *path, uint32_t observe,
+                                   uint8_t *response, size_t length)
+{
+	static uint16_t id = 0x5000;
+	const uint8_t token[] = { 0x0B, 0x5E };
+	uint8_t request[32];
+	lwiot::CoapBuilder builder(request, sizeof(request));
+
+	builder.begin(lwiot::CoapType::Confirmable, lwiot::CoapCode::Get, id++, token, sizeof(token));
+	builder.option(lwiot::CoapOption::Observe, observe);
+	builder.path(path);
+
+	assert(udp.write(request, builder.length()) == (ssize_t) builder.length());
+	auto num = udp.read(response, length);
+	assert(num > 0);
+
+	return lwiot::CoapMessage(response, num);
+}
+
+static void test_registration(lwiot::LoopbackNetwork& network, lwiot::CoapServer& server)
+{
+	lwiot::LoopbackUdpClient udp(network, localhost, COAP_PORT);
+	lwiot::CoapOptionValue option;
+	uint8_t response[64], reset[4];
+	lwiot::CoapBuilder builder(reset, sizeof(reset));
+
+	udp.setTimeout(1);
+
+	/* An error response doesn't register an observer */
+	auto failed = exchange(udp, "/offline", 0, response, sizeof(response));
+	assert(failed.code() == lwiot::CoapCode::ServiceUnavailable);
+	assert(!failed.find(lwiot::CoapOption::Observe, option));
+	assert(server.observers() == 0);
+
+	auto registered = exchange(udp, "/counter", 0, response, sizeof(response));
+	assert(registered.code() == lwiot::CoapCode::Content);
+	assert(registered.find(lwiot::CoapOption::Observe, option));
+	assert(server.observers() == 1);
+
+	/* No notification was sent yet, so no reset can refer to one */
+	builder.begin(lwiot::CoapType::Reset, lwiot::CoapCode::Empty, 0);
+	assert(udp.write(reset, builder.length()) == (ssize_t) builder.length());
+	lwiot::Thread::sleep(20);
+	assert(server.observers() == 1);
+
+	auto deregistered = exchange(udp, "/counter", 1, response, sizeof(response));
+	assert(deregistered.code() == lwiot::CoapCode::Content);
+	assert(server.observers() == 0);
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	for(size_t idx = 0; idx < sizeof(large); idx++)
+		large[idx] = static_cast<uint8_t>(idx * 7);
+
+	test_message();
+
+	lwiot::LoopbackNetwork network;
+	lwiot::CoapServer server;
+	auto udp = new lwiot::LoopbackUdpServer(network, BIND_ADDR_ANY, COAP_PORT);
+
+	setup(server);
+	assert(udp->bind());
+	server.begin(udp);
+
+	test_requests(network);
+	test_duplicates(network);
+	test_observe(network, server);
+	test_registration(network, server);
+
+	server.end();
+	print_dbg("CoAP test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
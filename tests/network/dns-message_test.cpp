@@ -0,0 +1,143 @@
+/*
+ * DNS message parser and builder unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+
+#include <lwiot/network/dns.h>
+#include <lwiot/network/dnsmessage.h>
+
+/* Query for www.Example.com A and a compressed example.com NS */
+static const uint8_t query[] = {
+	0xBE, 0xEF, 0x01, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x03, 'w', 'w', 'w', 0x07, 'E', 'x', 'a', 'm', 'p', 'l', 'e', 0x03, 'c', 'o', 'm', 0x00,
+	0x00, 0x01, 0x00, 0x01,
+	0xC0, 0x10,
+	0x00, 0x02, 0x00, 0x01
+};
+
+static void test_parse()
+{
+	lwiot::DnsMessage message(query, sizeof(query));
+	lwiot::DnsQuestion question;
+	lwiot::DnsResource resource;
+	char name[64];
+
+	assert(message.valid());
+	assert(message.id() == 0xBEEF);
+	assert(!message.response());
+	assert(message.questions() == 2);
+
+	assert(message.next(question));
+	assert(question.type == QTYPE_A && question.qclass == QCLASS_IN);
+	assert(question.name.equals("www.example.com"));
+	assert(question.name.equals("WWW.EXAMPLE.COM."));
+	assert(!question.name.equals("www.example.co"));
+	assert(!question.name.equals("www.example.com.au"));
+	assert(question.name.hash() == lwiot::DnsName::hash("www.example.com"));
+	assert(question.name.toString(name, sizeof(name)) == 15);
+	assert(strcmp(name, "www.Example.com") == 0);
+
+	assert(message.next(question));
+	assert(question.type == QTYPE_NS);
+	assert(question.name.equals("example.com"));
+	assert(question.name.hash() == lwiot::DnsName::hash("Example.Com."));
+
+	assert(!message.next(question));
+	assert(!message.next(resource));
+	assert(!message.malformed());
+}
+
+static void test_malformed()
+{
+	uint8_t packet[sizeof(query)];
+	lwiot::DnsQuestion question;
+
+	/* Truncated in the middle of a label */
+	lwiot::DnsMessage truncated(query, 20);
+	assert(!truncated.next(question));
+	assert(truncated.malformed());
+
+	/* A pointer to itself must not loop */
+	memcpy(packet, query, sizeof(query));
+	packet[33] = 0xC0;
+	packet[34] = 33;
+	lwiot::DnsMessage loop(packet, sizeof(packet));
+	assert(loop.next(question));
+	assert(loop.next(question));
+	assert(!question.name.equals("example.com"));
+	assert(question.name.toString().length() == 0);
+
+	/* Header only */
+	lwiot::DnsMessage empty(query, 4);
+	assert(!empty.valid());
+	assert(!empty.next(question));
+}
+
+static void test_build()
+{
+	uint8_t buffer[DNS_LEN];
+	lwiot::DnsMessage message(query, sizeof(query));
+	lwiot::DnsBuilder builder(buffer, sizeof(buffer));
+	lwiot::DnsQuestion question;
+	lwiot::DnsResource resource;
+	const uint8_t addr[] = { 10, 0, 0, 1 };
+
+	assert(builder.reply(message));
+	assert(message.next(question));
+	assert(builder.answer(question, 60, addr, sizeof(addr)));
+	assert(builder.length() == sizeof(query) + 2 + 10 + 4);
+
+	lwiot::DnsMessage reply(builder.data(), builder.length());
+	assert(reply.response());
+	assert(reply.id() == 0xBEEF);
+	assert(reply.answers() == 1);
+	assert(reply.next(resource));
+	assert(resource.name.equals("www.example.com"));
+	assert(resource.type == QTYPE_A && resource.ttl == 60);
+	assert(resource.length == 4 && memcmp(resource.data, addr, 4) == 0);
+	assert(!reply.next(resource));
+
+	/* Names from another packet are written out in full */
+	lwiot::DnsBuilder copy(buffer, sizeof(buffer));
+	assert(copy.reply(message));
+	assert(copy.answer(resource.name, QTYPE_A, QCLASS_IN, 0, addr, sizeof(addr)));
+	assert(copy.length() == sizeof(query) + 17 + 10 + 4);
+
+	/* Answers that do not fit leave the message as it was */
+	lwiot::DnsBuilder small(buffer, sizeof(query) + 4);
+	assert(small.reply(message));
+	assert(!small.answer(question, 0, addr, sizeof(addr)));
+	assert(small.length() == sizeof(query));
+
+	lwiot::DnsBuilder error(buffer, sizeof(buffer));
+	assert(error.error(message, lwiot::DnsReplyCode::NonExistentDomain));
+	lwiot::DnsMessage nx(error.data(), error.length());
+	assert(nx.rcode() == lwiot::DnsReplyCode::NonExistentDomain);
+	assert(nx.questions() == 0);
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	test_parse();
+	test_malformed();
+	test_build();
+
+	print_dbg("DNS message test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -6,6 +6,8 @@
  */
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
 #include <lwiot.h>
 #include <assert.h>
 
@@ -17,9 +19,96 @@
 #include <lwiot/network/udpserver.h>
 #include <lwiot/network/socketudpserver.h>
 #include <lwiot/network/dnsserver.h>
+#include <lwiot/network/dnsmessage.h>
+#include <lwiot/network/loopbacknetwork.h>
+#include <lwiot/network/loopbackudpclient.h>
+#include <lwiot/network/loopbackudpserver.h>
 
 #include <lwiot/stl/move.h>
 
+static size_t build_query(uint8_t *buffer, const char *host)
+{
+	static const uint8_t header[] = { 0xAB, 0xCD, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	size_t length = sizeof(header);
+	size_t label = length++;
+
+	memcpy(buffer, header, sizeof(header));
+
+	for(; *host != '\0'; host++) {
+		if(*host == '.') {
+			buffer[label] = length - label - 1;
+			label = length++;
+		} else {
+			buffer[length++] = *host;
+		}
+	}
+
+	buffer[label] = length - label - 1;
+	buffer[length++] = 0;
+
+	const uint8_t footer[] = { 0x00, QTYPE_A, 0x00, QCLASS_IN };
+	memcpy(buffer + length, footer, sizeof(footer));
+
+	return length + sizeof(footer);
+}
+
+static lwiot::DnsReplyCode lookup(lwiot::UdpClient& client, const char *host, uint8_t *addr)
+{
+	uint8_t request[DNS_LEN];
+	uint8_t response[DNS_LEN];
+	lwiot::DnsResource resource;
+
+	client.write(request, build_query(request, host));
+	auto num = client.read(response, sizeof(response));
+	assert(num > 0);
+
+	lwiot::DnsMessage reply(response, num);
+	assert(reply.response() && reply.id() == 0xABCD);
+
+	if(reply.next(resource)) {
+		assert(resource.type == QTYPE_A && resource.length == 4);
+		assert(resource.name.equals(host));
+		memcpy(addr, resource.data, 4);
+	}
+
+	return reply.rcode();
+}
+
+static void test_table()
+{
+	lwiot::LoopbackNetwork network;
+	lwiot::DnsServer srv(4);
+	auto udp = new lwiot::LoopbackUdpServer(network, BIND_ADDR_ANY, DNS_SERVER_PORT);
+	uint8_t addr[4];
+	char host[32];
+
+	/* Enough hosts to grow the table a couple of times */
+	for(int idx = 0; idx < 100; idx++) {
+		snprintf(host, sizeof(host), "node-%i.lwiot.local", idx);
+		srv.map(host, lwiot::IPAddress(10, 0, 0, idx));
+	}
+
+	srv.map("Node-7.LWIOT.local", lwiot::IPAddress(10, 0, 1, 7));
+	assert(srv.size() == 100);
+
+	assert(udp->bind());
+	srv.begin(udp);
+
+	lwiot::LoopbackUdpClient client(network, lwiot::IPAddress(127, 0, 0, 1), DNS_SERVER_PORT);
+	client.setTimeout(2);
+
+	assert(lookup(client, "node-42.lwiot.local", addr) == lwiot::DnsReplyCode::NoError);
+	assert(memcmp(addr, "\x0A\x00\x00\x2A", 4) == 0);
+	assert(lookup(client, "NODE-99.Lwiot.Local", addr) == lwiot::DnsReplyCode::NoError);
+	assert(addr[3] == 99);
+	assert(lookup(client, "node-7.lwiot.local", addr) == lwiot::DnsReplyCode::NoError);
+	assert(memcmp(addr, "\x0A\x00\x01\x07", 4) == 0);
+	assert(lookup(client, "node-100.lwiot.local", addr) == lwiot::DnsReplyCode::NonExistentDomain);
+
+	srv.end();
+	print_dbg("DNS host table test completed!\n");
+}
+
 static void start_and_run_server()
 {
 	auto udp = new lwiot::SocketUdpServer(BIND_ADDR_LB, 5000);
@@ -42,6 +131,7 @@ int main(int argc, char **argv)
 	lwiot_init();
 
 	print_dbg("Testing UdpServer implementation!\n");
+	test_table();
 	start_and_run_server();
 	lwiot_destroy();
 	wait_close();
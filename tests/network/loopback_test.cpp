@@ -0,0 +1,401 @@
+/*
+ * Loopback network unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/kernel/thread.h>
+
+#include <lwiot/util/json.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/httpserver.h>
+#include <lwiot/network/dnsserver.h>
+#include <lwiot/network/mqttclient.h>
+#include <lwiot/network/asyncmqttclient.h>
+#include <lwiot/network/mqttbroker.h>
+#include <lwiot/network/loopbacknetwork.h>
+#include <lwiot/network/loopbacktcpclient.h>
+#include <lwiot/network/loopbacktcpserver.h>
+#include <lwiot/network/loopbackudpclient.h>
+#include <lwiot/network/loopbackudpserver.h>
+
+#include <lwiot/stl/move.h>
+
+static const lwiot::IPAddress localhost(127, 0, 0, 1);
+
+static void test_tcp_echo()
+{
+	lwiot::LoopbackNetwork network;
+	lwiot::LoopbackTcpServer server(network);
+	char buffer[16];
+
+	assert(server.bind(BIND_ADDR_ANY, 8000));
+	server.setTimeout(1);
+
+	lwiot::LoopbackTcpClient client(network, localhost, 8000);
+	assert(client.connected());
+	assert(client.write("hello", 5) == 5);
+
+	auto peer = lwiot::stl::move(server.accept());
+	assert(peer && peer->connected());
+	assert(peer->read(buffer, sizeof(buffer)) == 5);
+	assert(memcmp(buffer, "hello", 5) == 0);
+	assert(peer->write(buffer, 5) == 5);
+
+	assert(client.wait(100));
+	assert(client.available() == 5);
+	assert(client.read(buffer, sizeof(buffer)) == 5);
+
+	/* The peer sees the end of the stream once the client hangs up */
+	client.close();
+	assert(peer->read(buffer, sizeof(buffer)) == 0);
+	assert(!peer->connected());
+
+	/* Nothing listens on this port */
+	lwiot::LoopbackTcpClient refused(network, localhost, 8001);
+	assert(!refused.connected());
+
+	server.close();
+	assert(!server.accept());
+}
+
+static void test_link()
+{
+	lwiot::LoopbackNetwork network;
+	lwiot::LoopbackTcpServer server(network);
+	uint8_t buffer[1000];
+
+	network.setLink(lwiot::LoopbackLink{ 20000, 10000, 0.0, lwiot::LoopbackNetwork::DefaultRetransmit });
+	assert(server.bind(BIND_ADDR_LB, 8000));
+
+	lwiot::LoopbackTcpClient client(network, localhost, 8000);
+	auto peer = lwiot::stl::move(server.accept());
+	assert(peer);
+
+	/* 20 ms of latency and 100 ms to clock a kilobyte through 10 kB/s */
+	auto start = lwiot_tick_ms();
+	memset(buffer, 0xAA, sizeof(buffer));
+	assert(client.write(buffer, sizeof(buffer)) == sizeof(buffer));
+	assert(peer->available() == 0);
+
+	size_t total = 0;
+	while(total < sizeof(buffer)) {
+		auto num = peer->read(buffer + total, sizeof(buffer) - total);
+		assert(num > 0);
+		total += num;
+	}
+
+	assert(lwiot_tick_ms() - start >= 120);
+}
+
+static int lossy_transfer(uint32_t seed)
+{
+	lwiot::LoopbackNetwork network(lwiot::LoopbackNetwork::DefaultPipeSize, seed);
+	lwiot::LoopbackUdpServer server(network);
+	char buffer[16];
+	size_t length = sizeof(buffer);
+	int received = 0;
+
+	network.setLink(lwiot::LoopbackLink{ 0, 0, 0.5, lwiot::LoopbackNetwork::DefaultRetransmit });
+	assert(server.bind(BIND_ADDR_LB, 5353));
+
+	lwiot::LoopbackUdpClient client(network, localhost, 5353);
+	server.setTimeout(1);
+
+	for(int idx = 0; idx < 100; idx++)
+		assert(client.write("ping", 4) == 4);
+
+	while(server.recv(buffer, length)) {
+		length = sizeof(buffer);
+		received++;
+	}
+
+	return received;
+}
+
+static void test_udp()
+{
+	lwiot::LoopbackNetwork network;
+	lwiot::LoopbackUdpServer server(network);
+	char buffer[16];
+	size_t length = sizeof(buffer);
+
+	assert(server.bind(BIND_ADDR_LB, 5353));
+	server.setTimeout(1);
+
+	lwiot::LoopbackUdpClient client(network, localhost, 5353);
+	client.setTimeout(1);
+	assert(client.write("ping", 4) == 4);
+
+	auto reply = lwiot::stl::move(server.recv(buffer, length));
+	assert(reply && length == 4);
+	assert(reply->write("pong", 4) == 4);
+	assert(client.read(buffer, sizeof(buffer)) == 4);
+	assert(memcmp(buffer, "pong", 4) == 0);
+
+	/* Replies straight from the server socket, without a client object */
+	remote_addr_t remote;
+
+	assert(client.write("ping", 4) == 4);
+	assert(server.recvFrom(buffer, sizeof(buffer), remote) == 4);
+	assert((uint32_t) lwiot::IPAddress(remote) == (uint32_t) localhost);
+	assert(server.sendTo("pong", 4, remote) == 4);
+	assert(client.read(buffer, sizeof(buffer)) == 4);
+	assert(memcmp(buffer, "pong", 4) == 0);
+
+	/* The loss pattern only depends on the seed */
+	auto lost = lossy_transfer(42);
+	assert(lost > 0 && lost < 100);
+	assert(lossy_transfer(42) == lost);
+}
+
+static void test_dns()
+{
+	lwiot::LoopbackNetwork network;
+	lwiot::DnsServer dns;
+	auto udp = new lwiot::LoopbackUdpServer(network, BIND_ADDR_ANY, 53);
+	static const uint8_t query[] = {
+		0x12, 0x34, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+		0x04, 't', 'e', 's', 't', 0x03, 'c', 'o', 'm', 0x00,
+		0x00, 0x01, 0x00, 0x01
+	};
+	uint8_t buffer[128];
+
+	dns.map("test.com", lwiot::IPAddress(10, 0, 0, 1));
+	assert(udp->bind());
+	dns.begin(udp);
+
+	lwiot::LoopbackUdpClient client(network, localhost, 53);
+	client.setTimeout(2);
+	assert(client.write(query, sizeof(query)) == sizeof(query));
+
+	auto num = client.read(buffer, sizeof(buffer));
+	assert(num > 4);
+	assert(buffer[0] == 0x12 && buffer[1] == 0x34);
+	assert(memcmp(buffer + num - 4, "\x0A\x00\x00\x01", 4) == 0);
+
+	dns.end();
+}
+
+static void test_http()
+{
+	lwiot::LoopbackNetwork network;
+	lwiot::HttpServer server(new lwiot::LoopbackTcpServer(network, BIND_ADDR_ANY, 80));
+	char buffer[256];
+
+	server.on("/", lwiot::HTTP_GET, [](lwiot::HttpServer& srv) {
+		srv.send(200, "text/plain", "loopback");
+	});
+
+	assert(server.begin());
+
+	lwiot::LoopbackTcpClient client(network, localhost, 80);
+	client.write(lwiot::String("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+
+	for(int tries = 0; client.available() == 0 && tries < 100; tries++)
+		server.handleClient();
+
+	auto num = client.read(buffer, sizeof(buffer) - 1);
+	assert(num > 0);
+	buffer[num] = '\0';
+
+	assert(strstr(buffer, "200 OK") != nullptr);
+}
+
+static void readings(lwiot::JsonObject& root, int count)
+{
+	root["device"] = "node-12";
+	root["seq"] = 4711;
+	root["ok"] = true;
+
+	auto& values = root.createNestedArray("readings");
+
+	for(int idx = 0; idx < count; idx++)
+		values.add(idx * 3);
+}
+
+static bool verify(const char *json, int count)
+{
+	lwiot::DynamicJsonBuffer buffer;
+	auto& root = buffer.parseObject(json);
+
+	if(!root.success() || strcmp(root["device"].as<const char *>(), "node-12") != 0)
+		return false;
+
+	if(root["seq"].as<int>() != 4711 || !root["ok"].as<bool>())
+		return false;
+
+	auto& values = root["readings"].as<lwiot::JsonArray&>();
+
+	if(values.size() != static_cast<size_t>(count))
+		return false;
+
+	for(int idx = 0; idx < count; idx++) {
+		if(values[idx].as<int>() != idx * 3)
+			return false;
+	}
+
+	return true;
+}
+
+static void test_http_json()
+{
+	lwiot::LoopbackNetwork network;
+	lwiot::HttpServer server(new lwiot::LoopbackTcpServer(network, BIND_ADDR_ANY, 80));
+	static char response[8192];
+	static char body[8192];
+	size_t length = 0, used = 0;
+
+	server.on("/readings", lwiot::HTTP_GET, [](lwiot::HttpServer& srv) {
+		lwiot::DynamicJsonBuffer buffer;
+		auto& root = buffer.createObject();
+
+		readings(root, 256);
+		srv.sendJson(200, root);
+	});
+
+	assert(server.begin());
+
+	lwiot::LoopbackTcpClient client(network, localhost, 80);
+	client.write(lwiot::String("GET /readings HTTP/1.1\r\nHost: localhost\r\n\r\n"));
+
+	/* The response ends with an empty chunk */
+	for(int tries = 0; tries < 200; tries++) {
+		server.handleClient();
+
+		if(client.available() > 0) {
+			auto num = client.read(response + length, sizeof(response) - length - 1);
+			assert(num > 0);
+			length += num;
+		}
+
+		if(length >= 5 && memcmp(response + length - 5, "0\r\n\r\n", 5) == 0)
+			break;
+	}
+
+	response[length] = '\0';
+	assert(strstr(response, "200 OK") != nullptr);
+	assert(strstr(response, "Transfer-Encoding: chunked") != nullptr);
+
+	auto chunk = strstr(response, "\r\n\r\n");
+	assert(chunk != nullptr);
+	chunk += 4;
+
+	/* Reassembles the chunks, the document takes more than one */
+	int chunks = 0;
+
+	while(true) {
+		char *data;
+		auto size = strtoul(chunk, &data, 16);
+
+		assert(data[0] == '\r' && data[1] == '\n');
+		data += 2;
+
+		if(size == 0)
+			break;
+
+		assert(used + size < sizeof(body));
+		memcpy(body + used, data, size);
+		used += size;
+		chunks++;
+
+		assert(data[size] == '\r' && data[size + 1] == '\n');
+		chunk = data + size + 2;
+	}
+
+	body[used] = '\0';
+	assert(chunks > 1);
+	assert(verify(body, 256));
+}
+
+static void test_mqtt()
+{
+	lwiot::LoopbackNetwork network;
+	lwiot::LoopbackTcpServer server(network, BIND_ADDR_ANY, 1883);
+	lwiot::MqttBroker broker(server);
+	volatile int received = 0;
+
+	network.setLink(lwiot::LoopbackLink{ 1000, 0, 0.0, lwiot::LoopbackNetwork::DefaultRetransmit });
+	assert(server.bind());
+	assert(broker.start());
+
+	lwiot::LoopbackTcpClient subclient(network, localhost, 1883);
+	lwiot::LoopbackTcpClient pubclient(network, localhost, 1883);
+	lwiot::AsyncMqttClient subscriber;
+	lwiot::MqttClient publisher;
+
+	subscriber.start(subclient);
+	assert(subscriber.connect("loopback-subscriber", "", ""));
+	assert(subscriber.subscribe("loopback/#", [&](const lwiot::ByteBuffer& payload) {
+		received = received + 1;
+	}));
+
+	publisher.begin(pubclient);
+	assert(publisher.connect("loopback-publisher", "", ""));
+	assert(publisher.publish("loopback/a", "1"));
+	assert(publisher.publish("loopback/b", "2"));
+
+	for(int tries = 0; received != 2 && tries < 200; tries++)
+		lwiot::Thread::sleep(10);
+
+	assert(received == 2);
+
+	/* A serialized document arrives intact */
+	lwiot::DynamicJsonBuffer buffer;
+	auto& root = buffer.createObject();
+	volatile int parsed = 0;
+
+	readings(root, 32);
+	assert(root.measureLength() < lwiot::MqttClient::MQTT_MAX_PACKET_SIZE - 32);
+	assert(subscriber.subscribe("loopback/json", [&](const lwiot::ByteBuffer& payload) {
+		lwiot::String text(payload);
+
+		if(verify(text.c_str(), 32))
+			parsed = parsed + 1;
+	}));
+
+	lwiot::Thread::sleep(100);
+	assert(publisher.publishJson("loopback/json", root));
+
+	for(int tries = 0; parsed != 1 && tries < 200; tries++)
+		lwiot::Thread::sleep(10);
+
+	assert(parsed == 1);
+
+	publisher.disconnect();
+	subscriber.stop();
+	broker.stop();
+	server.close();
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	test_tcp_echo();
+	test_link();
+	test_udp();
+	test_dns();
+	test_http();
+	test_http_json();
+	test_mqtt();
+
+	print_dbg("Loopback network test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
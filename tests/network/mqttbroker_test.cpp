@@ -0,0 +1,424 @@
+/*
+ * Embedded MQTT broker unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/kernel/thread.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/mqttclient.h>
+#include <lwiot/network/asyncmqttclient.h>
+#include <lwiot/network/mqttbroker.h>
+#include <lwiot/network/sockettcpserver.h>
+#include <lwiot/network/sockettcpclient.h>
+#include <lwiot/network/loopbacknetwork.h>
+#include <lwiot/network/loopbacktcpserver.h>
+#include <lwiot/network/loopbacktcpclient.h>
+
+static uint16_t bind(lwiot::SocketTcpServer& server)
+{
+	uint16_t port = 18890;
+
+	while(!server.bind(BIND_ADDR_LB, port))
+		port++;
+
+	return port;
+}
+
+static bool await(volatile int& value, int expected)
+{
+	for(int tries = 0; value != expected && tries < 200; tries++)
+		lwiot::Thread::sleep(10);
+
+	return value == expected;
+}
+
+static void test_routing(uint16_t port)
+{
+	lwiot::SocketTcpClient subclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::SocketTcpClient pubclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::AsyncMqttClient subscriber;
+	lwiot::MqttClient publisher;
+	volatile int single = 0, multi = 0, acked = 0;
+
+	subscriber.start(subclient);
+	assert(subscriber.connect("test-subscriber", "", ""));
+
+	assert(subscriber.subscribe("test/+/temp", [&](const lwiot::ByteBuffer& payload) {
+		single = single + 1;
+	}));
+
+	assert(subscriber.subscribe("test/#", [&](const lwiot::ByteBuffer& payload) {
+		multi = multi + 1;
+	}));
+
+	publisher.begin(pubclient);
+	publisher.setAckCallback([&](uint16_t id) {
+		acked = acked + 1;
+	});
+
+	assert(publisher.connect("test-publisher", "", ""));
+	assert(publisher.publish("test/kitchen/temp", "21.5"));
+	assert(publisher.publish("test/kitchen/humidity", "40"));
+	assert(publisher.publish("other/kitchen/temp", "19.0"));
+
+	lwiot::ByteBuffer payload(4, true);
+	payload.write("22.0", 4);
+	assert(publisher.publish("test/hall/temp", payload, false, lwiot::MqttClient::QOS1));
+
+	for(int tries = 0; acked == 0 && tries < 200; tries++) {
+		publisher.loop();
+		lwiot::Thread::sleep(10);
+	}
+
+	assert(acked == 1);
+	assert(await(single, 2));
+	assert(await(multi, 3));
+
+	publisher.disconnect();
+	subscriber.stop();
+}
+
+static void test_retained(lwiot::MqttBroker& broker, uint16_t port)
+{
+	lwiot::SocketTcpClient pubclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::MqttClient publisher;
+	volatile int received = 0;
+
+	publisher.begin(pubclient);
+	assert(publisher.connect("test-publisher", "", ""));
+	assert(publisher.publish("test/retained", "value", true));
+
+	for(int tries = 0; broker.retained() != 1 && tries < 200; tries++)
+		lwiot::Thread::sleep(10);
+
+	assert(broker.retained() == 1);
+
+	lwiot::SocketTcpClient subclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::AsyncMqttClient subscriber;
+
+	subscriber.start(subclient);
+	assert(subscriber.connect("test-subscriber", "", ""));
+	assert(subscriber.subscribe("test/+", [&](const lwiot::ByteBuffer& payload) {
+		if(payload.count() == 5 && memcmp(payload.data(), "value", 5) == 0)
+			received = received + 1;
+	}));
+
+	assert(await(received, 1));
+
+	/* An empty retained message clears the topic */
+	assert(publisher.publish("test/retained", "", true));
+
+	for(int tries = 0; broker.retained() != 0 && tries < 200; tries++)
+		lwiot::Thread::sleep(10);
+
+	assert(broker.retained() == 0);
+
+	publisher.disconnect();
+	subscriber.stop();
+}
+
+static void test_will(uint16_t port)
+{
+	lwiot::SocketTcpClient subclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::SocketTcpClient willclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::AsyncMqttClient subscriber;
+	lwiot::MqttClient client;
+	volatile int received = 0;
+
+	subscriber.start(subclient);
+	assert(subscriber.connect("test-subscriber", "", ""));
+	assert(subscriber.subscribe("test/status", [&](const lwiot::ByteBuffer& payload) {
+		received = received + 1;
+	}));
+
+	client.begin(willclient);
+	assert(client.connect("test-will", "", "", "test/status", 0, false, "offline", true));
+
+	/* Drop the connection without a DISCONNECT */
+	willclient.close();
+
+	assert(await(received, 1));
+	subscriber.stop();
+}
+
+static void test_v5(uint16_t port)
+{
+	lwiot::SocketTcpClient firstclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::SocketTcpClient secondclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::SocketTcpClient pubclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::AsyncMqttClient first, second;
+	lwiot::MqttClient publisher;
+	volatile int shared = 0, aliased = 0, acked = 0;
+	int messages = 0;
+
+	first.setProtocolVersion(lwiot::MqttClient::MQTT_V5);
+	first.start(firstclient);
+	assert(first.connect("test-first", "", ""));
+
+	second.start(secondclient);
+	assert(second.connect("test-second", "", ""));
+
+	/* Both subscribers are in the same group, each message goes to one of them */
+	assert(first.subscribe("$share/workers/test/jobs", [&](const lwiot::ByteBuffer& payload) {
+		shared = shared + 1;
+	}));
+
+	assert(second.subscribe("$share/workers/test/jobs", [&](const lwiot::ByteBuffer& payload) {
+		shared = shared + 1;
+	}));
+
+	assert(first.subscribe("test/site/+/temperature", [&](const lwiot::ByteBuffer& payload) {
+		if(payload.count() == 4 && memcmp(payload.data(), "21.5", 4) == 0)
+			aliased = aliased + 1;
+	}));
+
+	publisher.setProtocolVersion(lwiot::MqttClient::MQTT_V5);
+	publisher.begin(pubclient);
+	publisher.setAckCallback([&](uint16_t id) {
+		acked = acked + 1;
+	});
+
+	assert(publisher.connect("test-publisher", "", ""));
+	assert(publisher.reasonCode() == 0);
+	assert(publisher.receiveMaximum() == lwiot::MqttBroker::ReceiveMaximum);
+
+	for(int idx = 0; idx < 10; idx++)
+		assert(publisher.publish("test/jobs", "job"));
+
+	/* Repeated topics are sent as topic aliases after the first publish */
+	for(int idx = 0; idx < 10; idx++)
+		assert(publisher.publish("test/site/0123456789abcdef/temperature", "21.5"));
+
+	assert(await(shared, 10));
+	assert(await(aliased, 10));
+
+	/* QoS 1 publishes are refused while the broker's receive maximum is in flight */
+	lwiot::ByteBuffer payload(4, true);
+	payload.write("21.5", 4);
+
+	while(publisher.publish("test/site/0123456789abcdef/temperature", payload, false, lwiot::MqttClient::QOS1))
+		messages++;
+
+	assert(messages == lwiot::MqttBroker::ReceiveMaximum);
+	assert(publisher.inflight() == lwiot::MqttBroker::ReceiveMaximum);
+
+	for(int tries = 0; acked < messages && tries < 200; tries++) {
+		publisher.loop();
+		lwiot::Thread::sleep(10);
+	}
+
+	assert(acked == messages);
+	assert(publisher.inflight() == 0);
+	assert(await(aliased, 10 + messages));
+
+	/* Invalid filters are refused with a reason code */
+	assert(publisher.subscribe("test/#/invalid", lwiot::MqttClient::QOS0));
+
+	for(int tries = 0; publisher.reasonCode() == 0 && tries < 200; tries++) {
+		publisher.loop();
+		lwiot::Thread::sleep(10);
+	}
+
+	assert(publisher.reasonCode() == 0x8F);
+
+	publisher.disconnect();
+	first.stop();
+	second.stop();
+}
+
+static void test_shared_handlers(uint16_t port)
+{
+	lwiot::SocketTcpClient subclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::SocketTcpClient pubclient(lwiot::IPAddress(127, 0, 0, 1), port);
+	lwiot::AsyncMqttClient subscriber;
+	lwiot::MqttClient publisher;
+	volatile int shared = 0, templated = 0, plain = 0;
+
+	lwiot::AsyncMqttClient::AsyncHandler handler([&](const lwiot::ByteBuffer& payload) {
+		shared = shared + 1;
+	});
+
+	subscriber.start(subclient);
+	assert(subscriber.connect("test-handlers", "", ""));
+
+	/* Both overloads key the handler by the filter the messages match */
+	assert(subscriber.subscribe("$share/workers/test/overlap", handler));
+	assert(subscriber.subscribe("$share/workers/test/other", [&](const lwiot::ByteBuffer& payload) {
+		templated = templated + 1;
+	}));
+
+	publisher.begin(pubclient);
+	assert(publisher.connect("test-handlers-publisher", "", ""));
+	lwiot::Thread::sleep(100);
+
+	assert(publisher.publish("test/overlap", "1"));
+	assert(publisher.publish("test/other", "1"));
+	assert(await(shared, 1));
+	assert(await(templated, 1));
+
+	/* Dropping the shared subscription leaves the plain one on the same filter alone */
+	assert(subscriber.subscribe("test/overlap", [&](const lwiot::ByteBuffer& payload) {
+		plain = plain + 1;
+	}));
+
+	assert(subscriber.unsubscribe("$share/workers/test/overlap"));
+	lwiot::Thread::sleep(100);
+	shared = 0;
+
+	assert(publisher.publish("test/overlap", "2"));
+	assert(await(plain, 1));
+	lwiot::Thread::sleep(50);
+	assert(shared == 0 && plain == 1);
+
+	publisher.disconnect();
+	subscriber.stop();
+}
+
+static void test_reap()
+{
+	lwiot::LoopbackNetwork network;
+	lwiot::LoopbackTcpServer server(network, BIND_ADDR_ANY, 1883);
+	lwiot::MqttBroker broker(server);
+	lwiot::IPAddress localhost(127, 0, 0, 1);
+
+	assert(server.bind());
+	assert(broker.start());
+
+	lwiot::LoopbackTcpClient io1(network, localhost, 1883);
+	lwiot::LoopbackTcpClient io2(network, localhost, 1883);
+	lwiot::LoopbackTcpClient io3(network, localhost, 1883);
+	lwiot::MqttClient first, second, third;
+
+	first.begin(io1);
+	second.begin(io2);
+	third.begin(io3);
+	assert(first.connect("test-first", "", ""));
+	assert(second.connect("test-second", "", ""));
+	assert(third.connect("test-third", "", ""));
+
+	/* Reaping the oldest session used to leave the broker spinning on its session list */
+	first.disconnect();
+
+	for(int tries = 0; broker.sessions() != 2 && tries < 200; tries++)
+		lwiot::Thread::sleep(10);
+
+	assert(broker.sessions() == 2);
+	lwiot::Thread::sleep(1100);
+
+	lwiot::LoopbackTcpClient io4(network, localhost, 1883);
+	lwiot::MqttClient fourth;
+
+	fourth.begin(io4);
+	assert(fourth.connect("test-fourth", "", ""));
+	assert(broker.sessions() == 3);
+
+	fourth.disconnect();
+	broker.stop();
+	assert(broker.sessions() == 0);
+	server.close();
+}
+
+static void test_slow_subscriber()
+{
+	lwiot::LoopbackNetwork network(2048);
+	lwiot::LoopbackTcpServer server(network, BIND_ADDR_ANY, 1883);
+	lwiot::MqttBroker broker(server);
+	lwiot::IPAddress localhost(127, 0, 0, 1);
+	volatile int received = 0;
+	char payload[400];
+
+	assert(server.bind());
+	assert(broker.start());
+
+	/* Subscribes and never reads, its pipe fills up after a few messages */
+	lwiot::LoopbackTcpClient slowclient(network, localhost, 1883);
+	lwiot::MqttClient slow;
+
+	slow.begin(slowclient);
+	assert(slow.connect("test-slow", "", ""));
+	assert(slow.subscribe("slow/#", lwiot::MqttClient::QOS0));
+
+	lwiot::LoopbackTcpClient subclient(network, localhost, 1883);
+	lwiot::LoopbackTcpClient pubclient(network, localhost, 1883);
+	lwiot::LoopbackTcpClient fastclient(network, localhost, 1883);
+	lwiot::AsyncMqttClient subscriber;
+	lwiot::MqttClient publisher, fast;
+
+	subscriber.start(subclient);
+	assert(subscriber.connect("test-fast-subscriber", "", ""));
+	assert(subscriber.subscribe("fast/#", [&](const lwiot::ByteBuffer& payload) {
+		received = received + 1;
+	}));
+
+	publisher.begin(pubclient);
+	assert(publisher.connect("test-slow-publisher", "", ""));
+	fast.begin(fastclient);
+	assert(fast.connect("test-fast-publisher", "", ""));
+	lwiot::Thread::sleep(100);
+
+	/* The session of this publisher blocks while writing to the slow subscriber */
+	memset(payload, 'x', sizeof(payload) - 1);
+	payload[sizeof(payload) - 1] = '\0';
+
+	for(int idx = 0; idx < 8; idx++)
+		assert(publisher.publish("slow/data", payload));
+
+	lwiot::Thread::sleep(100);
+
+	/* Other sessions keep routing in the meantime */
+	auto start = lwiot_tick_ms();
+	assert(fast.publish("fast/data", "1"));
+	assert(await(received, 1));
+	assert(lwiot_tick_ms() - start < 1000);
+
+	slowclient.close();
+	publisher.disconnect();
+	fast.disconnect();
+	subscriber.stop();
+	broker.stop();
+	assert(broker.sessions() == 0);
+	server.close();
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	lwiot::SocketTcpServer server;
+	auto port = bind(server);
+	lwiot::MqttBroker broker(server);
+
+	assert(broker.start());
+
+	test_routing(port);
+	test_retained(broker, port);
+	test_will(port);
+	test_v5(port);
+	test_shared_handlers(port);
+
+	broker.stop();
+	assert(broker.sessions() == 0);
+	server.close();
+
+	test_reap();
+	test_slow_subscriber();
+
+	print_dbg("MQTT broker test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -0,0 +1,267 @@
+/*
+ * NTP client unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+
+#include <lwiot/kernel/thread.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/ntpclient.h>
+#include <lwiot/network/loopbacknetwork.h>
+#include <lwiot/network/loopbackudpclient.h>
+#include <lwiot/network/loopbackudpserver.h>
+
+static const lwiot::IPAddress localhost(127, 0, 0, 1);
+
+/* An hour and a bit ahead of the local clock */
+static constexpr int64_t SHIFT = 3600123456LL;
+
+/* Server clock in microseconds since the UNIX epoch */
+static int64_t reference(int64_t shift)
+{
+	return static_cast<int64_t>(lwiot_tick()) + shift;
+}
+
+static void encode(int64_t time, uint8_t *output)
+{
+	auto seconds = static_cast<uint32_t>(time / 1000000 + 2208988800LL);
+	auto fraction = static_cast<uint32_t>((static_cast<uint64_t>(time % 1000000) << 32) / 1000000);
+
+	for(int idx = 0; idx < 4; idx++) {
+		output[idx] = static_cast<uint8_t>(seconds >> (24 - idx * 8));
+		output[idx + 4] = static_cast<uint8_t>(fraction >> (24 - idx * 8));
+	}
+}
+
+class NtpServer : public lwiot::Thread {
+public:
+	explicit NtpServer(lwiot::LoopbackNetwork& network, uint16_t port, int64_t shift) :
+		Thread("NTP server"), shift(shift), hold(5), stratum(2), kiss(nullptr), requests(0), _running(true), _server(network)
+	{
+		assert(this->_server.bind(BIND_ADDR_LB, port));
+		this->_server.setTimeout(1);
+		this->start();
+	}
+
+	~NtpServer() override
+	{
+		this->_running = false;
+		this->_server.close();
+		this->join();
+	}
+
+	volatile int64_t shift;
+	volatile int hold;
+	volatile uint8_t stratum;
+	const char * volatile kiss;
+	volatile int requests;
+
+protected:
+	void run() override
+	{
+		uint8_t packet[48];
+		remote_addr_t remote;
+
+		/* Spaced requests leave the server idle for longer than its timeout */
+		while(this->_running) {
+			if(this->_server.recvFrom(packet, sizeof(packet), remote) != sizeof(packet))
+				continue;
+
+			auto received = reference(this->shift);
+			this->requests = this->requests + 1;
+
+			/* Processing time on the server doesn't count towards the delay */
+			lwiot::Thread::sleep(this->hold);
+
+			memcpy(packet + 24, packet + 40, 8);
+			encode(received, packet + 32);
+			packet[0] = 0x24;
+			packet[1] = this->stratum;
+			encode(reference(this->shift), packet + 40);
+
+			if(this->kiss != nullptr)
+				memcpy(packet + 12, this->kiss, 4);
+
+			this->_server.sendTo(packet, sizeof(packet), remote);
+		}
+	}
+
+private:
+	volatile bool _running;
+	lwiot::LoopbackUdpServer _server;
+};
+
+static int64_t error(const lwiot::NtpClient& client, int64_t shift)
+{
+	return static_cast<int64_t>(client.milliseconds()) - reference(shift) / 1000;
+}
+
+static void test_offset()
+{
+	lwiot::LoopbackNetwork network;
+
+	/* 25 ms each way, the old client was off by half a second */
+	network.setLink(lwiot::LoopbackLink{ 25000, 0, 0.0, lwiot::LoopbackNetwork::DefaultRetransmit });
+
+	NtpServer server(network, 123, SHIFT);
+	lwiot::LoopbackUdpClient io(network, localhost, 123);
+	lwiot::NtpClient client;
+
+	client.begin(io);
+
+	assert(!client.synchronized());
+	assert(client.update());
+	assert(client.synchronized());
+
+	print_dbg("Offset %lli us, delay %lli us\n", (long long) client.offset(), (long long) client.delay());
+	assert(client.delay() >= 50000 && client.delay() < 60000);
+	assert(llabs(error(client, SHIFT)) <= 2);
+	assert(client.time() == reference(SHIFT) / 1000000 || client.time() + 1 == reference(SHIFT) / 1000000);
+
+	/* Small offsets are slewed in, time keeps running smoothly */
+	server.shift = SHIFT + 50000;
+	assert(client.update());
+	assert(client.offset() > 48000 && client.offset() < 52000);
+	assert(error(client, SHIFT) > -2 && error(client, SHIFT) < 3);
+
+	/* Large ones step the clock */
+	server.shift = SHIFT + 2000000;
+	assert(client.update());
+	assert(llabs(error(client, SHIFT + 2000000)) <= 2);
+}
+
+static void test_servers()
+{
+	lwiot::LoopbackNetwork network;
+
+	network.setLink(lwiot::LoopbackLink{ 10000, 0, 0.0, lwiot::LoopbackNetwork::DefaultRetransmit });
+
+	NtpServer first(network, 1230, SHIFT);
+	NtpServer second(network, 1231, SHIFT + 1000);
+	NtpServer falseticker(network, 1232, SHIFT + 10000000);
+	lwiot::LoopbackUdpClient io1(network, localhost, 1230);
+	lwiot::LoopbackUdpClient io2(network, localhost, 1231);
+	lwiot::LoopbackUdpClient io3(network, localhost, 1232);
+	lwiot::NtpClient client;
+
+	assert(client.addServer(io1));
+	assert(client.addServer(io2));
+	assert(client.addServer(io3));
+	client.setSamples(2);
+	client.begin();
+
+	/* The median is the server that is a millisecond ahead */
+	auto start = lwiot_tick();
+	assert(client.update());
+	assert(llabs(error(client, SHIFT + 1000)) <= 2);
+
+	/* Burst samples are spaced, not sent back-to-back */
+	assert(first.requests == 2);
+	assert(lwiot_tick() - start >= lwiot::NtpClient::BurstInterval);
+
+	/* A kiss-o'-death is no time source */
+	lwiot::LoopbackUdpClient io4(network, localhost, 1233);
+	NtpServer kiss(network, 1233, 0);
+	lwiot::NtpClient denied(io4);
+
+	kiss.stratum = 0;
+	denied.begin();
+	assert(!denied.update());
+	assert(!denied.synchronized());
+}
+
+static void test_kiss()
+{
+	lwiot::LoopbackNetwork network;
+	NtpServer good(network, 1240, SHIFT);
+	NtpServer limited(network, 1241, SHIFT);
+	NtpServer denied(network, 1242, SHIFT);
+	lwiot::LoopbackUdpClient io1(network, localhost, 1240);
+	lwiot::LoopbackUdpClient io2(network, localhost, 1241);
+	lwiot::LoopbackUdpClient io3(network, localhost, 1242);
+	lwiot::NtpClient client;
+
+	limited.stratum = 0;
+	limited.kiss = "RATE";
+	denied.stratum = 0;
+	denied.kiss = "DENY";
+
+	assert(client.addServer(io1));
+	assert(client.addServer(io2));
+	assert(client.addServer(io3));
+	client.begin();
+
+	assert(client.update());
+	assert(llabs(error(client, SHIFT)) <= 2);
+	assert(good.requests == 1 && limited.requests == 1 && denied.requests == 1);
+
+	/* RATE holds the server off for a while, DENY for good */
+	limited.stratum = 2;
+	limited.kiss = nullptr;
+	denied.stratum = 2;
+	denied.kiss = nullptr;
+
+	assert(client.update());
+	assert(good.requests == 2 && limited.requests == 1 && denied.requests == 1);
+
+	/* Without any server left there is nothing to synchronize with */
+	lwiot::LoopbackUdpClient io4(network, localhost, 1243);
+	NtpServer restricted(network, 1243, SHIFT);
+	lwiot::NtpClient refused(io4);
+
+	restricted.stratum = 0;
+	restricted.kiss = "RSTR";
+	refused.begin();
+	assert(!refused.update());
+	assert(!refused.update());
+	assert(restricted.requests == 1);
+	assert(!refused.synchronized());
+}
+
+static void test_stale()
+{
+	lwiot::LoopbackNetwork network;
+	NtpServer server(network, 123, SHIFT);
+	lwiot::LoopbackUdpClient io(network, localhost, 123);
+	lwiot::NtpClient client(io);
+	uint8_t packet[48];
+
+	client.begin();
+	memset(packet, 0, sizeof(packet));
+	packet[0] = 0x23;
+
+	/* A reply to somebody else's request is ignored */
+	assert(io.write(packet, sizeof(packet)) == sizeof(packet));
+	lwiot::Thread::sleep(20);
+
+	assert(client.update());
+	assert(llabs(error(client, SHIFT)) <= 2);
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	test_offset();
+	test_servers();
+	test_kiss();
+	test_stale();
+
+	print_dbg("NTP client test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
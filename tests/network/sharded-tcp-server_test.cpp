@@ -0,0 +1,76 @@
+/*
+ * Sharded TCP server unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <lwiot.h>
+#include <assert.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+
+#include <lwiot/kernel/thread.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/tcpclient.h>
+#include <lwiot/network/sockettcpclient.h>
+#include <lwiot/network/shardedtcpserver.h>
+
+#define CONNECTIONS 64
+
+static void test_sharded_server()
+{
+	lwiot::ShardedTcpServer server(4, 32);
+	volatile int served = 0;
+	uint16_t port = 18870;
+
+	while(!server.bind(BIND_ADDR_LB, port))
+		port++;
+
+	assert(server.shards() >= 1);
+
+	assert(server.start([&](lwiot::UniquePointer<lwiot::TcpClient>& client) {
+		uint8_t byte;
+
+		if(client->read(&byte, 1) == 1)
+			client->write(&byte, 1);
+
+		client->close();
+		__atomic_add_fetch(&served, 1, __ATOMIC_RELAXED);
+	}));
+
+	for(int idx = 0; idx < CONNECTIONS; idx++) {
+		lwiot::SocketTcpClient client(lwiot::IPAddress(127, 0, 0, 1), port);
+		uint8_t byte = idx, readback = 0;
+
+		assert(client.connected());
+		assert(client.write(&byte, 1) == 1);
+		assert(client.read(&readback, 1) == 1);
+		assert(readback == byte);
+		client.close();
+	}
+
+	for(int tries = 0; served < CONNECTIONS && tries < 200; tries++)
+		lwiot::Thread::sleep(10);
+
+	assert(served == CONNECTIONS);
+	print_dbg("Served %i connections on %u shards\n", served, (unsigned) server.shards());
+
+	server.stop();
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	test_sharded_server();
+	print_dbg("Sharded TCP server test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -0,0 +1,152 @@
+/*
+ * TLS session cache unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/kernel/thread.h>
+
+#include <lwiot/network/ipaddress.h>
+#include <lwiot/network/tlssessioncache.h>
+#include <lwiot/network/securetcpclient.h>
+
+static lwiot::ByteBuffer session(const char *data)
+{
+	lwiot::ByteBuffer buffer(strlen(data), true);
+
+	buffer.write(data, strlen(data));
+	return buffer;
+}
+
+static bool loads(lwiot::TlsSessionCache& cache, const char *host, uint16_t port, const char *expected)
+{
+	lwiot::ByteBuffer buffer;
+
+	if(!cache.load(host, port, buffer))
+		return false;
+
+	return buffer.index() == strlen(expected) && memcmp(buffer.data(), expected, buffer.index()) == 0;
+}
+
+static void test_keys()
+{
+	lwiot::TlsSessionCache cache;
+
+	cache.store("broker.local", 8883, session("first"));
+	cache.store("broker.local", 443, session("second"));
+	cache.store("api.local", 8883, session("third"));
+	assert(cache.size() == 3);
+
+	/* Sessions belong to a host and port combination */
+	assert(loads(cache, "broker.local", 8883, "first"));
+	assert(loads(cache, "broker.local", 443, "second"));
+	assert(loads(cache, "api.local", 8883, "third"));
+	assert(!loads(cache, "api.local", 443, "third"));
+
+	/* A new handshake replaces the session of its server */
+	cache.store("broker.local", 8883, session("fourth"));
+	assert(cache.size() == 3);
+	assert(loads(cache, "broker.local", 8883, "fourth"));
+
+	cache.remove("broker.local", 8883);
+	assert(cache.size() == 2);
+	assert(!loads(cache, "broker.local", 8883, "fourth"));
+	assert(loads(cache, "broker.local", 443, "second"));
+
+	cache.clear();
+	assert(cache.size() == 0);
+}
+
+static void test_eviction()
+{
+	lwiot::TlsSessionCache cache(2);
+
+	cache.store("a.local", 443, session("a"));
+	lwiot::Thread::sleep(5);
+	cache.store("b.local", 443, session("b"));
+	lwiot::Thread::sleep(5);
+
+	/* Loading doesn't refresh a session, only a new handshake does */
+	assert(loads(cache, "a.local", 443, "a"));
+	cache.store("c.local", 443, session("c"));
+
+	assert(cache.size() == 2);
+	assert(!loads(cache, "a.local", 443, "a"));
+	assert(loads(cache, "b.local", 443, "b"));
+	assert(loads(cache, "c.local", 443, "c"));
+
+	lwiot::Thread::sleep(5);
+	cache.store("b.local", 443, session("b2"));
+	lwiot::Thread::sleep(5);
+	cache.store("d.local", 443, session("d"));
+
+	assert(!loads(cache, "c.local", 443, "c"));
+	assert(loads(cache, "b.local", 443, "b2"));
+	assert(loads(cache, "d.local", 443, "d"));
+
+	/* Without capacity nothing is cached */
+	lwiot::TlsSessionCache none(0);
+
+	none.store("a.local", 443, session("a"));
+	assert(none.size() == 0);
+}
+
+static void test_expiry()
+{
+	lwiot::TlsSessionCache cache(4, 1);
+
+	cache.store("a.local", 443, session("a"));
+	assert(loads(cache, "a.local", 443, "a"));
+
+	/* Stale sessions are dropped when they are looked up */
+	lwiot::Thread::sleep(1100);
+	assert(cache.size() == 1);
+	assert(!loads(cache, "a.local", 443, "a"));
+	assert(cache.size() == 0);
+}
+
+static void test_failed_connect()
+{
+	lwiot::TlsSessionCache cache;
+	lwiot::SecureTcpClient client(lwiot::IPAddress(127, 0, 0, 1), 5399, "lwiot.local");
+
+	cache.store("lwiot.local", 5399, session("stale"));
+	cache.store("lwiot.local", 5300, session("other"));
+	client.setSessionCache(cache);
+
+	/* Nothing listens on this port: the offered session is not kept around */
+	assert(!client.connect());
+	assert(!client.connected());
+	assert(!client.resumed());
+
+	assert(cache.size() == 1);
+	assert(!loads(cache, "lwiot.local", 5399, "stale"));
+	assert(loads(cache, "lwiot.local", 5300, "other"));
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	test_keys();
+	test_eviction();
+	test_expiry();
+	test_failed_connect();
+
+	print_dbg("TLS session cache test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
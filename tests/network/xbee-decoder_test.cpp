@@ -0,0 +1,213 @@
+/*
+ * XBee API frame decoder unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bufferedstream.h>
+
+#include <lwiot/network/xbee/xbee.h>
+#include <lwiot/network/xbee/xbeeframedecoder.h>
+
+/* Escapes and frames `data` (API identifier first) the way the radio does */
+static size_t encode(uint8_t *output, const uint8_t *data, size_t length)
+{
+	uint8_t header[] = { static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length) };
+	uint8_t checksum = 0;
+	size_t num = 0;
+
+	auto put = [&](uint8_t byte) {
+		if(byte == START_BYTE || byte == ESCAPE || byte == XON || byte == XOFF) {
+			output[num++] = ESCAPE;
+			output[num++] = byte ^ 0x20;
+		} else {
+			output[num++] = byte;
+		}
+	};
+
+	output[num++] = START_BYTE;
+	put(header[0]);
+	put(header[1]);
+
+	for(size_t idx = 0; idx < length; idx++) {
+		put(data[idx]);
+		checksum += data[idx];
+	}
+
+	put(0xFF - checksum);
+	return num;
+}
+
+static void test_decode()
+{
+	const uint8_t frame[] = { ZB_RX_RESPONSE, 0x7E, 0x7D, 0x11, 0x13, 'l', 'w', 'i', 'o', 't' };
+	uint8_t stream[64];
+	lwiot::XBeeFrameDecoder decoder;
+
+	auto length = encode(stream, frame, sizeof(frame));
+	assert(length > sizeof(frame) + 4);
+
+	/* Whole frames, byte by byte and with leading noise */
+	decoder.feed(stream, length);
+
+	for(size_t idx = 0; idx < length; idx++)
+		decoder.feed(stream + idx, 1);
+
+	const uint8_t noise[] = { 0x00, 0x42, 0x13 };
+	decoder.feed(noise, sizeof(noise));
+	decoder.feed(stream, length);
+
+	assert(decoder.frames() == 3);
+	assert(decoder.errors() == 0);
+
+	while(decoder.frames() > 0) {
+		auto rx = decoder.front();
+
+		assert(rx->apiId() == ZB_RX_RESPONSE);
+		assert(rx->frameDataLength() == sizeof(frame) - 1);
+		assert(memcmp(rx->data, frame, sizeof(frame)) == 0);
+		decoder.pop();
+	}
+
+	/* A bad checksum is discarded, a truncated frame is abandoned at the next start byte */
+	stream[length - 1] ^= 0x01;
+	decoder.feed(stream, length);
+	stream[length - 1] ^= 0x01;
+	decoder.feed(stream, length / 2);
+	decoder.feed(stream, length);
+
+	assert(decoder.errors() == 2);
+	assert(decoder.frames() == 1);
+	decoder.pop();
+
+	/* Frames beyond the pool are dropped, not corrupted */
+	for(size_t idx = 0; idx < lwiot::XBeeFrameDecoder::PoolSize + 2; idx++)
+		decoder.feed(stream, length);
+
+	assert(decoder.full());
+	assert(decoder.dropped() == 2);
+	assert(memcmp(decoder.front()->data, frame, sizeof(frame)) == 0);
+}
+
+static void test_read()
+{
+	const size_t count = lwiot::XBeeFrameDecoder::PoolSize + 2;
+	uint8_t stream[lwiot::XBeeFrameDecoder::ReadSize];
+	lwiot::BufferedStream serial;
+	lwiot::XBeeFrameDecoder decoder;
+	size_t length = 0, used;
+
+	for(size_t idx = 0; idx < count; idx++) {
+		const uint8_t frame[] = { ZB_RX_RESPONSE, static_cast<uint8_t>(idx) };
+		length += encode(stream + length, frame, sizeof(frame));
+	}
+
+	assert(length <= sizeof(stream));
+
+	/* feed() stops at the frame that fills up the pool */
+	used = decoder.feed(stream, length);
+	assert(decoder.full() && decoder.dropped() == 0);
+	assert(used == length / count * lwiot::XBeeFrameDecoder::PoolSize);
+
+	/* read() keeps what it read beyond that frame for the next call */
+	decoder.reset();
+	serial.write(stream, length);
+
+	assert(decoder.read(serial) == length);
+	assert(decoder.full() && serial.available() == 0);
+
+	for(size_t idx = 0; idx < count; idx++) {
+		if(decoder.frames() == 0)
+			assert(decoder.read(serial) == 0);
+
+		assert(decoder.frames() > 0);
+		assert(decoder.front()->data[1] == idx);
+		decoder.pop();
+	}
+
+	assert(decoder.dropped() == 0);
+	assert(decoder.errors() == 0);
+}
+
+static void test_unescaped()
+{
+	/* Without escapes, start delimiters inside a frame are data */
+	const uint8_t stream[] = { START_BYTE, 0x00, 0x05, ZB_RX_RESPONSE, START_BYTE, ESCAPE, XON, XOFF, 0x00 };
+	uint8_t frame[sizeof(stream)];
+	lwiot::XBeeFrameDecoder decoder(false);
+	uint8_t checksum = 0;
+
+	memcpy(frame, stream, sizeof(stream));
+
+	for(size_t idx = 3; idx < sizeof(frame) - 1; idx++)
+		checksum += frame[idx];
+
+	frame[sizeof(frame) - 1] = 0xFF - checksum;
+	decoder.feed(frame, sizeof(frame));
+	decoder.feed(frame, 4);
+	decoder.feed(frame + 4, sizeof(frame) - 4);
+
+	assert(decoder.frames() == 2);
+	assert(decoder.errors() == 0);
+	assert(memcmp(decoder.front()->data, frame + 3, 5) == 0);
+}
+
+static void test_device()
+{
+	lwiot::BufferedStream serial;
+	lwiot::XBee xb;
+	uint8_t payload[] = { 'p', 'i', 'n', 'g', 0x7E, 0x7D };
+	lwiot::ZBTxRequest tx;
+
+	xb.setSerial(serial);
+	tx.setAddress64(0x0013A20040A1B2C3ULL);
+	tx.setAddress16(0xFFFE);
+	tx.setPayload(payload);
+	tx.setPayloadLength(sizeof(payload));
+	tx.setFrameId(DEFAULT_FRAME_ID);
+
+	/* The device reads back what it wrote to the serial port, more frames than fit the pool */
+	for(size_t idx = 0; idx < lwiot::XBeeFrameDecoder::PoolSize + 2; idx++)
+		xb.send(tx);
+
+	for(size_t idx = 0; idx < lwiot::XBeeFrameDecoder::PoolSize + 2; idx++) {
+		xb.readPacket();
+
+		auto& response = xb.getResponse();
+		assert(response.isAvailable());
+		assert(response.getApiId() == ZB_TX_REQUEST);
+		assert(response.getFrameData()[0] == DEFAULT_FRAME_ID);
+		assert(memcmp(response.getFrameData() + response.getFrameDataLength() - sizeof(payload),
+		              payload, sizeof(payload)) == 0);
+	}
+
+	xb.readPacket();
+	assert(!xb.getResponse().isAvailable());
+	assert(xb.getDecoder().errors() == 0);
+	assert(xb.getDecoder().dropped() == 0);
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	test_decode();
+	test_read();
+	test_unescaped();
+	test_device();
+
+	print_dbg("XBee decoder test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
@@ -0,0 +1,382 @@
+/*
+ * AsyncXbee transmit pipeline unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+#include <lwiot/bufferedstream.h>
+
+#include <lwiot/kernel/lock.h>
+#include <lwiot/kernel/thread.h>
+#include <lwiot/kernel/uniquelock.h>
+
+#include <lwiot/network/xbee/xbee.h>
+#include <lwiot/network/xbee/asyncxbee.h>
+#include <lwiot/network/xbee/xbeeframedecoder.h>
+
+#define FRAMES 6
+
+/* Escapes and frames `data` (API identifier first) the way the radio does */
+static size_t encode(uint8_t *output, const uint8_t *data, size_t length)
+{
+	uint8_t header[] = { static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length) };
+	uint8_t checksum = 0;
+	size_t num = 0;
+
+	auto put = [&](uint8_t byte) {
+		if(byte == START_BYTE || byte == ESCAPE || byte == XON || byte == XOFF) {
+			output[num++] = ESCAPE;
+			output[num++] = byte ^ 0x20;
+		} else {
+			output[num++] = byte;
+		}
+	};
+
+	output[num++] = START_BYTE;
+	put(header[0]);
+	put(header[1]);
+
+	for(size_t idx = 0; idx < length; idx++) {
+		put(data[idx]);
+		checksum += data[idx];
+	}
+
+	put(0xFF - checksum);
+	return num;
+}
+
+/*
+ * Serial port of a fake radio: every request written to it is answered with
+ * a TX status or AT command response carrying the same frame ID.
+ */
+class Radio : public lwiot::BufferedStream {
+public:
+	explicit Radio() : _lock(true), _held(64), _hold(false), _silent(false), _fail(false), _frames(0)
+	{
+	}
+
+	size_t available() const override
+	{
+		lwiot::UniqueLock<lwiot::Lock> lock(this->_lock);
+		return BufferedStream::available();
+	}
+
+	uint8_t read() override
+	{
+		lwiot::UniqueLock<lwiot::Lock> lock(this->_lock);
+		return BufferedStream::read();
+	}
+
+	ssize_t read(void *output, const size_t& length) override
+	{
+		lwiot::UniqueLock<lwiot::Lock> lock(this->_lock);
+		return BufferedStream::read(output, length);
+	}
+
+	bool write(uint8_t byte) override
+	{
+		return this->write(&byte, sizeof(byte)) == sizeof(byte);
+	}
+
+	ssize_t write(const void *bytes, const size_t& length) override
+	{
+		lwiot::UniqueLock<lwiot::Lock> lock(this->_lock);
+
+		this->_decoder.feed(static_cast<const uint8_t*>(bytes), length);
+
+		while(this->_decoder.frames() > 0) {
+			this->answer(*this->_decoder.front());
+			this->_decoder.pop();
+		}
+
+		return length;
+	}
+
+	void inject(const uint8_t *data, size_t length)
+	{
+		lwiot::UniqueLock<lwiot::Lock> lock(this->_lock);
+		uint8_t frame[64];
+
+		BufferedStream::write(frame, encode(frame, data, length));
+	}
+
+	void hold(bool hold)
+	{
+		lwiot::UniqueLock<lwiot::Lock> lock(this->_lock);
+
+		this->_hold = hold;
+
+		if(!hold) {
+			BufferedStream::write(this->_held.data(), this->_held.index());
+			this->_held.setIndex(0);
+		}
+	}
+
+	void setSilent(bool silent)
+	{
+		lwiot::UniqueLock<lwiot::Lock> lock(this->_lock);
+		this->_silent = silent;
+	}
+
+	void setFail(bool fail)
+	{
+		lwiot::UniqueLock<lwiot::Lock> lock(this->_lock);
+		this->_fail = fail;
+	}
+
+	size_t frames() const
+	{
+		lwiot::UniqueLock<lwiot::Lock> lock(this->_lock);
+		return this->_frames;
+	}
+
+private:
+	mutable lwiot::Lock _lock;
+	lwiot::XBeeFrameDecoder _decoder;
+	lwiot::ByteBuffer _held;
+	bool _hold;
+	bool _silent;
+	bool _fail;
+	size_t _frames;
+
+	void answer(const lwiot::XBeeFrame& request)
+	{
+		uint8_t response[16];
+		uint8_t frame[32];
+		size_t length;
+		auto id = request.frameData()[0];
+
+		this->_frames++;
+
+		if(this->_silent || id == NO_RESPONSE_FRAME_ID)
+			return;
+
+		if(request.apiId() == AT_COMMAND_REQUEST) {
+			auto cmd = request.frameData() + 1;
+
+			response[0] = AT_COMMAND_RESPONSE;
+			response[1] = id;
+			response[2] = cmd[0];
+			response[3] = cmd[1];
+			response[4] = 0;
+			response[5] = 0x12;
+			response[6] = 0x34;
+			length = 7;
+		} else {
+			response[0] = ZB_TX_STATUS_RESPONSE;
+			response[1] = id;
+			response[2] = 0xFF;
+			response[3] = 0xFE;
+			response[4] = 0;
+			response[5] = this->_fail ? NETWORK_ACK_FAILURE : SUCCESS;
+			response[6] = 0;
+			length = 7;
+		}
+
+		length = encode(frame, response, length);
+
+		if(this->_hold)
+			this->_held.write(frame, length);
+		else
+			BufferedStream::write(frame, length);
+	}
+};
+
+static lwiot::Lock lock(false);
+static int completed;
+static int successful;
+static int received;
+static uint32_t ids[256 / 32];
+
+template <typename Func>
+static bool wait_for(Func done)
+{
+	auto deadline = lwiot_tick_ms() + 2000;
+
+	while(lwiot_tick_ms() < deadline) {
+		lwiot::UniqueLock<lwiot::Lock> guard(lock);
+
+		if(done())
+			return true;
+
+		guard.unlock();
+		lwiot::Thread::sleep(5);
+	}
+
+	return false;
+}
+
+static auto complete = [](bool success, lwiot::XBeeResponse& response) {
+	lwiot::UniqueLock<lwiot::Lock> guard(lock);
+
+	if(success) {
+		auto id = response.getFrameData()[0];
+
+		assert((ids[id / 32] & (1U << (id % 32))) == 0);
+		ids[id / 32] |= 1U << (id % 32);
+		successful++;
+	}
+
+	completed++;
+};
+
+static void reset()
+{
+	lwiot::UniqueLock<lwiot::Lock> guard(lock);
+
+	completed = successful = 0;
+	memset(ids, 0, sizeof(ids));
+}
+
+static void test_blocking(lwiot::AsyncXbee& xbee, Radio& radio)
+{
+	lwiot::ByteBuffer payload(8);
+
+	payload.write("lwiot", 5);
+	assert(xbee.transmit(lwiot::ZigbeeAddress(static_cast<uint16_t>(0x1234)), payload));
+	assert(xbee.transmit(lwiot::String("hello"), static_cast<uint64_t>(0x0013A20040A1B2C3ULL)));
+
+	radio.setFail(true);
+	assert(!xbee.transmit(lwiot::ZigbeeAddress(static_cast<uint16_t>(0x1234)), payload));
+	radio.setFail(false);
+}
+
+static void test_pipeline(lwiot::AsyncXbee& xbee, Radio& radio)
+{
+	uint8_t payload[] = { 'p', 'i', 'n', 'g' };
+	lwiot::ZBTxRequest tx;
+	auto frames = radio.frames();
+
+	reset();
+	tx.setAddress64(0x0013A20040A1B2C3ULL);
+	tx.setAddress16(0xFFFE);
+	tx.setPayload(payload, sizeof(payload));
+
+	/* Unanswered frames hold back the rest of the queue */
+	radio.hold(true);
+	xbee.setMaxInFlight(2);
+
+	for(int idx = 0; idx < FRAMES; idx++)
+		assert(xbee.enqueue(tx, complete));
+
+	assert(wait_for([&]() { return radio.frames() == frames + 2; }));
+	lwiot::Thread::sleep(20);
+	assert(radio.frames() == frames + 2);
+	assert(xbee.inFlight() == 2);
+	assert(xbee.queued() == FRAMES - 2);
+
+	radio.hold(false);
+	assert(wait_for([]() { return completed == FRAMES; }));
+	assert(successful == FRAMES);
+	assert(xbee.inFlight() == 0 && xbee.queued() == 0);
+	assert(radio.frames() == frames + FRAMES);
+
+	/* Asynchronous AT command */
+	reset();
+	assert(xbee.command("MY", nullptr, 0, [](bool success, lwiot::XBeeResponse& response) {
+		lwiot::AtCommandResponse at;
+		lwiot::UniqueLock<lwiot::Lock> guard(lock);
+
+		response.getAtCommandResponse(at);
+		assert(success);
+		assert(at.getValueLength() == 2 && at.getValue()[0] == 0x12 && at.getValue()[1] == 0x34);
+		completed++;
+	}));
+
+	assert(wait_for([]() { return completed == 1; }));
+	xbee.setMaxInFlight(lwiot::AsyncXbee::MaxInFlight);
+}
+
+static void test_timeout(lwiot::AsyncXbee& xbee, Radio& radio)
+{
+	uint8_t payload[] = { 'l', 'o', 's', 't' };
+	lwiot::ZBTxRequest tx;
+
+	reset();
+	tx.setAddress64(0x0013A20040A1B2C3ULL);
+	tx.setAddress16(0xFFFE);
+	tx.setPayload(payload, sizeof(payload));
+
+	radio.setSilent(true);
+	xbee.setTxTimeout(50);
+
+	assert(xbee.enqueue(tx, complete));
+	assert(wait_for([]() { return completed == 1; }));
+	assert(successful == 0);
+	assert(xbee.inFlight() == 0);
+
+	radio.setSilent(false);
+	xbee.setTxTimeout(lwiot::AsyncXbee::DefaultTxTimeout);
+}
+
+static void test_unsolicited(Radio& radio)
+{
+	const uint8_t rx[] = { ZB_RX_RESPONSE, 0x00, 0x13, 0xA2, 0x00, 0x40, 0xA1, 0xB2, 0xC3, 0x12, 0x34, 0x01,
+	                       'h', 'i' };
+
+	/* A TX status nobody waits for goes to the response handler as well */
+	const uint8_t status[] = { ZB_TX_STATUS_RESPONSE, 0xEE, 0xFF, 0xFE, 0x00, SUCCESS, 0x00 };
+
+	radio.inject(rx, sizeof(rx));
+	radio.inject(status, sizeof(status));
+	assert(wait_for([]() { return received == 2; }));
+}
+
+static void test_end(lwiot::AsyncXbee& xbee, Radio& radio)
+{
+	uint8_t payload[] = { 'b', 'y', 'e' };
+	lwiot::ZBTxRequest tx;
+
+	reset();
+	tx.setAddress64(0x0013A20040A1B2C3ULL);
+	tx.setAddress16(0xFFFE);
+	tx.setPayload(payload, sizeof(payload));
+
+	radio.setSilent(true);
+	xbee.setMaxInFlight(1);
+
+	assert(xbee.enqueue(tx, complete));
+	assert(xbee.enqueue(tx, complete));
+
+	/* Outstanding and queued requests fail when the thread stops */
+	xbee.end();
+	assert(completed == 2 && successful == 0);
+	assert(!xbee.enqueue(tx, complete));
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	Radio radio;
+	lwiot::AsyncXbee xbee(radio);
+
+	xbee.begin([](lwiot::XBeeResponse& response) {
+		lwiot::UniqueLock<lwiot::Lock> guard(lock);
+
+		assert(response.getApiId() == ZB_RX_RESPONSE || response.getApiId() == ZB_TX_STATUS_RESPONSE);
+		received++;
+	});
+
+	test_blocking(xbee, radio);
+	test_pipeline(xbee, radio);
+	test_timeout(xbee, radio);
+	test_unsolicited(radio);
+	test_end(xbee, radio);
+
+	print_dbg("XBee pipeline test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}
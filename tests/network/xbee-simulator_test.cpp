@@ -0,0 +1,236 @@
+/*
+ * XBee simulator unit test.
+ *
+ * @author Michel Megens
+ * @email  dev@bietje.net
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <lwiot.h>
+
+#include <lwiot/log.h>
+#include <lwiot/test.h>
+#include <lwiot/bytebuffer.h>
+
+#include <lwiot/kernel/thread.h>
+
+#include <lwiot/network/xbee/xbee.h>
+#include <lwiot/network/xbee/asyncxbee.h>
+#include <lwiot/network/xbee/xbeesimulator.h>
+#include <lwiot/network/xbee/xbeeframedecoder.h>
+
+#define COORDINATOR 0x0013A20040000001ULL
+#define ROUTER      0x0013A20040000002ULL
+#define END_DEVICE  0x0013A20040000003ULL
+
+static void send(lwiot::XBee& xb, uint64_t address, const void *payload, uint8_t length)
+{
+	lwiot::ZBTxRequest tx;
+
+	tx.setAddress64(address);
+	tx.setAddress16(0xFFFE);
+	tx.setPayload((uint8_t *) payload, length);
+	tx.setFrameId(xb.getNextFrameId());
+	xb.send(tx);
+}
+
+static uint8_t status(lwiot::XBee& xb)
+{
+	lwiot::ZBTxStatusResponse status;
+
+	assert(xb.readPacket(100));
+	assert(xb.getResponse().getApiId() == ZB_TX_STATUS_RESPONSE);
+	xb.getResponse().getZBTxStatusResponse(status);
+
+	return status.getDeliveryStatus();
+}
+
+static void test_commands(lwiot::XBeeMedium& medium)
+{
+	lwiot::XBeeSimulator radio(medium, ROUTER, 0x1234);
+	lwiot::XBee xb;
+
+	xb.begin(radio);
+	assert(xb.getMaxPayloadSize() == lwiot::XBeeSimulator::MaxPayload);
+	assert(xb.getNetworkAddress() == 0x1234);
+	assert(xb.getParentAddress() == 0xFFFE);
+	assert(xb.getHardwareAddress() == ROUTER);
+
+	xb.setNetworkID(0x4242);
+	xb.setNodeIdentifier("lwiot");
+	xb.setMaxHops(10);
+
+	/* Unknown commands and read only registers are refused */
+	const uint8_t unknown[] = { AT_COMMAND_REQUEST, 0x05, 'Q', 'Q' };
+	const uint8_t readonly[] = { AT_COMMAND_REQUEST, 0x06, 'M', 'Y', 0x00, 0x01 };
+	lwiot::AtCommandResponse at;
+	uint8_t frame[16];
+	lwiot::XBeeFrameDecoder decoder;
+
+	auto encode = [&](const uint8_t *data, uint8_t length) {
+		uint8_t checksum = 0;
+
+		frame[0] = START_BYTE;
+		frame[1] = 0;
+		frame[2] = length;
+		memcpy(frame + 3, data, length);
+
+		for(uint8_t idx = 0; idx < length; idx++)
+			checksum += data[idx];
+
+		frame[length + 3] = 0xFF - checksum;
+		return length + 4;
+	};
+
+	radio.write(frame, encode(unknown, sizeof(unknown)));
+	assert(xb.readPacket(100));
+	xb.getResponse().getAtCommandResponse(at);
+	assert(at.getFrameId() == 0x05 && at.getStatus() == 2);
+
+	radio.write(frame, encode(readonly, sizeof(readonly)));
+	assert(xb.readPacket(100));
+	xb.getResponse().getAtCommandResponse(at);
+	assert(at.getStatus() == 1);
+	assert(xb.getNetworkAddress() == 0x1234);
+
+	/* API mode 1 leaves 0x7D, 0x7E, 0x11 and 0x13 unescaped */
+	const uint8_t ap[] = { AT_COMMAND_REQUEST, 0x07, 'A', 'P', 0x01 };
+	const uint8_t query[] = { AT_COMMAND_REQUEST, 0x7E, 'A', 'P' };
+	uint8_t output[32];
+
+	radio.write(frame, encode(ap, sizeof(ap)));
+	assert(xb.readPacket(100));
+	assert(radio.mode() == 1);
+
+	decoder.setEscaped(false);
+	radio.write(frame, encode(query, sizeof(query)));
+	auto num = radio.read(output, sizeof(output));
+	assert(num == 10 && output[4] == 0x7E);
+	decoder.feed(output, num);
+	assert(decoder.frames() == 1 && decoder.errors() == 0);
+	assert(decoder.front()->apiId() == AT_COMMAND_RESPONSE && decoder.front()->frameData()[4] == 0x01);
+}
+
+static void test_routing(lwiot::XBeeMedium& medium)
+{
+	lwiot::XBeeSimulator coordinator(medium, COORDINATOR, 0x0000);
+	lwiot::XBeeSimulator router(medium, ROUTER, 0x1234);
+	lwiot::XBeeSimulator device(medium, END_DEVICE, 0x5678);
+	lwiot::XBee a, b, c;
+	lwiot::ZBRxResponse rx;
+	const char payload[] = "\x7E\x7Dlwiot\x11\x13";
+
+	a.setSerial(coordinator);
+	b.setSerial(router);
+	c.setSerial(device);
+
+	/* Unicast */
+	send(a, ROUTER, payload, sizeof(payload));
+	assert(status(a) == SUCCESS);
+	assert(b.readPacket(100));
+	assert(b.getResponse().getApiId() == ZB_RX_RESPONSE);
+	b.getResponse().getZBRxResponse(rx);
+	assert(rx.getRemoteAddress64().get() == COORDINATOR);
+	assert(rx.getRemoteAddress16() == 0x0000);
+	assert(rx.getOption() == ZB_PACKET_ACKNOWLEDGED);
+	assert(rx.getDataLength() == sizeof(payload) && memcmp(rx.getData(), payload, sizeof(payload)) == 0);
+	assert(!c.readPacket(10));
+
+	/* Explicit addressing, to the coordinator on address 0 */
+	lwiot::ZBExplicitTxRequest tx;
+	lwiot::ZBExplicitRxResponse explicit_rx;
+
+	tx.setAddress64(0ULL);
+	tx.setAddress16(0xFFFE);
+	tx.setPayload((uint8_t *) payload, sizeof(payload));
+	tx.setClusterId(0x0011);
+	tx.setProfileId(0xC105);
+	tx.setFrameId(c.getNextFrameId());
+	c.send(tx);
+
+	assert(status(c) == SUCCESS);
+	assert(a.readPacket(100));
+	assert(a.getResponse().getApiId() == ZB_EXPLICIT_RX_RESPONSE);
+	a.getResponse().getZBExplicitRxResponse(explicit_rx);
+	assert(explicit_rx.getClusterId() == 0x0011 && explicit_rx.getProfileId() == 0xC105);
+	assert(explicit_rx.getDataLength() == sizeof(payload));
+
+	/* Broadcast */
+	send(b, 0xFFFFULL, "all", 3);
+	assert(status(b) == SUCCESS);
+	assert(a.readPacket(100) && c.readPacket(100));
+	assert(!b.readPacket(10));
+
+	/* Errors */
+	send(a, 0x0013A20040FFFFFFULL, "nobody", 6);
+	assert(status(a) == ADDRESS_NOT_FOUND);
+	send(a, COORDINATOR, "me", 2);
+	assert(status(a) == SELF_ADDRESSED);
+
+	uint8_t large[lwiot::XBeeSimulator::MaxPayload + 1] = { 0 };
+	send(a, ROUTER, large, sizeof(large));
+	assert(status(a) == 0x74);
+	assert(!b.readPacket(10));
+
+	/* Loss and latency */
+	medium.setLoss(100);
+	send(a, ROUTER, "lost", 4);
+	assert(status(a) == NETWORK_ACK_FAILURE);
+	assert(medium.lost() == 1);
+	medium.setLoss(0);
+
+	medium.setLatency(50);
+	send(a, ROUTER, "slow", 4);
+	assert(router.available() == 0);
+	assert(status(a) == SUCCESS);
+	assert(b.readPacket(100));
+	medium.setLatency(0);
+}
+
+static void test_async(lwiot::XBeeMedium& medium)
+{
+	lwiot::XBeeSimulator coordinator(medium, COORDINATOR, 0x0000);
+	lwiot::XBeeSimulator router(medium, ROUTER, 0x1234);
+	lwiot::AsyncXbee a(coordinator), b(router);
+	lwiot::ByteBuffer payload(8);
+	volatile int received = 0;
+
+	a.begin([](lwiot::XBeeResponse& response) { });
+	b.begin([&](lwiot::XBeeResponse& response) {
+		if(response.getApiId() == ZB_RX_RESPONSE)
+			received++;
+	});
+
+	payload.write("hello", 5);
+
+	for(int idx = 0; idx < 10; idx++)
+		assert(a.transmit(lwiot::ZigbeeAddress(static_cast<uint16_t>(0x1234)), payload));
+
+	for(int idx = 0; idx < 100 && received < 10; idx++)
+		lwiot::Thread::sleep(10);
+
+	assert(received == 10);
+
+	a.end();
+	b.end();
+}
+
+int main(int argc, char **argv)
+{
+	lwiot_init();
+
+	lwiot::XBeeMedium medium;
+
+	test_commands(medium);
+	test_routing(medium);
+	test_async(medium);
+
+	print_dbg("XBee simulator test successful!\n");
+
+	lwiot_destroy();
+	wait_close();
+
+	return -EXIT_SUCCESS;
+}